@@ -0,0 +1,137 @@
+///////////////////////////////////////////////////////////////////////////////
+// FILE:          AnalogueFilter.cpp
+// PROJECT:       Devices 
+// SUBSYSTEM:     Device Controller 
+//-----------------------------------------------------------------------------
+// DESCRIPTION:   implementation of the analogue input filter
+//             
+// COPYRIGHT:     Karl Hoover, No Prior Art, 2009
+//
+// LICENSE:       This library is free software; you can redistribute it and/or
+//                modify it under the terms of the GNU Lesser General Public
+//                License (LGPL) as published by the Free Software Foundation.
+//                See license text at http://www.gnu.org/licenses/lgpl.txt 
+//                Briefly you can use this source code pretty much however you
+//                wish, as long as this notice remains intact and you
+//                prominently acknowledge this copyright.
+//
+//                This file is distributed in the hope that it will be useful,
+//                but WITHOUT ANY WARRANTY; without even the implied warranty
+//                of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//                IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//                CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+//                INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES.
+//
+// AUTHOR:        Karl Hoover  karl.hoover@gmail.com
+//
+// REVISIONS:     
+//
+// NOTES:   
+// see AnalogueFilter.h for comments and history
+
+#include <cmath>
+#include <stdexcept>
+
+#include "AnalogueFilter.h"
+
+using namespace std;
+
+AnalogueFilter::AnalogueFilter(ProcessImage& image): m_image(image), m_primed(false)
+{
+	size_t count = image.AnalogueInputCount();
+	m_gain.assign(count, 1.);
+	m_offset.assign(count, 0.);
+	m_alpha.assign(count, 1.);
+	m_deadband.assign(count, 0.);
+	m_value.assign(count, 0.);
+	m_reported.assign(count, 0.);
+	m_changed.assign(count, 0.);
+	m_changedPoints.reserve(count);
+}
+
+void AnalogueFilter::SetScale(const int point, const double gain, const double offset)
+{
+	m_gain.at(point) = gain;
+	m_offset.at(point) = offset;
+}
+
+void AnalogueFilter::SetSmoothing(const int point, const double alpha)
+{
+	if (!(alpha > 0. && alpha <= 1.))
+	{
+		throw invalid_argument("AnalogueFilter: smoothing alpha must be in (0, 1]");
+	}
+	m_alpha.at(point) = alpha;
+}
+
+void AnalogueFilter::SetMovingAverage(const int point, const int samples)
+{
+	SetSmoothing(point, 2. / ((samples < 1 ? 1 : samples) + 1));
+}
+
+void AnalogueFilter::SetDeadband(const int point, const double deadband)
+{
+	m_deadband.at(point) = fabs(deadband);
+}
+
+// __restrict only reliably reaches the vectorizer on parameters, hence
+// the loop lives out here rather than in Process()
+static double Filter(const size_t count, double* __restrict io, const double* __restrict gain,
+	const double* __restrict offset, const double* __restrict alpha, const double* __restrict deadband,
+	double* __restrict value, double* __restrict reported, double* __restrict changed)
+{
+	double changes = 0.;
+	for (size_t i = 0; i < count; ++i)
+	{
+		double scaled = io[i] * gain[i] + offset[i];
+		double v = value[i] + alpha[i] * (scaled - value[i]);
+		value[i] = v;
+		io[i] = v;
+		double moved = fabs(v - reported[i]) > deadband[i] ? 1. : 0.;
+		reported[i] = moved != 0. ? v : reported[i];
+		changed[i] = moved;
+		changes += moved;
+	}
+	return changes;
+}
+
+int AnalogueFilter::Process()
+{
+	const size_t count = m_value.size();
+	m_changedPoints.clear();
+	if (0 == count)
+	{
+		return 0;
+	}
+	double* io = m_image.AnalogueInputValues();
+	const double* gain = &m_gain[0];
+	const double* offset = &m_offset[0];
+	const double* alpha = &m_alpha[0];
+	const double* deadband = &m_deadband[0];
+	double* value = &m_value[0];
+	double* reported = &m_reported[0];
+	double* changed = &m_changed[0];
+	if (!m_primed)
+	{
+		// start at the first sample rather than ramping up from 0
+		for (size_t i = 0; i < count; ++i)
+		{
+			value[i] = io[i] * gain[i] + offset[i];
+			reported[i] = value[i];
+			io[i] = value[i];
+			m_changedPoints.push_back(i);
+		}
+		m_primed = true;
+		return count;
+	}
+	double changes = Filter(count, io, gain, offset, alpha, deadband, value, reported, changed);
+	for (size_t i = 0; changes != 0. && i < count; ++i)
+	{
+		if (changed[i] != 0.)
+		{
+			m_changedPoints.push_back(i);
+		}
+	}
+	return m_changedPoints.size();
+}
@@ -0,0 +1,93 @@
+///////////////////////////////////////////////////////////////////////////////
+// FILE:          AnalogueFilter.h
+// PROJECT:       Devices 
+// SUBSYSTEM:     Device Controller 
+//-----------------------------------------------------------------------------
+// DESCRIPTION:   scaling, smoothing and deadband change detection of analogue inputs
+//             
+// COPYRIGHT:     Karl Hoover, No Prior Art, 2009
+//
+// LICENSE:       This library is free software; you can redistribute it and/or
+//                modify it under the terms of the GNU Lesser General Public
+//                License (LGPL) as published by the Free Software Foundation.
+//                See license text at http://www.gnu.org/licenses/lgpl.txt 
+//                Briefly you can use this source code pretty much however you
+//                wish, as long as this notice remains intact and you
+//                prominently acknowledge this copyright.
+//
+//                This file is distributed in the hope that it will be useful,
+//                but WITHOUT ANY WARRANTY; without even the implied warranty
+//                of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//                IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//                CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+//                INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES.
+//
+// AUTHOR:        Karl Hoover  karl.hoover@gmail.com
+//
+// REVISIONS:     1.0 October 16, 2026
+//
+// NOTES:   
+// Gauges and flow meters are noisy and sampled faster than anybody wants
+// to look at them. Once per scan, after LatchInputs(), Process() takes every
+// analogue input of the image through
+//
+//     scaled = raw * gain + offset                    engineering units
+//     value += alpha * (scaled - value)               first order IIR
+//
+// and writes value back into the scan image, so AnalogueInput::Value() and
+// everything else reading the image this scan sees the filtered value. An
+// alpha of 1 is no smoothing; SetMovingAverage(point, n) sets the alpha,
+// 2 / (n + 1), whose IIR has the lag of an n sample moving average. The
+// first Process() starts each filter at its first sample.
+//
+// A point has changed when its value has moved more than its deadband
+// away from the value last reported for it. Process() returns how many
+// points changed this scan and ChangedPoints() lists them, so callbacks and
+// logging run on meaningful changes only. The default deadband of 0
+// reports every change.
+//
+// The parameters and state are kept as one array each, and Process() is a
+// single loop over all points with no branches and nothing but doubles in
+// it, which gcc vectorizes (the Makefile builds AnalogueFilter.o with
+// -ftree-vectorize, which -O2 alone leaves off), plus a pass to list the
+// changed points.
+
+#ifndef ANALOGUEFILTER_H
+#define ANALOGUEFILTER_H
+
+#include <vector>
+
+#include "ProcessImage.h"
+
+class AnalogueFilter
+{
+public:
+	// every analogue input of the image, unscaled, unsmoothed, deadband 0
+	AnalogueFilter(ProcessImage& image);
+	void SetScale(const int point, const double gain, const double offset);
+	void SetSmoothing(const int point, const double alpha); // 0 < alpha <= 1
+	void SetMovingAverage(const int point, const int samples);
+	void SetDeadband(const int point, const double deadband);
+
+	int Process(); // scan thread, after LatchInputs. Returns points changed.
+	const std::vector<int>& ChangedPoints() const {return m_changedPoints;};
+	double Reported(const int point) const {return m_reported[point];};
+
+private:
+	AnalogueFilter(const AnalogueFilter&);
+	AnalogueFilter& operator=(const AnalogueFilter&);
+
+	ProcessImage& m_image;
+	bool m_primed;
+	std::vector<double> m_gain;
+	std::vector<double> m_offset;
+	std::vector<double> m_alpha;
+	std::vector<double> m_deadband;
+	std::vector<double> m_value;    // filter state
+	std::vector<double> m_reported; // as of the last change
+	std::vector<double> m_changed;   // 1 or 0, a double so the loop vectorizes
+	std::vector<int> m_changedPoints;
+};
+
+#endif // ANALOGUEFILTER_H
@@ -0,0 +1,88 @@
+///////////////////////////////////////////////////////////////////////////////
+// FILE:          Arena.cpp
+// PROJECT:       Devices 
+// SUBSYSTEM:     Device Controller 
+//-----------------------------------------------------------------------------
+// DESCRIPTION:   implementation of the monotonic and scan clocks
+//             
+// COPYRIGHT:     Karl Hoover, No Prior Art, 2009
+//
+// LICENSE:       This library is free software; you can redistribute it and/or
+//                modify it under the terms of the GNU Lesser General Public
+//                License (LGPL) as published by the Free Software Foundation.
+//                See license text at http://www.gnu.org/licenses/lgpl.txt 
+//                Briefly you can use this source code pretty much however you
+//                wish, as long as this notice remains intact and you
+//                prominently acknowledge this copyright.
+//
+//                This file is distributed in the hope that it will be useful,
+//                but WITHOUT ANY WARRANTY; without even the implied warranty
+//                of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//                IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//                CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+//                INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES.
+//
+// AUTHOR:        Karl Hoover  karl.hoover@gmail.com
+//
+// REVISIONS:     
+//
+// NOTES:   
+// see Arena.h for comments and history
+
+#include <algorithm>
+#include <functional>
+
+#include "Arena.h"
+
+using namespace std;
+
+Arena::Arena(): m_next(NULL), m_end(NULL), m_nextBlock(ARENA_FIRST_BLOCK), m_reserved(0),
+	m_used(0)
+{
+}
+
+Arena::~Arena()
+{
+	for (size_t i = 0; i < m_blocks.size(); ++i)
+	{
+		::operator delete(m_blocks[i].begin);
+	}
+}
+
+bool Arena::Before(const Block& a, const Block& b)
+{
+	return less<const char*>()(a.begin, b.begin);
+}
+
+void* Arena::Allocate(const size_t bytes, const size_t alignment)
+{
+	size_t padding = (alignment - reinterpret_cast<size_t>(m_next) % alignment) % alignment;
+	if (!m_next || padding + bytes > (size_t)(m_end - m_next))
+	{
+		// the rest of the last block is wasted, it is small next to the new one
+		size_t size = max(m_nextBlock, bytes + alignment);
+		Block block;
+		block.begin = static_cast<char*>(::operator new(size));
+		block.end = block.begin + size;
+		m_blocks.insert(upper_bound(m_blocks.begin(), m_blocks.end(), block, Before), block);
+		m_next = block.begin;
+		m_end = block.end;
+		m_reserved += size;
+		m_nextBlock = min(m_nextBlock * 2, (size_t)ARENA_MAX_BLOCK);
+		padding = (alignment - reinterpret_cast<size_t>(m_next) % alignment) % alignment;
+	}
+	char* p = m_next + padding;
+	m_next = p + bytes;
+	m_used += padding + bytes;
+	return p;
+}
+
+// the last block starting at or before p, if any, is the one p could be in
+bool Arena::Owns(const void* p) const
+{
+	Block at;
+	at.begin = at.end = const_cast<char*>(static_cast<const char*>(p));
+	vector<Block>::const_iterator it = upper_bound(m_blocks.begin(), m_blocks.end(), at, Before);
+	return it != m_blocks.begin() && at.begin < (it - 1)->end;
+}
@@ -0,0 +1,155 @@
+///////////////////////////////////////////////////////////////////////////////
+// FILE:          Arena.h
+// PROJECT:       Devices 
+// SUBSYSTEM:     Device Controller 
+//-----------------------------------------------------------------------------
+// DESCRIPTION:   bump allocator a plant is built in
+//             
+// COPYRIGHT:     Karl Hoover, No Prior Art, 2009
+//
+// LICENSE:       This library is free software; you can redistribute it and/or
+//                modify it under the terms of the GNU Lesser General Public
+//                License (LGPL) as published by the Free Software Foundation.
+//                See license text at http://www.gnu.org/licenses/lgpl.txt 
+//                Briefly you can use this source code pretty much however you
+//                wish, as long as this notice remains intact and you
+//                prominently acknowledge this copyright.
+//
+//                This file is distributed in the hope that it will be useful,
+//                but WITHOUT ANY WARRANTY; without even the implied warranty
+//                of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//                IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//                CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+//                INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES.
+//
+// AUTHOR:        Karl Hoover  karl.hoover@gmail.com
+//
+// REVISIONS:     1.0 October 16, 2026
+//
+// NOTES:   
+// A plant is built once and lives until shutdown, so there is no point in
+// malloc'ing its devices, their IO maps, bound point tables and command
+// rings one by one. An Arena hands memory out of a few large blocks by
+// bumping a pointer, so a plant of N devices ends up in a handful of
+// contiguous blocks instead of scattered over the heap. Blocks start at
+// ARENA_FIRST_BLOCK bytes and double up to ARENA_MAX_BLOCK, then stay at
+// that size: a few blocks for a small plant, then one more per
+// ARENA_MAX_BLOCK bytes.
+//
+// Nothing is given back before the Arena is destroyed: destructors of
+// objects in it still have to run (Plant does that), but their memory
+// stays reserved. Owns() tells whether an object lives in the arena, i.e.
+// whether to delete it or only call its destructor; the blocks are kept in
+// address order, so it is a binary search. Not thread safe, build the
+// plant from one thread.
+//
+// ArenaAllocator<T> lets the standard containers allocate from an Arena.
+// A default constructed one has no arena and uses the heap, so containers
+// carrying it behave as before wherever no arena is given. A container
+// copied or moved keeps its source's arena. Either way it honours alignas
+// beyond malloc's alignment, which std::allocator doesn't before C++17.
+
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <cstddef>
+#include <cstdlib>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#define ARENA_FIRST_BLOCK (64 * 1024)
+#define ARENA_MAX_BLOCK (16 * 1024 * 1024)
+
+class Arena
+{
+public:
+	Arena();
+	~Arena();
+	void* Allocate(const size_t bytes, const size_t alignment = alignof(std::max_align_t));
+	// construct a T in the arena
+	template <class T, class... Args> T* New(Args&&... args)
+		{return new (Allocate(sizeof(T), alignof(T))) T(std::forward<Args>(args)...);};
+	bool Owns(const void* p) const;
+	size_t Reserved() const {return m_reserved;}; // bytes in blocks
+	size_t Used() const {return m_used;};         // bytes handed out
+	size_t Blocks() const {return m_blocks.size();};
+
+private:
+	Arena(const Arena&);
+	Arena& operator=(const Arena&);
+	struct Block
+	{
+		char* begin;
+		char* end;
+	};
+	static bool Before(const Block& a, const Block& b); // by address
+	std::vector<Block> m_blocks; // by address
+	char* m_next; // free space of the last block
+	char* m_end;
+	size_t m_nextBlock; // size of the next block
+	size_t m_reserved;
+	size_t m_used;
+};
+
+template <class T> class ArenaAllocator
+{
+public:
+	typedef T value_type;
+	typedef std::true_type propagate_on_container_copy_assignment;
+	typedef std::true_type propagate_on_container_move_assignment;
+	typedef std::true_type propagate_on_container_swap;
+
+	ArenaAllocator(): m_arena(NULL) {};
+	explicit ArenaAllocator(Arena* arena): m_arena(arena) {};
+	template <class U> ArenaAllocator(const ArenaAllocator<U>& other): m_arena(other.Source()) {};
+	Arena* Source() const {return m_arena;}; // NULL: the heap
+
+	T* allocate(const size_t n)
+	{
+		if (m_arena)
+		{
+			return static_cast<T*>(m_arena->Allocate(n * sizeof(T), alignof(T)));
+		}
+		if (!OverAligned())
+		{
+			return static_cast<T*>(::operator new(n * sizeof(T)));
+		}
+		void* p;
+		if (posix_memalign(&p, alignof(T), n * sizeof(T)))
+		{
+			throw std::bad_alloc();
+		}
+		return static_cast<T*>(p);
+	};
+	void deallocate(T* p, const size_t)
+	{
+		if (m_arena)
+		{
+			return;
+		}
+		if (OverAligned())
+		{
+			free(p);
+		}
+		else
+		{
+			::operator delete(p);
+		}
+	};
+
+private:
+	static bool OverAligned() {return alignof(T) > alignof(std::max_align_t);};
+	Arena* m_arena;
+};
+
+template <class T, class U> 
+bool operator==(const ArenaAllocator<T>& a, const ArenaAllocator<U>& b) 
+	{return a.Source() == b.Source();}
+template <class T, class U> 
+bool operator!=(const ArenaAllocator<T>& a, const ArenaAllocator<U>& b) 
+	{return a.Source() != b.Source();}
+
+#endif // ARENA_H
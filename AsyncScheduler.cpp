@@ -0,0 +1,160 @@
+///////////////////////////////////////////////////////////////////////////////
+// FILE:          AsyncScheduler.cpp
+// PROJECT:       Devices 
+// SUBSYSTEM:     Device Controller 
+//-----------------------------------------------------------------------------
+// DESCRIPTION:   implementation of the monotonic and scan clocks
+//             
+// COPYRIGHT:     Karl Hoover, No Prior Art, 2009
+//
+// LICENSE:       This library is free software; you can redistribute it and/or
+//                modify it under the terms of the GNU Lesser General Public
+//                License (LGPL) as published by the Free Software Foundation.
+//                See license text at http://www.gnu.org/licenses/lgpl.txt 
+//                Briefly you can use this source code pretty much however you
+//                wish, as long as this notice remains intact and you
+//                prominently acknowledge this copyright.
+//
+//                This file is distributed in the hope that it will be useful,
+//                but WITHOUT ANY WARRANTY; without even the implied warranty
+//                of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//                IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//                CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+//                INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES.
+//
+// AUTHOR:        Karl Hoover  karl.hoover@gmail.com
+//
+// REVISIONS:     
+//
+// NOTES:   
+// see AsyncScheduler.h for comments and history
+
+#include <algorithm>
+
+#include <time.h>
+
+#include "AsyncScheduler.h"
+
+using namespace std;
+
+AsyncScheduler::AsyncScheduler(): m_order(0), m_stop(false), m_running(0)
+{
+	pthread_mutex_init(&m_mtx, NULL);
+	pthread_condattr_t attr;
+	pthread_condattr_init(&attr);
+	pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+	pthread_cond_init(&m_wake, &attr);
+	pthread_condattr_destroy(&attr);
+}
+
+AsyncScheduler::~AsyncScheduler()
+{
+	pthread_cond_destroy(&m_wake);
+	pthread_mutex_destroy(&m_mtx);
+}
+
+void AsyncScheduler::Post(AsyncCallback callback, void* context)
+{
+	Entry entry = {0, 0, callback, context};
+	pthread_mutex_lock(&m_mtx);
+	m_ready.push_back(entry);
+	pthread_mutex_unlock(&m_mtx);
+	pthread_cond_signal(&m_wake);
+}
+
+void AsyncScheduler::PostAt(const Nanoseconds deadline, AsyncCallback callback, void* context)
+{
+	pthread_mutex_lock(&m_mtx);
+	Entry entry = {deadline, m_order++, callback, context};
+	m_timers.push_back(entry);
+	push_heap(m_timers.begin(), m_timers.end(), Later());
+	bool earliest = m_timers.front().order == entry.order;
+	pthread_mutex_unlock(&m_mtx);
+	if (earliest) // a waiting Run() sleeps until the old earliest
+	{
+		pthread_cond_signal(&m_wake);
+	}
+}
+
+// the ready ones, then the timers which are due
+void AsyncScheduler::TakeDue(vector<Entry>& due, const Nanoseconds now)
+{
+	due.swap(m_ready);
+	while (!m_timers.empty() && m_timers.front().deadline <= now)
+	{
+		pop_heap(m_timers.begin(), m_timers.end(), Later());
+		due.push_back(m_timers.back());
+		m_timers.pop_back();
+	}
+}
+
+size_t AsyncScheduler::Call(vector<Entry>& due)
+{
+	size_t count = due.size();
+	for (size_t i = 0; i < count; ++i)
+	{
+		due[i].callback(due[i].context);
+	}
+	due.clear();
+	return count;
+}
+
+void AsyncScheduler::Run()
+{
+	vector<Entry> due;
+	pthread_mutex_lock(&m_mtx);
+	++m_running;
+	while (!m_stop)
+	{
+		TakeDue(due, MonotonicNanoseconds());
+		if (!due.empty())
+		{
+			pthread_mutex_unlock(&m_mtx);
+			Call(due);
+			pthread_mutex_lock(&m_mtx);
+			continue;
+		}
+		if (m_timers.empty())
+		{
+			pthread_cond_wait(&m_wake, &m_mtx);
+		}
+		else
+		{
+			Nanoseconds deadline = m_timers.front().deadline;
+			struct timespec until = {(time_t)(deadline / NANOSECONDS_PER_SECOND), 
+				(long)(deadline % NANOSECONDS_PER_SECOND)};
+			pthread_cond_timedwait(&m_wake, &m_mtx, &until);
+		}
+	}
+	if (0 == --m_running)
+	{
+		m_stop = false; // the last one out, the next Run() runs
+	}
+	pthread_mutex_unlock(&m_mtx);
+}
+
+size_t AsyncScheduler::Poll()
+{
+	vector<Entry> due;
+	pthread_mutex_lock(&m_mtx);
+	TakeDue(due, MonotonicNanoseconds());
+	pthread_mutex_unlock(&m_mtx);
+	return Call(due);
+}
+
+void AsyncScheduler::Stop()
+{
+	pthread_mutex_lock(&m_mtx);
+	m_stop = true;
+	pthread_mutex_unlock(&m_mtx);
+	pthread_cond_broadcast(&m_wake);
+}
+
+size_t AsyncScheduler::Pending() const
+{
+	pthread_mutex_lock(&m_mtx);
+	size_t pending = m_ready.size() + m_timers.size();
+	pthread_mutex_unlock(&m_mtx);
+	return pending;
+}
@@ -0,0 +1,105 @@
+///////////////////////////////////////////////////////////////////////////////
+// FILE:          AsyncScheduler.h
+// PROJECT:       Devices 
+// SUBSYSTEM:     Device Controller 
+//-----------------------------------------------------------------------------
+// DESCRIPTION:   runs callbacks on client threads, now or at a deadline
+//             
+// COPYRIGHT:     Karl Hoover, No Prior Art, 2009
+//
+// LICENSE:       This library is free software; you can redistribute it and/or
+//                modify it under the terms of the GNU Lesser General Public
+//                License (LGPL) as published by the Free Software Foundation.
+//                See license text at http://www.gnu.org/licenses/lgpl.txt 
+//                Briefly you can use this source code pretty much however you
+//                wish, as long as this notice remains intact and you
+//                prominently acknowledge this copyright.
+//
+//                This file is distributed in the hope that it will be useful,
+//                but WITHOUT ANY WARRANTY; without even the implied warranty
+//                of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//                IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//                CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+//                INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES.
+//
+// AUTHOR:        Karl Hoover  karl.hoover@gmail.com
+//
+// REVISIONS:     1.0 October 16, 2026
+//
+// NOTES:   
+// The event loop for client code which waits on the plant, e.g. the
+// coroutines of ValveAsync.h. Any thread, the scan thread included, may
+// Post() a callback; one or two client threads Run() the loop and call
+// it. A completion callback on the scan thread then costs a lock and a
+// push instead of the client's work, and nothing on the client side polls
+// or blocks a thread per operation.
+//
+// PostAt() calls back once MonotonicNanoseconds() has passed a deadline,
+// for timeouts. Timers are a binary heap, waiting is a condition variable
+// on CLOCK_MONOTONIC with the earliest deadline as its timeout, so an idle
+// scheduler sleeps.
+//
+// Callbacks run outside the lock, in the order posted (or due), and may
+// post more. With more than one thread running the loop two callbacks may
+// run at the same time. Stop() makes every Run() return once the
+// callbacks it has taken are done, including a Run() which starts after
+// it; once they have all returned the next Run() runs. What is still
+// queued stays queued for it or for Poll(); destroying the scheduler drops
+// it without calling it.
+
+#ifndef ASYNCSCHEDULER_H
+#define ASYNCSCHEDULER_H
+
+#include <vector>
+#include <cstddef>
+
+#include <pthread.h>
+
+#include "ScanClock.h"
+
+typedef void (*AsyncCallback)(void* context);
+
+class AsyncScheduler
+{
+public:
+	AsyncScheduler();
+	~AsyncScheduler();
+
+	void Post(AsyncCallback callback, void* context); // any thread
+	// any thread, deadline on MonotonicNanoseconds()
+	void PostAt(const Nanoseconds deadline, AsyncCallback callback, void* context);
+
+	void Run();    // calls back until Stop(), several threads may Run()
+	size_t Poll(); // calls what is due now without waiting, returns how many
+	void Stop();   // any thread, also every Run()
+	size_t Pending() const; // posted or timed, not called yet
+
+private:
+	AsyncScheduler(const AsyncScheduler&);
+	AsyncScheduler& operator=(const AsyncScheduler&);
+	struct Entry
+	{
+		Nanoseconds deadline;
+		unsigned long long order; // ties, so timers due together run as posted
+		AsyncCallback callback;
+		void* context;
+	};
+	struct Later  // heap order, earliest on top
+	{
+		bool operator()(const Entry& a, const Entry& b) const 
+			{return a.deadline > b.deadline || (a.deadline == b.deadline && a.order > b.order);};
+	};
+	void TakeDue(std::vector<Entry>& due, const Nanoseconds now); // under the lock
+	static size_t Call(std::vector<Entry>& due);
+
+	std::vector<Entry> m_ready;
+	std::vector<Entry> m_timers;
+	unsigned long long m_order;
+	bool m_stop;
+	int m_running; // threads in Run()
+	mutable pthread_mutex_t m_mtx;
+	pthread_cond_t m_wake;
+};
+
+#endif // ASYNCSCHEDULER_H
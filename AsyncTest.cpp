@@ -0,0 +1,341 @@
+///////////////////////////////////////////////////////////////////////////////
+// FILE:          AsyncTest.cpp
+// PROJECT:       Devices
+// SUBSYSTEM:     Device Controller
+//-----------------------------------------------------------------------------
+// DESCRIPTION:   checks of the valve coroutines, ValveAsync.h
+//
+// COPYRIGHT:     Karl Hoover, No Prior Art, 2009
+//
+// LICENSE:       This library is free software; you can redistribute it and/or
+//                modify it under the terms of the GNU Lesser General Public
+//                License (LGPL) as published by the Free Software Foundation.
+//                See license text at http://www.gnu.org/licenses/lgpl.txt
+//                Briefly you can use this source code pretty much however you
+//                wish, as long as this notice remains intact and you
+//                prominently acknowledge this copyright.
+//
+//                This file is distributed in the hope that it will be useful,
+//                but WITHOUT ANY WARRANTY; without even the implied warranty
+//                of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//                IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//                CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+//                INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES.
+//
+// AUTHOR:        Karl Hoover  karl.hoover@gmail.com
+//
+// REVISIONS:     1.0 October 17, 2026  needs C++20 for the coroutines
+//
+// NOTES:
+// make test   builds asynctest with devicetest and runs them both
+//
+// The library is C++11, ValveAsync.h is C++20, so this is a program of its
+// own. Real valves on a simulated plant, scanned by their own thread on
+// the monotonic clock, as in a controller:
+//
+//   scan        completions resume a task started without a scheduler
+//               on the scan thread
+//   scheduler   ... and one started with an AsyncScheduler on the
+//               scheduler's thread, its timers that didn't fire do nothing
+//   timeout     a jammed valve: the timeout resumes the task first, the
+//               valve's late completion is then ignored
+//   rejected    COMMAND_RESULT_REJECTED for a timeout without a scheduler,
+//               posting nothing, and for a full command queue, with and
+//               without one; a task never started posts nothing either
+//
+// Each operation is shared by the coroutine, its completion and its timer,
+// and freed by whichever is last. Leaks and double frees show under
+// AddressSanitizer, which is worth a run after changing ValveAsync.h:
+//
+//     make clean
+//     CXXFLAGS="-O1 -g -fsanitize=address" LDFLAGS=-fsanitize=address make test
+//
+// (in the environment, not on the command line, so the Makefile's own
+// flags are still added). ThreadSanitizer the same way.
+
+#include <cstdio>
+#include <sstream>
+#include <atomic>
+#include <unistd.h>
+#include <pthread.h>
+
+#include "device.h"
+#include "DeviceFactory.h"
+#include "PlantSimulator.h"
+#include "AsyncScheduler.h"
+#include "ValveAsync.h"
+
+#define CHECK(condition) Check((condition), #condition, __FILE__, __LINE__)
+
+#define SCANNED 4         // valves the scan thread updates, then one it doesn't
+#define JAMMED 2
+#define WAIT_LIMIT (5 * NANOSECONDS_PER_SECOND)
+
+static int failures = 0;
+static int checkFailures = 0; // in the check being run
+
+static void Check(const bool ok, const char* what, const char* file, const int line)
+{
+	if (!ok)
+	{
+		printf("  failed: %s at %s:%d\n", what, file, line);
+		++failures;
+		++checkFailures;
+	}
+}
+
+static void Begin()
+{
+	checkFailures = 0;
+}
+
+static void End(const char* check, const string& detail)
+{
+	printf("%s: %s%s%s\n", check, checkFailures ? "FAILED" : "ok",
+		detail.empty() ? "" : ", ", detail.c_str());
+	fflush(stdout);
+}
+
+// count double throw valves, each with its own sensors, commands and
+// interlocks, built the way a real configuration is
+static void BuildPlant(Plant& plant, const int count)
+{
+	ostringstream table;
+	for (int i = 0; i < count; ++i)
+	{
+		table << 'V' << i << ",CLOSED?,V" << i << "CLOSED?,bool,ReadOnly,DoubleThrowValve\n"
+			<< 'V' << i << ",OPENED?,V" << i << "OPENED?,bool,ReadOnly\n"
+			<< 'V' << i << ",CLOSE!,V" << i << "CLOSE!,bool,WriteOnly\n"
+			<< 'V' << i << ",OPEN!,V" << i << "OPEN!,bool,WriteOnly\n"
+			<< 'V' << i << ",CLOSE_OK?,V" << i << "CLOSE_OK?,bool,ReadOnly\n"
+			<< 'V' << i << ",OPEN_OK?,V" << i << "OPEN_OK?,bool,ReadOnly\n";
+	}
+	string text = table.str();
+	DeviceFactory::Parse(text.data(), text.size(), "test", plant);
+}
+
+// the controller: a scan a millisecond over the first SCANNED valves
+struct Scanner
+{
+	Plant* plant;
+	PlantSimulator* simulator;
+	atomic<bool> stop;
+};
+
+static void* Scan(void* arg)
+{
+	Scanner& scanner = *static_cast<Scanner*>(arg);
+	ProcessImage& image = scanner.plant->Image();
+	const vector<Device*>& devices = scanner.plant->Devices();
+	while (!scanner.stop)
+	{
+		scanner.simulator->Step(MonotonicNanoseconds());
+		image.LatchInputs();
+		SampleScanTime();
+		for (int i = 0; i < SCANNED; ++i)
+		{
+			devices[i]->Update();
+		}
+		image.CommitOutputs();
+		usleep(1000);
+	}
+	return NULL;
+}
+
+static void* RunScheduler(void* arg)
+{
+	static_cast<AsyncScheduler*>(arg)->Run();
+	return NULL;
+}
+
+// what a task saw after each co_await
+struct Awaited
+{
+	Awaited(): resumed(0) {};
+	atomic<int> resumed;
+	int results[2];
+	pthread_t threads[2];
+};
+
+static void Resumed(Awaited& awaited, const int result)
+{
+	int n = awaited.resumed;
+	if (n < 2)
+	{
+		awaited.results[n] = result;
+		awaited.threads[n] = pthread_self();
+	}
+	awaited.resumed = n + 1; // one thread at a time runs the task
+}
+
+static AsyncTask OpenThenClose(Valve& valve, const Nanoseconds timeout, Awaited& awaited)
+{
+	Resumed(awaited, co_await OpenAsync(valve, timeout));
+	Resumed(awaited, co_await CloseAsync(valve, timeout));
+}
+
+// the reset is only taken once the open has finished, completion and all
+static AsyncTask OpenThenReset(Valve& valve, const Nanoseconds timeout, Awaited& awaited)
+{
+	Resumed(awaited, co_await OpenAsync(valve, timeout));
+	Resumed(awaited, co_await ResetAsync(valve));
+}
+
+static AsyncTask AwaitOne(Device& device, const Nanoseconds timeout, Awaited& awaited)
+{
+	Resumed(awaited, co_await CommandAsync(device, COMMAND_OPEN, timeout));
+}
+
+// false if it took longer than WAIT_LIMIT
+static bool WaitFor(const atomic<int>& value, const int wanted)
+{
+	Nanoseconds start = MonotonicNanoseconds();
+	while (value < wanted && MonotonicNanoseconds() - start < WAIT_LIMIT)
+	{
+		usleep(1000);
+	}
+	return value >= wanted;
+}
+
+static bool WaitForTimers(const AsyncScheduler& scheduler)
+{
+	Nanoseconds start = MonotonicNanoseconds();
+	while (scheduler.Pending() && MonotonicNanoseconds() - start < WAIT_LIMIT)
+	{
+		usleep(1000);
+	}
+	return !scheduler.Pending();
+}
+
+static void TestScan(Plant& plant, const pthread_t scanThread)
+{
+	Begin();
+	Awaited awaited;
+	Valve& valve = *static_cast<Valve*>(plant.Devices()[0]);
+	OpenThenClose(valve, 0, awaited).Start(); // here until it posts the open
+	CHECK(WaitFor(awaited.resumed, 2));
+	CHECK(2 == awaited.resumed);
+	CHECK(COMMAND_RESULT_DONE == awaited.results[0] && COMMAND_RESULT_DONE == awaited.results[1]);
+	CHECK(pthread_equal(scanThread, awaited.threads[0]) &&
+		pthread_equal(scanThread, awaited.threads[1]));
+	End("scan", "");
+}
+
+static void TestScheduler(Plant& plant, AsyncScheduler& scheduler,
+	const pthread_t schedulerThread)
+{
+	Begin();
+	Awaited awaited;
+	Valve& valve = *static_cast<Valve*>(plant.Devices()[1]);
+	Nanoseconds start = MonotonicNanoseconds();
+	OpenThenClose(valve, 200 * NANOSECONDS_PER_MILLISECOND, awaited).Start(scheduler);
+	CHECK(WaitFor(awaited.resumed, 2));
+	Nanoseconds took = MonotonicNanoseconds() - start;
+	CHECK(COMMAND_RESULT_DONE == awaited.results[0] && COMMAND_RESULT_DONE == awaited.results[1]);
+	CHECK(pthread_equal(schedulerThread, awaited.threads[0]) &&
+		pthread_equal(schedulerThread, awaited.threads[1]));
+	// both timers are still due, and then they must do nothing
+	CHECK(WaitForTimers(scheduler));
+	CHECK(2 == awaited.resumed);
+
+	ostringstream detail;
+	detail << "opened and closed in " << took / NANOSECONDS_PER_MILLISECOND << " ms";
+	End("scheduler", detail.str());
+}
+
+static void TestTimeout(Plant& plant, AsyncScheduler& scheduler)
+{
+	Begin();
+	Awaited awaited;
+	Valve& valve = *static_cast<Valve*>(plant.Devices()[JAMMED]);
+	OpenThenReset(valve, 20 * NANOSECONDS_PER_MILLISECOND, awaited).Start(scheduler);
+	CHECK(WaitFor(awaited.resumed, 1));
+	CHECK(COMMAND_RESULT_TIMED_OUT == awaited.results[0]);
+	// the open fails at the valve's motion timeout, well after ours; had
+	// its completion resumed the task as well, the reset would see it
+	CHECK(WaitFor(awaited.resumed, 2));
+	CHECK(2 == awaited.resumed);
+	CHECK(COMMAND_RESULT_DONE == awaited.results[1]);
+	CHECK(WaitForTimers(scheduler));
+	End("timeout", "");
+}
+
+// on the valve the scan thread leaves alone
+static void TestRejected(Plant& plant, AsyncScheduler& scheduler)
+{
+	Begin();
+	Device& spare = *plant.Devices()[SCANNED];
+	{
+		Awaited awaited;
+		AwaitOne(spare, 10 * NANOSECONDS_PER_MILLISECOND, awaited).Start();
+		CHECK(1 == awaited.resumed); // at once, on this thread
+		CHECK(COMMAND_RESULT_REJECTED == awaited.results[0]);
+		CHECK(pthread_equal(pthread_self(), awaited.threads[0]));
+	}
+	{
+		Awaited awaited;
+		AsyncTask never = AwaitOne(spare, 0, awaited);
+		CHECK(0 == awaited.resumed);
+	}
+	// neither posted anything, the whole queue is still free
+	int posted = 0;
+	while (spare.PostCommand(COMMAND_CLOSE))
+	{
+		++posted;
+	}
+	CHECK(DEFAULT_COMMAND_QUEUE_DEPTH == posted);
+	{
+		Awaited awaited;
+		AwaitOne(spare, 0, awaited).Start();
+		CHECK(1 == awaited.resumed);
+		CHECK(COMMAND_RESULT_REJECTED == awaited.results[0]);
+	}
+	{
+		Awaited awaited;
+		AwaitOne(spare, 10 * NANOSECONDS_PER_MILLISECOND, awaited).Start(scheduler);
+		CHECK(WaitFor(awaited.resumed, 1));
+		CHECK(COMMAND_RESULT_REJECTED == awaited.results[0]);
+		CHECK(WaitForTimers(scheduler)); // it never armed one
+	}
+	End("rejected", "");
+}
+
+int main(int argc, char* argv[])
+{
+	Plant plant;
+	BuildPlant(plant, SCANNED + 1);
+	PlantSimulator simulator(plant.Image(), 9);
+	simulator.SetTravelTime(NANOSECONDS_PER_MILLISECOND, 4 * NANOSECONDS_PER_MILLISECOND);
+	for (int i = 0; i < SCANNED; ++i)
+	{
+		Valve& valve = *static_cast<Valve*>(plant.Devices()[i]);
+		valve.SetMotionTimeOut(200 * NANOSECONDS_PER_MILLISECOND);
+		simulator.AddValve(valve);
+		simulator.Place(i, true);
+	}
+	simulator.SetFaults(JAMMED, SIM_FAULT_JAMMED);
+
+	Scanner scanner;
+	scanner.plant = &plant;
+	scanner.simulator = &simulator;
+	scanner.stop = false;
+	pthread_t scanThread;
+	pthread_create(&scanThread, NULL, Scan, &scanner);
+	AsyncScheduler scheduler;
+	pthread_t schedulerThread;
+	pthread_create(&schedulerThread, NULL, RunScheduler, &scheduler);
+	usleep(50000); // the valves come up closed
+
+	TestScan(plant, scanThread);
+	TestScheduler(plant, scheduler, schedulerThread);
+	TestTimeout(plant, scheduler);
+	TestRejected(plant, scheduler);
+
+	scheduler.Stop();
+	pthread_join(schedulerThread, NULL);
+	scanner.stop = true;
+	pthread_join(scanThread, NULL);
+	printf("%d failed\n", failures);
+	return failures;
+}
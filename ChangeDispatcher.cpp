@@ -0,0 +1,175 @@
+///////////////////////////////////////////////////////////////////////////////
+// FILE:          ChangeDispatcher.cpp
+// PROJECT:       Devices 
+// SUBSYSTEM:     Device Controller 
+//-----------------------------------------------------------------------------
+// DESCRIPTION:   implementation of change driven callback dispatch
+//             
+// COPYRIGHT:     Karl Hoover, No Prior Art, 2009
+//
+// LICENSE:       This library is free software; you can redistribute it and/or
+//                modify it under the terms of the GNU Lesser General Public
+//                License (LGPL) as published by the Free Software Foundation.
+//                See license text at http://www.gnu.org/licenses/lgpl.txt 
+//                Briefly you can use this source code pretty much however you
+//                wish, as long as this notice remains intact and you
+//                prominently acknowledge this copyright.
+//
+//                This file is distributed in the hope that it will be useful,
+//                but WITHOUT ANY WARRANTY; without even the implied warranty
+//                of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//                IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//                CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+//                INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES.
+//
+// AUTHOR:        Karl Hoover  karl.hoover@gmail.com
+//
+// REVISIONS:     
+//
+// NOTES:   
+// see ChangeDispatcher.h for comments and history
+
+#include "ChangeDispatcher.h"
+#include "device.h"
+
+ChangeDispatcher::ChangeDispatcher(const ProcessImage& image): m_image(image),
+	m_cycle(0), m_notified(NULL), m_initial(true)
+{
+}
+
+int ChangeDispatcher::DeviceIndex(Device& device)
+{
+	DispatchLink& link = device.m_dispatchLink;
+	if (link.m_dispatcher != this)
+	{
+		link.m_dispatcher = this;
+		link.m_index = m_devices.size();
+		m_devices.push_back(&device);
+	}
+	return link.m_index;
+}
+
+void ChangeDispatcher::Subscribe(Device& device)
+{
+	vector<int> points;
+	device.InputPoints(points);
+	int index = DeviceIndex(device);
+	for (size_t i = 0; i < points.size(); ++i)
+	{
+		m_subscriptions.push_back(make_pair(points[i], index));
+	}
+}
+
+void ChangeDispatcher::Subscribe(Device& device, const int point)
+{
+	m_subscriptions.push_back(make_pair(point, DeviceIndex(device)));
+}
+
+// counting sort of the (point, device) pairs into the flat index
+void ChangeDispatcher::Build()
+{
+	int points = m_image.DigitalInputCount();
+	m_offsets.assign(points + 1, 0);
+	for (size_t i = 0; i < m_subscriptions.size(); ++i)
+	{
+		++m_offsets[m_subscriptions[i].first + 1];
+	}
+	for (int p = 0; p < points; ++p)
+	{
+		m_offsets[p + 1] += m_offsets[p];
+	}
+	m_subscribers.resize(m_subscriptions.size());
+	vector<int> fill(m_offsets.begin(), m_offsets.end() - 1);
+	for (size_t i = 0; i < m_subscriptions.size(); ++i)
+	{
+		m_subscribers[fill[m_subscriptions[i].first]++] = m_subscriptions[i].second;
+	}
+	m_subscriptions.clear();
+	m_markedCycle.assign(m_devices.size(), 0);
+	m_initial = true;
+}
+
+// push onto the notify stack unless already there. The consumer takes the
+// whole stack with one exchange, so there is no ABA problem.
+void ChangeDispatcher::Notify(Device& device)
+{
+	DispatchLink& link = device.m_dispatchLink;
+	if (link.m_pending.exchange(true, std::memory_order_acq_rel))
+	{
+		return;
+	}
+	Device* top = m_notified.load(std::memory_order_relaxed);
+	do
+	{
+		link.m_next = top;
+	} while (!m_notified.compare_exchange_weak(top, &device, 
+		std::memory_order_release, std::memory_order_relaxed));
+}
+
+void ChangeDispatcher::Mark(const int device, std::vector<Device*>& devices)
+{
+	if (m_markedCycle[device] != m_cycle)
+	{
+		m_markedCycle[device] = m_cycle;
+		devices.push_back(m_devices[device]);
+	}
+}
+
+void ChangeDispatcher::CollectChanged(std::vector<Device*>& devices)
+{
+	if (0 == ++m_cycle) // wrapped, old marks could now match
+	{
+		m_markedCycle.assign(m_markedCycle.size(), 0);
+		m_cycle = 1;
+	}
+	if (m_initial)
+	{
+		m_initial = false;
+		for (size_t d = 0; d < m_devices.size(); ++d)
+		{
+			Mark(d, devices);
+		}
+	}
+	else
+	{
+		m_changedPoints.clear();
+		m_image.ChangedInputs(m_changedPoints);
+		for (size_t i = 0; i < m_changedPoints.size(); ++i)
+		{
+			int point = m_changedPoints[i];
+			for (int s = m_offsets[point]; s < m_offsets[point + 1]; ++s)
+			{
+				Mark(m_subscribers[s], devices);
+			}
+		}
+	}
+	
+	Device* device = m_notified.exchange(NULL, std::memory_order_acquire);
+	while (device)
+	{
+		Device* next = device->m_dispatchLink.m_next;
+		// clear first: a Notify from now on queues it for the next cycle
+		device->m_dispatchLink.m_pending.store(false, std::memory_order_release);
+		if (device->m_dispatchLink.m_dispatcher == this)
+		{
+			Mark(device->m_dispatchLink.m_index, devices);
+		}
+		else
+		{
+			devices.push_back(device); // not subscribed, can't be marked already
+		}
+		device = next;
+	}
+}
+
+int ChangeDispatcher::Dispatch()
+{
+	m_dirty.clear();
+	CollectChanged(m_dirty);
+	for (size_t i = 0; i < m_dirty.size(); ++i)
+	{
+		m_dirty[i]->DoProcessCallBacks();
+	}
+	return m_dirty.size();
+}
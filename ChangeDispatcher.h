@@ -0,0 +1,114 @@
+///////////////////////////////////////////////////////////////////////////////
+// FILE:          ChangeDispatcher.h
+// PROJECT:       Devices 
+// SUBSYSTEM:     Device Controller 
+//-----------------------------------------------------------------------------
+// DESCRIPTION:   calls DoProcessCallBacks() only on devices whose inputs
+//                changed in the last scan
+//             
+// COPYRIGHT:     Karl Hoover, No Prior Art, 2009
+//
+// LICENSE:       This library is free software; you can redistribute it and/or
+//                modify it under the terms of the GNU Lesser General Public
+//                License (LGPL) as published by the Free Software Foundation.
+//                See license text at http://www.gnu.org/licenses/lgpl.txt 
+//                Briefly you can use this source code pretty much however you
+//                wish, as long as this notice remains intact and you
+//                prominently acknowledge this copyright.
+//
+//                This file is distributed in the hope that it will be useful,
+//                but WITHOUT ANY WARRANTY; without even the implied warranty
+//                of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//                IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//                CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+//                INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES.
+//
+// AUTHOR:        Karl Hoover  karl.hoover@gmail.com
+//
+// REVISIONS:     1.0 October 16, 2026
+//
+// NOTES:   
+// The subscription index maps each digital input point to the devices that
+// read it. It is built once from the devices' bound inputs and then frozen
+// into two flat arrays (offsets per point, device indices), so a lookup is
+// two array reads. Per cycle:
+//
+//     image.LatchInputs();        // XORs old against new image
+//     dispatcher.Dispatch();      // DoProcessCallBacks() on affected devices
+//
+// A device that reads several changed points is called back once. Changes
+// that aren't visible in the inputs, a new command for example, are passed
+// in with Notify(); it may be called from any thread and doesn't lock. A
+// subscribed device notifies itself when a command is posted to it.
+//
+// The first Dispatch() after Build() calls back every device, so each one
+// sees its initial inputs. Timeouts come from a TimerWheel, see TimerWheel.h.
+
+#ifndef CHANGEDISPATCHER_H
+#define CHANGEDISPATCHER_H
+
+#include <vector>
+#include <atomic>
+#include <cstddef>
+
+class Device;
+class ProcessImage;
+class ChangeDispatcher;
+
+// a Device's entry in its dispatcher's notify list: a lock-free stack of
+// devices, the flag stops a device being pushed twice. Not copied with the
+// device.
+class DispatchLink
+{
+public:
+	DispatchLink(): m_pending(false), m_next(NULL), m_dispatcher(NULL), m_index(-1) {};
+	DispatchLink(const DispatchLink&): m_pending(false), m_next(NULL), m_dispatcher(NULL), 
+		m_index(-1) {};
+	ChangeDispatcher* Dispatcher() const {return m_dispatcher;};
+private:
+	friend class ChangeDispatcher;
+	DispatchLink& operator=(const DispatchLink&);
+	std::atomic<bool> m_pending;
+	Device* m_next;
+	ChangeDispatcher* m_dispatcher;
+	int m_index; // in m_dispatcher's devices
+};
+
+class ChangeDispatcher
+{
+public:
+	ChangeDispatcher(const ProcessImage& image);
+	~ChangeDispatcher() {};
+	void Subscribe(Device& device);  // to all the device's bound inputs
+	void Subscribe(Device& device, const int point);
+	void Build();  // after the last Subscribe, before the first Dispatch
+	
+	void Notify(Device& device);  // call back next Dispatch() regardless
+	void CollectChanged(std::vector<Device*>& devices); // appends, clears
+	int Dispatch(); // returns number of devices called back
+	
+	int SubscriberCount(const int point) const 
+		{return m_offsets[point + 1] - m_offsets[point];};
+
+private:
+	ChangeDispatcher(const ChangeDispatcher&);
+	ChangeDispatcher& operator=(const ChangeDispatcher&);
+
+	int DeviceIndex(Device& device);
+	void Mark(const int device, std::vector<Device*>& devices);
+
+	const ProcessImage& m_image;
+	std::vector<Device*> m_devices;
+	std::vector<std::pair<int, int> > m_subscriptions; // (point, device), until Build
+	std::vector<int> m_offsets;      // per point, into m_subscribers
+	std::vector<int> m_subscribers;  // device indices grouped by point
+	std::vector<unsigned> m_markedCycle; // per device, dedup within a cycle
+	unsigned m_cycle;
+	std::vector<int> m_changedPoints;  // scratch
+	std::vector<Device*> m_dirty;      // scratch
+	std::atomic<Device*> m_notified;   // top of the notify stack
+	bool m_initial;
+};
+
+#endif // CHANGEDISPATCHER_H
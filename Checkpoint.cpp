@@ -0,0 +1,265 @@
+///////////////////////////////////////////////////////////////////////////////
+// FILE:          Checkpoint.cpp
+// PROJECT:       Devices 
+// SUBSYSTEM:     Device Controller 
+//-----------------------------------------------------------------------------
+// DESCRIPTION:   implementation of checkpoint and warm restart
+//             
+// COPYRIGHT:     Karl Hoover, No Prior Art, 2009
+//
+// LICENSE:       This library is free software; you can redistribute it and/or
+//                modify it under the terms of the GNU Lesser General Public
+//                License (LGPL) as published by the Free Software Foundation.
+//                See license text at http://www.gnu.org/licenses/lgpl.txt 
+//                Briefly you can use this source code pretty much however you
+//                wish, as long as this notice remains intact and you
+//                prominently acknowledge this copyright.
+//
+//                This file is distributed in the hope that it will be useful,
+//                but WITHOUT ANY WARRANTY; without even the implied warranty
+//                of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//                IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//                CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+//                INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES.
+//
+// AUTHOR:        Karl Hoover  karl.hoover@gmail.com
+//
+// REVISIONS:     
+//
+// NOTES:   
+// see Checkpoint.h for comments and history
+
+#include <cstring>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "Checkpoint.h"
+#include "device.h"
+#include "TimeMicroseconds.h"
+
+#define CHECKPOINT_MAGIC 0x54504b4356454444ULL  // "DDEVCKPT"
+
+struct CheckpointHeader  // start of each slot
+{
+	unsigned long long magic;
+	unsigned int version;
+	unsigned int checksum;     // of everything after the header
+	unsigned long long sequence;  // 0: slot never written
+	unsigned long long savedAt;   // wall clock, TimeMicroseconds(), for people
+	unsigned int deviceCount;
+	unsigned int digitalWords;
+	unsigned int analogueCount;
+	unsigned int reserved;
+};
+
+static size_t SlotSize(const size_t devices, const size_t words, const size_t analogues)
+{
+	size_t size = sizeof(CheckpointHeader) + devices * sizeof(DeviceCheckpoint) +
+		words * sizeof(ImageWord) + analogues * sizeof(double);
+	return (size + 4095) & ~(size_t)4095; // page aligned, so msync per slot
+}
+
+// FNV-1a
+unsigned long long CheckpointNameHash(const string& name)
+{
+	unsigned long long hash = 14695981039346656037ULL;
+	for (size_t i = 0; i < name.size(); ++i)
+	{
+		hash ^= (unsigned char)name[i];
+		hash *= 1099511628211ULL;
+	}
+	return hash;
+}
+
+static unsigned int Checksum(const char* data, const size_t length)
+{
+	unsigned int hash = 2166136261U;
+	for (size_t i = 0; i < length; ++i)
+	{
+		hash ^= (unsigned char)data[i];
+		hash *= 16777619U;
+	}
+	return hash;
+}
+
+// definitions for class CheckpointWriter
+
+CheckpointWriter::CheckpointWriter(const string& path, const vector<Device*>& devices,
+	const ProcessImage& image): m_devices(devices), m_image(image), m_map(NULL), 
+	m_sequence(0)
+{
+	m_image.ReadFieldOutputs(m_digital, m_analogue);
+	m_slotSize = SlotSize(m_devices.size(), m_digital.size(), m_analogue.size());
+	int fd = open(path.c_str(), O_RDWR | O_CREAT, 0644);
+	if (fd < 0)
+	{
+		throw runtime_error(path + ": cannot open checkpoint");
+	}
+	if (ftruncate(fd, 2 * m_slotSize) < 0)
+	{
+		close(fd);
+		throw runtime_error(path + ": cannot size checkpoint");
+	}
+	void* map = mmap(NULL, 2 * m_slotSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if (MAP_FAILED == map)
+	{
+		throw runtime_error(path + ": cannot mmap checkpoint");
+	}
+	m_map = static_cast<char*>(map);
+	// carry on from the sequence already in the file, so a restart doesn't
+	// make the older slot look newer
+	for (int slot = 0; slot < 2; ++slot)
+	{
+		const CheckpointHeader* header = 
+			reinterpret_cast<const CheckpointHeader*>(m_map + slot * m_slotSize);
+		if (CHECKPOINT_MAGIC == header->magic && header->sequence > m_sequence)
+		{
+			m_sequence = header->sequence;
+		}
+	}
+}
+
+CheckpointWriter::~CheckpointWriter()
+{
+	msync(m_map, 2 * m_slotSize, MS_SYNC);
+	munmap(m_map, 2 * m_slotSize);
+}
+
+void CheckpointWriter::Write()
+{
+	++m_sequence;
+	char* slot = m_map + (m_sequence % 2) * m_slotSize;
+	CheckpointHeader* header = reinterpret_cast<CheckpointHeader*>(slot);
+	header->sequence = 0; // invalid until complete
+	
+	DeviceCheckpoint* records = reinterpret_cast<DeviceCheckpoint*>(header + 1);
+	for (size_t i = 0; i < m_devices.size(); ++i)
+	{
+		memset(&records[i], 0, sizeof(DeviceCheckpoint));
+		m_devices[i]->SaveState(records[i]);
+	}
+	m_image.ReadFieldOutputs(m_digital, m_analogue);
+	char* outputs = reinterpret_cast<char*>(records + m_devices.size());
+	if (!m_digital.empty())
+	{
+		memcpy(outputs, &m_digital[0], m_digital.size() * sizeof(ImageWord));
+	}
+	outputs += m_digital.size() * sizeof(ImageWord);
+	if (!m_analogue.empty())
+	{
+		memcpy(outputs, &m_analogue[0], m_analogue.size() * sizeof(double));
+	}
+	outputs += m_analogue.size() * sizeof(double);
+
+	header->magic = CHECKPOINT_MAGIC;
+	header->version = CHECKPOINT_VERSION;
+	header->savedAt = TimeMicroseconds();
+	header->deviceCount = m_devices.size();
+	header->digitalWords = m_digital.size();
+	header->analogueCount = m_analogue.size();
+	header->reserved = 0;
+	char* payload = reinterpret_cast<char*>(header + 1);
+	header->checksum = Checksum(payload, outputs - payload);
+	header->sequence = m_sequence;
+	msync(slot, m_slotSize, MS_ASYNC);
+}
+
+// restore
+
+// the newest slot which is complete and matches this plant, NULL if none
+static const CheckpointHeader* NewestSlot(const char* map, const size_t length,
+	const size_t slotSize, const vector<Device*>& devices, const size_t words, 
+	const size_t analogues)
+{
+	const CheckpointHeader* newest = NULL;
+	for (int slot = 0; slot < 2; ++slot)
+	{
+		if ((slot + 1) * slotSize > length)
+		{
+			break;
+		}
+		const CheckpointHeader* header = 
+			reinterpret_cast<const CheckpointHeader*>(map + slot * slotSize);
+		if (CHECKPOINT_MAGIC != header->magic || CHECKPOINT_VERSION != header->version ||
+			0 == header->sequence || devices.size() != header->deviceCount ||
+			words != header->digitalWords || analogues != header->analogueCount)
+		{
+			continue;
+		}
+		const char* payload = reinterpret_cast<const char*>(header + 1);
+		size_t payloadSize = devices.size() * sizeof(DeviceCheckpoint) +
+			words * sizeof(ImageWord) + analogues * sizeof(double);
+		if (Checksum(payload, payloadSize) != header->checksum)
+		{
+			continue;
+		}
+		if (!newest || header->sequence > newest->sequence)
+		{
+			newest = header;
+		}
+	}
+	return newest;
+}
+
+int RestoreCheckpoint(const string& path, const vector<Device*>& devices,
+	ProcessImage& image)
+{
+	vector<ImageWord> digital;
+	vector<double> analogue;
+	image.ReadFieldOutputs(digital, analogue);
+	size_t slotSize = SlotSize(devices.size(), digital.size(), analogue.size());
+	
+	int fd = open(path.c_str(), O_RDONLY);
+	if (fd < 0)
+	{
+		return 0;
+	}
+	struct stat info;
+	if (fstat(fd, &info) < 0 || (size_t)info.st_size < slotSize)
+	{
+		close(fd);
+		return 0;
+	}
+	void* map = mmap(NULL, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (MAP_FAILED == map)
+	{
+		return 0;
+	}
+	
+	int restored = 0;
+	const CheckpointHeader* header = NewestSlot(static_cast<const char*>(map), 
+		info.st_size, slotSize, devices, digital.size(), analogue.size());
+	if (header)
+	{
+		const DeviceCheckpoint* records = reinterpret_cast<const DeviceCheckpoint*>(header + 1);
+		const char* outputs = reinterpret_cast<const char*>(records + devices.size());
+		if (!digital.empty())
+		{
+			memcpy(&digital[0], outputs, digital.size() * sizeof(ImageWord));
+		}
+		outputs += digital.size() * sizeof(ImageWord);
+		if (!analogue.empty())
+		{
+			memcpy(&analogue[0], outputs, analogue.size() * sizeof(double));
+		}
+		// outputs first: a valve checks its sensors against its commands
+		image.RestoreOutputs(digital, analogue);
+		for (size_t i = 0; i < devices.size(); ++i)
+		{
+			if (records[i].nameHash == CheckpointNameHash(devices[i]->Name()) &&
+				devices[i]->RestoreState(records[i]))
+			{
+				++restored;
+			}
+		}
+	}
+	munmap(map, info.st_size);
+	return restored;
+}
@@ -0,0 +1,105 @@
+///////////////////////////////////////////////////////////////////////////////
+// FILE:          Checkpoint.h
+// PROJECT:       Devices 
+// SUBSYSTEM:     Device Controller 
+//-----------------------------------------------------------------------------
+// DESCRIPTION:   binary checkpoint of device state and outputs, for a warm
+//                restart
+//             
+// COPYRIGHT:     Karl Hoover, No Prior Art, 2009
+//
+// LICENSE:       This library is free software; you can redistribute it and/or
+//                modify it under the terms of the GNU Lesser General Public
+//                License (LGPL) as published by the Free Software Foundation.
+//                See license text at http://www.gnu.org/licenses/lgpl.txt 
+//                Briefly you can use this source code pretty much however you
+//                wish, as long as this notice remains intact and you
+//                prominently acknowledge this copyright.
+//
+//                This file is distributed in the hope that it will be useful,
+//                but WITHOUT ANY WARRANTY; without even the implied warranty
+//                of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//                IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//                CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+//                INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES.
+//
+// AUTHOR:        Karl Hoover  karl.hoover@gmail.com
+//
+// REVISIONS:     1.0 October 16, 2026
+//
+// NOTES:   
+// A valve comes up in STATE_INITIALIZING and works out where it is from its
+// sensors, timing out if it can't. With a checkpoint the plant can instead
+// pick up where it left off: a valve that was opening carries on opening
+// with the time it had already spent, a valve waiting for an interlock
+// keeps waiting for it.
+//
+// The file is mmap'd and holds two slots, written alternately, each with a
+// sequence number and a checksum, so a crash part way through a write
+// leaves the other slot good. A slot is a header, one fixed size record per
+// device, then the committed digital and analogue output images. Writing
+// is a pass over the devices straight into the mapping plus an
+// asynchronous msync, cheap enough to do every few hundred scans.
+//
+// Times are saved as time already elapsed in the state, the monotonic clock
+// doesn't survive a reboot. Devices are matched by position and by a hash
+// of the name; a plant whose table changed won't restore. Restore after the
+// first LatchInputs(): each device checks its record against the live
+// inputs (Device::RestoreState) and a device which won't restore is left to
+// initialize itself.
+
+#ifndef CHECKPOINT_H
+#define CHECKPOINT_H
+
+#include <string>
+#include <vector>
+#include <cstddef>
+
+#include "ScanClock.h"
+#include "ProcessImage.h"
+
+class Device;
+
+#define CHECKPOINT_VERSION 1
+
+struct DeviceCheckpoint  // fixed size, the on disk record
+{
+	unsigned long long nameHash;
+	int state;
+	int command;           // the command being executed, COMMAND_IDLE if none
+	int pendingCommand;    // waiting for interlock
+	int reserved;
+	Nanoseconds motionElapsed; // in STATE_OPENING/CLOSING
+	Nanoseconds waitElapsed;   // in STATE_WAITING
+};
+
+extern unsigned long long CheckpointNameHash(const std::string& name);
+
+class CheckpointWriter
+{
+public:
+	// creates or resizes the file; throws runtime_error if it can't
+	CheckpointWriter(const std::string& path, const std::vector<Device*>& devices,
+		const ProcessImage& image);
+	~CheckpointWriter();
+	void Write();  // scan thread, between scans
+	unsigned long long Sequence() const {return m_sequence;};
+private:
+	CheckpointWriter(const CheckpointWriter&);
+	CheckpointWriter& operator=(const CheckpointWriter&);
+	const std::vector<Device*>& m_devices;
+	const ProcessImage& m_image;
+	char* m_map;
+	size_t m_slotSize;
+	unsigned long long m_sequence;
+	std::vector<ImageWord> m_digital;  // scratch
+	std::vector<double> m_analogue;
+};
+
+// returns the number of devices restored, 0 if there is no usable
+// checkpoint (missing, corrupt, other plant). Restores the output image.
+extern int RestoreCheckpoint(const std::string& path, const std::vector<Device*>& devices,
+	ProcessImage& image);
+
+#endif // CHECKPOINT_H
@@ -0,0 +1,142 @@
+///////////////////////////////////////////////////////////////////////////////
+// FILE:          CommandQueue.cpp
+// PROJECT:       Devices 
+// SUBSYSTEM:     Device Controller 
+//-----------------------------------------------------------------------------
+// DESCRIPTION:   implementation of the per device command queue
+//             
+// COPYRIGHT:     Karl Hoover, No Prior Art, 2009
+//
+// LICENSE:       This library is free software; you can redistribute it and/or
+//                modify it under the terms of the GNU Lesser General Public
+//                License (LGPL) as published by the Free Software Foundation.
+//                See license text at http://www.gnu.org/licenses/lgpl.txt 
+//                Briefly you can use this source code pretty much however you
+//                wish, as long as this notice remains intact and you
+//                prominently acknowledge this copyright.
+//
+//                This file is distributed in the hope that it will be useful,
+//                but WITHOUT ANY WARRANTY; without even the implied warranty
+//                of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//                IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//                CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+//                INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES.
+//
+// AUTHOR:        Karl Hoover  karl.hoover@gmail.com
+//
+// REVISIONS:     
+//
+// NOTES:   
+// see CommandQueue.h for comments and history
+
+#include <new>
+#include <stdexcept>
+
+#include "CommandQueue.h"
+#include "Arena.h"
+
+CommandQueue::CommandQueue(const size_t depth, Arena* arena): m_arena(arena)
+{
+	Allocate(depth);
+}
+
+CommandQueue::CommandQueue(const CommandQueue& other): m_arena(other.m_arena)
+{
+	if (other.m_enqueuePos.load(std::memory_order_acquire) != other.m_dequeuePos)
+	{
+		throw std::logic_error("CommandQueue: copying a queue with commands in it");
+	}
+	Allocate(other.Depth());
+}
+
+CommandQueue::CommandQueue(CommandQueue&& other): m_cells(other.m_cells), 
+	m_arena(other.m_arena), m_mask(other.m_mask), 
+	m_enqueuePos(other.m_enqueuePos.load(std::memory_order_relaxed)), 
+	m_dequeuePos(other.m_dequeuePos)
+{
+	other.m_cells = NULL;
+}
+
+CommandQueue::~CommandQueue()
+{
+	if (!m_arena)
+	{
+		delete [] m_cells;
+	}
+}
+
+void CommandQueue::Allocate(const size_t depth)
+{
+	size_t size = 2;
+	while (size < depth)
+	{
+		size *= 2;
+	}
+	if (m_arena)
+	{
+		m_cells = static_cast<Cell*>(m_arena->Allocate(size * sizeof(Cell), alignof(Cell)));
+		for (size_t i = 0; i < size; ++i)
+		{
+			new (&m_cells[i]) Cell;
+		}
+	}
+	else
+	{
+		m_cells = new Cell[size];
+	}
+	for (size_t i = 0; i < size; ++i)
+	{
+		m_cells[i].sequence.store(i, std::memory_order_relaxed);
+	}
+	m_mask = size - 1;
+	m_enqueuePos.store(0, std::memory_order_relaxed);
+	m_dequeuePos = 0;
+}
+
+// a cell is free for position pos when its sequence is pos, and holds the
+// command for pos once its sequence is pos + 1
+bool CommandQueue::Push(const DeviceCommand& command)
+{
+	size_t pos = m_enqueuePos.load(std::memory_order_relaxed);
+	Cell* cell;
+	while (true)
+	{
+		cell = &m_cells[pos & m_mask];
+		size_t sequence = cell->sequence.load(std::memory_order_acquire);
+		long difference = (long)sequence - (long)pos;
+		if (0 == difference)
+		{
+			if (m_enqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+			{
+				break;
+			}
+			// pos was reloaded by the failed CAS, try again
+		}
+		else if (difference < 0)
+		{
+			return false; // full, the consumer hasn't freed this cell yet
+		}
+		else
+		{
+			pos = m_enqueuePos.load(std::memory_order_relaxed);
+		}
+	}
+	cell->command = command;
+	cell->sequence.store(pos + 1, std::memory_order_release);
+	return true;
+}
+
+bool CommandQueue::Pop(DeviceCommand& command)
+{
+	Cell& cell = m_cells[m_dequeuePos & m_mask];
+	size_t sequence = cell.sequence.load(std::memory_order_acquire);
+	if ((long)sequence - (long)(m_dequeuePos + 1) < 0)
+	{
+		return false; // empty
+	}
+	command = cell.command;
+	cell.sequence.store(m_dequeuePos + m_mask + 1, std::memory_order_release);
+	++m_dequeuePos;
+	return true;
+}
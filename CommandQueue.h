@@ -0,0 +1,98 @@
+///////////////////////////////////////////////////////////////////////////////
+// FILE:          CommandQueue.h
+// PROJECT:       Devices 
+// SUBSYSTEM:     Device Controller 
+//-----------------------------------------------------------------------------
+// DESCRIPTION:   bounded lock-free multi producer, single consumer queue of
+//                commands for one device
+//             
+// COPYRIGHT:     Karl Hoover, No Prior Art, 2009
+//
+// LICENSE:       This library is free software; you can redistribute it and/or
+//                modify it under the terms of the GNU Lesser General Public
+//                License (LGPL) as published by the Free Software Foundation.
+//                See license text at http://www.gnu.org/licenses/lgpl.txt 
+//                Briefly you can use this source code pretty much however you
+//                wish, as long as this notice remains intact and you
+//                prominently acknowledge this copyright.
+//
+//                This file is distributed in the hope that it will be useful,
+//                but WITHOUT ANY WARRANTY; without even the implied warranty
+//                of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//                IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//                CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+//                INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES.
+//
+// AUTHOR:        Karl Hoover  karl.hoover@gmail.com
+//
+// REVISIONS:     1.0 October 16, 2026
+//
+// NOTES:   
+// Any number of client threads (HMI, recipes) Push() commands, the scan
+// thread Pop()s them. It is a ring of cells each carrying a sequence number
+// (D. Vyukov's bounded queue): a producer claims a slot with one CAS on the
+// enqueue position and publishes the cell by storing its sequence, the
+// consumer checks the sequence. No locks, no allocation after construction,
+// and a full queue is reported to the producer rather than blocking it.
+//
+// Every command carries an id and an optional completion callback. The
+// device calls it exactly once, from the scan thread, with one of the
+// COMMAND_RESULT_ codes in statedefinitions.h. Keep callbacks short.
+//
+// The ring can come out of an Arena (Arena.h), that of the device's plant.
+// Moving a queue hands its ring over and leaves the source without one, so
+// only move a queue nobody pushes to yet, i.e. while building the device.
+
+#ifndef COMMANDQUEUE_H
+#define COMMANDQUEUE_H
+
+#include <atomic>
+#include <cstddef>
+
+typedef void (*CommandCallback)(void* context, const unsigned long long id, 
+	const int result);
+
+struct DeviceCommand
+{
+	unsigned long long id;
+	int command;              // COMMAND_ in statedefinitions.h
+	CommandCallback callback; // may be NULL
+	void* context;
+};
+
+#define DEFAULT_COMMAND_QUEUE_DEPTH 8 // per device, rounded up to a power of 2
+
+class Arena;
+
+class CommandQueue
+{
+public:
+	// arena NULL: the ring is allocated on the heap
+	CommandQueue(const size_t depth = DEFAULT_COMMAND_QUEUE_DEPTH, Arena* arena = NULL);
+	// a copied device gets an empty queue of the same depth. Throws
+	// logic_error if other has commands in it: they would never complete.
+	CommandQueue(const CommandQueue& other);
+	CommandQueue(CommandQueue&& other);
+	~CommandQueue();
+	bool Push(const DeviceCommand& command); // any thread, false if full
+	bool Pop(DeviceCommand& command);        // consumer thread only
+	size_t Depth() const {return m_mask + 1;};
+
+private:
+	CommandQueue& operator=(const CommandQueue&);
+	void Allocate(const size_t depth);
+
+	struct Cell
+	{
+		std::atomic<size_t> sequence;
+		DeviceCommand command;
+	};
+	Cell* m_cells;
+	Arena* m_arena;
+	size_t m_mask;
+	std::atomic<size_t> m_enqueuePos;
+	size_t m_dequeuePos;  // consumer only
+};
+
+#endif // COMMANDQUEUE_H
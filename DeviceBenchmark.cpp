@@ -0,0 +1,565 @@
+///////////////////////////////////////////////////////////////////////////////
+// FILE:          DeviceBenchmark.cpp
+// PROJECT:       Devices
+// SUBSYSTEM:     Device Controller
+//-----------------------------------------------------------------------------
+// DESCRIPTION:   benchmarks of the device control hot paths
+//
+// COPYRIGHT:     Karl Hoover, No Prior Art, 2009
+//
+// LICENSE:       This library is free software; you can redistribute it and/or
+//                modify it under the terms of the GNU Lesser General Public
+//                License (LGPL) as published by the Free Software Foundation.
+//                See license text at http://www.gnu.org/licenses/lgpl.txt
+//                Briefly you can use this source code pretty much however you
+//                wish, as long as this notice remains intact and you
+//                prominently acknowledge this copyright.
+//
+//                This file is distributed in the hope that it will be useful,
+//                but WITHOUT ANY WARRANTY; without even the implied warranty
+//                of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//                IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//                CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+//                INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES.
+//
+// AUTHOR:        Karl Hoover  karl.hoover@gmail.com
+//
+// REVISIONS:     1.0 October 16, 2026
+//
+// NOTES:
+// make benchmark && ./benchmark [--csv] [--quick] [--threads n]
+//
+// One result per line on stdout, JSON by default, CSV with --csv, so runs
+// can be kept and compared by a script. Every result has the same fields:
+//
+//   benchmark    what was measured
+//   devices      how many devices took part (0: not device bound)
+//   state        the valve state during the measurement, or ""
+//   iterations   how many samples
+//   ns_per_op    mean nanoseconds per operation
+//   min_ns, p50_ns, p99_ns, max_ns   per sample; for the micro benchmarks a
+//                sample is a batch, divided down to one operation
+//   bytes_per_device   memory held per device, 0 where not measured
+//
+// The micro benchmarks are Valve::Update in each steady state, the same for
+// a ValveArray (StaticValve.h), reading a DigitalInput, setting a
+// DigitalOutput and the two clocks. The scan
+// benchmarks run the whole cycle, plant simulator included, at 1k, 10k and
+// 100k valves: "scan_full" updates every valve on a ScanExecutor,
+// "scan_dispatch" updates only those with changed inputs through a
+// ChangeDispatcher. Their spread (p99_ns - p50_ns, max_ns) is the jitter.
+// "build_arena" and "build_heap" construct plants of double throw valves,
+// in the plant's Arena or one malloc at a time with copies, and give the
+// time per device and the memory malloc reports the plant holding on to.
+// "find_by_name" looks a device up in the plant's DeviceRegistry by its
+// name, "device_name" is Device::Name(), the interned string.
+// --quick stops at 10k valves and takes fewer samples, for a smoke run.
+// Numbers only compare on the same machine, quiet, with the same flags.
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+#include <sstream>
+#include <malloc.h>
+
+#include "device.h"
+#include "DeviceFactory.h"
+#include "PlantSimulator.h"
+#include "ScanExecutor.h"
+#include "StaticValve.h"
+#include "TimeMicroseconds.h"
+
+static bool csv = false;
+static bool quick = false;
+static int threads = 1;
+
+// the optimizer must not drop what we measure
+static volatile unsigned long long sink;
+
+struct Result
+{
+	string benchmark;
+	int devices;
+	string state;
+	vector<double> samples; // nanoseconds per operation
+	double mean;
+	size_t bytes; // per device
+	Result(): devices(0), mean(0.), bytes(0) {};
+};
+
+static void Report(Result& r)
+{
+	static bool header = false;
+	sort(r.samples.begin(), r.samples.end());
+	size_t n = r.samples.size();
+	double p50 = n ? r.samples[n / 2] : 0.;
+	double p99 = n ? r.samples[min(n - 1, (size_t)(n * 0.99))] : 0.;
+	double low = n ? r.samples[0] : 0.;
+	double high = n ? r.samples[n - 1] : 0.;
+	if (csv)
+	{
+		if (!header)
+		{
+			printf("benchmark,devices,state,iterations,ns_per_op,min_ns,p50_ns,p99_ns,max_ns,"
+				"bytes_per_device\n");
+			header = true;
+		}
+		printf("%s,%d,%s,%lu,%.2f,%.2f,%.2f,%.2f,%.2f,%lu\n", r.benchmark.c_str(), r.devices,
+			r.state.c_str(), (unsigned long)n, r.mean, low, p50, p99, high, 
+			(unsigned long)r.bytes);
+	}
+	else
+	{
+		printf("{\"benchmark\":\"%s\",\"devices\":%d,\"state\":\"%s\",\"iterations\":%lu,"
+			"\"ns_per_op\":%.2f,\"min_ns\":%.2f,\"p50_ns\":%.2f,\"p99_ns\":%.2f,\"max_ns\":%.2f,"
+			"\"bytes_per_device\":%lu}\n",
+			r.benchmark.c_str(), r.devices, r.state.c_str(), (unsigned long)n, r.mean,
+			low, p50, p99, high, (unsigned long)r.bytes);
+	}
+	fflush(stdout);
+}
+
+static const char* StateName(const int state)
+{
+	switch (state)
+	{
+		case STATE_IDLE: return "IDLE";
+		case STATE_WAITING: return "WAITING";
+		case STATE_CLOSING: return "CLOSING";
+		case STATE_OPENING: return "OPENING";
+		case STATE_INVALID: return "INVALID";
+		case STATE_INITIALIZING: return "INITIALIZING";
+		default: return "OTHER";
+	}
+}
+
+// count double throw valves with their own sensors and commands, sharing
+// one pair of interlocks, built the way a real configuration is
+static void BuildPlant(Plant& plant, const int count)
+{
+	ostringstream table;
+	for (int i = 0; i < count; ++i)
+	{
+		table << 'V' << i << ",CLOSED?,V" << i << "CLOSED?,bool,ReadOnly,DoubleThrowValve\n"
+			<< 'V' << i << ",OPENED?,V" << i << "OPENED?,bool,ReadOnly\n"
+			<< 'V' << i << ",CLOSE!,V" << i << "CLOSE!,bool,WriteOnly\n"
+			<< 'V' << i << ",OPEN!,V" << i << "OPEN!,bool,WriteOnly\n"
+			<< 'V' << i << ",CLOSE_OK?,CloseOK,bool,ReadOnly\n"
+			<< 'V' << i << ",OPEN_OK?,OpenOK,bool,ReadOnly\n";
+	}
+	string text = table.str();
+	DeviceFactory::Parse(text.data(), text.size(), "benchmark", plant);
+}
+
+// one batch of batch calls of operation, timed as a whole
+template<class Operation>
+static void Measure(Result& r, const int batches, const int batch, Operation operation)
+{
+	Nanoseconds total = 0;
+	for (int b = 0; b < batches; ++b)
+	{
+		Nanoseconds start = MonotonicNanoseconds();
+		for (int i = 0; i < batch; ++i)
+		{
+			operation(i);
+		}
+		Nanoseconds elapsed = MonotonicNanoseconds() - start;
+		total += elapsed;
+		r.samples.push_back((double)elapsed / batch);
+	}
+	r.mean = (double)total / ((double)batches * batch);
+}
+
+// all closed, interlocks made unless the valves are to wait for them, both
+// sensors made for STATE_INVALID. The plant is then held still.
+static void HoldField(Plant& plant, const int state)
+{
+	ProcessImage& image = plant.Image();
+	const vector<Device*>& devices = plant.Devices();
+	for (size_t i = 0; i < devices.size(); ++i)
+	{
+		image.WriteFieldInput(devices[i]->DigitalInputPoint("CLOSED?"), true);
+		image.WriteFieldInput(devices[i]->DigitalInputPoint("OPENED?"), STATE_INVALID == state);
+	}
+	image.WriteFieldInput(devices[0]->DigitalInputPoint("CLOSE_OK?"), true);
+	image.WriteFieldInput(devices[0]->DigitalInputPoint("OPEN_OK?"), STATE_WAITING != state);
+	image.LatchInputs();
+	SampleScanTime();
+}
+
+// Valve::Update with the plant held still, so each valve stays in state
+static void BenchmarkUpdate(const int state)
+{
+	const int count = 1000;
+	Plant plant;
+	BuildPlant(plant, count);
+	vector<Valve*> valves;
+	for (size_t i = 0; i < plant.Devices().size(); ++i)
+	{
+		Valve* valve = static_cast<Valve*>(plant.Devices()[i]);
+		valve->SetMotionTimeOut(3600 * NANOSECONDS_PER_SECOND);
+		valve->SetInterlockTimeOut(3600 * NANOSECONDS_PER_SECOND);
+		valves.push_back(valve);
+	}
+	HoldField(plant, state);
+	for (int i = 0; i < count; ++i)
+	{
+		valves[i]->Update(); // initialize
+		if (STATE_OPENING == state || STATE_WAITING == state)
+		{
+			valves[i]->PostCommand(COMMAND_OPEN);
+			valves[i]->Update();
+		}
+	}
+	plant.Image().CommitOutputs();
+
+	Result r;
+	r.benchmark = "valve_update";
+	r.devices = count;
+	r.state = StateName(valves[0]->State());
+	Measure(r, quick ? 200 : 2000, count, [&](int i) {sink += valves[i]->Update();});
+	if (valves[0]->State() != state || valves[count - 1]->State() != state)
+	{
+		r.state += "_UNSTABLE";
+	}
+	Report(r);
+}
+
+// the same for ValveArray, one UpdateAll a sample
+static void BenchmarkStaticUpdate(const int state)
+{
+	const int count = 1000;
+	Plant plant;
+	BuildPlant(plant, count);
+	ValveArray<DoubleThrowTopology> valves(plant.Image());
+	valves.SetMotionTimeOut(3600 * NANOSECONDS_PER_SECOND);
+	valves.SetInterlockTimeOut(3600 * NANOSECONDS_PER_SECOND);
+	for (size_t i = 0; i < plant.Devices().size(); ++i)
+	{
+		valves.Add(*plant.Devices()[i]);
+	}
+	HoldField(plant, state);
+	valves.UpdateAll(); // initialize
+	if (STATE_OPENING == state || STATE_WAITING == state)
+	{
+		for (int i = 0; i < count; ++i)
+		{
+			valves.SetCommand(i, COMMAND_OPEN);
+		}
+		valves.UpdateAll();
+	}
+	plant.Image().CommitOutputs();
+
+	Result r;
+	r.benchmark = "static_valve_update";
+	r.devices = count;
+	r.state = StateName(valves.State(0));
+	Measure(r, quick ? 200 : 2000, 1, [&](int) {sink += valves.UpdateAll();});
+	for (size_t i = 0; i < r.samples.size(); ++i)
+	{
+		r.samples[i] /= count;
+	}
+	r.mean /= count;
+	if (valves.State(0) != state || valves.State(count - 1) != state)
+	{
+		r.state += "_UNSTABLE";
+	}
+	Report(r);
+}
+
+static void BenchmarkIO()
+{
+	const int count = 4096;
+	ProcessImage image;
+	vector<DigitalInput> inputs;
+	vector<DigitalOutput> outputs;
+	for (int i = 0; i < count; ++i)
+	{
+		inputs.push_back(DigitalInput("", image, image.AddDigitalInput()));
+		outputs.push_back(DigitalOutput("", image, image.AddDigitalOutput()));
+	}
+	for (int i = 0; i < count; i += 3)
+	{
+		image.WriteFieldInput(inputs[i].Point(), true);
+	}
+	image.LatchInputs();
+	int batches = quick ? 200 : 2000;
+
+	Result read;
+	read.benchmark = "digital_input_value";
+	read.devices = 0;
+	Measure(read, batches, count, [&](int i) {sink += inputs[i].Value();});
+	Report(read);
+
+	Result write;
+	write.benchmark = "digital_output_set";
+	write.devices = 0;
+	Measure(write, batches, count, [&](int i) {outputs[i].Set(i & 1);});
+	Report(write);
+
+	Result commit;
+	commit.benchmark = "commit_outputs";
+	commit.devices = 0;
+	Measure(commit, batches, 1, [&](int) {image.CommitOutputs();});
+	Report(commit);
+}
+
+static void BenchmarkClocks()
+{
+	int batches = quick ? 200 : 2000;
+	const int batch = 1000;
+
+	Result wall;
+	wall.benchmark = "time_microseconds";
+	wall.devices = 0;
+	Measure(wall, batches, batch, [&](int) {sink += TimeMicroseconds();});
+	Report(wall);
+
+	Result monotonic;
+	monotonic.benchmark = "monotonic_nanoseconds";
+	monotonic.devices = 0;
+	Measure(monotonic, batches, batch, [&](int) {sink += MonotonicNanoseconds();});
+	Report(monotonic);
+
+	Result scan;
+	scan.benchmark = "scan_time";
+	scan.devices = 0;
+	Measure(scan, batches, batch, [&](int) {sink += ScanTime();});
+	Report(scan);
+}
+
+// whole scans with the valves kept moving: every scan a slice of them is
+// commanded to the other end, and the simulator moves them there
+static void BenchmarkScan(const int count, const bool dispatch)
+{
+	Plant plant;
+	BuildPlant(plant, count);
+	ProcessImage& image = plant.Image();
+	const vector<Device*>& devices = plant.Devices();
+
+	PlantSimulator simulator(image, 1);
+	simulator.SetTravelTime(NANOSECONDS_PER_MILLISECOND, 5 * NANOSECONDS_PER_MILLISECOND);
+	TimerWheel wheel(NANOSECONDS_PER_MILLISECOND, MonotonicNanoseconds());
+	ScanExecutor executor(threads);
+	ChangeDispatcher dispatcher(image);
+	for (size_t i = 0; i < devices.size(); ++i)
+	{
+		Valve* valve = static_cast<Valve*>(devices[i]);
+		simulator.AddValve(*valve);
+		valve->SetTimerWheel(&wheel);
+		if (dispatch)
+		{
+			dispatcher.Subscribe(*valve);
+		}
+		else
+		{
+			executor.Register(*valve);
+		}
+	}
+	dispatcher.Build();
+
+	int scans = quick ? 200 : 1000;
+	int warmup = 20;
+	int commanded = max(1, count / 100); // per scan
+	int next = 0;
+	Result r;
+	r.benchmark = dispatch ? "scan_dispatch" : "scan_full";
+	r.devices = count;
+	r.state = "";
+	Nanoseconds total = 0;
+	for (int s = 0; s < warmup + scans; ++s)
+	{
+		for (int c = 0; c < commanded; ++c, next = (next + 1) % count)
+		{
+			Valve* valve = static_cast<Valve*>(devices[next]);
+			valve->PostCommand(valve->IsClosed() ? COMMAND_OPEN : COMMAND_CLOSE);
+		}
+		Nanoseconds start = MonotonicNanoseconds();
+		simulator.Step(start);
+		image.LatchInputs();
+		if (dispatch)
+		{
+			SampleScanTime();
+			dispatcher.Dispatch();
+		}
+		else
+		{
+			executor.RunCycle();
+		}
+		wheel.Advance(ScanTime());
+		image.CommitOutputs();
+		Nanoseconds elapsed = MonotonicNanoseconds() - start;
+		if (s >= warmup)
+		{
+			total += elapsed;
+			r.samples.push_back(elapsed);
+		}
+	}
+	r.mean = (double)total / scans;
+	Report(r);
+}
+
+// bytes malloc has handed out and not had back, glibc's count
+static size_t HeapInUse()
+{
+	struct mallinfo2 info = mallinfo2();
+	return info.uordblks + info.hblkhd;
+}
+
+// one valve's points, as DeviceFactory makes them, into either kind of map
+template <class DigitalInputs, class DigitalOutputs>
+static void ValvePoints(ProcessImage& image, const string& name, const int closeOk, 
+	const int openOk, DigitalInputs& dis, DigitalOutputs& dos)
+{
+	dis.insert(make_pair(string("CLOSED?"), 
+		DigitalInput(name + "CLOSED?", image, image.AddDigitalInput())));
+	dis.insert(make_pair(string("OPENED?"), 
+		DigitalInput(name + "OPENED?", image, image.AddDigitalInput())));
+	dis.insert(make_pair(string("CLOSE_OK?"), DigitalInput("CloseOK", image, closeOk)));
+	dis.insert(make_pair(string("OPEN_OK?"), DigitalInput("OpenOK", image, openOk)));
+	dos.insert(make_pair(string("CLOSE!"), 
+		DigitalOutput(name + "CLOSE!", image, image.AddDigitalOutput())));
+	dos.insert(make_pair(string("OPEN!"), 
+		DigitalOutput(name + "OPEN!", image, image.AddDigitalOutput())));
+}
+
+// count double throw valves built in the plant's arena, the maps moved into
+// the valve, or on the heap through copies the way it was done before Arena
+static void BenchmarkBuild(const int count, const bool arena)
+{
+	vector<string> names;
+	for (int i = 0; i < count; ++i)
+	{
+		ostringstream name;
+		name << 'V' << i;
+		names.push_back(name.str());
+	}
+	Result r;
+	r.benchmark = arena ? "build_arena" : "build_heap";
+	r.devices = count;
+	Nanoseconds total = 0;
+	int runs = quick ? 3 : 10;
+	for (int run = 0; run < runs; ++run)
+	{
+		Plant plant;
+		ProcessImage& image = plant.Image();
+		size_t before = HeapInUse();
+		Nanoseconds start = MonotonicNanoseconds();
+		int closeOk = image.AddDigitalInput();
+		int openOk = image.AddDigitalInput();
+		for (int i = 0; i < count; ++i)
+		{
+			if (arena)
+			{
+				ArenaAllocator<char> memory(&plant.Memory());
+				DigitalInputMap dis(memory);
+				DigitalOutputMap dos(memory);
+				ValvePoints(image, names[i], closeOk, openOk, dis, dos);
+				plant.Add(plant.Memory().New<DoubleThrowValve>(Device(names[i], "", 
+					std::move(dis), std::move(dos), AnalogueInputMap(memory), 
+					AnalogueOutputMap(memory))));
+			}
+			else
+			{
+				map<string, DigitalInput> dis;
+				map<string, DigitalOutput> dos;
+				ValvePoints(image, names[i], closeOk, openOk, dis, dos);
+				Device base(names[i], "", dis, dos, map<string, AnalogueInput>(), 
+					map<string, AnalogueOutput>());
+				plant.Add(new DoubleThrowValve(base));
+			}
+		}
+		Nanoseconds elapsed = MonotonicNanoseconds() - start;
+		total += elapsed;
+		r.samples.push_back((double)elapsed / count);
+		r.bytes = (HeapInUse() - before) / count;
+	}
+	r.mean = (double)total / ((double)runs * count);
+	Report(r);
+}
+
+// HMI style lookups while nothing else runs: a device by its name, and
+// the name of a device
+static void BenchmarkLookup(const int count)
+{
+	Plant plant;
+	BuildPlant(plant, count);
+	vector<string> names;
+	for (int i = 0; i < count; ++i)
+	{
+		names.push_back(plant.Devices()[(i * 7919) % count]->Name());
+	}
+	int batches = quick ? 100 : 1000;
+	const int batch = 1000;
+
+	Result find;
+	find.benchmark = "find_by_name";
+	find.devices = count;
+	Measure(find, batches, batch, [&](int i) 
+	{
+		const string& name = names[i % count];
+		sink += (size_t)plant.Registry().Find(name.data(), name.size());
+	});
+	Report(find);
+
+	Result name;
+	name.benchmark = "device_name";
+	name.devices = count;
+	const vector<Device*>& devices = plant.Devices();
+	Measure(name, batches, batch, [&](int i) {sink += devices[i % count]->Name().size();});
+	Report(name);
+}
+
+int main(int argc, char* argv[])
+{
+	for (int i = 1; i < argc; ++i)
+	{
+		if (!strcmp(argv[i], "--csv"))
+		{
+			csv = true;
+		}
+		else if (!strcmp(argv[i], "--quick"))
+		{
+			quick = true;
+		}
+		else if (!strcmp(argv[i], "--threads") && i + 1 < argc)
+		{
+			threads = max(1, atoi(argv[++i]));
+		}
+		else
+		{
+			fprintf(stderr, "usage: %s [--csv] [--quick] [--threads n]\n", argv[0]);
+			return 2;
+		}
+	}
+
+	BenchmarkUpdate(STATE_IDLE);
+	BenchmarkUpdate(STATE_WAITING);
+	BenchmarkUpdate(STATE_OPENING);
+	BenchmarkUpdate(STATE_INVALID);
+	BenchmarkStaticUpdate(STATE_IDLE);
+	BenchmarkStaticUpdate(STATE_WAITING);
+	BenchmarkStaticUpdate(STATE_OPENING);
+	BenchmarkStaticUpdate(STATE_INVALID);
+	BenchmarkIO();
+	BenchmarkClocks();
+
+	int sizes[] = {1000, 10000, 100000};
+	for (int i = 0; i < (quick ? 2 : 3); ++i)
+	{
+		BenchmarkScan(sizes[i], false);
+		BenchmarkScan(sizes[i], true);
+	}
+	for (int i = 0; i < (quick ? 2 : 3); ++i)
+	{
+		BenchmarkBuild(sizes[i], true);
+		BenchmarkBuild(sizes[i], false);
+	}
+	for (int i = 0; i < (quick ? 2 : 3); ++i)
+	{
+		BenchmarkLookup(sizes[i]);
+	}
+	return 0;
+}
@@ -0,0 +1,461 @@
+///////////////////////////////////////////////////////////////////////////////
+// FILE:          DeviceFactory.cpp
+// PROJECT:       Devices 
+// SUBSYSTEM:     Device Controller 
+//-----------------------------------------------------------------------------
+// DESCRIPTION:   implementation of the table driven device factory
+//             
+// COPYRIGHT:     Karl Hoover, No Prior Art, 2009
+//
+// LICENSE:       This library is free software; you can redistribute it and/or
+//                modify it under the terms of the GNU Lesser General Public
+//                License (LGPL) as published by the Free Software Foundation.
+//                See license text at http://www.gnu.org/licenses/lgpl.txt 
+//                Briefly you can use this source code pretty much however you
+//                wish, as long as this notice remains intact and you
+//                prominently acknowledge this copyright.
+//
+//                This file is distributed in the hope that it will be useful,
+//                but WITHOUT ANY WARRANTY; without even the implied warranty
+//                of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//                IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//                CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+//                INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES.
+//
+// AUTHOR:        Karl Hoover  karl.hoover@gmail.com
+//
+// REVISIONS:     
+//
+// NOTES:   
+// see DeviceFactory.h for comments and history
+
+#include <cstring>
+#include <sstream>
+#include <stdexcept>
+#include <unordered_map>
+#include <unordered_set>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "DeviceFactory.h"
+#include "device.h"
+
+#define TABLE_COLUMNS 7  // 5 required, class and serial optional
+
+// point kinds, for checking an IO path isn't both an input and an output
+#define KIND_DIGITAL_INPUT 0
+#define KIND_DIGITAL_OUTPUT 1
+#define KIND_ANALOGUE_INPUT 2
+#define KIND_ANALOGUE_OUTPUT 3
+
+Plant::~Plant()
+{
+	Clear();
+}
+
+void Plant::Truncate(const size_t count)
+{
+	for (size_t i = count; i < m_devices.size(); ++i)
+	{
+		m_registry.Remove(*m_devices[i]);
+		if (m_arena.Owns(m_devices[i]))
+		{
+			m_devices[i]->~Device();  // the arena keeps the memory
+		}
+		else
+		{
+			delete m_devices[i];
+		}
+	}
+	if (count < m_devices.size())
+	{
+		m_devices.resize(count);
+	}
+}
+
+namespace
+{
+
+// a field is a slice of the mapped file, no copy until it is needed
+struct Field
+{
+	const char* text;
+	size_t length;
+	bool Is(const char* literal) const 
+	{
+		return strlen(literal) == length && 0 == memcmp(text, literal, length);
+	};
+	string String() const {return string(text, length);};
+};
+
+// read-only private mapping of a whole file, unmapped on scope exit
+class MappedFile
+{
+public:
+	MappedFile(const string& path): m_data(NULL), m_length(0)
+	{
+		int fd = open(path.c_str(), O_RDONLY);
+		if (fd < 0)
+		{
+			throw runtime_error(path + ": cannot open");
+		}
+		struct stat info;
+		if (fstat(fd, &info) < 0)
+		{
+			close(fd);
+			throw runtime_error(path + ": cannot stat");
+		}
+		m_length = info.st_size;
+		if (m_length)
+		{
+			void* data = mmap(NULL, m_length, PROT_READ, MAP_PRIVATE, fd, 0);
+			if (MAP_FAILED == data)
+			{
+				close(fd);
+				throw runtime_error(path + ": cannot mmap");
+			}
+			madvise(data, m_length, MADV_SEQUENTIAL);
+			m_data = static_cast<const char*>(data);
+		}
+		close(fd); // the mapping keeps the file
+	};
+	~MappedFile() 
+	{
+		if (m_data)
+		{
+			munmap(const_cast<char*>(m_data), m_length);
+		}
+	};
+	const char* Data() const {return m_data;};
+	size_t Length() const {return m_length;};
+private:
+	const char* m_data;
+	size_t m_length;
+};
+
+// the rows of the device currently being read
+struct DeviceRows
+{
+	string name;
+	string serno;
+	string deviceClass;
+	size_t firstLine;
+	DigitalInputMap dis;
+	DigitalOutputMap dos;
+	AnalogueInputMap ais;
+	AnalogueOutputMap aos;
+	DeviceRows(Arena& arena): firstLine(0), dis(ArenaAllocator<char>(&arena)), 
+		dos(ArenaAllocator<char>(&arena)), ais(ArenaAllocator<char>(&arena)), 
+		aos(ArenaAllocator<char>(&arena)) {};
+};
+
+class TableParser
+{
+public:
+	TableParser(const string& source, Plant& plant): m_source(source), m_plant(plant),
+		m_line(0), m_haveDevice(false), m_device(plant.Memory()) {};
+	void Parse(const char* text, const size_t length);
+private:
+	void Fail(const size_t line, const string& what);
+	size_t Split(const char* begin, const char* end, Field* fields);
+	void Row(Field* fields, const size_t count);
+	int Point(const Field& path, const int kind);
+	void Build();
+
+	string m_source;
+	Plant& m_plant;
+	size_t m_line;
+	bool m_haveDevice;
+	DeviceRows m_device;
+	unordered_map<string, pair<int, int> > m_points; // path -> (kind, point)
+	unordered_set<string> m_built;
+};
+
+void TableParser::Fail(const size_t line, const string& what)
+{
+	ostringstream message;
+	message << m_source << ":" << line << ": " << what;
+	throw runtime_error(message.str());
+}
+
+// comma separated, surrounding blanks trimmed. Returns the field count.
+size_t TableParser::Split(const char* begin, const char* end, Field* fields)
+{
+	size_t count = 0;
+	const char* p = begin;
+	while (true)
+	{
+		const char* comma = static_cast<const char*>(memchr(p, ',', end - p));
+		const char* fieldEnd = comma ? comma : end;
+		const char* first = p;
+		const char* last = fieldEnd;
+		while (first < last && (' ' == *first || '\t' == *first))
+		{
+			++first;
+		}
+		while (last > first && (' ' == last[-1] || '\t' == last[-1] || '\r' == last[-1]))
+		{
+			--last;
+		}
+		if (count == TABLE_COLUMNS)
+		{
+			Fail(m_line, "too many columns");
+		}
+		fields[count].text = first;
+		fields[count].length = last - first;
+		++count;
+		if (!comma)
+		{
+			break;
+		}
+		p = comma + 1;
+	}
+	// a trailing comma leaves an empty last column, ignore it
+	while (count && 0 == fields[count - 1].length)
+	{
+		--count;
+	}
+	return count;
+}
+
+int TableParser::Point(const Field& path, const int kind)
+{
+	pair<unordered_map<string, pair<int, int> >::iterator, bool> entry = 
+		m_points.insert(make_pair(path.String(), make_pair(kind, -1)));
+	if (!entry.second)
+	{
+		if (entry.first->second.first != kind)
+		{
+			Fail(m_line, "IO path " + path.String() + " used as both input and output or bool and double");
+		}
+		return entry.first->second.second;
+	}
+	ProcessImage& image = m_plant.Image();
+	int point = -1;
+	switch (kind)
+	{
+		case KIND_DIGITAL_INPUT:
+			point = image.AddDigitalInput();
+			break;
+		case KIND_DIGITAL_OUTPUT:
+			point = image.AddDigitalOutput();
+			break;
+		case KIND_ANALOGUE_INPUT:
+			point = image.AddAnalogueInput();
+			break;
+		default:
+			point = image.AddAnalogueOutput();
+			break;
+	}
+	entry.first->second.second = point;
+	return point;
+}
+
+void TableParser::Row(Field* fields, const size_t count)
+{
+	if (count < 5)
+	{
+		Fail(m_line, "expected Device name, IO attribute, IO path, IO type, IO access");
+	}
+	for (size_t i = 0; i < 5; ++i)
+	{
+		if (0 == fields[i].length)
+		{
+			Fail(m_line, "empty field");
+		}
+	}
+	if (!m_haveDevice || !fields[0].Is(m_device.name.c_str()))
+	{
+		if (m_haveDevice)
+		{
+			Build();
+		}
+		m_device = DeviceRows(m_plant.Memory());
+		m_device.name = fields[0].String();
+		m_device.firstLine = m_line;
+		m_haveDevice = true;
+		if (m_built.count(m_device.name))
+		{
+			Fail(m_line, "rows of device " + m_device.name + " are not together");
+		}
+	}
+	if (count > 5 && fields[5].length)
+	{
+		if (!m_device.deviceClass.empty() && !fields[5].Is(m_device.deviceClass.c_str()))
+		{
+			Fail(m_line, "conflicting class for " + m_device.name);
+		}
+		m_device.deviceClass = fields[5].String();
+	}
+	if (count > 6 && fields[6].length)
+	{
+		m_device.serno = fields[6].String();
+	}
+
+	bool digital = false;
+	if (fields[3].Is("bool"))
+	{
+		digital = true;
+	}
+	else if (fields[3].Is("double"))
+	{
+		digital = false;
+	}
+	else
+	{
+		Fail(m_line, "IO type must be bool or double, not " + fields[3].String());
+	}
+	bool input = false;
+	if (fields[4].Is("ReadOnly"))
+	{
+		input = true;
+	}
+	else if (fields[4].Is("WriteOnly") || fields[4].Is("ReadWrite"))
+	{
+		input = false;
+	}
+	else
+	{
+		Fail(m_line, "IO access must be ReadOnly, WriteOnly or ReadWrite, not " + 
+			fields[4].String());
+	}
+
+	string attribute = fields[1].String();
+	string path = fields[2].String();
+	ProcessImage& image = m_plant.Image();
+	bool added;
+	if (digital && input)
+	{
+		added = m_device.dis.insert(make_pair(attribute, 
+			DigitalInput(path, image, Point(fields[2], KIND_DIGITAL_INPUT)))).second;
+	}
+	else if (digital)
+	{
+		added = m_device.dos.insert(make_pair(attribute, 
+			DigitalOutput(path, image, Point(fields[2], KIND_DIGITAL_OUTPUT)))).second;
+	}
+	else if (input)
+	{
+		added = m_device.ais.insert(make_pair(attribute, 
+			AnalogueInput(path, image, Point(fields[2], KIND_ANALOGUE_INPUT)))).second;
+	}
+	else
+	{
+		added = m_device.aos.insert(make_pair(attribute, 
+			AnalogueOutput(path, image, Point(fields[2], KIND_ANALOGUE_OUTPUT)))).second;
+	}
+	if (!added)
+	{
+		Fail(m_line, "duplicate attribute " + attribute + " for " + m_device.name);
+	}
+}
+
+void TableParser::Build()
+{
+	string deviceClass = m_device.deviceClass;
+	if (deviceClass.empty())
+	{
+		if (m_device.dos.count("OPEN!"))
+		{
+			deviceClass = "DoubleThrowValve";
+		}
+		else if (m_device.dos.count("CLOSE!"))
+		{
+			deviceClass = "SingleThrowValve";
+		}
+		else
+		{
+			deviceClass = "Device";
+		}
+	}
+	if (m_plant.Registry().Find(m_device.name))
+	{
+		Fail(m_device.firstLine, "device " + m_device.name + " is already in the plant");
+	}
+	Device base(m_device.name, m_device.serno, std::move(m_device.dis), 
+		std::move(m_device.dos), std::move(m_device.ais), std::move(m_device.aos));
+	Arena& arena = m_plant.Memory();
+	Device* device = NULL;
+	try
+	{
+		if ("DoubleThrowValve" == deviceClass)
+		{
+			device = arena.New<DoubleThrowValve>(std::move(base));
+		}
+		else if ("SingleThrowValve" == deviceClass)
+		{
+			device = arena.New<SingleThrowValve>(std::move(base));
+		}
+		else if ("Device" == deviceClass)
+		{
+			device = arena.New<Device>(std::move(base));
+		}
+		else
+		{
+			Fail(m_device.firstLine, "unknown class " + deviceClass);
+		}
+	}
+	catch (invalid_argument& missing) // a valve's binding found a point missing
+	{
+		Fail(m_device.firstLine, missing.what());
+	}
+	m_plant.Add(device);
+	m_built.insert(m_device.name);
+}
+
+void TableParser::Parse(const char* text, const size_t length)
+{
+	Field fields[TABLE_COLUMNS];
+	const char* end = text + length;
+	const char* line = text;
+	while (line < end)
+	{
+		const char* newline = static_cast<const char*>(memchr(line, '\n', end - line));
+		const char* lineEnd = newline ? newline : end;
+		++m_line;
+		const char* first = line;
+		while (first < lineEnd && (' ' == *first || '\t' == *first || '\r' == *first))
+		{
+			++first;
+		}
+		bool skip = (first == lineEnd) || ('#' == *first) || 
+			(lineEnd - first >= 11 && 0 == memcmp(first, "Device name", 11));
+		if (!skip)
+		{
+			Row(fields, Split(first, lineEnd, fields));
+		}
+		line = lineEnd + 1;
+	}
+	if (m_haveDevice)
+	{
+		Build();
+	}
+}
+
+} // namespace
+
+void DeviceFactory::Parse(const char* text, const size_t length, 
+	const string& source, Plant& plant)
+{
+	size_t firstNew = plant.Devices().size();
+	try
+	{
+		TableParser parser(source, plant);
+		parser.Parse(text, length);
+	}
+	catch (...)
+	{
+		plant.Truncate(firstNew); // drop what this table added
+		throw;
+	}
+}
+
+void DeviceFactory::Load(const string& path, Plant& plant)
+{
+	MappedFile file(path);
+	Parse(file.Data(), file.Length(), path, plant);
+}
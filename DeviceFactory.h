@@ -0,0 +1,108 @@
+///////////////////////////////////////////////////////////////////////////////
+// FILE:          DeviceFactory.h
+// PROJECT:       Devices 
+// SUBSYSTEM:     Device Controller 
+//-----------------------------------------------------------------------------
+// DESCRIPTION:   builds a whole plant of devices from an IO configuration
+//                table
+//             
+// COPYRIGHT:     Karl Hoover, No Prior Art, 2009
+//
+// LICENSE:       This library is free software; you can redistribute it and/or
+//                modify it under the terms of the GNU Lesser General Public
+//                License (LGPL) as published by the Free Software Foundation.
+//                See license text at http://www.gnu.org/licenses/lgpl.txt 
+//                Briefly you can use this source code pretty much however you
+//                wish, as long as this notice remains intact and you
+//                prominently acknowledge this copyright.
+//
+//                This file is distributed in the hope that it will be useful,
+//                but WITHOUT ANY WARRANTY; without even the implied warranty
+//                of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//                IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//                CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+//                INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES.
+//
+// AUTHOR:        Karl Hoover  karl.hoover@gmail.com
+//
+// REVISIONS:     1.0 October 16, 2026
+//
+// NOTES:   
+// The table is the one described in device.h, one row per IO attribute,
+// comma separated, with two optional columns:
+//
+// Device name, IO attribute, IO path,       IO type, IO access, Class,            Serial
+// Valve1,      OPENED?,      Valve1OPENED?, bool,    ReadOnly,  DoubleThrowValve, SN1234
+//
+// IO type is bool or double, IO access is ReadOnly (an input) or WriteOnly
+// or ReadWrite (an output). The rows of one device must be together. Class
+// is SingleThrowValve, DoubleThrowValve or Device and need only be given on
+// one row of the device; without it a device with an OPEN! output is a
+// DoubleThrowValve, one with only CLOSE! a SingleThrowValve, anything else
+// a plain Device. Every IO path becomes one point in the plant's
+// ProcessImage, so devices naming the same path (a shared interlock, say)
+// share the point. Blank lines, lines starting with # and a header line
+// starting with "Device name" are skipped. Fields are not quoted, so no
+// commas inside them.
+//
+// The file is mmap'd and parsed in one pass without copying lines, each
+// device is built as soon as its last row has been read. Any error throws
+// runtime_error "file:line: what"; the devices already built are deleted
+// but points stay allocated in the image, so throw the Plant away.
+//
+// Each device is built in the plant's Arena (Arena.h): its IO maps, the
+// device itself, its bound points and its command ring, moved from one to
+// the next rather than copied. A plant of N devices takes a few blocks
+// of memory, not several malloc's per IO point.
+//
+// A device whose name is already in the plant, from this table or an
+// earlier one, is an error.
+
+#ifndef DEVICEFACTORY_H
+#define DEVICEFACTORY_H
+
+#include <string>
+#include <vector>
+#include <cstddef>
+
+#include "Arena.h"
+#include "ProcessImage.h"
+#include "DeviceRegistry.h"
+
+class Device;
+
+class Plant  // owns a ProcessImage and the devices viewing it
+{
+public:
+	Plant() {};
+	~Plant();
+	ProcessImage& Image() {return m_image;};
+	Arena& Memory() {return m_arena;}; // for the devices, see Arena.h
+	const std::vector<Device*>& Devices() const {return m_devices;};
+	// by name or serial number, any thread, see DeviceRegistry.h
+	const DeviceRegistry& Registry() const {return m_registry;};
+	// takes ownership of a device new'd on the heap or made in Memory(),
+	// and registers it unless its name is taken
+	void Add(Device* device) {m_devices.push_back(device); m_registry.Add(*device);};
+	void Truncate(const size_t count); // delete all but the first count devices
+	void Clear() {Truncate(0);};
+private:
+	Plant(const Plant&);
+	Plant& operator=(const Plant&);
+	ProcessImage m_image;
+	Arena m_arena;
+	std::vector<Device*> m_devices;
+	DeviceRegistry m_registry;
+};
+
+class DeviceFactory
+{
+public:
+	static void Load(const std::string& path, Plant& plant);
+	// the same from memory, source names it in error messages
+	static void Parse(const char* text, const size_t length, 
+		const std::string& source, Plant& plant);
+};
+
+#endif // DEVICEFACTORY_H
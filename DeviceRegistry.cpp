@@ -0,0 +1,107 @@
+///////////////////////////////////////////////////////////////////////////////
+// FILE:          DeviceRegistry.cpp
+// PROJECT:       Devices 
+// SUBSYSTEM:     Device Controller 
+//-----------------------------------------------------------------------------
+// DESCRIPTION:   implementation of the monotonic and scan clocks
+//             
+// COPYRIGHT:     Karl Hoover, No Prior Art, 2009
+//
+// LICENSE:       This library is free software; you can redistribute it and/or
+//                modify it under the terms of the GNU Lesser General Public
+//                License (LGPL) as published by the Free Software Foundation.
+//                See license text at http://www.gnu.org/licenses/lgpl.txt 
+//                Briefly you can use this source code pretty much however you
+//                wish, as long as this notice remains intact and you
+//                prominently acknowledge this copyright.
+//
+//                This file is distributed in the hope that it will be useful,
+//                but WITHOUT ANY WARRANTY; without even the implied warranty
+//                of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//                IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//                CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+//                INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES.
+//
+// AUTHOR:        Karl Hoover  karl.hoover@gmail.com
+//
+// REVISIONS:     
+//
+// NOTES:   
+// see DeviceRegistry.h for comments and history
+
+#include "DeviceRegistry.h"
+#include "device.h"
+
+using namespace std;
+
+#define CHUNK_ENTRIES (1U << SYMBOL_CHUNK_BITS)
+
+DeviceRegistry::DeviceRegistry(): m_count(0)
+{
+	for (size_t i = 0; i < SYMBOL_CHUNKS; ++i)
+	{
+		m_names[i].store(NULL, memory_order_relaxed);
+		m_serials[i].store(NULL, memory_order_relaxed);
+	}
+	pthread_mutex_init(&m_mtx, NULL);
+}
+
+DeviceRegistry::~DeviceRegistry()
+{
+	for (size_t i = 0; i < SYMBOL_CHUNKS; ++i)
+	{
+		delete [] m_names[i].load(memory_order_relaxed);
+		delete [] m_serials[i].load(memory_order_relaxed);
+	}
+	pthread_mutex_destroy(&m_mtx);
+}
+
+DeviceRegistry::Entry& DeviceRegistry::At(Chunk* chunks, const Symbol symbol)
+{
+	Chunk& chunk = chunks[symbol >> SYMBOL_CHUNK_BITS];
+	Entry* entries = chunk.load(memory_order_relaxed);
+	if (!entries)
+	{
+		entries = new Entry[CHUNK_ENTRIES];
+		for (size_t i = 0; i < CHUNK_ENTRIES; ++i)
+		{
+			entries[i].store(NULL, memory_order_relaxed);
+		}
+		chunk.store(entries, memory_order_release);
+	}
+	return entries[symbol & (CHUNK_ENTRIES - 1)];
+}
+
+bool DeviceRegistry::Add(Device& device)
+{
+	bool added = false;
+	pthread_mutex_lock(&m_mtx);
+	if (!Lookup(m_names, device.NameSymbol()))
+	{
+		At(m_names, device.NameSymbol()).store(&device, memory_order_release);
+		if (device.SerialSymbol() && !Lookup(m_serials, device.SerialSymbol()))
+		{
+			At(m_serials, device.SerialSymbol()).store(&device, memory_order_release);
+		}
+		m_count.fetch_add(1, memory_order_relaxed);
+		added = true;
+	}
+	pthread_mutex_unlock(&m_mtx);
+	return added;
+}
+
+void DeviceRegistry::Remove(Device& device)
+{
+	pthread_mutex_lock(&m_mtx);
+	if (&device == Lookup(m_names, device.NameSymbol()))
+	{
+		At(m_names, device.NameSymbol()).store(NULL, memory_order_release);
+		m_count.fetch_sub(1, memory_order_relaxed);
+	}
+	if (&device == Lookup(m_serials, device.SerialSymbol()))
+	{
+		At(m_serials, device.SerialSymbol()).store(NULL, memory_order_release);
+	}
+	pthread_mutex_unlock(&m_mtx);
+}
@@ -0,0 +1,104 @@
+///////////////////////////////////////////////////////////////////////////////
+// FILE:          DeviceRegistry.h
+// PROJECT:       Devices 
+// SUBSYSTEM:     Device Controller 
+//-----------------------------------------------------------------------------
+// DESCRIPTION:   devices by name and serial number
+//             
+// COPYRIGHT:     Karl Hoover, No Prior Art, 2009
+//
+// LICENSE:       This library is free software; you can redistribute it and/or
+//                modify it under the terms of the GNU Lesser General Public
+//                License (LGPL) as published by the Free Software Foundation.
+//                See license text at http://www.gnu.org/licenses/lgpl.txt 
+//                Briefly you can use this source code pretty much however you
+//                wish, as long as this notice remains intact and you
+//                prominently acknowledge this copyright.
+//
+//                This file is distributed in the hope that it will be useful,
+//                but WITHOUT ANY WARRANTY; without even the implied warranty
+//                of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//                IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//                CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+//                INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES.
+//
+// AUTHOR:        Karl Hoover  karl.hoover@gmail.com
+//
+// REVISIONS:     1.0 October 16, 2026
+//
+// NOTES:   
+// Finds a device by name or serial number for an HMI or scripting front
+// end, in constant time and without allocating or locking, while the scan
+// runs. Names and serial numbers are interned symbols (SymbolTable.h),
+// which are small and dense, so the index is a direct table from symbol
+// to device: a lookup is one FindSymbol hash probe and one array load.
+// The table is in fixed size chunks that never move, a chunk is added
+// when a symbol past the end is registered, so readers never see it
+// reallocated.
+//
+// Add and Remove take a mutex and are for setting up, e.g. Plant::Add;
+// a name registered twice keeps its first device and Add returns false.
+// A serial number, if the device has one, is registered too unless
+// another device has it already. Remove doesn't wait for readers, so a
+// device must not be destroyed while a front end may still use what Find
+// returned, which is the rule for the devices anyway.
+
+#ifndef DEVICEREGISTRY_H
+#define DEVICEREGISTRY_H
+
+#include <atomic>
+#include <string>
+#include <cstddef>
+
+#include <pthread.h>
+
+#include "SymbolTable.h"
+
+class Device;
+
+class DeviceRegistry
+{
+public:
+	DeviceRegistry();
+	~DeviceRegistry();
+
+	bool Add(Device& device); // false if the name is taken
+	void Remove(Device& device);
+	size_t Count() const {return m_count.load(std::memory_order_relaxed);};
+
+	// any thread, NULL if there is none
+	Device* Find(const Symbol name) const {return Lookup(m_names, name);};
+	Device* Find(const char* name, const size_t length) const
+		{return Lookup(m_names, FindSymbol(name, length));};
+	Device* Find(const std::string& name) const {return Find(name.data(), name.size());};
+	Device* FindSerial(const Symbol serial) const {return Lookup(m_serials, serial);};
+	Device* FindSerial(const char* serial, const size_t length) const
+		{return Lookup(m_serials, FindSymbol(serial, length));};
+	Device* FindSerial(const std::string& serial) const 
+		{return FindSerial(serial.data(), serial.size());};
+
+private:
+	DeviceRegistry(const DeviceRegistry&);
+	DeviceRegistry& operator=(const DeviceRegistry&);
+	typedef std::atomic<Device*> Entry;
+	typedef std::atomic<Entry*> Chunk;
+	static Device* Lookup(const Chunk* chunks, const Symbol symbol)
+	{
+		if (!symbol || NO_SYMBOL == symbol)
+		{
+			return NULL;
+		}
+		const Entry* chunk = chunks[symbol >> SYMBOL_CHUNK_BITS].load(std::memory_order_acquire);
+		return chunk ? chunk[symbol & ((1U << SYMBOL_CHUNK_BITS) - 1)].load(
+			std::memory_order_acquire) : NULL;
+	};
+	static Entry& At(Chunk* chunks, const Symbol symbol); // under the lock, adds the chunk
+
+	Chunk m_names[SYMBOL_CHUNKS];
+	Chunk m_serials[SYMBOL_CHUNKS];
+	std::atomic<size_t> m_count;
+	pthread_mutex_t m_mtx;
+};
+
+#endif // DEVICEREGISTRY_H
@@ -0,0 +1,1617 @@
+///////////////////////////////////////////////////////////////////////////////
+// FILE:          DeviceTest.cpp
+// PROJECT:       Devices
+// SUBSYSTEM:     Device Controller
+//-----------------------------------------------------------------------------
+// DESCRIPTION:   checks of the device library
+//
+// COPYRIGHT:     Karl Hoover, No Prior Art, 2009
+//
+// LICENSE:       This library is free software; you can redistribute it and/or
+//                modify it under the terms of the GNU Lesser General Public
+//                License (LGPL) as published by the Free Software Foundation.
+//                See license text at http://www.gnu.org/licenses/lgpl.txt
+//                Briefly you can use this source code pretty much however you
+//                wish, as long as this notice remains intact and you
+//                prominently acknowledge this copyright.
+//
+//                This file is distributed in the hope that it will be useful,
+//                but WITHOUT ANY WARRANTY; without even the implied warranty
+//                of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//                IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//                CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+//                INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES.
+//
+// AUTHOR:        Karl Hoover  karl.hoover@gmail.com
+//
+// REVISIONS:     1.0 October 17, 2026
+//
+// NOTES:
+// make test   builds devicetest and runs it
+//
+// One line per check on stdout, "ok" or what failed and where; the exit
+// status is the number of failed checks. The checks are deterministic
+// where they can be: every random choice comes from a fixed seed and the
+// plants run on the virtual scan clock, so a failure repeats.
+//
+// The checks with threads race on purpose and look for what mustn't
+// happen.
+//
+//   executor    a ScanExecutor updates every device exactly once a cycle,
+//               and its other workers steal from a slice of slow devices
+//   outputs     a field side thread reading the outputs while the scan
+//               commits them never sees half of a commit
+//   commands    CommandQueue keeps each producer's order with several
+//               producers; every command posted to a valve from other
+//               threads completes once, on the scan thread
+//   checkpoint  a plant restored from a checkpoint, and from the older
+//               slot once the newer one is corrupt
+//   sequence    hundreds of Sequences over a ScanExecutor with several
+//               threads, one with a jammed valve
+//   interlock   an InterlockEngine's results against the same rules
+//               evaluated directly, over random field inputs and states
+//   publisher   a StateReader thread reading while the scan publishes
+//               only ever gets whole scans
+//   historian   what a Historian wrote, read back with HistoryReader,
+//               against the image and states of every scan recorded
+//   replay      a simulated plant with faults and random commands,
+//               recorded, then replayed into a fresh plant: no
+//               divergences, and some once a valve's timeout is changed
+//   registry    symbol and DeviceRegistry lookups from one thread while
+//               another interns names and adds devices
+//
+// Files go to a directory made under $TMPDIR (or /tmp) and are removed
+// afterwards.
+//
+// The state segment is named after the process, and removed afterwards.
+//
+// The checks with threads are the ones for ThreadSanitizer:
+//
+//     make clean
+//     CXXFLAGS="-O1 -g -fsanitize=thread" LDFLAGS=-fsanitize=thread make test
+//
+// (in the environment, not on the command line, so the Makefile's own
+// flags are still added).
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+#include <sstream>
+#include <atomic>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sched.h>
+#include <pthread.h>
+
+#include "device.h"
+#include "Checkpoint.h"
+#include "CommandQueue.h"
+#include "DeviceFactory.h"
+#include "DeviceRegistry.h"
+#include "Historian.h"
+#include "Interlock.h"
+#include "PlantSimulator.h"
+#include "Replay.h"
+#include "ScanExecutor.h"
+#include "Sequence.h"
+#include "StatePublisher.h"
+#include "SymbolTable.h"
+
+#define CHECK(condition) Check((condition), #condition, __FILE__, __LINE__)
+
+static int failures = 0;
+static int checkFailures = 0; // in the check being run
+
+static void Check(const bool ok, const char* what, const char* file, const int line)
+{
+	if (!ok)
+	{
+		printf("  failed: %s at %s:%d\n", what, file, line);
+		++failures;
+		++checkFailures;
+	}
+}
+
+static void Begin()
+{
+	checkFailures = 0;
+}
+
+static void End(const char* check, const string& detail)
+{
+	printf("%s: %s%s%s\n", check, checkFailures ? "FAILED" : "ok",
+		detail.empty() ? "" : ", ", detail.c_str());
+	fflush(stdout);
+}
+
+// xorshift, the same sequence on every run
+static unsigned long long Random()
+{
+	static unsigned long long state = 88172645463325252ULL;
+	state ^= state << 13;
+	state ^= state >> 7;
+	state ^= state << 17;
+	return state;
+}
+
+// count double throw valves, each with its own sensors, commands and
+// interlocks, built the way a real configuration is
+static void BuildPlant(Plant& plant, const int count)
+{
+	ostringstream table;
+	for (int i = 0; i < count; ++i)
+	{
+		table << 'V' << i << ",CLOSED?,V" << i << "CLOSED?,bool,ReadOnly,DoubleThrowValve\n"
+			<< 'V' << i << ",OPENED?,V" << i << "OPENED?,bool,ReadOnly\n"
+			<< 'V' << i << ",CLOSE!,V" << i << "CLOSE!,bool,WriteOnly\n"
+			<< 'V' << i << ",OPEN!,V" << i << "OPEN!,bool,WriteOnly\n"
+			<< 'V' << i << ",CLOSE_OK?,V" << i << "CLOSE_OK?,bool,ReadOnly\n"
+			<< 'V' << i << ",OPEN_OK?,V" << i << "OPEN_OK?,bool,ReadOnly\n";
+	}
+	string text = table.str();
+	DeviceFactory::Parse(text.data(), text.size(), "test", plant);
+}
+
+static void SetTimeOuts(Plant& plant, const Nanoseconds motion, const Nanoseconds interlock)
+{
+	for (size_t i = 0; i < plant.Devices().size(); ++i)
+	{
+		Valve* valve = static_cast<Valve*>(plant.Devices()[i]);
+		valve->SetMotionTimeOut(motion);
+		valve->SetInterlockTimeOut(interlock);
+	}
+}
+
+// a Device with no IO at all
+static Device* PlainDevice(const string& name, const string& serial)
+{
+	return new Device(name, serial, map<string, DigitalInput>(), map<string, DigitalOutput>(),
+		map<string, AnalogueInput>(), map<string, AnalogueOutput>());
+}
+
+// a scratch directory for files, removed by the check which made it
+static string MakeDirectory()
+{
+	const char* tmp = getenv("TMPDIR");
+	string path = string(tmp && *tmp ? tmp : "/tmp") + "/devicetest.XXXXXX";
+	vector<char> name(path.begin(), path.end());
+	name.push_back('\0');
+	if (!mkdtemp(&name[0]))
+	{
+		throw runtime_error("devicetest: can't make a directory under " + path);
+	}
+	return &name[0];
+}
+
+static vector<string> Segments(const string& prefix)
+{
+	vector<string> paths;
+	for (unsigned int segment = 0; ; ++segment)
+	{
+		char suffix[32];
+		snprintf(suffix, sizeof(suffix), ".%06u.hist", segment);
+		if (access((prefix + suffix).c_str(), F_OK))
+		{
+			break;
+		}
+		paths.push_back(prefix + suffix);
+	}
+	return paths;
+}
+
+static void RemoveDirectory(const string& directory, const string& prefix)
+{
+	vector<string> paths = Segments(prefix);
+	for (size_t i = 0; i < paths.size(); ++i)
+	{
+		unlink(paths[i].c_str());
+	}
+	rmdir(directory.c_str());
+}
+
+// counts its updates, and a slow one takes a while over them
+class CountingDevice : public Device
+{
+public:
+	CountingDevice(const string& name, const bool slow): Device(name, "",
+		map<string, DigitalInput>(), map<string, DigitalOutput>(),
+		map<string, AnalogueInput>(), map<string, AnalogueOutput>()),
+		m_slow(slow), m_updates(0), m_thread(pthread_self()) {};
+	virtual bool Update()
+	{
+		if (m_slow)
+		{
+			usleep(20); // gives the other workers the processor, too
+		}
+		++m_updates; // one worker a cycle, the barriers order the cycles
+		m_thread = pthread_self();
+		return true;
+	};
+	int Updates() const {return m_updates;};
+	pthread_t Thread() const {return m_thread;};
+private:
+	bool m_slow;
+	int m_updates;
+	pthread_t m_thread;
+};
+
+// runs cycles, returns the devices not updated exactly once in each
+static int RunCycles(ScanExecutor& executor, const vector<CountingDevice*>& devices,
+	const int cycles, int& stolen)
+{
+	int wrong = 0;
+	vector<int> before(devices.size());
+	for (int c = 0; c < cycles; ++c)
+	{
+		for (size_t i = 0; i < devices.size(); ++i)
+		{
+			before[i] = devices[i]->Updates();
+		}
+		executor.RunCycle();
+		stolen += executor.StolenLastCycle();
+		for (size_t i = 0; i < devices.size(); ++i)
+		{
+			wrong += before[i] + 1 != devices[i]->Updates();
+		}
+	}
+	return wrong;
+}
+
+static void TestExecutor()
+{
+	Begin();
+	const int count = 1000;
+	const int slow = 100; // all in worker 0's slice
+	const int cycles = 50;
+	vector<CountingDevice*> devices;
+	for (int i = 0; i < count; ++i)
+	{
+		ostringstream name;
+		name << "executor.D" << i;
+		devices.push_back(new CountingDevice(name.str(), i < slow));
+	}
+
+	int stolen = 0;
+	vector<pthread_t> threads; // which updated a device last
+	{
+		ScanExecutor executor(4);
+		for (int i = 0; i < count; ++i)
+		{
+			executor.Register(*devices[i]);
+		}
+		CHECK(count == executor.DeviceCount());
+		CHECK(4 == executor.ThreadCount());
+		CHECK(0 == RunCycles(executor, devices, cycles, stolen));
+		CHECK(cycles == (int)executor.Cycles());
+		CHECK(executor.MinCycleTime() <= executor.MeanCycleTime()
+			&& executor.MeanCycleTime() <= executor.MaxCycleTime());
+		for (int i = 0; i < count; ++i)
+		{
+			size_t t = 0;
+			while (t < threads.size() && !pthread_equal(threads[t], devices[i]->Thread()))
+			{
+				++t;
+			}
+			if (t == threads.size())
+			{
+				threads.push_back(devices[i]->Thread());
+			}
+		}
+	}
+	CHECK(stolen > 0);
+	CHECK(threads.size() > 1);
+
+	// fewer devices than workers, one worker, and a device registered
+	// between cycles
+	int unused = 0;
+	{
+		ScanExecutor executor(4);
+		vector<CountingDevice*> few(devices.begin(), devices.begin() + 3);
+		for (size_t i = 0; i < few.size(); ++i)
+		{
+			executor.Register(*few[i]);
+		}
+		CHECK(0 == RunCycles(executor, few, 10, unused));
+		few.push_back(devices[slow]);
+		executor.Register(*devices[slow]);
+		CHECK(0 == RunCycles(executor, few, 10, unused));
+	}
+	{
+		ScanExecutor executor(1);
+		vector<CountingDevice*> all(devices.begin() + slow, devices.end());
+		for (size_t i = 0; i < all.size(); ++i)
+		{
+			executor.Register(*all[i]);
+		}
+		int none = 0;
+		CHECK(0 == RunCycles(executor, all, 10, none));
+		CHECK(0 == none);
+	}
+	for (int i = 0; i < count; ++i)
+	{
+		delete devices[i];
+	}
+
+	ostringstream detail;
+	detail << cycles << " cycles, " << stolen << " chunks stolen";
+	End("executor", detail.str());
+}
+
+struct OutputReader
+{
+	const ProcessImage* image;
+	atomic<bool> stop;
+	atomic<long> reads;
+	long torn;       // digital and analogue outputs of different commits
+	long backwards;  // an older commit after a newer one
+};
+
+// the field side. Commit k sets every digital output to k & 1 and every
+// analogue one to k, so a read of a whole commit is all alike.
+static void* ReadOutputs(void* arg)
+{
+	OutputReader& reader = *static_cast<OutputReader*>(arg);
+	vector<ImageWord> digital;
+	vector<double> analogue;
+	double last = 0.;
+	while (!reader.stop.load())
+	{
+		reader.image->ReadFieldOutputs(digital, analogue);
+		ImageWord expected = ((unsigned long long)analogue[0] & 1) ? ~(ImageWord)0 : 0;
+		bool torn = false;
+		for (size_t i = 0; i < digital.size(); ++i)
+		{
+			torn |= expected != digital[i];
+		}
+		for (size_t i = 1; i < analogue.size(); ++i)
+		{
+			torn |= analogue[0] != analogue[i];
+		}
+		reader.torn += torn;
+		reader.backwards += analogue[0] < last;
+		last = analogue[0];
+		++reader.reads;
+	}
+	return NULL;
+}
+
+static void TestOutputs()
+{
+	Begin();
+	const int digitals = 4 * IMAGE_WORD_BITS;
+	const int analogues = 8;
+	const unsigned long long commits = 20000;
+	const long reads = 20000;
+	ProcessImage image;
+	for (int i = 0; i < digitals; ++i)
+	{
+		image.AddDigitalOutput();
+	}
+	for (int i = 0; i < analogues; ++i)
+	{
+		image.AddAnalogueOutput();
+	}
+
+	OutputReader reader;
+	reader.image = &image;
+	reader.stop = false;
+	reader.reads = 0;
+	reader.torn = 0;
+	reader.backwards = 0;
+	pthread_t thread;
+	pthread_create(&thread, NULL, ReadOutputs, &reader);
+	// on as long as it takes the reader to get its reads in
+	unsigned long long k = 0;
+	while (k < commits || (reader.reads < reads && k < 1000 * commits))
+	{
+		++k;
+		for (int i = 0; i < digitals; ++i)
+		{
+			image.WriteOutput(i, k & 1);
+		}
+		for (int i = 0; i < analogues; ++i)
+		{
+			image.WriteAnalogueOutput(i, k);
+		}
+		image.CommitOutputs();
+		if (0 == k % 1000)
+		{
+			sched_yield();
+		}
+	}
+	reader.stop = true;
+	pthread_join(thread, NULL);
+	CHECK(reader.reads >= reads);
+	CHECK(0 == reader.torn);
+	CHECK(0 == reader.backwards);
+	CHECK(k == image.OutputCommits());
+
+	// a restored image is staged and committed at once
+	vector<ImageWord> digital(digitals / IMAGE_WORD_BITS, 0x5555555555555555ULL);
+	vector<double> analogue(analogues, 3.5);
+	image.RestoreOutputs(digital, analogue);
+	CHECK(k + 1 == image.OutputCommits());
+	CHECK(image.ReadOutput(0) && !image.ReadOutput(1));
+	CHECK(3.5 == image.ReadAnalogueOutput(analogues - 1));
+	vector<ImageWord> fieldDigital;
+	vector<double> fieldAnalogue;
+	image.ReadFieldOutputs(fieldDigital, fieldAnalogue);
+	CHECK(digital == fieldDigital && analogue == fieldAnalogue);
+
+	ostringstream detail;
+	detail << k << " commits, " << reader.reads << " reads, " << reader.torn << " torn";
+	End("outputs", detail.str());
+}
+
+struct Producer
+{
+	CommandQueue* queue;
+	int producer;
+	int count;
+};
+
+// ids carry the producer and its count, so the consumer can check the order
+static void* Produce(void* arg)
+{
+	Producer& producer = *static_cast<Producer*>(arg);
+	for (int i = 0; i < producer.count; )
+	{
+		DeviceCommand command = {((unsigned long long)producer.producer << 32) | i,
+			COMMAND_OPEN, NULL, NULL};
+		if (producer.queue->Push(command))
+		{
+			++i;
+		}
+		else
+		{
+			sched_yield();
+		}
+	}
+	return NULL;
+}
+
+// one per command a client posts to a valve
+struct Posted
+{
+	bool accepted;
+	atomic<int> calls;
+	atomic<int> result;
+};
+
+struct Client
+{
+	Plant* plant;
+	Posted* posted;
+	int client;
+	int count;
+};
+
+static pthread_t scanThread;
+static atomic<int> commandsCompleted(0);
+static atomic<int> commandsAccepted(0);
+static atomic<int> completedElsewhere(0); // not on the scan thread
+static atomic<int> clientsFinished(0);
+
+static void CommandDone(void* context, const unsigned long long, const int result)
+{
+	Posted& posted = *static_cast<Posted*>(context);
+	posted.result = result;
+	++posted.calls;
+	if (!pthread_equal(pthread_self(), scanThread))
+	{
+		++completedElsewhere;
+	}
+	++commandsCompleted;
+}
+
+static void* PostCommands(void* arg)
+{
+	Client& client = *static_cast<Client*>(arg);
+	const vector<Device*>& devices = client.plant->Devices();
+	const int commands[] = {COMMAND_OPEN, COMMAND_CLOSE, COMMAND_RESET};
+	for (int i = 0; i < client.count; ++i)
+	{
+		Posted& posted = client.posted[i];
+		Device& device = *devices[(client.client * 7 + i * 3) % devices.size()];
+		posted.accepted = 0 != device.PostCommand(commands[(client.client + i) % 3],
+			CommandDone, &posted);
+		commandsAccepted += posted.accepted;
+		sched_yield();
+	}
+	++clientsFinished;
+	return NULL;
+}
+
+static void TestCommands()
+{
+	Begin();
+	// the bare queue: producers on their own threads, the consumer here
+	const int producers = 4;
+	const int each = 20000;
+	CommandQueue queue(10);
+	CHECK(16 == queue.Depth());
+	vector<Producer> producing(producers);
+	vector<pthread_t> threads(producers);
+	for (int p = 0; p < producers; ++p)
+	{
+		Producer producer = {&queue, p, each};
+		producing[p] = producer;
+		pthread_create(&threads[p], NULL, Produce, &producing[p]);
+	}
+	vector<int> next(producers, 0);
+	int received = 0;
+	int outOfOrder = 0;
+	while (received < producers * each)
+	{
+		DeviceCommand command;
+		if (!queue.Pop(command))
+		{
+			sched_yield();
+			continue;
+		}
+		int producer = command.id >> 32;
+		int index = command.id & 0xffffffffULL;
+		outOfOrder += index != next[producer];
+		next[producer] = index + 1;
+		++received;
+	}
+	for (int p = 0; p < producers; ++p)
+	{
+		pthread_join(threads[p], NULL);
+	}
+	DeviceCommand command;
+	CHECK(!queue.Pop(command));
+	CHECK(0 == outOfOrder);
+	for (size_t i = 0; i < queue.Depth(); ++i)
+	{
+		DeviceCommand filler = {i + 1, COMMAND_OPEN, NULL, NULL};
+		CHECK(queue.Push(filler));
+	}
+	DeviceCommand overflow = {99, COMMAND_OPEN, NULL, NULL};
+	CHECK(!queue.Push(overflow));
+
+	// clients posting to valves while the plant scans, a millisecond a
+	// scan on the virtual clock
+	const int count = 16;
+	const int clients = 4;
+	const int posts = 500;
+	Plant plant;
+	BuildPlant(plant, count);
+	SetTimeOuts(plant, 30 * NANOSECONDS_PER_MILLISECOND, 30 * NANOSECONDS_PER_MILLISECOND);
+	ProcessImage& image = plant.Image();
+	const vector<Device*>& devices = plant.Devices();
+	PlantSimulator simulator(image, 3);
+	simulator.SetTravelTime(NANOSECONDS_PER_MILLISECOND, 4 * NANOSECONDS_PER_MILLISECOND);
+	for (int i = 0; i < count; ++i)
+	{
+		simulator.AddValve(*devices[i]);
+		simulator.Place(i, true);
+	}
+	scanThread = pthread_self();
+	vector<Posted> posted(clients * posts);
+	for (size_t i = 0; i < posted.size(); ++i)
+	{
+		posted[i].accepted = false;
+		posted[i].calls = 0;
+		posted[i].result = 1;
+	}
+	vector<Client> posting(clients);
+	threads.resize(clients);
+	SetScanClockSource(CLOCK_SOURCE_VIRTUAL);
+	Nanoseconds now = 1000 * NANOSECONDS_PER_SECOND;
+	for (int c = 0; c < clients; ++c)
+	{
+		Client client = {&plant, &posted[c * posts], c, posts};
+		posting[c] = client;
+		pthread_create(&threads[c], NULL, PostCommands, &posting[c]);
+	}
+	int scans = 0;
+	for (; (clientsFinished < clients || commandsCompleted < commandsAccepted) && scans < 1000000;
+		++scans, now += NANOSECONDS_PER_MILLISECOND)
+	{
+		SetVirtualNanoseconds(now);
+		simulator.Step(now);
+		image.LatchInputs();
+		SampleScanTime();
+		for (int i = 0; i < count; ++i)
+		{
+			devices[i]->Update();
+		}
+		image.CommitOutputs();
+	}
+	SetScanClockSource(CLOCK_SOURCE_MONOTONIC);
+	for (int c = 0; c < clients; ++c)
+	{
+		pthread_join(threads[c], NULL);
+	}
+	int once = 0;
+	int results[4] = {0, 0, 0, 0}; // by -COMMAND_RESULT_
+	for (size_t i = 0; i < posted.size(); ++i)
+	{
+		once += (posted[i].accepted ? 1 : 0) == posted[i].calls;
+		int result = posted[i].result;
+		if (posted[i].accepted && result <= COMMAND_RESULT_DONE && result >= COMMAND_RESULT_REJECTED)
+		{
+			++results[-result];
+		}
+	}
+	CHECK(commandsAccepted > 0);
+	CHECK((int)posted.size() == once);
+	CHECK(commandsAccepted == commandsCompleted);
+	CHECK(commandsAccepted == results[0] + results[1] + results[2]);
+	CHECK(0 == completedElsewhere);
+
+	// a plain Device has no commands, it rejects them, and copying one
+	// with commands queued would lose them
+	{
+		Device* device = PlainDevice("commands.plain", "");
+		Posted rejected;
+		rejected.calls = 0;
+		rejected.result = 1;
+		CHECK(0 != device->PostCommand(COMMAND_OPEN, CommandDone, &rejected));
+		future<int> result = device->PostCommandAsync(COMMAND_CLOSE);
+		bool threw = false;
+		try
+		{
+			Device copy(*device);
+		}
+		catch (logic_error&)
+		{
+			threw = true;
+		}
+		CHECK(threw);
+		CHECK(!device->Update());
+		CHECK(1 == rejected.calls && COMMAND_RESULT_REJECTED == rejected.result);
+		CHECK(COMMAND_RESULT_REJECTED == result.get());
+		CHECK(device->Update());
+		Device copy(*device);
+		CHECK(copy.Name() == device->Name());
+		delete device;
+	}
+
+	ostringstream detail;
+	detail << producers * each << " queued, " << commandsAccepted << " posted to valves, "
+		<< results[0] << " done, " << results[1] << " failed, " << results[2]
+		<< " rejected in " << scans << " scans";
+	End("commands", detail.str());
+}
+
+// the scan inputs of one plant into the live image of another of the
+// same table, as if it were reading the same field
+static void CopyInputs(const ProcessImage& from, ProcessImage& to)
+{
+	vector<ImageWord> values(to.InputWordCount(), 0);
+	for (size_t i = 0; i < values.size() && i < from.InputWordCount(); ++i)
+	{
+		values[i] = from.InputWords()[i];
+	}
+	vector<ImageWord> mask(values.size(), ~(ImageWord)0);
+	to.WriteFieldInputs(values.data(), mask.data());
+}
+
+// flips a byte of a file
+static void Corrupt(const string& path, const long offset)
+{
+	FILE* file = fopen(path.c_str(), "r+b");
+	if (!file)
+	{
+		throw runtime_error("devicetest: can't open " + path);
+	}
+	fseek(file, offset, SEEK_SET);
+	int byte = fgetc(file);
+	fseek(file, offset, SEEK_SET);
+	fputc(byte ^ 0xff, file);
+	fclose(file);
+}
+
+// a fresh plant of count valves seeing the inputs given, restored from
+// path. Returns the devices restored, states their states.
+static int Restore(const string& path, const int count, const ProcessImage& inputs,
+	vector<int>& states)
+{
+	Plant plant;
+	BuildPlant(plant, count);
+	CopyInputs(inputs, plant.Image());
+	plant.Image().LatchInputs();
+	SampleScanTime();
+	int restored = RestoreCheckpoint(path, plant.Devices(), plant.Image());
+	states.clear();
+	for (size_t i = 0; i < plant.Devices().size(); ++i)
+	{
+		states.push_back(plant.Devices()[i]->State());
+	}
+	return restored;
+}
+
+static void TestCheckpoint()
+{
+	Begin();
+	const int count = 20;
+	const int moving = 5;
+	string directory = MakeDirectory();
+	string path = directory + "/checkpoint";
+	Plant plant;
+	BuildPlant(plant, count);
+	ProcessImage& image = plant.Image();
+	const vector<Device*>& devices = plant.Devices();
+	PlantSimulator simulator(image, 11);
+	simulator.SetTravelTime(2 * NANOSECONDS_PER_SECOND, 2 * NANOSECONDS_PER_SECOND);
+	for (int i = 0; i < count; ++i)
+	{
+		simulator.AddValve(*devices[i]);
+		simulator.Place(i, true);
+	}
+
+	// at rest, then the first few valves set off opening
+	SetScanClockSource(CLOCK_SOURCE_VIRTUAL);
+	Nanoseconds now = 1000 * NANOSECONDS_PER_SECOND;
+	Plant atRest; // its image holds the inputs as they were
+	BuildPlant(atRest, count);
+	{
+		CheckpointWriter writer(path, devices, image);
+		for (int s = 0; s < 60; ++s, now += 20 * NANOSECONDS_PER_MILLISECOND)
+		{
+			if (50 == s)
+			{
+				writer.Write();
+				CopyInputs(image, atRest.Image());
+				atRest.Image().LatchInputs();
+				for (int i = 0; i < moving; ++i)
+				{
+					devices[i]->PostCommand(COMMAND_OPEN);
+				}
+			}
+			SetVirtualNanoseconds(now);
+			simulator.Step(now);
+			image.LatchInputs();
+			SampleScanTime();
+			for (int i = 0; i < count; ++i)
+			{
+				devices[i]->Update();
+			}
+			image.CommitOutputs();
+		}
+		writer.Write();
+		CHECK(2 == writer.Sequence());
+	}
+	int unexpected = 0;
+	for (int i = 0; i < count; ++i)
+	{
+		unexpected += (i < moving ? STATE_OPENING : STATE_IDLE) != devices[i]->State();
+	}
+	CHECK(0 == unexpected);
+
+	// the newer slot, the valves carry on opening
+	vector<int> states;
+	CHECK(count == Restore(path, count, image, states));
+	unexpected = 0;
+	for (int i = 0; i < count; ++i)
+	{
+		unexpected += devices[i]->State() != states[i];
+	}
+	CHECK(0 == unexpected);
+
+	// the newer slot is corrupt, the older one has them all at rest
+	struct stat info;
+	CHECK(0 == stat(path.c_str(), &info));
+	long slotSize = info.st_size / 2;
+	Corrupt(path, 200); // the device records of slot 0, written second
+	CHECK(count == Restore(path, count, atRest.Image(), states));
+	unexpected = 0;
+	for (int i = 0; i < count; ++i)
+	{
+		unexpected += STATE_IDLE != states[i];
+	}
+	CHECK(0 == unexpected);
+
+	// neither is any good; flipped back, both are but for another plant;
+	// none at all
+	Corrupt(path, slotSize + 200);
+	CHECK(0 == Restore(path, count, atRest.Image(), states));
+	Corrupt(path, 200);
+	Corrupt(path, slotSize + 200);
+	CHECK(count == Restore(path, count, atRest.Image(), states));
+	CHECK(0 == Restore(path, count + 1, atRest.Image(), states));
+	unlink(path.c_str());
+	CHECK(0 == Restore(path, count, atRest.Image(), states));
+	SetScanClockSource(CLOCK_SOURCE_MONOTONIC);
+	rmdir(directory.c_str());
+
+	ostringstream detail;
+	detail << count << " valves, " << moving << " restored opening";
+	End("checkpoint", detail.str());
+}
+
+static atomic<int> sequencesFinished(0);
+static atomic<int> sequencesFailed(0);
+
+static void SequenceDone(void*, Sequence&, const int result)
+{
+	++sequencesFinished;
+	if (COMMAND_RESULT_DONE != result)
+	{
+		++sequencesFailed;
+	}
+}
+
+// diamonds of four valves, a opens, then b and c, then d, on an executor
+// with several threads so steps complete on different threads
+static void TestSequence()
+{
+	Begin();
+	const int sequences = 300;
+	const int count = sequences * 4;
+	const int jammed = 7 * 4 + 2; // step c of sequence 7
+	Plant plant;
+	BuildPlant(plant, count);
+	SetTimeOuts(plant, 30 * NANOSECONDS_PER_MILLISECOND, 30 * NANOSECONDS_PER_MILLISECOND);
+	ProcessImage& image = plant.Image();
+	const vector<Device*>& devices = plant.Devices();
+	PlantSimulator simulator(image, 5);
+	simulator.SetTravelTime(NANOSECONDS_PER_MILLISECOND, 4 * NANOSECONDS_PER_MILLISECOND);
+	ScanExecutor executor(4);
+	for (int i = 0; i < count; ++i)
+	{
+		simulator.AddValve(*devices[i]);
+		simulator.Place(i, true);
+		executor.Register(*devices[i]);
+	}
+	simulator.SetFaults(jammed, SIM_FAULT_JAMMED);
+
+	vector<Sequence*> opens;
+	for (int s = 0; s < sequences; ++s)
+	{
+		Sequence* sequence = new Sequence;
+		int a = sequence->Step(*devices[4 * s], COMMAND_OPEN);
+		int b = sequence->Step(*devices[4 * s + 1], COMMAND_OPEN);
+		int c = sequence->Step(*devices[4 * s + 2], COMMAND_OPEN);
+		int d = sequence->Step(*devices[4 * s + 3], COMMAND_OPEN);
+		sequence->After(b, a);
+		sequence->After(c, a);
+		sequence->After(d, b);
+		sequence->After(d, c);
+		opens.push_back(sequence);
+	}
+	{
+		Sequence cycle;
+		int a = cycle.Step(*devices[0], COMMAND_OPEN);
+		int b = cycle.Step(*devices[1], COMMAND_OPEN);
+		cycle.After(a, b);
+		cycle.After(b, a);
+		bool threw = false;
+		try
+		{
+			cycle.Start();
+		}
+		catch (invalid_argument&)
+		{
+			threw = true;
+		}
+		CHECK(threw);
+	}
+
+	// a millisecond a scan on the virtual clock, however slow the build
+	SetScanClockSource(CLOCK_SOURCE_VIRTUAL);
+	Nanoseconds now = 1000 * NANOSECONDS_PER_SECOND;
+	int scans = 0;
+	for (; scans < 20; ++scans, now += NANOSECONDS_PER_MILLISECOND)
+	{
+		SetVirtualNanoseconds(now);
+		simulator.Step(now);
+		image.LatchInputs();
+		executor.RunCycle();
+		image.CommitOutputs();
+	}
+	for (int s = 0; s < sequences; ++s)
+	{
+		CHECK(opens[s]->Start(SequenceDone));
+	}
+	CHECK(!opens[0]->Start());
+	for (; sequencesFinished < sequences && scans < 1000; ++scans, now += NANOSECONDS_PER_MILLISECOND)
+	{
+		SetVirtualNanoseconds(now);
+		simulator.Step(now);
+		image.LatchInputs();
+		executor.RunCycle();
+		image.CommitOutputs();
+	}
+	SetScanClockSource(CLOCK_SOURCE_MONOTONIC);
+
+	CHECK(sequences == sequencesFinished);
+	CHECK(1 == sequencesFailed);
+	CHECK(COMMAND_RESULT_FAILED == opens[7]->Result());
+	CHECK(2 == opens[7]->FailedStep());
+	CHECK(0 == opens[7]->StepTime(3));
+	vector<int> path;
+	opens[0]->CriticalPath(path);
+	CHECK(3 == path.size() && 0 == path.front() && 3 == path.back());
+	int unexpected = 0; // all at rest, the jammed valve failed
+	for (int i = 0; i < count; ++i)
+	{
+		unexpected += (i == jammed ? STATE_INVALID : STATE_IDLE) != devices[i]->State();
+	}
+	CHECK(0 == unexpected);
+	for (int s = 0; s < sequences; ++s)
+	{
+		delete opens[s];
+	}
+
+	ostringstream detail;
+	detail << sequencesFinished << " sequences in " << scans << " scans, " << sequencesFailed
+		<< " failed";
+	End("sequence", detail.str());
+}
+
+// the rules of TestInterlock, evaluated directly. states are as the
+// devices were left by the previous scan, as the engine sees them.
+static bool Direct(const int rule, ProcessImage& image, const vector<Device*>& devices,
+	const vector<int>& states)
+{
+	struct Point
+	{
+		ProcessImage& image;
+		const vector<Device*>& devices;
+		bool operator()(const int device, const char* attribute) const
+			{return image.ReadInput(devices[device]->DigitalInputPoint(attribute));};
+	} input = {image, devices};
+	switch (rule)
+	{
+		case 0: return input(0, "CLOSED?") && !input(2, "OPENED?");
+		case 1: return true;
+		case 2: return !(input(0, "CLOSED?") && input(3, "CLOSED?")) || STATE_INVALID == states[4];
+		case 3: return (input(3, "CLOSED?") || input(4, "CLOSED?"))
+				&& (STATE_IDLE == states[3] || input(5, "CLOSED?")) && STATE_INVALID != states[2];
+		case 4: return !(input(1, "OPENED?") || input(5, "OPENED?")) || (STATE_WAITING == states[1]
+				&& !input(5, "CLOSED?"));
+	}
+	return false;
+}
+
+static void TestInterlock()
+{
+	Begin();
+	const int count = 6;
+	Plant plant;
+	BuildPlant(plant, count);
+	ProcessImage& image = plant.Image();
+	const vector<Device*>& devices = plant.Devices();
+	SetTimeOuts(plant, 3600 * NANOSECONDS_PER_SECOND, 3600 * NANOSECONDS_PER_SECOND);
+
+	InterlockEngine interlocks(image, devices);
+	interlocks.Parse(
+		"# rules in the order of Direct()\n"
+		"V1.OPEN_OK? = V0.CLOSED? & !V2.OPENED?  # comment\n"
+		" V1.CLOSE_OK? = TRUE\n"
+		"V2.OPEN_OK? = !(V0.CLOSED? & V3.CLOSED?) | V4.INVALID\n"
+		"\n"
+		"V0.OPEN_OK? = (V3.CLOSED? | V4.CLOSED?) & (V3.IDLE or V5.CLOSED?) and not V2.INVALID\n"
+		"V3.CLOSE_OK? = !(V1.OPENED? || V5.OPENED?) || V1.WAITING && !V5.CLOSED?\n",
+		"rules");
+	CHECK(5 == interlocks.RuleCount());
+	const char* targets[][2] = {{"V1", "OPEN_OK?"}, {"V1", "CLOSE_OK?"}, {"V2", "OPEN_OK?"},
+		{"V0", "OPEN_OK?"}, {"V3", "CLOSE_OK?"}};
+
+	const char* bad[] = {"V1.OPEN_OK? = V0.CLOSED?", "V9.OPEN_OK? = TRUE",
+		"V2.CLOSE_OK? = V0.NOPE", "V2.CLOSE_OK? = (V0.CLOSED?", "V2.CLOSE_OK? = V0.CLOSED? &",
+		"V2.CLOSE_OK? V0"};
+	for (size_t i = 0; i < sizeof(bad) / sizeof(bad[0]); ++i)
+	{
+		bool threw = false;
+		try
+		{
+			interlocks.Parse(bad[i], "bad");
+		}
+		catch (runtime_error&)
+		{
+			threw = true;
+		}
+		CHECK(threw);
+	}
+
+	// random sensors, commands now and then so the valves wander through
+	// their states, each interlock checked against Direct()
+	const int scans = 5000;
+	int mismatches = 0;
+	vector<int> seen(interlocks.RuleCount()); // bit 0: was false, bit 1: true
+	vector<int> states(count);
+	for (int s = 0; s < scans; ++s)
+	{
+		for (int i = 0; i < count; ++i)
+		{
+			unsigned long long r = Random();
+			image.WriteFieldInput(devices[i]->DigitalInputPoint("CLOSED?"), r & 1);
+			image.WriteFieldInput(devices[i]->DigitalInputPoint("OPENED?"), (r >> 1) & 1);
+			if (0 == (r >> 8) % 8)
+			{
+				int commands[] = {COMMAND_OPEN, COMMAND_CLOSE, COMMAND_RESET};
+				devices[i]->PostCommand(commands[(r >> 16) % 3]);
+			}
+			states[i] = devices[i]->State();
+		}
+		image.LatchInputs();
+		SampleScanTime();
+		interlocks.Evaluate();
+		for (int rule = 0; rule < interlocks.RuleCount(); ++rule)
+		{
+			bool expected = Direct(rule, image, devices, states);
+			seen[rule] |= 1 << expected;
+			Device& target = *plant.Registry().Find(targets[rule][0]);
+			if (interlocks.Result(rule) != expected
+				|| image.ReadInput(target.DigitalInputPoint(targets[rule][1])) != expected)
+			{
+				++mismatches;
+			}
+		}
+		for (int i = 0; i < count; ++i)
+		{
+			devices[i]->Update();
+		}
+		image.CommitOutputs();
+	}
+	CHECK(0 == mismatches);
+	for (int rule = 0; rule < interlocks.RuleCount(); ++rule)
+	{
+		CHECK((1 == rule ? 2 : 3) == seen[rule]); // rule 1 is TRUE
+	}
+
+	ostringstream detail;
+	detail << scans << " scans, " << mismatches << " mismatches";
+	End("interlock", detail.str());
+}
+
+struct PublishedReader
+{
+	const StateReader* reader;
+	int count;
+	int inputs;
+	Nanoseconds start;
+	Nanoseconds period;
+	atomic<bool> stop;
+	atomic<long> reads;
+	long torn;       // not all of one scan
+	long backwards;  // an older scan after a newer one
+};
+
+// scan k latches every digital input at k & 1 and the analogue input at
+// k, at start + k periods, so a whole scan is all alike
+static void* ReadPublished(void* arg)
+{
+	PublishedReader& reader = *static_cast<PublishedReader*>(arg);
+	StateSnapshot snapshot;
+	unsigned long long last = 0;
+	while (!reader.stop.load())
+	{
+		if (!reader.reader->Read(snapshot))
+		{
+			sched_yield();
+			continue;
+		}
+		bool torn = snapshot.analogueInputs.size() != 1 || (int)snapshot.states.size() != reader.count
+			|| (double)snapshot.scan != snapshot.analogueInputs[0]
+			|| reader.start + (Nanoseconds)snapshot.scan * reader.period != snapshot.scanTime;
+		for (int p = 0; p < reader.inputs; ++p)
+		{
+			torn |= snapshot.Input(p) != (bool)(snapshot.scan & 1);
+		}
+		reader.torn += torn;
+		reader.backwards += snapshot.scan < last;
+		last = snapshot.scan;
+		++reader.reads;
+	}
+	return NULL;
+}
+
+static void TestPublisher()
+{
+	Begin();
+	const int count = 50;
+	const unsigned long long scans = 5000;
+	const long reads = 5000;
+	Plant plant;
+	BuildPlant(plant, count);
+	ProcessImage& image = plant.Image();
+	const vector<Device*>& devices = plant.Devices();
+	image.AddAnalogueInput();
+	ostringstream name;
+	name << "/devicetest." << getpid();
+
+	bool threw = false;
+	try
+	{
+		StateReader missing(name.str());
+	}
+	catch (runtime_error&)
+	{
+		threw = true;
+	}
+	CHECK(threw);
+
+	PublishedReader published;
+	published.count = count;
+	published.inputs = image.DigitalInputCount();
+	published.start = 1000 * NANOSECONDS_PER_SECOND;
+	published.period = 10 * NANOSECONDS_PER_MILLISECOND;
+	published.stop = false;
+	published.reads = 0;
+	published.torn = 0;
+	published.backwards = 0;
+	StateReader* reader = NULL;
+	unsigned long long k = 0;
+	SetScanClockSource(CLOCK_SOURCE_VIRTUAL);
+	{
+		StatePublisher publisher(name.str(), devices, image);
+		reader = new StateReader(name.str());
+		CHECK(reader->Open());
+		CHECK(count == reader->DeviceCount());
+		CHECK(5 == reader->FindDevice("V5") && -1 == reader->FindDevice("V5?"));
+		CHECK("V7" == reader->DeviceName(7));
+		CHECK(devices[7]->NameHash() == reader->DeviceNameHash(7));
+		StateSnapshot snapshot;
+		CHECK(!reader->Read(snapshot));
+
+		published.reader = reader;
+		pthread_t thread;
+		pthread_create(&thread, NULL, ReadPublished, &published);
+		vector<ImageWord> values(image.InputWordCount());
+		vector<ImageWord> mask(image.InputWordCount(), ~(ImageWord)0);
+		while (k < scans || (published.reads < reads && k < 1000 * scans))
+		{
+			++k;
+			values.assign(values.size(), (k & 1) ? ~(ImageWord)0 : 0);
+			image.WriteFieldInputs(values.data(), mask.data());
+			image.WriteFieldAnalogueInput(0, k);
+			image.LatchInputs();
+			SetVirtualNanoseconds(published.start + k * published.period);
+			SampleScanTime();
+			image.CommitOutputs();
+			publisher.Publish();
+			if (0 == k % 100)
+			{
+				sched_yield();
+			}
+		}
+		published.stop = true;
+		pthread_join(thread, NULL);
+		CHECK(k == publisher.Published());
+		CHECK(reader->Read(snapshot) && k == snapshot.scan);
+	}
+	SetScanClockSource(CLOCK_SOURCE_MONOTONIC);
+	CHECK(!reader->Open());
+	delete reader;
+	CHECK(published.reads >= reads);
+	CHECK(0 == published.torn);
+	CHECK(0 == published.backwards);
+
+	ostringstream detail;
+	detail << k << " scans published, " << published.reads << " reads, " << published.torn
+		<< " torn";
+	End("publisher", detail.str());
+}
+
+struct Snapshot
+{
+	vector<ImageWord> inputs;
+	vector<int> states;
+	double analogue;
+};
+
+static void TestHistorian()
+{
+	Begin();
+	const int count = 200;
+	const int scans = 5000;
+	const double deadband = 0.5;
+	Plant plant;
+	BuildPlant(plant, count);
+	ProcessImage& image = plant.Image();
+	const vector<Device*>& devices = plant.Devices();
+	int analogue = image.AddAnalogueInput();
+	string directory = MakeDirectory();
+	string prefix = directory + "/history";
+
+	vector<Snapshot> snapshots;
+	unsigned long long recorded = 0;
+	SetScanClockSource(CLOCK_SOURCE_VIRTUAL);
+	{
+		Historian historian(prefix, devices, image, 16 * 1024, 4);
+		historian.SetAnalogueDeadband(deadband);
+		double level = 0.;
+		for (int s = 0; s < scans; ++s)
+		{
+			if (0 == s % 7)
+			{
+				for (int i = 0; i < count; i += 3)
+				{
+					image.WriteFieldInput(devices[i]->DigitalInputPoint("CLOSED?"), (s / 7) & 1);
+				}
+			}
+			if (0 == s % 11)
+			{
+				level += 1.;
+			}
+			image.WriteFieldAnalogueInput(analogue, level + (s & 1) * 0.1);
+			image.LatchInputs();
+			SetVirtualNanoseconds(1000 * NANOSECONDS_PER_SECOND + s * 10 * NANOSECONDS_PER_MILLISECOND);
+			SampleScanTime();
+			for (int i = 0; i < count; ++i)
+			{
+				devices[i]->Update();
+			}
+			image.CommitOutputs();
+			historian.Record();
+
+			Snapshot snapshot;
+			snapshot.inputs.assign(image.InputWords(), image.InputWords() + image.InputWordCount());
+			for (int i = 0; i < count; ++i)
+			{
+				snapshot.states.push_back(devices[i]->State());
+			}
+			snapshot.analogue = image.AnalogueInputValues()[analogue];
+			snapshots.push_back(snapshot);
+		}
+		historian.Flush();
+		CHECK(!historian.Failed());
+		CHECK(0 == historian.Dropped());
+		CHECK(historian.Segments() > 1);
+		recorded = historian.Records();
+	}
+	SetScanClockSource(CLOCK_SOURCE_MONOTONIC);
+
+	vector<string> segments = Segments(prefix);
+	int records = 0;
+	int keyframes = 0;
+	unsigned long long next = 0; // a scan that changed nothing isn't recorded
+	for (size_t i = 0; i < segments.size(); ++i)
+	{
+		HistoryReader reader(segments[i]);
+		CHECK(count == (int)reader.Header().deviceCount);
+		CHECK(devices[5]->NameHash() == reader.DeviceNameHash(5));
+		while (reader.Next())
+		{
+			CHECK(next <= reader.Scan() && reader.Scan() < snapshots.size());
+			if (reader.Scan() >= snapshots.size())
+			{
+				break;
+			}
+			next = reader.Scan() + 1;
+			const Snapshot& snapshot = snapshots[reader.Scan()];
+			CHECK(snapshot.inputs == reader.Inputs());
+			CHECK(snapshot.states == reader.States());
+			CHECK(fabs(snapshot.analogue - reader.AnalogueInputs()[analogue]) <= deadband);
+			keyframes += reader.Keyframe();
+			++records;
+		}
+	}
+	CHECK(recorded == (unsigned long long)records);
+	CHECK(records > 0);
+
+	bool threw = false;
+	try
+	{
+		HistoryReader reader("DeviceTest.cpp");
+	}
+	catch (runtime_error&)
+	{
+		threw = true;
+	}
+	CHECK(threw);
+	RemoveDirectory(directory, prefix);
+
+	ostringstream detail;
+	detail << records << " records, " << keyframes << " keyframes, " << segments.size()
+		<< " segments";
+	End("historian", detail.str());
+}
+
+// record a simulated plant: faults, random commands, now and then a
+// COMMAND_RESET and a COMMAND_OPEN in the same scan
+static void Record(const string& prefix, const int count, const int scans,
+	const Nanoseconds start, const Nanoseconds period, int& transitions, int& withinScan)
+{
+	Plant plant;
+	BuildPlant(plant, count);
+	SetTimeOuts(plant, 400 * NANOSECONDS_PER_MILLISECOND, 300 * NANOSECONDS_PER_MILLISECOND);
+	ProcessImage& image = plant.Image();
+	const vector<Device*>& devices = plant.Devices();
+	image.AddAnalogueInput();
+	PlantSimulator simulator(image, 7);
+	simulator.SetTravelTime(50 * NANOSECONDS_PER_MILLISECOND, 350 * NANOSECONDS_PER_MILLISECOND);
+	for (int i = 0; i < count; ++i)
+	{
+		simulator.AddValve(*devices[i]);
+		simulator.Place(i, true);
+	}
+	simulator.SetFaults(3, SIM_FAULT_JAMMED);
+	simulator.SetFaults(5, SIM_FAULT_NO_OPEN_OK);
+	simulator.SetFaults(8, SIM_FAULT_BOTH_SENSORS);
+
+	SetScanClockSource(CLOCK_SOURCE_VIRTUAL);
+	{
+		Historian historian(prefix, devices, image, 32 * 1024);
+		for (int s = 0; s < scans; ++s)
+		{
+			Nanoseconds now = start + s * period;
+			SetVirtualNanoseconds(now);
+			simulator.Step(now);
+			image.WriteFieldAnalogueInput(0, (s / 100) * 0.7);
+			image.LatchInputs();
+			SampleScanTime();
+			for (int k = 0; s > 5 && 0 == s % 40 && k < 5; ++k)
+			{
+				unsigned long long r = Random();
+				Device& device = *devices[r % count];
+				switch ((r >> 20) % 4)
+				{
+					case 0: device.PostCommand(COMMAND_OPEN); break;
+					case 1: device.PostCommand(COMMAND_CLOSE); break;
+					case 2: device.PostCommand(COMMAND_RESET); break;
+					case 3:
+						device.PostCommand(COMMAND_RESET);
+						device.PostCommand(COMMAND_OPEN);
+						break;
+				}
+			}
+			for (int i = 0; i < count; ++i)
+			{
+				devices[i]->Update();
+			}
+			image.CommitOutputs();
+			historian.Record();
+		}
+		historian.Flush();
+		CHECK(!historian.Failed());
+		CHECK(0 == historian.Dropped());
+	}
+	SetScanClockSource(CLOCK_SOURCE_MONOTONIC);
+
+	// a device passing through a state within one scan
+	transitions = 0;
+	withinScan = 0;
+	vector<string> segments = Segments(prefix);
+	for (size_t i = 0; i < segments.size(); ++i)
+	{
+		HistoryReader reader(segments[i]);
+		while (reader.Next())
+		{
+			const vector<HistoryTransition>& logged = reader.Transitions();
+			transitions += logged.size();
+			for (size_t k = 1; k < logged.size(); ++k)
+			{
+				withinScan += logged[k].device == logged[k - 1].device
+					&& logged[k].from == logged[k - 1].to;
+			}
+		}
+	}
+}
+
+// replay into a fresh plant, one valve's motion timeout changed if
+// timeout isn't 0. Returns the divergences.
+static unsigned long long Play(const string& prefix, const int count, const Nanoseconds timeout,
+	unsigned long long& scans)
+{
+	Plant plant;
+	BuildPlant(plant, count);
+	SetTimeOuts(plant, 400 * NANOSECONDS_PER_MILLISECOND, 300 * NANOSECONDS_PER_MILLISECOND);
+	plant.Image().AddAnalogueInput();
+	if (timeout)
+	{
+		static_cast<Valve*>(plant.Devices()[10])->SetMotionTimeOut(timeout);
+	}
+	Replay replay(plant.Devices(), plant.Image());
+	vector<string> segments = Segments(prefix);
+	for (size_t i = 0; i < segments.size(); ++i)
+	{
+		replay.Play(segments[i]);
+	}
+	scans = replay.Scans();
+	return replay.DivergenceCount();
+}
+
+static void TestReplay()
+{
+	Begin();
+	const int count = 100;
+	const int scans = 30000;
+	string directory = MakeDirectory();
+	string prefix = directory + "/replay";
+
+	int transitions = 0;
+	int withinScan = 0;
+	Record(prefix, count, scans, 1000 * NANOSECONDS_PER_SECOND, 10 * NANOSECONDS_PER_MILLISECOND,
+		transitions, withinScan);
+	CHECK(CLOCK_SOURCE_MONOTONIC == ScanClockSource());
+	CHECK(withinScan > 0);
+
+	unsigned long long replayed = 0;
+	unsigned long long divergences = Play(prefix, count, 0, replayed);
+	CHECK(0 == divergences);
+	CHECK(replayed > 0);
+	CHECK(CLOCK_SOURCE_MONOTONIC == ScanClockSource());
+	// and it does notice a difference
+	unsigned long long changed = 0;
+	CHECK(Play(prefix, count, 60 * NANOSECONDS_PER_MILLISECOND, changed) > 0);
+
+	// another plant's history
+	{
+		Plant plant;
+		BuildPlant(plant, count + 1);
+		Replay replay(plant.Devices(), plant.Image());
+		bool threw = false;
+		try
+		{
+			replay.Play(Segments(prefix)[0]);
+		}
+		catch (invalid_argument&)
+		{
+			threw = true;
+		}
+		CHECK(threw);
+	}
+	RemoveDirectory(directory, prefix);
+
+	ostringstream detail;
+	detail << replayed << " scans replayed, " << transitions << " transitions, " << withinScan
+		<< " within a scan, " << divergences << " divergences";
+	End("replay", detail.str());
+}
+
+struct Registering
+{
+	DeviceRegistry* registry;
+	const vector<Device*>* devices;
+	int names;
+	atomic<int> interned; // names interned so far
+	atomic<bool> done;
+	long lookups;
+	long wrong;
+};
+
+static int RegistryName(char* name, const size_t size, const char* kind, const int i)
+{
+	return snprintf(name, size, "registry.%s%d", kind, i);
+}
+
+// the second half of the devices, with a run of new names between each
+static void* AddDevices(void* arg)
+{
+	Registering& registering = *static_cast<Registering*>(arg);
+	const vector<Device*>& devices = *registering.devices;
+	int half = devices.size() / 2;
+	int perDevice = registering.names / half;
+	for (int i = half; i < (int)devices.size(); ++i)
+	{
+		registering.registry->Add(*devices[i]);
+		for (int k = 0; k < perDevice; ++k)
+		{
+			char name[64];
+			int n = registering.interned.load();
+			InternSymbol(name, RegistryName(name, sizeof(name), "N", n));
+			registering.interned.store(n + 1);
+		}
+	}
+	registering.done = true;
+	return NULL;
+}
+
+// the first half must always be found, the second half found as itself
+// or not at all, every name interned so far must be there
+static void LookUp(Registering& registering)
+{
+	const vector<Device*>& devices = *registering.devices;
+	const DeviceRegistry& registry = *registering.registry;
+	char name[64];
+	int half = devices.size() / 2;
+	for (int i = 0; i < (int)devices.size(); ++i)
+	{
+		Device* found = registry.Find(name, RegistryName(name, sizeof(name), "R", i));
+		Device* bySerial = registry.FindSerial(name, RegistryName(name, sizeof(name), "S", i));
+		if (i < half)
+		{
+			registering.wrong += found != devices[i] || bySerial != devices[i];
+		}
+		else
+		{
+			registering.wrong += (found && found != devices[i]) || (bySerial && bySerial != devices[i]);
+		}
+		registering.lookups += 2;
+	}
+	int interned = registering.interned.load();
+	for (int k = 0; k < interned; k += 1 + interned / 64)
+	{
+		size_t length = RegistryName(name, sizeof(name), "N", k);
+		Symbol symbol = FindSymbol(name, length);
+		registering.wrong += NO_SYMBOL == symbol || SymbolName(symbol) != name;
+		++registering.lookups;
+	}
+	registering.wrong += NO_SYMBOL != FindSymbol("registry.never", 14);
+}
+
+static void TestRegistry()
+{
+	Begin();
+	const int count = 2000;
+	const int names = 100000;
+	vector<Device*> devices;
+	for (int i = 0; i < count; ++i)
+	{
+		char name[64];
+		char serial[64];
+		RegistryName(name, sizeof(name), "R", i);
+		RegistryName(serial, sizeof(serial), "S", i);
+		devices.push_back(PlainDevice(name, serial));
+	}
+	size_t symbols = SymbolCount();
+
+	DeviceRegistry registry;
+	for (int i = 0; i < count / 2; ++i)
+	{
+		CHECK(registry.Add(*devices[i]));
+	}
+	Registering registering;
+	registering.registry = &registry;
+	registering.devices = &devices;
+	registering.names = names;
+	registering.interned = 0;
+	registering.done = false;
+	registering.lookups = 0;
+	registering.wrong = 0;
+	pthread_t thread;
+	pthread_create(&thread, NULL, AddDevices, &registering);
+	int passes = 0;
+	while (!registering.done)
+	{
+		LookUp(registering);
+		++passes;
+		sched_yield();
+	}
+	pthread_join(thread, NULL);
+	LookUp(registering); // everything there now
+	CHECK(0 == registering.wrong);
+	CHECK(passes > 0);
+	CHECK(symbols + names == SymbolCount());
+	CHECK(count == (int)registry.Count());
+
+	CHECK(!registry.Add(*devices[0]));
+	for (int i = 0; i < count; i += 2)
+	{
+		registry.Remove(*devices[i]);
+	}
+	CHECK(count / 2 == (int)registry.Count());
+	CHECK(!registry.Find(devices[0]->Name()) && !registry.FindSerial(devices[0]->SerialNumber()));
+	CHECK(devices[1] == registry.Find(devices[1]->Name()));
+	for (int i = 0; i < count; ++i)
+	{
+		delete devices[i];
+	}
+
+	ostringstream detail;
+	detail << registering.lookups << " lookups in " << passes << " passes while " << names
+		<< " names were interned";
+	End("registry", detail.str());
+}
+
+int main(int argc, char* argv[])
+{
+	try
+	{
+		TestExecutor();
+		TestOutputs();
+		TestCommands();
+		TestCheckpoint();
+		TestSequence();
+		TestInterlock();
+		TestPublisher();
+		TestHistorian();
+		TestReplay();
+		TestRegistry();
+	}
+	catch (exception& e)
+	{
+		printf("  failed: %s\n", e.what());
+		++failures;
+	}
+	printf("%d failed\n", failures);
+	return failures;
+}
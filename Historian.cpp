@@ -0,0 +1,825 @@
+///////////////////////////////////////////////////////////////////////////////
+// FILE:          Historian.cpp
+// PROJECT:       Devices 
+// SUBSYSTEM:     Device Controller 
+//-----------------------------------------------------------------------------
+// DESCRIPTION:   implementation of the monotonic and scan clocks
+//             
+// COPYRIGHT:     Karl Hoover, No Prior Art, 2009
+//
+// LICENSE:       This library is free software; you can redistribute it and/or
+//                modify it under the terms of the GNU Lesser General Public
+//                License (LGPL) as published by the Free Software Foundation.
+//                See license text at http://www.gnu.org/licenses/lgpl.txt 
+//                Briefly you can use this source code pretty much however you
+//                wish, as long as this notice remains intact and you
+//                prominently acknowledge this copyright.
+//
+//                This file is distributed in the hope that it will be useful,
+//                but WITHOUT ANY WARRANTY; without even the implied warranty
+//                of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//                IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//                CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+//                INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES.
+//
+// AUTHOR:        Karl Hoover  karl.hoover@gmail.com
+//
+// REVISIONS:     
+//
+// NOTES:   
+// see Historian.h for comments and history
+
+#include <cerrno>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "Historian.h"
+#include "device.h"
+#include "TimeMicroseconds.h"
+
+using namespace std;
+
+// single producer, single consumer ring of buffer numbers
+class HistoryQueue
+{
+public:
+	HistoryQueue(const size_t buffers): m_head(0), m_tail(0)
+	{
+		size_t size = 2;
+		while (size < buffers)
+		{
+			size *= 2;
+		}
+		m_slots.resize(size);
+		m_mask = size - 1;
+	};
+	bool Push(const int buffer)
+	{
+		size_t tail = m_tail.load(memory_order_relaxed);
+		if (tail - m_head.load(memory_order_acquire) > m_mask)
+		{
+			return false;
+		}
+		m_slots[tail & m_mask] = buffer;
+		m_tail.store(tail + 1, memory_order_release);
+		return true;
+	};
+	bool Pop(int& buffer)
+	{
+		size_t head = m_head.load(memory_order_relaxed);
+		if (head == m_tail.load(memory_order_acquire))
+		{
+			return false;
+		}
+		buffer = m_slots[head & m_mask];
+		m_head.store(head + 1, memory_order_release);
+		return true;
+	};
+private:
+	vector<int> m_slots;
+	size_t m_mask;
+	atomic<size_t> m_head;
+	atomic<size_t> m_tail;
+};
+
+static void PutVarint(vector<unsigned char>& out, unsigned long long value)
+{
+	while (value >= 0x80)
+	{
+		out.push_back((unsigned char)(value | 0x80));
+		value >>= 7;
+	}
+	out.push_back((unsigned char)value);
+}
+
+static void PutRaw(vector<unsigned char>& out, const void* data, const size_t length)
+{
+	const unsigned char* bytes = static_cast<const unsigned char*>(data);
+	out.insert(out.end(), bytes, bytes + length);
+}
+
+static unsigned int ZigZag(const int value)
+{
+	return ((unsigned int)value << 1) ^ (unsigned int)(value >> 31);
+}
+
+static int UnZigZag(const unsigned long long value)
+{
+	return (int)(value >> 1) ^ -(int)(value & 1);
+}
+
+// count, then the gap before each changed point
+static void PutPoints(vector<unsigned char>& out, const vector<int>& points)
+{
+	PutVarint(out, points.size());
+	int previous = -1;
+	for (size_t i = 0; i < points.size(); ++i)
+	{
+		PutVarint(out, points[i] - previous - 1);
+		previous = points[i];
+	}
+}
+
+// definitions for class Historian
+
+Historian::Historian(const string& prefix, const vector<Device*>& devices,
+	const ProcessImage& image, const size_t segmentBytes, const int buffers): 
+	m_prefix(prefix), m_devices(devices), m_image(image), m_segmentBytes(segmentBytes),
+	m_deadband(0.), m_lastTime(0), m_scan(0), m_lastScan(0), m_needKeyframe(true),
+	m_segmentUsed(segmentBytes), m_current(-1), m_records(0), m_dropped(0), 
+	m_handedOver(0), m_full(NULL), m_free(NULL), m_stop(false), m_buffersWritten(0), 
+	m_written(0), m_segment(0), m_failed(false), m_fd(-1)
+{
+	if (buffers < 2)
+	{
+		throw invalid_argument("Historian: needs at least 2 buffers");
+	}
+	for (size_t i = 0; i < m_devices.size(); ++i)
+	{
+		m_hashes.push_back(m_devices[i]->NameHash());
+	}
+	m_image.ReadFieldOutputs(m_digital, m_analogue);
+	for (size_t i = 0; i < m_devices.size(); ++i)
+	{
+		m_states.push_back(m_devices[i]->State());
+	}
+	m_inputs.assign(m_image.InputWordCount(), 0);
+	m_outputs.assign(m_digital.size(), 0);
+	m_analogueInputs.assign(m_image.AnalogueInputCount(), 0.);
+	m_analogueOutputs.assign(m_analogue.size(), 0.);
+	m_logs.resize(m_devices.size());
+	size_t transitionBytes = 5 + m_states.size() * (5 + 1 + (1 + HISTORY_MAX_TRANSITIONS) * 5);
+	m_keyframeBytes = 1 + 10 + 10 + m_states.size() * 5 + transitionBytes +
+		(m_inputs.size() + m_outputs.size()) * sizeof(ImageWord) +
+		(m_analogueInputs.size() + m_analogueOutputs.size()) * sizeof(double);
+	m_record.reserve(m_keyframeBytes);
+	m_transitions.reserve(transitionBytes);
+	m_changed.reserve(m_states.size());
+
+	m_buffers.resize(buffers);
+	m_full = new HistoryQueue(buffers);
+	m_free = new HistoryQueue(buffers);
+	for (int i = 0; i < buffers; ++i)
+	{
+		m_buffers[i].data.resize(max((size_t)HISTORY_BUFFER_BYTES, 2 * m_keyframeBytes));
+		m_buffers[i].used = 0;
+		m_buffers[i].startsSegment = false;
+		m_buffers[i].started = 0;
+		m_free->Push(i);
+	}
+	if (pthread_create(&m_thread, NULL, Run, this))
+	{
+		delete m_full;
+		delete m_free;
+		throw runtime_error(m_prefix + ": cannot start historian thread");
+	}
+	for (size_t i = 0; i < m_devices.size(); ++i)
+	{
+		m_logs[i].reserve(1 + HISTORY_MAX_TRANSITIONS);
+		m_devices[i]->SetStateLog(&m_logs[i]);
+	}
+}
+
+Historian::~Historian()
+{
+	for (size_t i = 0; i < m_devices.size(); ++i)
+	{
+		if (m_devices[i]->StateLog() == &m_logs[i])
+		{
+			m_devices[i]->SetStateLog(NULL);
+		}
+	}
+	if (m_current >= 0)
+	{
+		HandOver();
+	}
+	m_stop.store(true);
+	pthread_join(m_thread, NULL);
+	Drain();
+	if (m_fd >= 0)
+	{
+		close(m_fd);
+	}
+	delete m_full;
+	delete m_free;
+}
+
+void Historian::Record()
+{
+	Nanoseconds now = ScanTime();
+	m_image.ReadFieldOutputs(m_digital, m_analogue);
+	bool startSegment = m_segmentUsed >= m_segmentBytes;
+	bool keyframe = m_needKeyframe || startSegment;
+	bool record = true;
+	Transitions();
+	if (!keyframe)
+	{
+		record = Delta(now);
+		keyframe = m_record.size() > m_keyframeBytes;
+	}
+	if (keyframe)
+	{
+		Keyframe(now);
+	}
+	if (record)
+	{
+		if (Append(startSegment))
+		{
+			m_needKeyframe = false;
+			m_lastTime = now;
+			m_lastScan = m_scan;
+			++m_records;
+		}
+		else
+		{
+			++m_dropped;
+			m_needKeyframe = true;
+		}
+	}
+	if (m_current >= 0 && 
+		MonotonicNanoseconds() - m_buffers[m_current].started >= HISTORY_HANDOVER_INTERVAL)
+	{
+		HandOver();
+	}
+	++m_scan;
+}
+
+void Historian::Flush()
+{
+	if (m_current >= 0)
+	{
+		HandOver();
+	}
+	struct timespec idle = {0, 1000000};
+	while (m_buffersWritten.load(memory_order_acquire) < m_handedOver)
+	{
+		nanosleep(&idle, NULL);
+	}
+}
+
+// the changed digital points of one image against the last recorded
+static void ChangedBits(const ImageWord* now, vector<ImageWord>& last, vector<int>& changed)
+{
+	changed.clear();
+	for (size_t w = 0; w < last.size(); ++w)
+	{
+		ImageWord bits = now[w] ^ last[w];
+		if (bits)
+		{
+			last[w] = now[w];
+			do
+			{
+				changed.push_back(w * IMAGE_WORD_BITS + __builtin_ctzll(bits));
+				bits &= bits - 1;
+			} while (bits);
+		}
+	}
+}
+
+// count, then gap and value of each point moved beyond the deadband
+static void PutAnalogue(vector<unsigned char>& out, const double* now, vector<double>& last,
+	const double deadband, vector<int>& changed)
+{
+	changed.clear();
+	for (size_t i = 0; i < last.size(); ++i)
+	{
+		if (!(fabs(now[i] - last[i]) <= deadband)) // NaN counts as moved
+		{
+			last[i] = now[i];
+			changed.push_back(i);
+		}
+	}
+	PutVarint(out, changed.size());
+	int previous = -1;
+	for (size_t i = 0; i < changed.size(); ++i)
+	{
+		PutVarint(out, changed[i] - previous - 1);
+		PutRaw(out, &last[changed[i]], sizeof(double));
+		previous = changed[i];
+	}
+}
+
+// count, then per device that changed: gap, count of states entered, the
+// state it started from and the states entered
+void Historian::Transitions()
+{
+	m_changed.clear();
+	for (size_t i = 0; i < m_devices.size(); ++i)
+	{
+		if (!m_logs[i].empty() || m_devices[i]->State() != m_states[i])
+		{
+			m_changed.push_back(i);
+		}
+	}
+	m_transitions.clear();
+	PutVarint(m_transitions, m_changed.size());
+	int previous = -1;
+	for (size_t c = 0; c < m_changed.size(); ++c)
+	{
+		int i = m_changed[c];
+		vector<int>& log = m_logs[i];
+		if (log.empty()) // changed before the log was set
+		{
+			log.push_back(m_states[i]);
+			log.push_back(m_devices[i]->State());
+		}
+		PutVarint(m_transitions, i - previous - 1);
+		PutVarint(m_transitions, log.size() - 1);
+		for (size_t k = 0; k < log.size(); ++k)
+		{
+			PutVarint(m_transitions, ZigZag(log[k]));
+		}
+		m_states[i] = log.back();
+		log.clear();
+		previous = i;
+	}
+}
+
+bool Historian::Delta(const Nanoseconds now)
+{
+	m_record.clear();
+	m_record.push_back(HISTORY_DELTA);
+	PutVarint(m_record, now > m_lastTime ? now - m_lastTime : 0);
+	PutVarint(m_record, m_scan - m_lastScan);
+	size_t empty = m_record.size() + 5; // five zero counts
+
+	ChangedBits(m_image.InputWords(), m_inputs, m_changed);
+	PutPoints(m_record, m_changed);
+	ChangedBits(m_digital.empty() ? NULL : &m_digital[0], m_outputs, m_changed);
+	PutPoints(m_record, m_changed);
+
+	PutRaw(m_record, m_transitions.data(), m_transitions.size());
+
+	PutAnalogue(m_record, m_image.AnalogueInputValues(), m_analogueInputs, m_deadband, 
+		m_changed);
+	PutAnalogue(m_record, m_analogue.empty() ? NULL : &m_analogue[0], m_analogueOutputs, 
+		m_deadband, m_changed);
+	return m_record.size() > empty;
+}
+
+void Historian::Keyframe(const Nanoseconds now)
+{
+	m_record.clear();
+	m_record.push_back(HISTORY_KEYFRAME);
+	PutVarint(m_record, now);
+	PutVarint(m_record, m_scan);
+	for (size_t i = 0; i < m_devices.size(); ++i)
+	{
+		m_states[i] = m_devices[i]->State();
+		PutVarint(m_record, ZigZag(m_states[i]));
+	}
+	PutRaw(m_record, m_transitions.data(), m_transitions.size());
+	m_inputs.assign(m_image.InputWords(), m_image.InputWords() + m_inputs.size());
+	m_outputs = m_digital;
+	const double* analogue = m_image.AnalogueInputValues();
+	m_analogueInputs.assign(analogue, analogue + m_analogueInputs.size());
+	m_analogueOutputs = m_analogue;
+	PutRaw(m_record, m_inputs.data(), m_inputs.size() * sizeof(ImageWord));
+	PutRaw(m_record, m_outputs.data(), m_outputs.size() * sizeof(ImageWord));
+	PutRaw(m_record, m_analogueInputs.data(), m_analogueInputs.size() * sizeof(double));
+	PutRaw(m_record, m_analogueOutputs.data(), m_analogueOutputs.size() * sizeof(double));
+}
+
+bool Historian::Append(const bool startSegment)
+{
+	if (m_current >= 0 && (startSegment || 
+		m_buffers[m_current].used + m_record.size() > m_buffers[m_current].data.size()))
+	{
+		HandOver();
+	}
+	if (m_current < 0)
+	{
+		int buffer;
+		if (!m_free->Pop(buffer))
+		{
+			return false;
+		}
+		m_current = buffer;
+		m_buffers[buffer].used = 0;
+		m_buffers[buffer].startsSegment = startSegment;
+		m_buffers[buffer].started = MonotonicNanoseconds();
+	}
+	Buffer& buffer = m_buffers[m_current];
+	memcpy(&buffer.data[buffer.used], &m_record[0], m_record.size());
+	buffer.used += m_record.size();
+	if (startSegment)
+	{
+		m_segmentUsed = 0;
+	}
+	m_segmentUsed += m_record.size();
+	return true;
+}
+
+bool Historian::HandOver()
+{
+	m_full->Push(m_current); // holds every buffer, can't be full
+	m_current = -1;
+	++m_handedOver;
+	return true;
+}
+
+void* Historian::Run(void* historian)
+{
+	Historian* self = static_cast<Historian*>(historian);
+	struct timespec idle = {0, 1000000};
+	while (!self->m_stop.load(memory_order_relaxed))
+	{
+		if (0 == self->Drain())
+		{
+			nanosleep(&idle, NULL);
+		}
+	}
+	return NULL;
+}
+
+size_t Historian::Drain()
+{
+	size_t count = 0;
+	int buffer;
+	while (m_full->Pop(buffer))
+	{
+		Write(m_buffers[buffer]);
+		m_free->Push(buffer);
+		m_buffersWritten.fetch_add(1, memory_order_release);
+		++count;
+	}
+	return count;
+}
+
+void Historian::OpenSegment()
+{
+	if (m_fd >= 0)
+	{
+		close(m_fd);
+	}
+	unsigned int segment = m_segment.load(memory_order_relaxed);
+	char suffix[32];
+	snprintf(suffix, sizeof(suffix), ".%06u.hist", segment);
+	m_fd = open((m_prefix + suffix).c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (m_fd < 0)
+	{
+		m_failed.store(true, memory_order_relaxed);
+		return;
+	}
+	HistoryFileHeader header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, "DEVHISTO", sizeof(header.magic));
+	header.version = HISTORY_VERSION;
+	header.segment = segment;
+	header.deviceCount = m_states.size();
+	header.inputWords = m_inputs.size();
+	header.outputWords = m_outputs.size();
+	header.analogueInputs = m_analogueInputs.size();
+	header.analogueOutputs = m_analogueOutputs.size();
+	header.startedAt = TimeMicroseconds();
+	m_segment.store(segment + 1, memory_order_relaxed);
+	vector<unsigned char> start;
+	PutRaw(start, &header, sizeof(header));
+	PutRaw(start, m_hashes.data(), m_hashes.size() * sizeof(unsigned long long));
+	Buffer preamble;
+	preamble.data.swap(start);
+	preamble.used = preamble.data.size();
+	preamble.startsSegment = false;
+	Write(preamble);
+}
+
+void Historian::Write(Buffer& buffer)
+{
+	if (buffer.startsSegment)
+	{
+		buffer.startsSegment = false;
+		OpenSegment();
+	}
+	if (m_fd < 0)
+	{
+		return;
+	}
+	const unsigned char* data = &buffer.data[0];
+	size_t length = buffer.used;
+	while (length > 0)
+	{
+		ssize_t written = write(m_fd, data, length);
+		if (written < 0)
+		{
+			if (EINTR == errno)
+			{
+				continue;
+			}
+			m_failed.store(true, memory_order_relaxed);
+			return;
+		}
+		data += written;
+		length -= written;
+	}
+	m_written.fetch_add(buffer.used, memory_order_relaxed);
+}
+
+// definitions for class HistoryReader
+
+HistoryReader::HistoryReader(const string& path): m_position(0), m_first(true), 
+	m_keyframe(false), m_time(0), m_scan(0)
+{
+	FILE* file = fopen(path.c_str(), "rb");
+	if (!file)
+	{
+		throw runtime_error(path + ": cannot open history");
+	}
+	unsigned char chunk[65536];
+	size_t count;
+	while ((count = fread(chunk, 1, sizeof(chunk), file)) > 0)
+	{
+		m_data.insert(m_data.end(), chunk, chunk + count);
+	}
+	fclose(file);
+	if (!Raw(&m_header, sizeof(m_header)) || memcmp(m_header.magic, "DEVHISTO", 8) ||
+		HISTORY_VERSION != m_header.version)
+	{
+		throw runtime_error(path + ": not a history segment");
+	}
+	// nothing is sized from the header before the file is known to hold
+	// it: the hashes follow the header, and the first record is a keyframe
+	// with the whole image in it
+	if (m_header.deviceCount > (m_data.size() - m_position) / sizeof(unsigned long long))
+	{
+		throw runtime_error(path + ": truncated history segment");
+	}
+	m_hashes.resize(m_header.deviceCount);
+	Raw(m_hashes.data(), m_hashes.size() * sizeof(unsigned long long));
+	m_states.assign(m_header.deviceCount, 0);
+	if (m_position == m_data.size())
+	{
+		return; // cut short before its first record, Next() is false
+	}
+	unsigned long long image = 
+		((unsigned long long)m_header.inputWords + m_header.outputWords) * sizeof(ImageWord) +
+		((unsigned long long)m_header.analogueInputs + m_header.analogueOutputs) * sizeof(double);
+	if (image > m_data.size() - m_position)
+	{
+		throw runtime_error(path + ": corrupt history segment header");
+	}
+	m_inputs.assign(m_header.inputWords, 0);
+	m_outputs.assign(m_header.outputWords, 0);
+	m_analogueInputs.assign(m_header.analogueInputs, 0.);
+	m_analogueOutputs.assign(m_header.analogueOutputs, 0.);
+}
+
+bool HistoryReader::Next()
+{
+	m_changedInputs.clear();
+	m_changedOutputs.clear();
+	m_changedDevices.clear();
+	m_changedAnalogueInputs.clear();
+	m_changedAnalogueOutputs.clear();
+	m_transitions.clear();
+	if (m_position >= m_data.size())
+	{
+		return false;
+	}
+	unsigned char type = m_data[m_position++];
+	bool ok = false;
+	if (HISTORY_KEYFRAME == type)
+	{
+		ok = ReadKeyframe();
+	}
+	else if (HISTORY_DELTA == type && !m_first)
+	{
+		ok = ReadDelta();
+	}
+	if (!ok)
+	{
+		m_position = m_data.size(); // a segment cut short by a crash ends here
+		return false;
+	}
+	m_first = false;
+	return true;
+}
+
+bool HistoryReader::Varint(unsigned long long& value)
+{
+	value = 0;
+	for (int shift = 0; shift < 64 && m_position < m_data.size(); shift += 7)
+	{
+		unsigned char byte = m_data[m_position++];
+		value |= (unsigned long long)(byte & 0x7f) << shift;
+		if (!(byte & 0x80))
+		{
+			return true;
+		}
+	}
+	return false;
+}
+
+bool HistoryReader::Raw(void* data, const size_t length)
+{
+	if (m_data.size() - m_position < length)
+	{
+		return false;
+	}
+	if (length)
+	{
+		memcpy(data, &m_data[m_position], length);
+	}
+	m_position += length;
+	return true;
+}
+
+// count and gaps, toggling each point
+bool HistoryReader::Bits(vector<ImageWord>& words, vector<int>& changed)
+{
+	unsigned long long count;
+	if (!Varint(count))
+	{
+		return false;
+	}
+	long long point = -1;
+	for (unsigned long long i = 0; i < count; ++i)
+	{
+		unsigned long long gap;
+		if (!Varint(gap))
+		{
+			return false;
+		}
+		if (gap >= (unsigned long long)((long long)words.size() * IMAGE_WORD_BITS - point - 1))
+		{
+			return false; // past the last point
+		}
+		point += gap + 1;
+		words[point / IMAGE_WORD_BITS] ^= (ImageWord)1 << (point % IMAGE_WORD_BITS);
+		changed.push_back(point);
+	}
+	return true;
+}
+
+bool HistoryReader::Analogue(vector<double>& values, vector<int>& changed)
+{
+	unsigned long long count;
+	if (!Varint(count))
+	{
+		return false;
+	}
+	long long point = -1;
+	for (unsigned long long i = 0; i < count; ++i)
+	{
+		unsigned long long gap;
+		if (!Varint(gap))
+		{
+			return false;
+		}
+		if (gap >= (unsigned long long)((long long)values.size() - point - 1))
+		{
+			return false;
+		}
+		point += gap + 1;
+		if (!Raw(&values[point], sizeof(double)))
+		{
+			return false;
+		}
+		changed.push_back(point);
+	}
+	return true;
+}
+
+bool HistoryReader::ReadDelta()
+{
+	unsigned long long time;
+	unsigned long long scans;
+	if (!Varint(time) || !Varint(scans))
+	{
+		return false;
+	}
+	m_time += time;
+	m_scan += scans;
+	m_keyframe = false;
+	if (!Bits(m_inputs, m_changedInputs) || !Bits(m_outputs, m_changedOutputs))
+	{
+		return false;
+	}
+	return ReadTransitions(true) && Analogue(m_analogueInputs, m_changedAnalogueInputs) && 
+		Analogue(m_analogueOutputs, m_changedAnalogueOutputs);
+}
+
+bool HistoryReader::ReadTransitions(const bool apply)
+{
+	unsigned long long count;
+	if (!Varint(count))
+	{
+		return false;
+	}
+	long long device = -1;
+	for (unsigned long long i = 0; i < count; ++i)
+	{
+		unsigned long long gap;
+		unsigned long long entered;
+		unsigned long long state;
+		if (!Varint(gap) || !Varint(entered) || !Varint(state))
+		{
+			return false;
+		}
+		if (gap >= (unsigned long long)((long long)m_states.size() - device - 1) ||
+			0 == entered || entered > HISTORY_MAX_TRANSITIONS)
+		{
+			return false;
+		}
+		device += gap + 1;
+		HistoryTransition transition = {(int)device, UnZigZag(state), 0};
+		for (unsigned long long k = 0; k < entered; ++k)
+		{
+			if (!Varint(state))
+			{
+				return false;
+			}
+			transition.to = UnZigZag(state);
+			m_transitions.push_back(transition);
+			transition.from = transition.to;
+		}
+		if (apply)
+		{
+			m_states[device] = transition.to;
+			m_changedDevices.push_back(device);
+		}
+	}
+	return true;
+}
+
+// the changed bits of two images
+static void DiffBits(const vector<ImageWord>& before, const vector<ImageWord>& after,
+	const bool all, vector<int>& changed)
+{
+	for (size_t w = 0; w < after.size(); ++w)
+	{
+		ImageWord bits = all ? ~(ImageWord)0 : before[w] ^ after[w];
+		for (; bits; bits &= bits - 1)
+		{
+			changed.push_back(w * IMAGE_WORD_BITS + __builtin_ctzll(bits));
+		}
+	}
+}
+
+bool HistoryReader::ReadKeyframe()
+{
+	unsigned long long time;
+	unsigned long long scan;
+	if (!Varint(time) || !Varint(scan))
+	{
+		return false;
+	}
+	m_time = time;
+	m_scan = scan;
+	m_keyframe = true;
+	for (size_t i = 0; i < m_states.size(); ++i)
+	{
+		unsigned long long state;
+		if (!Varint(state))
+		{
+			return false;
+		}
+		if (m_first || UnZigZag(state) != m_states[i])
+		{
+			m_changedDevices.push_back(i);
+		}
+		m_states[i] = UnZigZag(state);
+	}
+	if (!ReadTransitions(false))
+	{
+		return false;
+	}
+	vector<ImageWord> inputs(m_inputs.size());
+	vector<ImageWord> outputs(m_outputs.size());
+	vector<double> analogueInputs(m_analogueInputs.size());
+	vector<double> analogueOutputs(m_analogueOutputs.size());
+	if (!Raw(inputs.data(), inputs.size() * sizeof(ImageWord)) ||
+		!Raw(outputs.data(), outputs.size() * sizeof(ImageWord)) ||
+		!Raw(analogueInputs.data(), analogueInputs.size() * sizeof(double)) ||
+		!Raw(analogueOutputs.data(), analogueOutputs.size() * sizeof(double)))
+	{
+		return false;
+	}
+	DiffBits(m_inputs, inputs, m_first, m_changedInputs);
+	DiffBits(m_outputs, outputs, m_first, m_changedOutputs);
+	for (size_t i = 0; i < analogueInputs.size(); ++i)
+	{
+		if (m_first || analogueInputs[i] != m_analogueInputs[i])
+		{
+			m_changedAnalogueInputs.push_back(i);
+		}
+	}
+	for (size_t i = 0; i < analogueOutputs.size(); ++i)
+	{
+		if (m_first || analogueOutputs[i] != m_analogueOutputs[i])
+		{
+			m_changedAnalogueOutputs.push_back(i);
+		}
+	}
+	m_inputs.swap(inputs);
+	m_outputs.swap(outputs);
+	m_analogueInputs.swap(analogueInputs);
+	m_analogueOutputs.swap(analogueOutputs);
+	return true;
+}
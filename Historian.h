@@ -0,0 +1,280 @@
+///////////////////////////////////////////////////////////////////////////////
+// FILE:          Historian.h
+// PROJECT:       Devices 
+// SUBSYSTEM:     Device Controller 
+//-----------------------------------------------------------------------------
+// DESCRIPTION:   compressed history of the IO image and device states
+//             
+// COPYRIGHT:     Karl Hoover, No Prior Art, 2009
+//
+// LICENSE:       This library is free software; you can redistribute it and/or
+//                modify it under the terms of the GNU Lesser General Public
+//                License (LGPL) as published by the Free Software Foundation.
+//                See license text at http://www.gnu.org/licenses/lgpl.txt 
+//                Briefly you can use this source code pretty much however you
+//                wish, as long as this notice remains intact and you
+//                prominently acknowledge this copyright.
+//
+//                This file is distributed in the hope that it will be useful,
+//                but WITHOUT ANY WARRANTY; without even the implied warranty
+//                of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//                IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//                CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+//                INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES.
+//
+// AUTHOR:        Karl Hoover  karl.hoover@gmail.com
+//
+// REVISIONS:     1.0 October 16, 2026
+//
+// NOTES:   
+// For post-mortems the Historian keeps every change of every digital
+// point and every device state transition, and of the analogue values
+// beyond a deadband. Once per scan, after CommitOutputs(), Record()
+// compares the image against what it recorded last and encodes only the
+// differences; a scan with none costs the compare and nothing else. The
+// file I/O is done by the historian's own thread.
+//
+// A device can go through more than one state in one Update(), IDLE to
+// OPENING to INVALID for instance, and sampling the states once per scan
+// would lose the ones in between. So the historian gives each device a
+// state log (StateObject::SetStateLog), which the device appends its
+// transitions to, and Record() encodes and empties the logs. A device is
+// updated by one thread at a time, so the logs need no locking. At most
+// HISTORY_MAX_TRANSITIONS states entered are kept per device and scan,
+// after that the last one is overwritten, so the state a scan leaves a
+// device in is always right. One Historian at a time per device.
+//
+// The encoding is meant to be small rather than clever:
+//
+//     varint           LEB128, 7 bits a byte, small numbers are 1 byte
+//     time, scan       as the difference from the record before, so a
+//                      quiet plant is a run of unrecorded scans, not a
+//                      record per scan
+//     digital points   the changed point numbers, each as the gap from the
+//                      previous changed point, i.e. run lengths of the XOR
+//                      of two scans. The reader toggles them.
+//     states           per device that changed in the scan: gap, count,
+//                      the state it started from and the states entered,
+//                      in order (zigzag)
+//     analogue         gap and the 8 bytes of the double per changed point
+//
+// A keyframe record has everything in full, and the scan's transitions as
+// a delta has them. Every segment file starts with one, so each segment can
+// be read on its own, and one is written wherever a delta would be bigger
+// than a keyframe or records had to be dropped.
+//
+// Memory is bounded: the scan thread encodes into one of a fixed number of
+// buffers, and hands a buffer to the writer thread when it is full, or
+// HISTORY_HANDOVER_INTERVAL after its first record so a quiet plant still
+// gets to disk. That is real time, MonotonicNanoseconds(), not the scan
+// clock, which a replay (see Replay.h) runs much faster. If the writer
+// falls behind and there is no free buffer the scan's changes are dropped
+// and counted, the scan never waits for the disk, and the next record is a
+// keyframe. Segments are named prefix.000000.hist, prefix.000001.hist, ...
+// and a new one is started once segmentBytes have gone into the current
+// one. Old segments are never touched again, deleting them is up to the
+// operator.
+//
+// A segment is a HistoryFileHeader, the device name hashes (as
+// CheckpointNameHash) and the records, in the host's byte order.
+// HistoryReader reads one back scan by scan.
+
+#ifndef HISTORIAN_H
+#define HISTORIAN_H
+
+#include <string>
+#include <vector>
+#include <atomic>
+#include <cstddef>
+
+#include <pthread.h>
+
+#include "ScanClock.h"
+#include "ProcessImage.h"
+
+class Device;
+
+#define HISTORY_VERSION 2
+#define DEFAULT_HISTORY_SEGMENT_BYTES (64 * 1024 * 1024)
+#define DEFAULT_HISTORY_BUFFERS 8
+#define HISTORY_BUFFER_BYTES (256 * 1024)       // at least, or 2 keyframes
+#define HISTORY_HANDOVER_INTERVAL (100 * NANOSECONDS_PER_MILLISECOND)
+#define HISTORY_MAX_TRANSITIONS 4 // states entered, per device and scan
+
+#define HISTORY_KEYFRAME 1  // record types
+#define HISTORY_DELTA 2
+
+struct HistoryFileHeader
+{
+	char magic[8];              // "DEVHISTO"
+	unsigned int version;       // HISTORY_VERSION
+	unsigned int segment;       // 0, 1, ...
+	unsigned int deviceCount;
+	unsigned int inputWords;
+	unsigned int outputWords;
+	unsigned int analogueInputs;
+	unsigned int analogueOutputs;
+	unsigned int reserved;
+	unsigned long long startedAt; // wall clock, TimeMicroseconds(), for people
+};
+
+class HistoryQueue;
+
+struct HistoryTransition
+{
+	int device; // index
+	int from;   // states
+	int to;
+};
+
+class Historian
+{
+public:
+	// starts the writer thread; throws runtime_error if it can't. The
+	// first segment is created with the first buffer written.
+	Historian(const std::string& prefix, const std::vector<Device*>& devices,
+		const ProcessImage& image, const size_t segmentBytes = DEFAULT_HISTORY_SEGMENT_BYTES,
+		const int buffers = DEFAULT_HISTORY_BUFFERS);
+	~Historian(); // writes what's recorded, once the scan has stopped,
+	              // and takes the state logs off the devices
+	// analogue values are recorded when they move more than this from the
+	// value last recorded, default 0. Before the first Record().
+	void SetAnalogueDeadband(const double deadband) {m_deadband = deadband;};
+
+	void Record(); // scan thread, after CommitOutputs()
+	void Flush();  // scan thread: returns once everything recorded is written
+
+	// statistics
+	unsigned long long Records() const {return m_records;};   // scan thread
+	unsigned long long Dropped() const {return m_dropped;};   // scan thread
+	unsigned long long Written() const {return m_written.load(std::memory_order_relaxed);}; // bytes
+	unsigned int Segments() const {return m_segment.load(std::memory_order_relaxed);};
+	bool Failed() const {return m_failed.load(std::memory_order_relaxed);}; // a write failed
+
+private:
+	Historian(const Historian&);
+	Historian& operator=(const Historian&);
+	struct Buffer
+	{
+		std::vector<unsigned char> data; // sized once, never grows
+		size_t used;
+		bool startsSegment;
+		Nanoseconds started; // MonotonicNanoseconds() of its first record
+	};
+	void Transitions(); // the state logs into m_transitions, emptying them
+	bool Delta(const Nanoseconds now); // into m_record, false if nothing changed
+	void Keyframe(const Nanoseconds now);
+	bool Append(const bool startSegment); // m_record to a buffer, false if none free
+	bool HandOver(); // the current buffer to the writer
+	static void* Run(void* historian);
+	size_t Drain();  // writer thread, returns buffers written
+	void Write(Buffer& buffer);
+	void OpenSegment();
+
+	std::string m_prefix;
+	const std::vector<Device*>& m_devices;
+	const ProcessImage& m_image;
+	std::vector<unsigned long long> m_hashes; // of the device names
+	size_t m_segmentBytes;
+	double m_deadband;
+
+	// scan thread: as last recorded
+	std::vector<int> m_states;
+	std::vector<ImageWord> m_inputs;
+	std::vector<ImageWord> m_outputs;
+	std::vector<double> m_analogueInputs;
+	std::vector<double> m_analogueOutputs;
+	std::vector<std::vector<int> > m_logs; // per device, see StateObject::SetStateLog
+	std::vector<unsigned char> m_transitions; // this scan's, encoded
+	std::vector<ImageWord> m_digital;   // scratch for ReadFieldOutputs
+	std::vector<double> m_analogue;
+	std::vector<unsigned char> m_record; // being encoded
+	std::vector<int> m_changed;          // scratch
+	Nanoseconds m_lastTime;
+	unsigned long long m_scan;
+	unsigned long long m_lastScan;
+	bool m_needKeyframe;
+	size_t m_keyframeBytes; // at most
+	size_t m_segmentUsed;   // bytes appended since the last segment start
+	int m_current;          // buffer being filled, -1: none
+	unsigned long long m_records;
+	unsigned long long m_dropped;
+	unsigned long long m_handedOver;
+
+	std::vector<Buffer> m_buffers;
+	HistoryQueue* m_full; // scan thread to writer
+	HistoryQueue* m_free; // writer to scan thread
+	pthread_t m_thread;
+	std::atomic<bool> m_stop;
+	std::atomic<unsigned long long> m_buffersWritten;
+	std::atomic<unsigned long long> m_written;
+	std::atomic<unsigned int> m_segment; // segments opened
+	std::atomic<bool> m_failed;
+	int m_fd;  // writer thread
+};
+
+// one segment, record by record, with the whole state after each record
+class HistoryReader
+{
+public:
+	// reads the file; throws runtime_error if it isn't a history segment
+	HistoryReader(const std::string& path);
+	bool Next(); // false at the end, or at a truncated or corrupt record
+	const HistoryFileHeader& Header() const {return m_header;};
+	unsigned long long DeviceNameHash(const int device) const {return m_hashes[device];};
+
+	// as of the last record read
+	bool Keyframe() const {return m_keyframe;};
+	Nanoseconds Time() const {return m_time;};   // ScanTime() of the scan
+	unsigned long long Scan() const {return m_scan;}; // Record() calls before it
+	const std::vector<int>& States() const {return m_states;};
+	const std::vector<ImageWord>& Inputs() const {return m_inputs;};
+	const std::vector<ImageWord>& Outputs() const {return m_outputs;};
+	const std::vector<double>& AnalogueInputs() const {return m_analogueInputs;};
+	const std::vector<double>& AnalogueOutputs() const {return m_analogueOutputs;};
+	bool Input(const int point) const 
+		{return (m_inputs[point / IMAGE_WORD_BITS] >> (point % IMAGE_WORD_BITS)) & 1;};
+	bool Output(const int point) const 
+		{return (m_outputs[point / IMAGE_WORD_BITS] >> (point % IMAGE_WORD_BITS)) & 1;};
+	// what the last record changed; a keyframe lists nothing
+	const std::vector<int>& ChangedInputs() const {return m_changedInputs;};
+	const std::vector<int>& ChangedOutputs() const {return m_changedOutputs;};
+	const std::vector<int>& ChangedDevices() const {return m_changedDevices;};
+	// every state transition in the scan, a device's in order, keyframes
+	// included
+	const std::vector<HistoryTransition>& Transitions() const {return m_transitions;};
+	const std::vector<int>& ChangedAnalogueInputs() const {return m_changedAnalogueInputs;};
+	const std::vector<int>& ChangedAnalogueOutputs() const {return m_changedAnalogueOutputs;};
+
+private:
+	bool Varint(unsigned long long& value);
+	bool Bits(std::vector<ImageWord>& words, std::vector<int>& changed);
+	bool Analogue(std::vector<double>& values, std::vector<int>& changed);
+	bool Raw(void* data, const size_t length);
+	bool ReadTransitions(const bool apply); // to m_states if apply
+	bool ReadKeyframe();
+	bool ReadDelta();
+
+	HistoryFileHeader m_header;
+	std::vector<unsigned long long> m_hashes;
+	std::vector<unsigned char> m_data;
+	size_t m_position;
+	bool m_first;
+	bool m_keyframe;
+	Nanoseconds m_time;
+	unsigned long long m_scan;
+	std::vector<int> m_states;
+	std::vector<ImageWord> m_inputs;
+	std::vector<ImageWord> m_outputs;
+	std::vector<double> m_analogueInputs;
+	std::vector<double> m_analogueOutputs;
+	std::vector<int> m_changedInputs;
+	std::vector<int> m_changedOutputs;
+	std::vector<int> m_changedDevices;
+	std::vector<int> m_changedAnalogueInputs;
+	std::vector<int> m_changedAnalogueOutputs;
+	std::vector<HistoryTransition> m_transitions;
+};
+
+#endif // HISTORIAN_H
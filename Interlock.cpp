@@ -0,0 +1,492 @@
+///////////////////////////////////////////////////////////////////////////////
+// FILE:          Interlock.cpp
+// PROJECT:       Devices 
+// SUBSYSTEM:     Device Controller 
+//-----------------------------------------------------------------------------
+// DESCRIPTION:   implementation of the interlock rule engine
+//             
+// COPYRIGHT:     Karl Hoover, No Prior Art, 2009
+//
+// LICENSE:       This library is free software; you can redistribute it and/or
+//                modify it under the terms of the GNU Lesser General Public
+//                License (LGPL) as published by the Free Software Foundation.
+//                See license text at http://www.gnu.org/licenses/lgpl.txt 
+//                Briefly you can use this source code pretty much however you
+//                wish, as long as this notice remains intact and you
+//                prominently acknowledge this copyright.
+//
+//                This file is distributed in the hope that it will be useful,
+//                but WITHOUT ANY WARRANTY; without even the implied warranty
+//                of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//                IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//                CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+//                INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES.
+//
+// AUTHOR:        Karl Hoover  karl.hoover@gmail.com
+//
+// REVISIONS:     
+//
+// NOTES:   
+// see Interlock.h for comments and history
+
+#include <cstring>
+#include <cctype>
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+
+#include "Interlock.h"
+#include "device.h"
+
+typedef InterlockEngine::Term Term;
+typedef InterlockEngine::Terms Terms;
+
+// expressions straight to DNF, by recursive descent
+class RuleParser
+{
+public:
+	RuleParser(InterlockEngine& engine, const string& text): m_engine(engine), 
+		m_text(text), m_position(0) {};
+	Terms Parse()
+	{
+		Terms terms = Or();
+		if (!Next().empty())
+		{
+			throw invalid_argument("unexpected " + m_token);
+		}
+		return terms;
+	};
+	
+	static Terms True() {return Terms(1);};  // one term, no literals
+	static Terms False() {return Terms();};
+	static Terms Disjunction(const Terms& a, const Terms& b);
+	static Terms Conjunction(const Terms& a, const Terms& b);
+	static Terms Negation(const Terms& a);
+
+private:
+	Terms Or();
+	Terms And();
+	Terms Unary();
+	const string& Peek();
+	const string& Next();
+
+	InterlockEngine& m_engine;
+	const string& m_text;
+	size_t m_position;
+	string m_token;
+};
+
+static bool Operator(const string& token, const char* symbol, const char* word, 
+	const char* upper)
+{
+	return token == symbol || token == word || token == upper;
+}
+
+static void Simplify(Terms& terms)
+{
+	sort(terms.begin(), terms.end());
+	terms.erase(unique(terms.begin(), terms.end()), terms.end());
+	if (terms.size() > MAX_INTERLOCK_TERMS)
+	{
+		throw invalid_argument("too many terms, simplify the rule");
+	}
+}
+
+Terms RuleParser::Disjunction(const Terms& a, const Terms& b)
+{
+	Terms terms(a);
+	terms.insert(terms.end(), b.begin(), b.end());
+	Simplify(terms);
+	return terms;
+}
+
+Terms RuleParser::Conjunction(const Terms& a, const Terms& b)
+{
+	Terms terms;
+	for (size_t i = 0; i < a.size(); ++i)
+	{
+		for (size_t j = 0; j < b.size(); ++j)
+		{
+			Term term;
+			set_union(a[i].begin(), a[i].end(), b[j].begin(), b[j].end(), 
+				back_inserter(term));
+			bool contradiction = false;
+			for (size_t k = 1; k < term.size() && !contradiction; ++k)
+			{
+				contradiction = term[k] == (term[k - 1] ^ 1); // x & !x
+			}
+			if (!contradiction)
+			{
+				terms.push_back(term);
+			}
+		}
+		if (terms.size() > 4 * MAX_INTERLOCK_TERMS)
+		{
+			Simplify(terms);
+		}
+	}
+	Simplify(terms);
+	return terms;
+}
+
+// De Morgan: !(t1 | t2) = !t1 & !t2, and !(a & b) = !a | !b
+Terms RuleParser::Negation(const Terms& a)
+{
+	Terms terms = True();
+	for (size_t i = 0; i < a.size(); ++i)
+	{
+		Terms clause;
+		for (size_t k = 0; k < a[i].size(); ++k)
+		{
+			clause.push_back(Term(1, a[i][k] ^ 1));
+		}
+		terms = Conjunction(terms, clause);
+	}
+	return terms;
+}
+
+const string& RuleParser::Peek()
+{
+	size_t position = m_position;
+	Next();
+	m_position = position;
+	return m_token;
+}
+
+const string& RuleParser::Next()
+{
+	while (m_position < m_text.size() && isspace((unsigned char)m_text[m_position]))
+	{
+		++m_position;
+	}
+	m_token.clear();
+	if (m_position >= m_text.size())
+	{
+		return m_token;
+	}
+	char c = m_text[m_position];
+	if ('&' == c || '|' == c)
+	{
+		m_token.assign(1, c);
+		m_position += m_position + 1 < m_text.size() && c == m_text[m_position + 1] ? 2 : 1;
+	}
+	else if ('!' == c || '(' == c || ')' == c)
+	{
+		m_token.assign(1, c);
+		++m_position;
+	}
+	else
+	{
+		size_t end = m_position;
+		while (end < m_text.size() && !isspace((unsigned char)m_text[end]) && 
+			!strchr("&|!()", m_text[end]))
+		{
+			++end;
+		}
+		m_token = m_text.substr(m_position, end - m_position);
+		m_position = end;
+	}
+	return m_token;
+}
+
+Terms RuleParser::Or()
+{
+	Terms terms = And();
+	while (Operator(Peek(), "|", "or", "OR"))
+	{
+		Next();
+		terms = Disjunction(terms, And());
+	}
+	return terms;
+}
+
+Terms RuleParser::And()
+{
+	Terms terms = Unary();
+	while (Operator(Peek(), "&", "and", "AND"))
+	{
+		Next();
+		terms = Conjunction(terms, Unary());
+	}
+	return terms;
+}
+
+Terms RuleParser::Unary()
+{
+	string token = Next();
+	if (token.empty())
+	{
+		throw invalid_argument("expression ends too soon");
+	}
+	if (Operator(token, "!", "not", "NOT"))
+	{
+		return Negation(Unary());
+	}
+	if ("(" == token)
+	{
+		Terms terms = Or();
+		if (")" != Next())
+		{
+			throw invalid_argument("missing )");
+		}
+		return terms;
+	}
+	if (")" == token || "&" == token || "|" == token)
+	{
+		throw invalid_argument("unexpected " + token);
+	}
+	if ("TRUE" == token || "true" == token)
+	{
+		return True();
+	}
+	if ("FALSE" == token || "false" == token)
+	{
+		return False();
+	}
+	return Terms(1, Term(1, 2 * m_engine.Operand(token)));
+}
+
+static int StateNamed(const string& name)
+{
+	static const char* names[] = {"IDLE", "WAITING", "CLOSING", "OPENING", "INVALID", 
+		"INITIALIZING", "MOTION_COMPLETE"};
+	static const int states[] = {STATE_IDLE, STATE_WAITING, STATE_CLOSING, STATE_OPENING,
+		STATE_INVALID, STATE_INITIALIZING, STATE_MOTION_COMPLETE};
+	for (size_t i = 0; i < sizeof(states) / sizeof(states[0]); ++i)
+	{
+		if (name == names[i])
+		{
+			return states[i];
+		}
+	}
+	return -100;
+}
+
+InterlockEngine::InterlockEngine(ProcessImage& image, const vector<Device*>& devices):
+	m_image(image), m_inputWords(image.InputWordCount()), m_termBound(1, 0), 
+	m_ruleBound(1, 0)
+{
+	for (size_t i = 0; i < devices.size(); ++i)
+	{
+		m_devices[devices[i]->Name()] = devices[i];
+	}
+	m_bits.assign(m_inputWords, 0);
+	m_values.assign(m_inputWords, 0);
+	m_mask.assign(m_inputWords, 0);
+}
+
+// Device.ATTRIBUTE? or Device.STATE
+int InterlockEngine::Operand(const string& name)
+{
+	size_t dot = name.rfind('.');
+	map<string, Device*>::const_iterator device = 
+		string::npos == dot ? m_devices.end() : m_devices.find(name.substr(0, dot));
+	if (m_devices.end() == device)
+	{
+		throw invalid_argument(name + ": no such device");
+	}
+	string attribute = name.substr(dot + 1);
+	int point = device->second->DigitalInputPoint(attribute);
+	if (point >= 0)
+	{
+		return point;
+	}
+	int state = StateNamed(attribute);
+	if (-100 == state)
+	{
+		throw invalid_argument(name + ": no such digital input or state");
+	}
+	pair<Device*, int> key(device->second, state);
+	map<pair<Device*, int>, int>::const_iterator known = m_stateBits.find(key);
+	if (m_stateBits.end() != known)
+	{
+		return known->second;
+	}
+	int bit = m_inputWords * IMAGE_WORD_BITS + m_stateDevices.size();
+	m_stateDevices.push_back(device->second);
+	m_stateValues.push_back(state);
+	m_stateBits[key] = bit;
+	m_bits.resize(m_inputWords + (m_stateDevices.size() + IMAGE_WORD_BITS - 1) / IMAGE_WORD_BITS, 0);
+	return bit;
+}
+
+int InterlockEngine::Target(const string& name)
+{
+	size_t dot = name.rfind('.');
+	map<string, Device*>::const_iterator device = 
+		string::npos == dot ? m_devices.end() : m_devices.find(name.substr(0, dot));
+	if (m_devices.end() == device)
+	{
+		throw invalid_argument(name + ": no such device");
+	}
+	int point = device->second->DigitalInputPoint(name.substr(dot + 1));
+	if (point < 0)
+	{
+		throw invalid_argument(name + ": no such digital input");
+	}
+	if (m_mask[point / IMAGE_WORD_BITS] & ((ImageWord)1 << (point % IMAGE_WORD_BITS)))
+	{
+		throw invalid_argument(name + ": already has a rule");
+	}
+	return point;
+}
+
+void InterlockEngine::Add(const string& target, const string& expression)
+{
+	int point = Target(target);
+	Terms terms = RuleParser(*this, expression).Parse();
+	for (size_t t = 0; t < terms.size(); ++t)
+	{
+		// the literals are sorted by bit, so by word
+		const Term& term = terms[t];
+		for (size_t k = 0; k < term.size(); ++k)
+		{
+			int bit = term[k] / 2;
+			int word = bit / IMAGE_WORD_BITS;
+			if (k == 0 || m_entryWord.back() != word)
+			{
+				m_entryWord.push_back(word);
+				m_entryOne.push_back(0);
+				m_entryZero.push_back(0);
+			}
+			ImageWord mask = (ImageWord)1 << (bit % IMAGE_WORD_BITS);
+			if (term[k] & 1)
+			{
+				m_entryZero.back() |= mask;
+			}
+			else
+			{
+				m_entryOne.back() |= mask;
+			}
+		}
+		m_termBound.push_back(m_entryWord.size());
+	}
+	m_ruleBound.push_back(m_termBound.size() - 1);
+	m_targets.push_back(point);
+	m_results.push_back(0);
+	m_failed.resize(m_entryWord.size());
+	m_held.resize(m_termBound.size() - 1);
+	m_mask[point / IMAGE_WORD_BITS] |= (ImageWord)1 << (point % IMAGE_WORD_BITS);
+}
+
+void InterlockEngine::Parse(const string& text, const string& source)
+{
+	istringstream lines(text);
+	string line;
+	for (size_t number = 1; getline(lines, line); ++number)
+	{
+		size_t hash = line.find('#');
+		if (string::npos != hash)
+		{
+			line.erase(hash);
+		}
+		if (string::npos == line.find_first_not_of(" \t\r"))
+		{
+			continue;
+		}
+		try
+		{
+			size_t equals = line.find('=');
+			if (string::npos == equals)
+			{
+				throw invalid_argument("expected target = expression");
+			}
+			size_t first = line.find_first_not_of(" \t");
+			size_t last = line.find_last_not_of(" \t", equals - 1);
+			if (string::npos == last || last < first)
+			{
+				throw invalid_argument("no target");
+			}
+			Add(line.substr(first, last - first + 1), line.substr(equals + 1));
+		}
+		catch (const invalid_argument& e)
+		{
+			ostringstream message;
+			message << source << ":" << number << ": " << e.what();
+			throw runtime_error(message.str());
+		}
+	}
+}
+
+void InterlockEngine::Load(const string& path)
+{
+	ifstream file(path.c_str());
+	if (!file)
+	{
+		throw runtime_error(path + ": cannot open");
+	}
+	ostringstream text;
+	text << file.rdbuf();
+	Parse(text.str(), path);
+}
+
+void InterlockEngine::Evaluate()
+{
+	if (m_inputWords)
+	{
+		memcpy(&m_bits[0], m_image.InputWords(), m_inputWords * sizeof(ImageWord));
+	}
+	for (size_t w = m_inputWords; w < m_bits.size(); ++w)
+	{
+		m_bits[w] = 0;
+	}
+	ImageWord* states = m_bits.empty() ? NULL : &m_bits[m_inputWords];
+	for (size_t i = 0; i < m_stateDevices.size(); ++i)
+	{
+		states[i / IMAGE_WORD_BITS] |= 
+			(ImageWord)(m_stateDevices[i]->State() == m_stateValues[i]) << (i % IMAGE_WORD_BITS);
+	}
+
+	// every test of every rule, in passes with no dependency from one
+	// entry or term to the next. The gather can't be vectorized without
+	// hardware gathers, so it is a plain copy on its own, and the mask tests
+	// over the copy then vectorize. A term holds if none of its tests failed,
+	// a rule if any of its terms held; the ORs over a term's entries and a
+	// rule's terms vectorize where they are long enough.
+	const size_t entries = m_entryWord.size();
+	const ImageWord* __restrict bits = m_bits.empty() ? NULL : &m_bits[0];
+	const int* __restrict word = entries ? &m_entryWord[0] : NULL;
+	const ImageWord* __restrict one = entries ? &m_entryOne[0] : NULL;
+	const ImageWord* __restrict zero = entries ? &m_entryZero[0] : NULL;
+	ImageWord* __restrict failed = entries ? &m_failed[0] : NULL;
+	for (size_t e = 0; e < entries; ++e)
+	{
+		failed[e] = bits[word[e]];
+	}
+	for (size_t e = 0; e < entries; ++e)
+	{
+		failed[e] = (~failed[e] & one[e]) | (failed[e] & zero[e]);
+	}
+	const size_t terms = m_termBound.size() - 1;
+	const int* __restrict termBound = &m_termBound[0];
+	unsigned char* __restrict held = terms ? &m_held[0] : NULL;
+	for (size_t t = 0; t < terms; ++t)
+	{
+		ImageWord any = 0;
+		for (int e = termBound[t]; e < termBound[t + 1]; ++e)
+		{
+			any |= failed[e];
+		}
+		held[t] = 0 == any;
+	}
+	for (size_t r = 0; r < m_targets.size(); ++r)
+	{
+		unsigned char any = 0;
+		for (int t = m_ruleBound[r]; t < m_ruleBound[r + 1]; ++t)
+		{
+			any |= held[t];
+		}
+		bool result = any;
+		m_results[r] = result;
+		int point = m_targets[r];
+		ImageWord mask = (ImageWord)1 << (point % IMAGE_WORD_BITS);
+		ImageWord& value = m_values[point / IMAGE_WORD_BITS];
+		value = (value & ~mask) | (-(ImageWord)result & mask);
+	}
+	if (!m_targets.empty())
+	{
+		m_image.WriteScanInputs(&m_values[0], &m_mask[0]);
+	}
+}
@@ -0,0 +1,136 @@
+///////////////////////////////////////////////////////////////////////////////
+// FILE:          Interlock.h
+// PROJECT:       Devices 
+// SUBSYSTEM:     Device Controller 
+//-----------------------------------------------------------------------------
+// DESCRIPTION:   interlock rules compiled to bitmask tests over the input image
+//             
+// COPYRIGHT:     Karl Hoover, No Prior Art, 2009
+//
+// LICENSE:       This library is free software; you can redistribute it and/or
+//                modify it under the terms of the GNU Lesser General Public
+//                License (LGPL) as published by the Free Software Foundation.
+//                See license text at http://www.gnu.org/licenses/lgpl.txt 
+//                Briefly you can use this source code pretty much however you
+//                wish, as long as this notice remains intact and you
+//                prominently acknowledge this copyright.
+//
+//                This file is distributed in the hope that it will be useful,
+//                but WITHOUT ANY WARRANTY; without even the implied warranty
+//                of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//                IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//                CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+//                INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES.
+//
+// AUTHOR:        Karl Hoover  karl.hoover@gmail.com
+//
+// REVISIONS:     1.0 October 16, 2026
+//
+// NOTES:   
+// A valve's Close() and Open() only go ahead if its CLOSE_OK? or OPEN_OK?
+// input is made. With an InterlockEngine those inputs are computed by the
+// library from rules over other inputs and device states, instead of by
+// something outside it:
+//
+//     # target = expression
+//     Gate1.OPEN_OK? = Rough1.CLOSED? & !Vent1.OPENED? & (Turbo.IDLE | Turbo.INVALID)
+//     Vent1.OPEN_OK? = Gate1.CLOSED? & Gate2.CLOSED?
+//
+// A target is a digital input of a device. An operand is Device.ATTRIBUTE,
+// a digital input of a device, or Device.STATE, true while the device is in
+// that state (IDLE, WAITING, CLOSING, OPENING, INVALID, INITIALIZING), or
+// TRUE or FALSE. Operators are ! (or not), & (and, &&), | (or, ||) and
+// parentheses, with the usual precedence. # starts a comment.
+//
+// Each rule is compiled when it is added: to disjunctive normal form (an OR
+// of AND terms), and each term to a list of (word, must be one mask, must
+// be zero mask) entries over the packed input image, with device states
+// as extra bits after the inputs. Evaluate() then is:
+//
+//   - copy the scan image and set one bit per state operand
+//   - gather each entry's word, then one flat loop over all entries of
+//     all rules, a mask test each
+//   - a term holds if none of its tests failed, a rule if any term held
+//   - write the targets into the scan image
+//
+// Call it once per scan between LatchInputs() and the device updates. The
+// targets are written with ProcessImage::WriteScanInputs, so the devices see
+// them the same scan and a changed interlock wakes its devices through the
+// ChangeDispatcher like any other input. A rule reading another rule's
+// target sees it as of the previous scan. Device states are those the
+// devices were left in by the previous scan.
+//
+// Rule expansion is bounded, MAX_INTERLOCK_TERMS terms per rule. Build the
+// engine once the plant is loaded, the image must not grow afterwards.
+
+#ifndef INTERLOCK_H
+#define INTERLOCK_H
+
+#include <string>
+#include <vector>
+#include <map>
+#include <cstddef>
+
+#include "ProcessImage.h"
+
+class Device;
+
+#define MAX_INTERLOCK_TERMS 256  // per rule, after expansion to DNF
+
+class InterlockEngine
+{
+public:
+	InterlockEngine(ProcessImage& image, const std::vector<Device*>& devices);
+	// throws invalid_argument with what is wrong with it
+	void Add(const std::string& target, const std::string& expression);
+	// a rules file, one "target = expression" a line; throws runtime_error
+	// "file:line: what"
+	void Load(const std::string& path);
+	void Parse(const std::string& text, const std::string& source);
+
+	void Evaluate(); // scan thread, once per scan after LatchInputs()
+
+	int RuleCount() const {return m_targets.size();};
+	int TermCount() const {return m_termBound.size() - 1;};
+	int EntryCount() const {return m_entryWord.size();};
+	bool Result(const int rule) const {return m_results[rule];}; // last Evaluate()
+
+	// a literal is a bit of the evaluation image, negated or not
+	typedef std::vector<int> Term;  // sorted literals, bit * 2 + negated
+	typedef std::vector<Term> Terms;
+
+private:
+	InterlockEngine(const InterlockEngine&);
+	InterlockEngine& operator=(const InterlockEngine&);
+	friend class RuleParser;
+	int Operand(const std::string& name); // its bit, throws invalid_argument
+	int Target(const std::string& name);  // its input point
+
+	ProcessImage& m_image;
+	std::map<std::string, Device*> m_devices;
+	size_t m_inputWords;
+
+	// state operands, bit m_inputWords * IMAGE_WORD_BITS + index
+	std::vector<Device*> m_stateDevices;
+	std::vector<int> m_stateValues;
+	std::map<std::pair<Device*, int>, int> m_stateBits;
+
+	// compiled: entries grouped by term, terms grouped by rule
+	std::vector<int> m_entryWord;
+	std::vector<ImageWord> m_entryOne;
+	std::vector<ImageWord> m_entryZero;
+	std::vector<int> m_termBound; // term t is entries [bound[t], bound[t + 1])
+	std::vector<int> m_ruleBound; // rule r is terms [bound[r], bound[r + 1])
+	std::vector<int> m_targets;  // input point per rule
+
+	// per scan
+	std::vector<ImageWord> m_bits;   // scan image, then state bits
+	std::vector<ImageWord> m_failed; // per entry its word, then its failed bits
+	std::vector<unsigned char> m_held; // per term
+	std::vector<char> m_results;
+	std::vector<ImageWord> m_values; // targets, over the input words
+	std::vector<ImageWord> m_mask;
+};
+
+#endif // INTERLOCK_H
@@ -0,0 +1,123 @@
+///////////////////////////////////////////////////////////////////////////////
+// FILE:          LatencyHistogram.cpp
+// PROJECT:       Devices 
+// SUBSYSTEM:     Device Controller 
+//-----------------------------------------------------------------------------
+// DESCRIPTION:   implementation of the latency histograms
+//             
+// COPYRIGHT:     Karl Hoover, No Prior Art, 2009
+//
+// LICENSE:       This library is free software; you can redistribute it and/or
+//                modify it under the terms of the GNU Lesser General Public
+//                License (LGPL) as published by the Free Software Foundation.
+//                See license text at http://www.gnu.org/licenses/lgpl.txt 
+//                Briefly you can use this source code pretty much however you
+//                wish, as long as this notice remains intact and you
+//                prominently acknowledge this copyright.
+//
+//                This file is distributed in the hope that it will be useful,
+//                but WITHOUT ANY WARRANTY; without even the implied warranty
+//                of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//                IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//                CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+//                INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES.
+//
+// AUTHOR:        Karl Hoover  karl.hoover@gmail.com
+//
+// REVISIONS:     
+//
+// NOTES:   
+// see LatencyHistogram.h for comments and history
+
+#include "LatencyHistogram.h"
+
+void LatencyHistogram::Reset()
+{
+	for (int i = 0; i < HISTOGRAM_BUCKETS; ++i)
+	{
+		m_counts[i].store(0, std::memory_order_relaxed);
+	}
+	m_count.store(0, std::memory_order_relaxed);
+	m_total.store(0, std::memory_order_relaxed);
+	m_max.store(0, std::memory_order_relaxed);
+}
+
+Nanoseconds LatencyHistogram::BucketValue(const int bucket)
+{
+	if (bucket < (2 << HISTOGRAM_SUB_BITS))
+	{
+		return bucket;
+	}
+	int shift = (bucket >> HISTOGRAM_SUB_BITS) - 1;
+	Nanoseconds low = (Nanoseconds)((1 << HISTOGRAM_SUB_BITS) + 
+		(bucket & ((1 << HISTOGRAM_SUB_BITS) - 1))) << shift;
+	return low + ((1LL << shift) >> 1);
+}
+
+Nanoseconds LatencyHistogram::Percentile(const double fraction) const
+{
+	// the counts are read once, so the total is that of what we walk
+	unsigned long long total = 0;
+	unsigned int counts[HISTOGRAM_BUCKETS];
+	for (int i = 0; i < HISTOGRAM_BUCKETS; ++i)
+	{
+		counts[i] = m_counts[i].load(std::memory_order_relaxed);
+		total += counts[i];
+	}
+	if (0 == total)
+	{
+		return 0;
+	}
+	unsigned long long rank = (unsigned long long)(fraction * total + 0.5);
+	if (rank < 1)
+	{
+		rank = 1;
+	}
+	unsigned long long seen = 0;
+	for (int i = 0; i < HISTOGRAM_BUCKETS; ++i)
+	{
+		seen += counts[i];
+		if (seen >= rank)
+		{
+			// never report more than was recorded
+			Nanoseconds max = m_max.load(std::memory_order_relaxed);
+			Nanoseconds value = BucketValue(i);
+			return value > max ? max : value;
+		}
+	}
+	return m_max.load(std::memory_order_relaxed);
+}
+
+HistogramSnapshot LatencyHistogram::Snapshot() const
+{
+	HistogramSnapshot snapshot;
+	snapshot.count = m_count.load(std::memory_order_relaxed);
+	snapshot.p50 = Percentile(0.50);
+	snapshot.p99 = Percentile(0.99);
+	snapshot.max = m_max.load(std::memory_order_relaxed);
+	snapshot.mean = snapshot.count ? 
+		(double)m_total.load(std::memory_order_relaxed) / snapshot.count : 0.;
+	return snapshot;
+}
+
+void ValveTimings::Reset()
+{
+	open.Reset();
+	close.Reset();
+	interlockWait.Reset();
+	update.Reset();
+}
+
+void ValveTimings::Report(std::ostream& out, const std::string& name) const
+{
+	const LatencyHistogram* histograms[] = {&open, &close, &interlockWait, &update};
+	const char* names[] = {"open", "close", "interlockWait", "update"};
+	for (int i = 0; i < 4; ++i)
+	{
+		HistogramSnapshot s = histograms[i]->Snapshot();
+		out << name << ' ' << names[i] << " count " << s.count << " p50 " << s.p50 
+			<< " p99 " << s.p99 << " max " << s.max << " mean " << (Nanoseconds)s.mean 
+			<< std::endl;
+	}
+}
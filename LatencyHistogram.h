@@ -0,0 +1,146 @@
+///////////////////////////////////////////////////////////////////////////////
+// FILE:          LatencyHistogram.h
+// PROJECT:       Devices 
+// SUBSYSTEM:     Device Controller 
+//-----------------------------------------------------------------------------
+// DESCRIPTION:   lock-free log-linear latency histograms, valve timings
+//             
+// COPYRIGHT:     Karl Hoover, No Prior Art, 2009
+//
+// LICENSE:       This library is free software; you can redistribute it and/or
+//                modify it under the terms of the GNU Lesser General Public
+//                License (LGPL) as published by the Free Software Foundation.
+//                See license text at http://www.gnu.org/licenses/lgpl.txt 
+//                Briefly you can use this source code pretty much however you
+//                wish, as long as this notice remains intact and you
+//                prominently acknowledge this copyright.
+//
+//                This file is distributed in the hope that it will be useful,
+//                but WITHOUT ANY WARRANTY; without even the implied warranty
+//                of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//                IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//                CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+//                INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES.
+//
+// AUTHOR:        Karl Hoover  karl.hoover@gmail.com
+//
+// REVISIONS:     1.0 October 16, 2026
+//
+// NOTES:   
+// A LatencyHistogram counts nanosecond intervals in log-linear buckets, the
+// HDR histogram layout: each power of two is split into 16 equal buckets,
+// so a reported value is within 1/16 (about 6%) of the recorded one, from
+// 1 ns up to 2^40 ns (18 minutes, longer is counted there). The exact
+// maximum is kept as well. Recording is a handful of relaxed atomic adds,
+// no lock and no allocation, so any number of scan threads may record into
+// one histogram while another thread takes a Snapshot(). A snapshot taken
+// during recording may be a count or so behind, it is never torn.
+//
+// ValveTimings is the set a valve records into at its state transitions:
+//
+//   open, close     OPENING or CLOSING to IDLE, i.e. how long the motion
+//                   took. Motions that time out are not counted, they go
+//                   STATE_INVALID.
+//   interlockWait   time spent in STATE_WAITING, however it ended
+//   update          duration of Valve::Update, 1 call in
+//                   UPDATE_SAMPLE_INTERVAL per valve, timed with
+//                   MonotonicNanoseconds(), real time even while a
+//                   replay runs the scan clock virtual
+//
+// Each valve class has one ValveTimings all its valves record into
+// (SingleThrowValve::ClassTimings()), and a valve may be given its own as
+// well with Valve::SetTimings(). A per valve ValveTimings is about 9kB, so
+// give them to the valves you want to watch rather than to all of them;
+// a slowly degrading valve shows as its open or close p99 creeping up long
+// before it hits the motion timeout.
+
+#ifndef LATENCYHISTOGRAM_H
+#define LATENCYHISTOGRAM_H
+
+#include <atomic>
+#include <string>
+#include <ostream>
+
+#include "ScanClock.h"
+
+#define HISTOGRAM_SUB_BITS 4     // 16 buckets per power of two
+#define HISTOGRAM_MAX_BITS 40    // 2^40 ns
+#define HISTOGRAM_BUCKETS ((HISTOGRAM_MAX_BITS - HISTOGRAM_SUB_BITS + 1) << HISTOGRAM_SUB_BITS)
+#define UPDATE_SAMPLE_INTERVAL 64  // power of two
+
+struct HistogramSnapshot
+{
+	unsigned long long count;
+	Nanoseconds p50;
+	Nanoseconds p99;
+	Nanoseconds max;
+	double mean;
+};
+
+class LatencyHistogram
+{
+public:
+	LatencyHistogram() {Reset();};
+	void Record(Nanoseconds value)
+	{
+		if (value < 0)
+		{
+			value = 0;
+		}
+		m_counts[Bucket(value)].fetch_add(1, std::memory_order_relaxed);
+		m_count.fetch_add(1, std::memory_order_relaxed);
+		m_total.fetch_add(value, std::memory_order_relaxed);
+		Nanoseconds max = m_max.load(std::memory_order_relaxed);
+		while (value > max && 
+			!m_max.compare_exchange_weak(max, value, std::memory_order_relaxed))
+		{
+		}
+	};
+	unsigned long long Count() const {return m_count.load(std::memory_order_relaxed);};
+	// value at or below which fraction (0..1) of the recordings are
+	Nanoseconds Percentile(const double fraction) const;
+	HistogramSnapshot Snapshot() const;
+	void Reset(); // not while recording
+
+	static int Bucket(const Nanoseconds value);
+	static Nanoseconds BucketValue(const int bucket); // middle of the bucket
+
+private:
+	LatencyHistogram(const LatencyHistogram&);
+	LatencyHistogram& operator=(const LatencyHistogram&);
+	std::atomic<unsigned int> m_counts[HISTOGRAM_BUCKETS];
+	std::atomic<unsigned long long> m_count;
+	std::atomic<Nanoseconds> m_total;
+	std::atomic<Nanoseconds> m_max;
+};
+
+inline int LatencyHistogram::Bucket(const Nanoseconds value)
+{
+	unsigned long long v = value;
+	if (v < (2ULL << HISTOGRAM_SUB_BITS))
+	{
+		return (int)v;
+	}
+	int magnitude = 63 - __builtin_clzll(v);
+	if (magnitude >= HISTOGRAM_MAX_BITS)
+	{
+		return HISTOGRAM_BUCKETS - 1;
+	}
+	int shift = magnitude - HISTOGRAM_SUB_BITS;
+	return ((shift + 1) << HISTOGRAM_SUB_BITS) + 
+		(int)((v >> shift) & ((1 << HISTOGRAM_SUB_BITS) - 1));
+}
+
+struct ValveTimings
+{
+	LatencyHistogram open;
+	LatencyHistogram close;
+	LatencyHistogram interlockWait;
+	LatencyHistogram update;
+	void Reset();
+	// one line per histogram: "name open count 12 p50 ... p99 ... max ... mean ..."
+	void Report(std::ostream& out, const std::string& name) const;
+};
+
+#endif // LATENCYHISTOGRAM_H
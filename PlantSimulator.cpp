@@ -0,0 +1,182 @@
+///////////////////////////////////////////////////////////////////////////////
+// FILE:          PlantSimulator.cpp
+// PROJECT:       Devices 
+// SUBSYSTEM:     Device Controller 
+//-----------------------------------------------------------------------------
+// DESCRIPTION:   implementation of the simulated valve plant
+//             
+// COPYRIGHT:     Karl Hoover, No Prior Art, 2009
+//
+// LICENSE:       This library is free software; you can redistribute it and/or
+//                modify it under the terms of the GNU Lesser General Public
+//                License (LGPL) as published by the Free Software Foundation.
+//                See license text at http://www.gnu.org/licenses/lgpl.txt 
+//                Briefly you can use this source code pretty much however you
+//                wish, as long as this notice remains intact and you
+//                prominently acknowledge this copyright.
+//
+//                This file is distributed in the hope that it will be useful,
+//                but WITHOUT ANY WARRANTY; without even the implied warranty
+//                of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//                IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//                CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+//                INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES.
+//
+// AUTHOR:        Karl Hoover  karl.hoover@gmail.com
+//
+// REVISIONS:     
+//
+// NOTES:   
+// see PlantSimulator.h for comments and history
+
+#include "PlantSimulator.h"
+#include "device.h"
+
+// mechanical position of a simulated valve
+#define SIM_CLOSED 0
+#define SIM_OPEN 1
+#define SIM_OPENING 2  // travelling, neither sensor made
+#define SIM_CLOSING 3
+
+PlantSimulator::PlantSimulator(ProcessImage& image, const unsigned long long seed):
+	m_image(image), m_random(seed ? seed : 1), 
+	m_minTravel(200 * NANOSECONDS_PER_MILLISECOND), 
+	m_maxTravel(800 * NANOSECONDS_PER_MILLISECOND), m_motions(0)
+{
+}
+
+int PlantSimulator::AddValve(const Device& valve)
+{
+	return AddValve(valve.DigitalOutputPoint("CLOSE!"), valve.DigitalOutputPoint("OPEN!"),
+		valve.DigitalInputPoint("CLOSED?"), valve.DigitalInputPoint("OPENED?"),
+		valve.DigitalInputPoint("CLOSE_OK?"), valve.DigitalInputPoint("OPEN_OK?"));
+}
+
+int PlantSimulator::AddValve(const int closeCmd, const int openCmd, const int closedSensor,
+	const int openedSensor, const int closeOk, const int openOk)
+{
+	if (closeCmd < 0 || closedSensor < 0)
+	{
+		return -1;
+	}
+	m_closeCmd.push_back(closeCmd);
+	m_openCmd.push_back(openCmd);
+	m_closedSensor.push_back(closedSensor);
+	m_openedSensor.push_back(openedSensor);
+	m_closeOk.push_back(closeOk);
+	m_openOk.push_back(openOk);
+	m_faults.push_back(SIM_FAULT_NONE);
+	m_position.push_back(SIM_CLOSED);
+	m_arrival.push_back(0);
+	return m_closeCmd.size() - 1;
+}
+
+void PlantSimulator::SetTravelTime(const Nanoseconds minimum, const Nanoseconds maximum)
+{
+	m_minTravel = minimum;
+	m_maxTravel = maximum < minimum ? minimum : maximum;
+}
+
+void PlantSimulator::Place(const int valve, const bool closed)
+{
+	m_position[valve] = closed ? SIM_CLOSED : SIM_OPEN;
+}
+
+Nanoseconds PlantSimulator::TravelTime()
+{
+	m_random ^= m_random << 13;
+	m_random ^= m_random >> 7;
+	m_random ^= m_random << 17;
+	Nanoseconds span = m_maxTravel - m_minTravel;
+	return m_minTravel + (span ? (Nanoseconds)(m_random % (unsigned long long)(span + 1)) : 0);
+}
+
+void PlantSimulator::Drive(const int point, const bool value)
+{
+	if (point < 0)
+	{
+		return;
+	}
+	ImageWord bit = (ImageWord)1 << (point % IMAGE_WORD_BITS);
+	m_mask[point / IMAGE_WORD_BITS] |= bit;
+	if (value)
+	{
+		m_values[point / IMAGE_WORD_BITS] |= bit;
+	}
+	else
+	{
+		m_values[point / IMAGE_WORD_BITS] &= ~bit;
+	}
+}
+
+void PlantSimulator::Step(const Nanoseconds now)
+{
+	m_image.ReadFieldOutputs(m_outputs, m_analogueOutputs);
+	m_values.resize(m_image.InputWordCount(), 0);
+	m_mask.resize(m_image.InputWordCount(), 0);
+	for (size_t v = 0; v < m_closeCmd.size(); ++v)
+	{
+		int faults = m_faults[v];
+		bool close = Bit(m_outputs, m_closeCmd[v]);
+		bool open = m_openCmd[v] >= 0 ? Bit(m_outputs, m_openCmd[v]) : !close;
+		
+		// where is it being sent? double throw holds with neither or both
+		int target = -1;
+		if (close && !open)
+		{
+			target = SIM_CLOSED;
+		}
+		else if (open && !close)
+		{
+			target = SIM_OPEN;
+		}
+		signed char& position = m_position[v];
+		if (!(faults & SIM_FAULT_JAMMED) && target >= 0)
+		{
+			if (SIM_CLOSED == target && SIM_CLOSED != position && SIM_CLOSING != position)
+			{
+				position = SIM_CLOSING;
+				m_arrival[v] = now + TravelTime();
+				++m_motions;
+			}
+			else if (SIM_OPEN == target && SIM_OPEN != position && SIM_OPENING != position)
+			{
+				position = SIM_OPENING;
+				m_arrival[v] = now + TravelTime();
+				++m_motions;
+			}
+		}
+		if ((SIM_CLOSING == position || SIM_OPENING == position) && now >= m_arrival[v])
+		{
+			position = SIM_CLOSING == position ? SIM_CLOSED : SIM_OPEN;
+		}
+
+		bool closed = SIM_CLOSED == position;
+		bool opened = SIM_OPEN == position;
+		if (faults & (SIM_FAULT_CLOSED_STUCK_ON | SIM_FAULT_BOTH_SENSORS))
+		{
+			closed = true;
+		}
+		if (faults & SIM_FAULT_CLOSED_STUCK_OFF)
+		{
+			closed = false;
+		}
+		if (faults & (SIM_FAULT_OPENED_STUCK_ON | SIM_FAULT_BOTH_SENSORS))
+		{
+			opened = true;
+		}
+		if (faults & SIM_FAULT_OPENED_STUCK_OFF)
+		{
+			opened = false;
+		}
+		Drive(m_closedSensor[v], closed);
+		Drive(m_openedSensor[v], opened);
+		Drive(m_closeOk[v], !(faults & SIM_FAULT_NO_CLOSE_OK));
+		Drive(m_openOk[v], !(faults & SIM_FAULT_NO_OPEN_OK));
+	}
+	if (!m_values.empty())
+	{
+		m_image.WriteFieldInputs(&m_values[0], &m_mask[0]);
+	}
+}
@@ -0,0 +1,127 @@
+///////////////////////////////////////////////////////////////////////////////
+// FILE:          PlantSimulator.h
+// PROJECT:       Devices 
+// SUBSYSTEM:     Device Controller 
+//-----------------------------------------------------------------------------
+// DESCRIPTION:   simulated IO backend modelling valve mechanics, for running
+//                the library without hardware
+//             
+// COPYRIGHT:     Karl Hoover, No Prior Art, 2009
+//
+// LICENSE:       This library is free software; you can redistribute it and/or
+//                modify it under the terms of the GNU Lesser General Public
+//                License (LGPL) as published by the Free Software Foundation.
+//                See license text at http://www.gnu.org/licenses/lgpl.txt 
+//                Briefly you can use this source code pretty much however you
+//                wish, as long as this notice remains intact and you
+//                prominently acknowledge this copyright.
+//
+//                This file is distributed in the hope that it will be useful,
+//                but WITHOUT ANY WARRANTY; without even the implied warranty
+//                of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//                IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//                CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+//                INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES.
+//
+// AUTHOR:        Karl Hoover  karl.hoover@gmail.com
+//
+// REVISIONS:     1.0 October 16, 2026
+//
+// NOTES:   
+// The simulator plays the field side of a ProcessImage. Each Step() it
+// reads the committed outputs, moves each simulated valve towards where
+// its CLOSE!/OPEN! outputs send it and writes the sensor and interlock
+// inputs into the live image:
+//
+//     SingleThrowValve: CLOSE! on closes, off opens (spring return)
+//     DoubleThrowValve: CLOSE! closes, OPEN! opens, neither or both holds
+//
+// A valve leaving a seat drops its sensor at once and makes the other one
+// after a travel time drawn uniformly from [minimum, maximum]. Interlocks
+// (CLOSE_OK?, OPEN_OK?) are held made. Faults can be injected per valve:
+// stuck sensors, both sensors made, an interlock which never comes, or a
+// jammed actuator. The random source is seeded, so a run repeats.
+//
+// State is kept as parallel arrays and the inputs are written back with a
+// single masked WriteFieldInputs, so stepping 100k valves is a couple of
+// linear passes. Step() belongs to the field side: call it between scans,
+// or from its own thread.
+
+#ifndef PLANTSIMULATOR_H
+#define PLANTSIMULATOR_H
+
+#include <vector>
+
+#include "ProcessImage.h"
+#include "ScanClock.h"
+
+class Device;
+
+// faults, or'ed together
+#define SIM_FAULT_NONE 0
+#define SIM_FAULT_CLOSED_STUCK_ON 0x01   // CLOSED? always made
+#define SIM_FAULT_CLOSED_STUCK_OFF 0x02  // CLOSED? never made
+#define SIM_FAULT_OPENED_STUCK_ON 0x04
+#define SIM_FAULT_OPENED_STUCK_OFF 0x08
+#define SIM_FAULT_BOTH_SENSORS 0x10      // CLOSED? and OPENED? both made
+#define SIM_FAULT_NO_CLOSE_OK 0x20       // CLOSE_OK? interlock never met
+#define SIM_FAULT_NO_OPEN_OK 0x40        // OPEN_OK? interlock never met
+#define SIM_FAULT_JAMMED 0x80            // doesn't move at all
+
+class PlantSimulator
+{
+public:
+	PlantSimulator(ProcessImage& image, const unsigned long long seed = 1);
+	// a valve built from a configuration: points are looked up by attribute,
+	// OPEN! and OPENED? may be missing. Returns the simulator's valve index,
+	// -1 if the device has no CLOSE! and CLOSED?
+	int AddValve(const Device& valve);
+	int AddValve(const int closeCmd, const int openCmd, const int closedSensor,
+		const int openedSensor, const int closeOk, const int openOk); // -1: none
+	int ValveCount() const {return m_closeCmd.size();};
+	
+	void SetTravelTime(const Nanoseconds minimum, const Nanoseconds maximum);
+	void SetFaults(const int valve, const int faults) {m_faults[valve] = faults;};
+	int Faults(const int valve) const {return m_faults[valve];};
+	// put a valve at rest, e.g. initial conditions. Takes effect next Step.
+	void Place(const int valve, const bool closed);
+	
+	void Step(const Nanoseconds now);
+	unsigned long long Motions() const {return m_motions;}; // travels started
+
+private:
+	PlantSimulator(const PlantSimulator&);
+	PlantSimulator& operator=(const PlantSimulator&);
+
+	static bool Bit(const std::vector<ImageWord>& words, const int point)
+	{
+		return point >= 0 && ((words[point / IMAGE_WORD_BITS] >> (point % IMAGE_WORD_BITS)) & 1);
+	};
+	void Drive(const int point, const bool value);
+	Nanoseconds TravelTime();
+
+	ProcessImage& m_image;
+	unsigned long long m_random;  // xorshift64 state
+	Nanoseconds m_minTravel;
+	Nanoseconds m_maxTravel;
+	unsigned long long m_motions;
+
+	// per valve
+	std::vector<int> m_closeCmd;
+	std::vector<int> m_openCmd;
+	std::vector<int> m_closedSensor;
+	std::vector<int> m_openedSensor;
+	std::vector<int> m_closeOk;
+	std::vector<int> m_openOk;
+	std::vector<int> m_faults;
+	std::vector<signed char> m_position;  // SIM_ position, in the .cpp
+	std::vector<Nanoseconds> m_arrival;   // end of travel
+
+	std::vector<ImageWord> m_outputs;     // scratch: committed outputs
+	std::vector<double> m_analogueOutputs;
+	std::vector<ImageWord> m_values;      // inputs we drive
+	std::vector<ImageWord> m_mask;
+};
+
+#endif // PLANTSIMULATOR_H
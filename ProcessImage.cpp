@@ -0,0 +1,231 @@
+///////////////////////////////////////////////////////////////////////////////
+// FILE:          ProcessImage.cpp
+// PROJECT:       Devices 
+// SUBSYSTEM:     Device Controller 
+//-----------------------------------------------------------------------------
+// DESCRIPTION:   implementation of the packed process image
+//             
+// COPYRIGHT:     Karl Hoover, No Prior Art, 2009
+//
+// LICENSE:       This library is free software; you can redistribute it and/or
+//                modify it under the terms of the GNU Lesser General Public
+//                License (LGPL) as published by the Free Software Foundation.
+//                See license text at http://www.gnu.org/licenses/lgpl.txt 
+//                Briefly you can use this source code pretty much however you
+//                wish, as long as this notice remains intact and you
+//                prominently acknowledge this copyright.
+//
+//                This file is distributed in the hope that it will be useful,
+//                but WITHOUT ANY WARRANTY; without even the implied warranty
+//                of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//                IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//                CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+//                INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES.
+//
+// AUTHOR:        Karl Hoover  karl.hoover@gmail.com
+//
+// REVISIONS:     
+//
+// NOTES:   
+// see ProcessImage.h for comments and history
+
+#include <cstring>
+
+#include "ProcessImage.h"
+
+// mask for one point within its word
+static inline ImageWord PointMask(const int point)
+{
+	return (ImageWord)1 << (point % IMAGE_WORD_BITS);
+}
+
+ProcessImage::ProcessImage(): m_digitalInputCount(0), m_digitalOutputCount(0),
+	m_inputsChanged(false), m_outputSequence(0)
+{
+	pthread_mutex_init(&m_inputMtx, NULL);
+}
+
+ProcessImage::~ProcessImage()
+{
+	pthread_mutex_destroy(&m_inputMtx);
+}
+
+int ProcessImage::AddDigitalInput()
+{
+	int point = m_digitalInputCount++;
+	if (0 == point % IMAGE_WORD_BITS) // first point in a new word
+	{
+		m_liveInputs.push_back(0);
+		m_inputs.push_back(0);
+		m_changes.push_back(0);
+	}
+	return point;
+}
+
+int ProcessImage::AddDigitalOutput()
+{
+	int point = m_digitalOutputCount++;
+	if (0 == point % IMAGE_WORD_BITS)
+	{
+		m_stagedOutputs.push_back(0);
+		m_outputs.push_back(0);
+	}
+	return point;
+}
+
+int ProcessImage::AddAnalogueInput()
+{
+	m_liveAnalogueInputs.push_back(0.);
+	m_analogueInputs.push_back(0.);
+	return m_analogueInputs.size() - 1;
+}
+
+int ProcessImage::AddAnalogueOutput()
+{
+	m_stagedAnalogueOutputs.push_back(0.);
+	m_analogueOutputs.push_back(0.);
+	return m_analogueOutputs.size() - 1;
+}
+
+void ProcessImage::WriteFieldInput(const int point, const bool value)
+{
+	pthread_mutex_lock(&m_inputMtx);
+	if (value)
+	{
+		m_liveInputs[point / IMAGE_WORD_BITS] |= PointMask(point);
+	}
+	else
+	{
+		m_liveInputs[point / IMAGE_WORD_BITS] &= ~PointMask(point);
+	}
+	pthread_mutex_unlock(&m_inputMtx);
+}
+
+void ProcessImage::WriteFieldInputs(const ImageWord* values, const ImageWord* mask)
+{
+	pthread_mutex_lock(&m_inputMtx);
+	for (size_t i = 0; i < m_liveInputs.size(); ++i)
+	{
+		m_liveInputs[i] = (m_liveInputs[i] & ~mask[i]) | (values[i] & mask[i]);
+	}
+	pthread_mutex_unlock(&m_inputMtx);
+}
+
+void ProcessImage::WriteFieldAnalogueInput(const int point, const double value)
+{
+	pthread_mutex_lock(&m_inputMtx);
+	m_liveAnalogueInputs[point] = value;
+	pthread_mutex_unlock(&m_inputMtx);
+}
+
+// seqlock reader: the copy is good if no commit started or finished while
+// it was being taken
+void ProcessImage::ReadFieldOutputs(std::vector<ImageWord>& digital, 
+	std::vector<double>& analogue) const
+{
+	digital.resize(m_outputs.size());
+	analogue.resize(m_analogueOutputs.size());
+	unsigned long long before;
+	unsigned long long after;
+	do
+	{
+		before = m_outputSequence.load(std::memory_order_acquire);
+		for (size_t i = 0; i < digital.size(); ++i)
+		{
+			digital[i] = m_outputs[i].load(std::memory_order_relaxed);
+		}
+		for (size_t i = 0; i < analogue.size(); ++i)
+		{
+			analogue[i] = m_analogueOutputs[i].load(std::memory_order_relaxed);
+		}
+		std::atomic_thread_fence(std::memory_order_acquire);
+		after = m_outputSequence.load(std::memory_order_relaxed);
+	} while ((before & 1) || before != after);
+}
+
+void ProcessImage::LatchInputs()
+{
+	pthread_mutex_lock(&m_inputMtx);
+	// copy and diff in one pass. Plain loop over restrict pointers with an
+	// OR reduction, which gcc vectorizes (the Makefile turns the vectorizer
+	// on for this file, -O2 alone leaves the loop scalar).
+	const ImageWord* __restrict live = m_liveInputs.empty() ? NULL : &m_liveInputs[0];
+	ImageWord* __restrict scan = m_inputs.empty() ? NULL : &m_inputs[0];
+	ImageWord* __restrict changes = m_changes.empty() ? NULL : &m_changes[0];
+	ImageWord any = 0;
+	for (size_t i = 0, n = m_inputs.size(); i < n; ++i)
+	{
+		ImageWord word = live[i];
+		changes[i] = word ^ scan[i];
+		any |= changes[i];
+		scan[i] = word;
+	}
+	m_inputsChanged = (0 != any);
+	if (!m_analogueInputs.empty())
+	{
+		memcpy(&m_analogueInputs[0], &m_liveAnalogueInputs[0], 
+			m_analogueInputs.size() * sizeof(double));
+	}
+	pthread_mutex_unlock(&m_inputMtx);
+}
+
+void ProcessImage::WriteScanInputs(const ImageWord* values, const ImageWord* mask)
+{
+	ImageWord any = 0;
+	for (size_t i = 0, n = m_inputs.size(); i < n; ++i)
+	{
+		ImageWord previous = m_inputs[i] ^ m_changes[i]; // before the latch
+		m_inputs[i] = (m_inputs[i] & ~mask[i]) | (values[i] & mask[i]);
+		m_changes[i] = m_inputs[i] ^ previous;
+		any |= m_changes[i];
+	}
+	m_inputsChanged = (0 != any);
+}
+
+void ProcessImage::ChangedInputs(std::vector<int>& points) const
+{
+	if (!m_inputsChanged)
+	{
+		return;
+	}
+	for (size_t i = 0; i < m_changes.size(); ++i)
+	{
+		for (ImageWord word = m_changes[i]; word; word &= word - 1) // clear lowest bit
+		{
+			points.push_back(i * IMAGE_WORD_BITS + __builtin_ctzll(word));
+		}
+	}
+}
+
+void ProcessImage::CommitOutputs()
+{
+	unsigned long long sequence = m_outputSequence.load(std::memory_order_relaxed);
+	m_outputSequence.store(sequence + 1, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+	for (size_t i = 0; i < m_outputs.size(); ++i)
+	{
+		m_outputs[i].store(m_stagedOutputs[i].load(std::memory_order_relaxed),
+			std::memory_order_relaxed);
+	}
+	for (size_t i = 0; i < m_analogueOutputs.size(); ++i)
+	{
+		m_analogueOutputs[i].store(m_stagedAnalogueOutputs[i].load(std::memory_order_relaxed),
+			std::memory_order_relaxed);
+	}
+	m_outputSequence.store(sequence + 2, std::memory_order_release);
+}
+
+void ProcessImage::RestoreOutputs(const std::vector<ImageWord>& digital, 
+	const std::vector<double>& analogue)
+{
+	for (size_t i = 0; i < digital.size() && i < m_stagedOutputs.size(); ++i)
+	{
+		m_stagedOutputs[i].store(digital[i], std::memory_order_relaxed);
+	}
+	for (size_t i = 0; i < analogue.size() && i < m_stagedAnalogueOutputs.size(); ++i)
+	{
+		m_stagedAnalogueOutputs[i].store(analogue[i], std::memory_order_relaxed);
+	}
+	CommitOutputs();
+}
@@ -0,0 +1,206 @@
+///////////////////////////////////////////////////////////////////////////////
+// FILE:          ProcessImage.h
+// PROJECT:       Devices 
+// SUBSYSTEM:     Device Controller 
+//-----------------------------------------------------------------------------
+// DESCRIPTION:   contiguous process image owning every IO point in the system
+//             
+// COPYRIGHT:     Karl Hoover, No Prior Art, 2009
+//
+// LICENSE:       This library is free software; you can redistribute it and/or
+//                modify it under the terms of the GNU Lesser General Public
+//                License (LGPL) as published by the Free Software Foundation.
+//                See license text at http://www.gnu.org/licenses/lgpl.txt 
+//                Briefly you can use this source code pretty much however you
+//                wish, as long as this notice remains intact and you
+//                prominently acknowledge this copyright.
+//
+//                This file is distributed in the hope that it will be useful,
+//                but WITHOUT ANY WARRANTY; without even the implied warranty
+//                of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//                IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//                CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+//                INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES.
+//
+// AUTHOR:        Karl Hoover  karl.hoover@gmail.com
+//
+// REVISIONS:     1.0 October 16, 2026
+//
+// NOTES:   
+// The ProcessImage owns all IO points: digital points packed 64 to a word,
+// analogue points as plain arrays of double. The IO classes in device.h are
+// only (image, point index) views into it, so a scan over thousands of
+// devices walks a few contiguous arrays instead of chasing a bool& per point.
+//
+// There are two copies of the inputs. The field side (IO driver, simulator)
+// writes the live image whenever it likes; once per scan cycle LatchInputs()
+// copies the live image into the scan image in one pass per array, and
+// devices only ever read the scan image. So every device sees the same,
+// consistent inputs for the whole cycle.
+//
+// LatchInputs() also XORs the new digital scan image against the previous
+// one, so after the latch ChangedInputs() lists exactly the points that
+// changed this cycle. See ChangeDispatcher.h for what that is used for.
+//
+// Outputs are double buffered the other way round. Devices write a staging
+// image with atomic fetch_or/fetch_and, so concurrent writers of points in
+// the same word need no lock. Once per scan CommitOutputs() publishes the
+// whole staging image to the field image at once, under a sequence counter
+// (seqlock), and the field side copies it with ReadFieldOutputs() without
+// ever blocking the scan. Outputs written together in one scan, e.g. OPEN!
+// off and CLOSE! on, reach the field together.
+//
+// Points are allocated while the plant is being configured. Don't add points
+// once scanning has started, the arrays may move.
+
+#ifndef PROCESSIMAGE_H
+#define PROCESSIMAGE_H
+
+#include <vector>
+#include <atomic>
+#include <cstddef>
+
+#include <pthread.h>
+
+typedef unsigned long long ImageWord;  // 64 digital points
+#define IMAGE_WORD_BITS 64
+
+// std::vector can't hold atomics, they don't move. Grows only while
+// configuring, so the copy on growth needn't be atomic.
+template <class T> class AtomicArray
+{
+public:
+	AtomicArray(): m_data(NULL), m_size(0), m_capacity(0) {};
+	~AtomicArray() {delete [] m_data;};
+	size_t size() const {return m_size;};
+	std::atomic<T>& operator[](const size_t i) {return m_data[i];};
+	const std::atomic<T>& operator[](const size_t i) const {return m_data[i];};
+	void push_back(const T value)
+	{
+		if (m_size == m_capacity)
+		{
+			m_capacity = m_capacity ? 2 * m_capacity : 16;
+			std::atomic<T>* data = new std::atomic<T>[m_capacity];
+			for (size_t i = 0; i < m_size; ++i)
+			{
+				data[i].store(m_data[i].load(std::memory_order_relaxed), 
+					std::memory_order_relaxed);
+			}
+			delete [] m_data;
+			m_data = data;
+		}
+		m_data[m_size++].store(value, std::memory_order_relaxed);
+	};
+private:
+	AtomicArray(const AtomicArray&);
+	AtomicArray& operator=(const AtomicArray&);
+	std::atomic<T>* m_data;
+	size_t m_size;
+	size_t m_capacity;
+};
+
+class ProcessImage
+{
+public:
+	ProcessImage();
+	~ProcessImage();
+
+	// configuration, returns the new point's index
+	int AddDigitalInput();
+	int AddDigitalOutput();
+	int AddAnalogueInput();
+	int AddAnalogueOutput();
+	int DigitalInputCount() const {return m_digitalInputCount;};
+	int DigitalOutputCount() const {return m_digitalOutputCount;};
+	int AnalogueInputCount() const {return m_analogueInputs.size();};
+	int AnalogueOutputCount() const {return m_stagedAnalogueOutputs.size();};
+
+	// field side: IO drivers post new input values into the live image
+	void WriteFieldInput(const int point, const bool value);
+	void WriteFieldAnalogueInput(const int point, const double value);
+	// many at once, one lock: live = (live & ~mask) | (values & mask)
+	void WriteFieldInputs(const ImageWord* values, const ImageWord* mask);
+	// field side: the outputs as of the last CommitOutputs(), to send to
+	// hardware. Never blocks, retries if a commit overlaps the copy.
+	void ReadFieldOutputs(std::vector<ImageWord>& digital, 
+		std::vector<double>& analogue) const;
+	unsigned long long OutputCommits() const 
+		{return m_outputSequence.load(std::memory_order_acquire) / 2;};
+
+	// once per scan, before devices are updated
+	void LatchInputs();
+	// the scan image as last latched, e.g. for a per-cycle snapshot
+	const ImageWord* InputWords() const {return m_inputs.data();};
+	size_t InputWordCount() const {return m_inputs.size();};
+	// digital inputs which changed in the last LatchInputs()
+	const ImageWord* ChangedWords() const {return m_changes.data();};
+	bool InputsChanged() const {return m_inputsChanged;};
+	void ChangedInputs(std::vector<int>& points) const; // appends
+	// scan thread, after LatchInputs: inputs derived from the scan image,
+	// e.g. interlocks, scan = (scan & ~mask) | (values & mask). The change
+	// bits are corrected to compare against the previous scan.
+	void WriteScanInputs(const ImageWord* values, const ImageWord* mask);
+	// scan thread, after LatchInputs: the analogue scan image, to replace
+	// raw values by derived ones, e.g. filtered
+	double* AnalogueInputValues() {return m_analogueInputs.empty() ? NULL : &m_analogueInputs[0];};
+	const double* AnalogueInputValues() const 
+		{return m_analogueInputs.empty() ? NULL : &m_analogueInputs[0];};
+	
+	// once per scan, after devices are updated. One thread only.
+	void CommitOutputs();
+	// stage and commit a whole output image, e.g. from a checkpoint
+	void RestoreOutputs(const std::vector<ImageWord>& digital, 
+		const std::vector<double>& analogue);
+
+	// device side, scan thread(s)
+	bool ReadInput(const int point) const 
+	{
+		return (m_inputs[point / IMAGE_WORD_BITS] >> (point % IMAGE_WORD_BITS)) & 1;
+	};
+	// outputs read back as staged this scan, not as last committed
+	bool ReadOutput(const int point) const 
+	{
+		return (m_stagedOutputs[point / IMAGE_WORD_BITS].load(std::memory_order_relaxed) 
+			>> (point % IMAGE_WORD_BITS)) & 1;
+	};
+	double ReadAnalogueInput(const int point) const {return m_analogueInputs[point];};
+	double ReadAnalogueOutput(const int point) const 
+		{return m_stagedAnalogueOutputs[point].load(std::memory_order_relaxed);};
+	void WriteOutput(const int point, const bool value)
+	{
+		ImageWord mask = (ImageWord)1 << (point % IMAGE_WORD_BITS);
+		if (value)
+		{
+			m_stagedOutputs[point / IMAGE_WORD_BITS].fetch_or(mask, std::memory_order_relaxed);
+		}
+		else
+		{
+			m_stagedOutputs[point / IMAGE_WORD_BITS].fetch_and(~mask, std::memory_order_relaxed);
+		}
+	};
+	void WriteAnalogueOutput(const int point, const double value)
+		{m_stagedAnalogueOutputs[point].store(value, std::memory_order_relaxed);};
+
+private:
+	ProcessImage(const ProcessImage&);            // owns the mutex, no copies
+	ProcessImage& operator=(const ProcessImage&);
+
+	int m_digitalInputCount;
+	int m_digitalOutputCount;
+	std::vector<ImageWord> m_liveInputs;   // written by the field side
+	std::vector<ImageWord> m_inputs;       // latched, read by devices
+	std::vector<ImageWord> m_changes;      // m_inputs XOR previous m_inputs
+	bool m_inputsChanged;
+	std::vector<double> m_liveAnalogueInputs;
+	std::vector<double> m_analogueInputs;
+	mutable pthread_mutex_t m_inputMtx;  // live inputs against LatchInputs
+	
+	AtomicArray<ImageWord> m_stagedOutputs;   // written by devices
+	AtomicArray<double> m_stagedAnalogueOutputs;
+	AtomicArray<ImageWord> m_outputs;         // committed, read by the field
+	AtomicArray<double> m_analogueOutputs;
+	std::atomic<unsigned long long> m_outputSequence; // odd during a commit
+};
+
+#endif // PROCESSIMAGE_H
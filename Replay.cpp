@@ -0,0 +1,374 @@
+///////////////////////////////////////////////////////////////////////////////
+// FILE:          Replay.cpp
+// PROJECT:       Devices 
+// SUBSYSTEM:     Device Controller 
+//-----------------------------------------------------------------------------
+// DESCRIPTION:   implementation of the monotonic and scan clocks
+//             
+// COPYRIGHT:     Karl Hoover, No Prior Art, 2009
+//
+// LICENSE:       This library is free software; you can redistribute it and/or
+//                modify it under the terms of the GNU Lesser General Public
+//                License (LGPL) as published by the Free Software Foundation.
+//                See license text at http://www.gnu.org/licenses/lgpl.txt 
+//                Briefly you can use this source code pretty much however you
+//                wish, as long as this notice remains intact and you
+//                prominently acknowledge this copyright.
+//
+//                This file is distributed in the hope that it will be useful,
+//                but WITHOUT ANY WARRANTY; without even the implied warranty
+//                of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//                IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//                CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+//                INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES.
+//
+// AUTHOR:        Karl Hoover  karl.hoover@gmail.com
+//
+// REVISIONS:     
+//
+// NOTES:   
+// see Replay.h for comments and history
+
+#include <cstring>
+#include <stdexcept>
+
+#include "Replay.h"
+#include "Historian.h"
+#include "ScanExecutor.h"
+#include "device.h"
+
+using namespace std;
+
+static bool Busy(const int state)
+{
+	return STATE_IDLE != state && STATE_INVALID != state;
+}
+
+Replay::Replay(const vector<Device*>& devices, ProcessImage& image, ScanExecutor* executor): 
+	m_devices(devices), m_image(image), m_executor(executor), 
+	m_clockSource(ScanClockSource()), m_maxDivergences(REPLAY_MAX_DIVERGENCES), 
+	m_nextCommand(0), m_started(false), m_busy(false), m_scan(0), m_time(0), m_scans(0), 
+	m_skipped(0), m_records(0), m_commandCount(0), m_unresolved(0), m_divergenceCount(0)
+{
+	m_image.ReadFieldOutputs(m_digital, m_analogue);
+	m_recorded.assign(m_devices.size(), STATE_INITIALIZING);
+	m_diverged.assign(m_devices.size() + 1, 0);
+	m_mask.assign(m_image.InputWordCount(), ~(ImageWord)0);
+	SetScanClockSource(CLOCK_SOURCE_VIRTUAL);
+}
+
+Replay::~Replay()
+{
+	SetScanClockSource(m_clockSource);
+}
+
+void Replay::AddHook(const int phase, ReplayHook hook, void* context)
+{
+	if (phase < 0 || phase >= SCAN_PHASES)
+	{
+		throw invalid_argument("Replay: no such phase");
+	}
+	Hook entry;
+	entry.hook = hook;
+	entry.context = context;
+	m_hooks[phase].push_back(entry);
+}
+
+void Replay::Check(const HistoryReader& reader) const
+{
+	const HistoryFileHeader& header = reader.Header();
+	bool same = header.deviceCount == m_devices.size() && 
+		header.inputWords == m_image.InputWordCount() &&
+		header.outputWords == m_digital.size() &&
+		header.analogueInputs == (unsigned int)m_image.AnalogueInputCount() &&
+		header.analogueOutputs == m_analogue.size();
+	for (size_t i = 0; same && i < m_devices.size(); ++i)
+	{
+		same = reader.DeviceNameHash(i) == m_devices[i]->NameHash();
+	}
+	if (!same)
+	{
+		throw invalid_argument("Replay: history was recorded from another plant");
+	}
+}
+
+// a command for a transition only a command causes. A wait gets its
+// command when the valve leaves STATE_WAITING for a motion.
+void Replay::Infer(const unsigned long long scan, const int device, const int before,
+	const int after, vector<int>& waiting)
+{
+	if (before == after)
+	{
+		return;
+	}
+	int command = COMMAND_IDLE;
+	if (STATE_WAITING == before && waiting[device] >= 0)
+	{
+		if (STATE_OPENING == after)
+		{
+			m_commands[waiting[device]].command = COMMAND_OPEN;
+		}
+		else if (STATE_CLOSING == after)
+		{
+			m_commands[waiting[device]].command = COMMAND_CLOSE;
+		}
+		waiting[device] = -1;
+		return;
+	}
+	if (STATE_OPENING == after)
+	{
+		command = COMMAND_OPEN;
+	}
+	else if (STATE_CLOSING == after)
+	{
+		command = COMMAND_CLOSE;
+	}
+	else if (STATE_IDLE == after && STATE_INVALID == before)
+	{
+		command = COMMAND_RESET;
+	}
+	else if (STATE_WAITING != after)
+	{
+		return; // the valve did it on its own
+	}
+	Command inferred = {scan, device, command};
+	if (STATE_WAITING == after)
+	{
+		waiting[device] = m_commands.size();
+	}
+	m_commands.push_back(inferred);
+}
+
+// first pass: the commands of the segment, from every recorded transition
+// including those within a scan
+void Replay::InferCommands(const string& path)
+{
+	m_commands.clear();
+	m_nextCommand = 0;
+	HistoryReader reader(path);
+	Check(reader);
+	vector<int> states(m_recorded);
+	vector<int> waiting(m_devices.size(), -1); // index in m_commands
+	bool first = !m_started;
+	while (reader.Next())
+	{
+		const vector<int>& now = reader.States();
+		if (first)
+		{
+			// a motion or wait in progress is restored with its command
+			for (size_t i = 0; i < now.size(); ++i)
+			{
+				Infer(reader.Scan(), i, STATE_IDLE, now[i], waiting);
+			}
+			states = now;
+			first = false;
+			continue;
+		}
+		const vector<HistoryTransition>& transitions = reader.Transitions();
+		for (size_t t = 0; t < transitions.size(); ++t)
+		{
+			const HistoryTransition& transition = transitions[t];
+			int& state = states[transition.device];
+			Infer(reader.Scan(), transition.device, state, transition.from, waiting); // records dropped
+			Infer(reader.Scan(), transition.device, transition.from, transition.to, waiting);
+			state = transition.to;
+		}
+		for (size_t i = 0; i < now.size(); ++i)
+		{
+			Infer(reader.Scan(), i, states[i], now[i], waiting);
+			states[i] = now[i];
+		}
+	}
+}
+
+// a wait which timed out doesn't say what it waited for: guess the motion
+// away from where the valve is
+int Replay::Guess(const int device)
+{
+	++m_unresolved;
+	Valve* valve = dynamic_cast<Valve*>(m_devices[device]);
+	if (!valve)
+	{
+		return COMMAND_IDLE;
+	}
+	return valve->IsOpened() ? COMMAND_CLOSE : COMMAND_OPEN;
+}
+
+void Replay::RunHooks(const int phase)
+{
+	const vector<Hook>& hooks = m_hooks[phase];
+	for (size_t i = 0; i < hooks.size(); ++i)
+	{
+		hooks[i].hook(hooks[i].context, *this);
+	}
+}
+
+void Replay::Diverged(const int device, const int recorded, const int replayed)
+{
+	++m_divergenceCount;
+	if (m_divergences.size() < m_maxDivergences)
+	{
+		ReplayDivergence divergence = {m_scan, m_time, device, recorded, replayed};
+		m_divergences.push_back(divergence);
+	}
+}
+
+void Replay::RunScan(const Nanoseconds time)
+{
+	SetVirtualNanoseconds(time);
+	RunHooks(SCAN_PHASE_INPUTS);
+	m_image.LatchInputs();
+	RunHooks(SCAN_PHASE_LATCHED);
+	if (m_executor)
+	{
+		m_executor->RunCycle();
+	}
+	else
+	{
+		SampleScanTime();
+		for (size_t i = 0; i < m_devices.size(); ++i)
+		{
+			m_devices[i]->Update();
+		}
+	}
+	m_image.CommitOutputs();
+	RunHooks(SCAN_PHASE_COMMITTED);
+	++m_scans;
+
+	m_busy = false;
+	for (size_t i = 0; i < m_devices.size(); ++i)
+	{
+		int state = m_devices[i]->State();
+		m_busy = m_busy || Busy(state);
+		bool differs = state != m_recorded[i];
+		if (differs && !m_diverged[i])
+		{
+			Diverged(i, m_recorded[i], state);
+		}
+		m_diverged[i] = differs;
+	}
+}
+
+void Replay::CompareOutputs(const HistoryReader& reader)
+{
+	m_image.ReadFieldOutputs(m_digital, m_analogue);
+	bool differs = m_digital != reader.Outputs() || m_analogue != reader.AnalogueOutputs();
+	if (differs && !m_diverged[m_devices.size()])
+	{
+		Diverged(-1, 0, 0);
+	}
+	m_diverged[m_devices.size()] = differs;
+}
+
+// the first keyframe: outputs, inputs and states as recorded, as a warm
+// restart does
+void Replay::Start(const HistoryReader& reader)
+{
+	m_image.RestoreOutputs(reader.Outputs(), reader.AnalogueOutputs());
+	if (!m_mask.empty())
+	{
+		m_image.WriteFieldInputs(&reader.Inputs()[0], &m_mask[0]);
+	}
+	for (size_t i = 0; i < reader.AnalogueInputs().size(); ++i)
+	{
+		m_image.WriteFieldAnalogueInput(i, reader.AnalogueInputs()[i]);
+	}
+	m_image.LatchInputs();
+	SetVirtualNanoseconds(reader.Time());
+	SampleScanTime();
+	m_scan = reader.Scan();
+	m_time = reader.Time();
+	m_recorded = reader.States();
+	for (size_t i = 0; i < m_devices.size(); ++i)
+	{
+		DeviceCheckpoint record;
+		memset(&record, 0, sizeof(record));
+		record.nameHash = m_devices[i]->NameHash();
+		record.state = m_recorded[i];
+		record.command = STATE_OPENING == record.state ? COMMAND_OPEN : 
+			STATE_CLOSING == record.state ? COMMAND_CLOSE : COMMAND_IDLE;
+		for (size_t c = m_nextCommand; c < m_commands.size() && 
+			m_commands[c].scan == m_scan; ++c)
+		{
+			if (m_commands[c].device == (int)i)
+			{
+				record.command = record.pendingCommand = COMMAND_IDLE == m_commands[c].command ?
+					Guess(i) : m_commands[c].command;
+			}
+		}
+		m_devices[i]->RestoreState(record); // or it initializes from its sensors
+		m_busy = m_busy || Busy(m_devices[i]->State());
+	}
+	m_started = true;
+}
+
+// a recorded scan: the scans since the last one, then this one's inputs,
+// commands and scan
+void Replay::Apply(const HistoryReader& reader)
+{
+	unsigned long long gap = reader.Scan() - m_scan;
+	Nanoseconds from = m_time;
+	Nanoseconds span = reader.Time() - m_time;
+	for (unsigned long long s = 1; s < gap; ++s)
+	{
+		if (!m_busy)
+		{
+			m_skipped += gap - s;
+			break;
+		}
+		m_scan = reader.Scan() - gap + s;
+		m_time = from + (Nanoseconds)((double)span * s / gap);
+		RunScan(m_time);
+	}
+
+	if (!reader.ChangedInputs().empty() && !m_mask.empty())
+	{
+		m_image.WriteFieldInputs(&reader.Inputs()[0], &m_mask[0]);
+	}
+	const vector<int>& analogue = reader.ChangedAnalogueInputs();
+	for (size_t i = 0; i < analogue.size(); ++i)
+	{
+		m_image.WriteFieldAnalogueInput(analogue[i], reader.AnalogueInputs()[analogue[i]]);
+	}
+	m_scan = reader.Scan();
+	m_time = reader.Time();
+	for (; m_nextCommand < m_commands.size() && m_commands[m_nextCommand].scan <= m_scan;
+		++m_nextCommand)
+	{
+		const Command& command = m_commands[m_nextCommand];
+		if (command.scan < m_scan)
+		{
+			continue; // before where the replay started
+		}
+		int posted = COMMAND_IDLE == command.command ? Guess(command.device) : command.command;
+		if (COMMAND_IDLE != posted)
+		{
+			m_devices[command.device]->PostCommand(posted);
+			++m_commandCount;
+		}
+	}
+	m_recorded = reader.States();
+	RunScan(m_time);
+	CompareOutputs(reader);
+}
+
+unsigned long long Replay::Play(const string& path)
+{
+	InferCommands(path);
+	HistoryReader reader(path);
+	unsigned long long scans = m_scans;
+	while (reader.Next())
+	{
+		if (!m_started)
+		{
+			Start(reader);
+		}
+		else if (reader.Scan() > m_scan)
+		{
+			Apply(reader);
+		}
+		++m_records;
+	}
+	return m_scans - scans;
+}
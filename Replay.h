@@ -0,0 +1,186 @@
+///////////////////////////////////////////////////////////////////////////////
+// FILE:          Replay.h
+// PROJECT:       Devices 
+// SUBSYSTEM:     Device Controller 
+//-----------------------------------------------------------------------------
+// DESCRIPTION:   deterministic replay of a recorded history
+//             
+// COPYRIGHT:     Karl Hoover, No Prior Art, 2009
+//
+// LICENSE:       This library is free software; you can redistribute it and/or
+//                modify it under the terms of the GNU Lesser General Public
+//                License (LGPL) as published by the Free Software Foundation.
+//                See license text at http://www.gnu.org/licenses/lgpl.txt 
+//                Briefly you can use this source code pretty much however you
+//                wish, as long as this notice remains intact and you
+//                prominently acknowledge this copyright.
+//
+//                This file is distributed in the hope that it will be useful,
+//                but WITHOUT ANY WARRANTY; without even the implied warranty
+//                of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//                IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//                CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+//                INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES.
+//
+// AUTHOR:        Karl Hoover  karl.hoover@gmail.com
+//
+// REVISIONS:     1.0 October 16, 2026
+//
+// NOTES:   
+// Replay drives a plant from history segments written by a Historian (see
+// Historian.h), to reproduce in the office what the valves did on the
+// machine and to regression test changes to them against months of plant
+// history. Build the plant from the same configuration as the recorded
+// one, then Play() its segments in order. The devices and image must be
+// the same as recorded: same device order, names and point counts.
+//
+// Time is the recorded ScanTime() of each scan, put on the virtual clock
+// (CLOCK_SOURCE_VIRTUAL, see ScanClock.h), so the valves time out exactly
+// as they did and the replay runs as fast as the CPU allows. The first
+// keyframe restores the outputs and the device states, as a warm restart
+// from a checkpoint does; a motion or interlock wait in progress starts
+// its timeout again from there. Each recorded scan after that writes the
+// recorded inputs into the live image and runs a scan:
+//
+//     SCAN_PHASE_INPUTS hooks
+//     ProcessImage::LatchInputs()
+//     SCAN_PHASE_LATCHED hooks    e.g. the InterlockEngine the plant had
+//     Update() of every device    or ScanExecutor::RunCycle()
+//     ProcessImage::CommitOutputs()
+//     SCAN_PHASE_COMMITTED hooks  e.g. a Historian recording the replay
+//
+// Scans in which nothing was recorded changed nothing; they are replayed
+// at times interpolated between their neighbours (exact for a steady scan
+// period) while some valve is in motion or waiting, i.e. something could
+// time out, and skipped while every valve is at rest or STATE_INVALID.
+//
+// The history holds states, not commands, so the commands are inferred
+// from the recorded transitions, those within a scan included (IDLE to
+// OPENING to INVALID in one Update is an open): to STATE_OPENING an open, to
+// STATE_CLOSING a close, STATE_INVALID to STATE_IDLE a reset, and to
+// STATE_WAITING whichever motion the valve went on to start. A wait that
+// timed out, or that still waits at the end of the segment, doesn't say
+// which: it is counted as unresolved and replayed as the motion away from
+// where the valve is.
+// Analogue inputs are as recorded, i.e. to within the recorder's deadband.
+//
+// After every replayed scan the device states are compared with the
+// recorded ones, and the outputs on recorded scans. Each time a device
+// starts to differ a ReplayDivergence is kept, up to a limit, so two runs
+// of the same history give the same list and an empty list means the
+// valves did what they did on the machine. The scan clock source is set
+// to CLOCK_SOURCE_VIRTUAL for the life of the Replay and put back after.
+
+#ifndef REPLAY_H
+#define REPLAY_H
+
+#include <string>
+#include <vector>
+
+#include "ScanClock.h"
+#include "ScanRuntime.h"
+#include "ProcessImage.h"
+
+class Device;
+class ScanExecutor;
+class HistoryReader;
+class Replay;
+
+#define REPLAY_MAX_DIVERGENCES 1000 // kept, the rest are only counted
+
+struct ReplayDivergence
+{
+	unsigned long long scan; // recorded scan number
+	Nanoseconds time;
+	int device;              // index, -1: the outputs differ
+	int recorded;            // states, 0 for the outputs
+	int replayed;
+};
+
+typedef void (*ReplayHook)(void* context, Replay& replay);
+
+class Replay
+{
+public:
+	// the devices in the recorded order. Without an executor every device
+	// is updated in turn on the calling thread.
+	Replay(const std::vector<Device*>& devices, ProcessImage& image, 
+		ScanExecutor* executor = NULL);
+	~Replay(); // puts the scan clock source back
+
+	// before Play, phases as for ScanRuntime
+	void AddHook(const int phase, ReplayHook hook, void* context = NULL);
+	void SetMaxDivergences(const size_t max) {m_maxDivergences = max;};
+
+	// one segment, carrying on from the last one played. Throws
+	// runtime_error if it can't be read, invalid_argument if it was
+	// recorded from another plant. Returns the scans replayed.
+	unsigned long long Play(const std::string& path);
+
+	unsigned long long Scan() const {return m_scan;};  // last replayed, recorded numbering
+	Nanoseconds Time() const {return m_time;};
+	unsigned long long Scans() const {return m_scans;};     // run
+	unsigned long long Skipped() const {return m_skipped;}; // nothing could happen
+	unsigned long long Records() const {return m_records;};
+	unsigned long long Commands() const {return m_commandCount;}; // inferred and posted
+	unsigned long long Unresolved() const {return m_unresolved;}; // commands guessed
+	unsigned long long DivergenceCount() const {return m_divergenceCount;};
+	const std::vector<ReplayDivergence>& Divergences() const {return m_divergences;};
+	const std::vector<int>& RecordedStates() const {return m_recorded;};
+
+private:
+	Replay(const Replay&);
+	Replay& operator=(const Replay&);
+	struct Hook
+	{
+		ReplayHook hook;
+		void* context;
+	};
+	struct Command
+	{
+		unsigned long long scan;
+		int device;
+		int command; // COMMAND_IDLE: unresolved
+	};
+	void Check(const HistoryReader& reader) const;
+	void Infer(const unsigned long long scan, const int device, const int before, 
+		const int after, std::vector<int>& waiting);
+	void InferCommands(const std::string& path);
+	int Guess(const int device);
+	void Start(const HistoryReader& reader);
+	void Apply(const HistoryReader& reader);
+	void RunScan(const Nanoseconds time);
+	void RunHooks(const int phase);
+	void CompareOutputs(const HistoryReader& reader);
+	void Diverged(const int device, const int recorded, const int replayed);
+
+	std::vector<Device*> m_devices;
+	ProcessImage& m_image;
+	ScanExecutor* m_executor;
+	std::vector<Hook> m_hooks[SCAN_PHASES];
+	int m_clockSource; // to put back
+	size_t m_maxDivergences;
+
+	std::vector<Command> m_commands; // of the segment, in scan order
+	size_t m_nextCommand;
+	std::vector<int> m_recorded;     // states as of m_scan
+	std::vector<char> m_diverged;    // per device, last one the outputs
+	std::vector<ImageWord> m_mask;   // all ones, for WriteFieldInputs
+	std::vector<ImageWord> m_digital;
+	std::vector<double> m_analogue;
+	bool m_started;
+	bool m_busy;      // a valve in motion or waiting after the last scan
+
+	unsigned long long m_scan;
+	Nanoseconds m_time;
+	unsigned long long m_scans;
+	unsigned long long m_skipped;
+	unsigned long long m_records;
+	unsigned long long m_commandCount;
+	unsigned long long m_unresolved;
+	unsigned long long m_divergenceCount;
+	std::vector<ReplayDivergence> m_divergences;
+};
+
+#endif // REPLAY_H
@@ -0,0 +1,170 @@
+///////////////////////////////////////////////////////////////////////////////
+// FILE:          ScanClock.cpp
+// PROJECT:       Devices 
+// SUBSYSTEM:     Device Controller 
+//-----------------------------------------------------------------------------
+// DESCRIPTION:   implementation of the monotonic and scan clocks
+//             
+// COPYRIGHT:     Karl Hoover, No Prior Art, 2009
+//
+// LICENSE:       This library is free software; you can redistribute it and/or
+//                modify it under the terms of the GNU Lesser General Public
+//                License (LGPL) as published by the Free Software Foundation.
+//                See license text at http://www.gnu.org/licenses/lgpl.txt 
+//                Briefly you can use this source code pretty much however you
+//                wish, as long as this notice remains intact and you
+//                prominently acknowledge this copyright.
+//
+//                This file is distributed in the hope that it will be useful,
+//                but WITHOUT ANY WARRANTY; without even the implied warranty
+//                of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//                IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//                CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+//                INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES.
+//
+// AUTHOR:        Karl Hoover  karl.hoover@gmail.com
+//
+// REVISIONS:     
+//
+// NOTES:   
+// see ScanClock.h for comments and history
+
+#include <atomic>
+#include <time.h>
+
+#include <pthread.h>
+
+#include "ScanClock.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#include <cpuid.h>
+#define HAVE_TSC 1
+#else
+#define HAVE_TSC 0
+#endif
+
+// scan time of -1: never sampled, read the clock live
+static std::atomic<Nanoseconds> s_scanTime(-1);
+static std::atomic<int> s_clockSource(CLOCK_SOURCE_MONOTONIC);
+static std::atomic<Nanoseconds> s_virtualTime(0);
+
+Nanoseconds MonotonicNanoseconds()
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (Nanoseconds)now.tv_sec * NANOSECONDS_PER_SECOND + now.tv_nsec;
+}
+
+// TSC calibration: time a busy interval with both clocks, then
+// nanoseconds = base + (tsc - tscBase) * scale. Done once, under a
+// pthread_once so concurrent first callers agree.
+
+static bool s_tscUsable = false;
+static unsigned long long s_tscBase = 0;
+static Nanoseconds s_tscNanosecondsBase = 0;
+static double s_nanosecondsPerTick = 0.;
+static pthread_once_t s_tscOnce = PTHREAD_ONCE_INIT;
+
+static void CalibrateTsc()
+{
+#if HAVE_TSC
+	unsigned int eax, ebx, ecx, edx;
+	if (!__get_cpuid(0x80000007, &eax, &ebx, &ecx, &edx) || !(edx & (1 << 8)))
+	{
+		return; // no invariant TSC, it may stop or change rate
+	}
+	Nanoseconds startNs = MonotonicNanoseconds();
+	unsigned long long startTsc = __rdtsc();
+	Nanoseconds endNs;
+	do
+	{
+		endNs = MonotonicNanoseconds();
+	} while (endNs - startNs < 20 * NANOSECONDS_PER_MILLISECOND);
+	unsigned long long endTsc = __rdtsc();
+	if (endTsc <= startTsc)
+	{
+		return;
+	}
+	s_nanosecondsPerTick = (double)(endNs - startNs) / (double)(endTsc - startTsc);
+	s_tscBase = endTsc;
+	s_tscNanosecondsBase = endNs;
+	s_tscUsable = true;
+#endif
+}
+
+bool TscAvailable()
+{
+	pthread_once(&s_tscOnce, CalibrateTsc);
+	return s_tscUsable;
+}
+
+Nanoseconds TscNanoseconds()
+{
+#if HAVE_TSC
+	if (TscAvailable())
+	{
+		return s_tscNanosecondsBase + 
+			(Nanoseconds)((double)(__rdtsc() - s_tscBase) * s_nanosecondsPerTick);
+	}
+#endif
+	return MonotonicNanoseconds();
+}
+
+bool SetScanClockSource(const int source)
+{
+	if (CLOCK_SOURCE_TSC == source && !TscAvailable())
+	{
+		return false;
+	}
+	if (CLOCK_SOURCE_TSC != source && CLOCK_SOURCE_MONOTONIC != source &&
+		CLOCK_SOURCE_VIRTUAL != source)
+	{
+		return false;
+	}
+	s_clockSource.store(source, std::memory_order_relaxed);
+	return true;
+}
+
+int ScanClockSource()
+{
+	return s_clockSource.load(std::memory_order_relaxed);
+}
+
+Nanoseconds ClockNanoseconds()
+{
+	int source = s_clockSource.load(std::memory_order_relaxed);
+	if (CLOCK_SOURCE_TSC == source)
+	{
+		return TscNanoseconds();
+	}
+	if (CLOCK_SOURCE_VIRTUAL == source)
+	{
+		return s_virtualTime.load(std::memory_order_relaxed);
+	}
+	return MonotonicNanoseconds();
+}
+
+void SetVirtualNanoseconds(const Nanoseconds now)
+{
+	s_virtualTime.store(now, std::memory_order_relaxed);
+}
+
+Nanoseconds VirtualNanoseconds()
+{
+	return s_virtualTime.load(std::memory_order_relaxed);
+}
+
+Nanoseconds SampleScanTime()
+{
+	Nanoseconds now = ClockNanoseconds();
+	s_scanTime.store(now, std::memory_order_relaxed);
+	return now;
+}
+
+Nanoseconds ScanTime()
+{
+	Nanoseconds now = s_scanTime.load(std::memory_order_relaxed);
+	return now < 0 ? ClockNanoseconds() : now;
+}
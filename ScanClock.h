@@ -0,0 +1,77 @@
+///////////////////////////////////////////////////////////////////////////////
+// FILE:          ScanClock.h
+// PROJECT:       Devices 
+// SUBSYSTEM:     Device Controller 
+//-----------------------------------------------------------------------------
+// DESCRIPTION:   monotonic nanosecond clock and the per scan cached time
+//             
+// COPYRIGHT:     Karl Hoover, No Prior Art, 2009
+//
+// LICENSE:       This library is free software; you can redistribute it and/or
+//                modify it under the terms of the GNU Lesser General Public
+//                License (LGPL) as published by the Free Software Foundation.
+//                See license text at http://www.gnu.org/licenses/lgpl.txt 
+//                Briefly you can use this source code pretty much however you
+//                wish, as long as this notice remains intact and you
+//                prominently acknowledge this copyright.
+//
+//                This file is distributed in the hope that it will be useful,
+//                but WITHOUT ANY WARRANTY; without even the implied warranty
+//                of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//                IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//                CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+//                INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES.
+//
+// AUTHOR:        Karl Hoover  karl.hoover@gmail.com
+//
+// REVISIONS:     1.0 October 16, 2026
+//                1.1 October 16, 2026 virtual clock for replay
+//
+// NOTES:   
+// TimeMicroseconds() is the wall clock, fine for time stamping logs but it
+// steps when NTP or an operator sets the time, which can fire or hide a
+// timeout. Everything that measures an interval uses this clock instead:
+// CLOCK_MONOTONIC in integer nanoseconds, or on x86 with an invariant TSC
+// optionally the TSC, calibrated against CLOCK_MONOTONIC, which avoids even
+// the vDSO call.
+//
+// The scan time is the clock sampled once at the start of each scan cycle
+// by SampleScanTime() (ScanExecutor::RunCycle does this). Every device reads
+// ScanTime() during the cycle, so thousands of devices cost one clock read
+// and agree on what "now" is. Until the first SampleScanTime() ScanTime()
+// reads the clock live, so code driving Update() by hand still works.
+//
+// CLOCK_SOURCE_VIRTUAL is a clock which only moves when told to, by
+// SetVirtualNanoseconds(). Replay (see Replay.h) selects it so the valves'
+// timeouts run on the recorded time, not on how fast the replay goes, and
+// a test can step time past a timeout without sleeping through it.
+
+#ifndef SCANCLOCK_H
+#define SCANCLOCK_H
+
+typedef long long Nanoseconds;
+
+#define NANOSECONDS_PER_MICROSECOND 1000LL
+#define NANOSECONDS_PER_MILLISECOND 1000000LL
+#define NANOSECONDS_PER_SECOND 1000000000LL
+
+#define CLOCK_SOURCE_MONOTONIC 0  // clock_gettime(CLOCK_MONOTONIC)
+#define CLOCK_SOURCE_TSC 1        // calibrated rdtsc
+#define CLOCK_SOURCE_VIRTUAL 2    // SetVirtualNanoseconds()
+
+extern Nanoseconds MonotonicNanoseconds();
+extern bool TscAvailable();        // invariant TSC present, calibrates on first call
+extern Nanoseconds TscNanoseconds(); // same time base as MonotonicNanoseconds
+
+// source for SampleScanTime(), returns false if it isn't available here
+extern bool SetScanClockSource(const int source);
+extern int ScanClockSource();
+extern Nanoseconds ClockNanoseconds(); // the selected source, read now
+extern void SetVirtualNanoseconds(const Nanoseconds now); // any value, may go back
+extern Nanoseconds VirtualNanoseconds();
+
+extern Nanoseconds SampleScanTime(); // once per scan, returns the new time
+extern Nanoseconds ScanTime();       // cached, as of the last sample
+
+#endif // SCANCLOCK_H
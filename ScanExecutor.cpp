@@ -0,0 +1,179 @@
+///////////////////////////////////////////////////////////////////////////////
+// FILE:          ScanExecutor.cpp
+// PROJECT:       Devices 
+// SUBSYSTEM:     Device Controller 
+//-----------------------------------------------------------------------------
+// DESCRIPTION:   implementation of the work stealing scan executor
+//             
+// COPYRIGHT:     Karl Hoover, No Prior Art, 2009
+//
+// LICENSE:       This library is free software; you can redistribute it and/or
+//                modify it under the terms of the GNU Lesser General Public
+//                License (LGPL) as published by the Free Software Foundation.
+//                See license text at http://www.gnu.org/licenses/lgpl.txt 
+//                Briefly you can use this source code pretty much however you
+//                wish, as long as this notice remains intact and you
+//                prominently acknowledge this copyright.
+//
+//                This file is distributed in the hope that it will be useful,
+//                but WITHOUT ANY WARRANTY; without even the implied warranty
+//                of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//                IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//                CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+//                INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES.
+//
+// AUTHOR:        Karl Hoover  karl.hoover@gmail.com
+//
+// REVISIONS:     
+//
+// NOTES:   
+// see ScanExecutor.h for comments and history
+
+#include "ScanExecutor.h"
+#include "device.h"
+
+// devices claimed per fetch_add. Small enough to balance, big enough that
+// the cursor cache line isn't bounced around on every device.
+#define SCAN_CHUNK 16
+
+ScanExecutor::ScanExecutor(const int threads): m_threadCount(threads < 1 ? 1 : threads),
+	m_stop(false)
+{
+	m_slices = new Slice[m_threadCount];
+	ResetStatistics();
+	pthread_barrier_init(&m_start, NULL, m_threadCount);
+	pthread_barrier_init(&m_done, NULL, m_threadCount);
+	m_threads.resize(m_threadCount);
+	m_workerArgs.resize(m_threadCount);
+	for (int i = 1; i < m_threadCount; ++i) // the caller is worker 0
+	{
+		m_workerArgs[i] = std::make_pair(this, i);
+		pthread_create(&m_threads[i], NULL, WorkerEntry, &m_workerArgs[i]);
+	}
+}
+
+ScanExecutor::~ScanExecutor()
+{
+	m_stop = true;
+	pthread_barrier_wait(&m_start); // release the workers to see m_stop
+	for (int i = 1; i < m_threadCount; ++i)
+	{
+		pthread_join(m_threads[i], NULL);
+	}
+	pthread_barrier_destroy(&m_start);
+	pthread_barrier_destroy(&m_done);
+	delete [] m_slices;
+}
+
+void ScanExecutor::Register(Device& device)
+{
+	m_devices.push_back(&device);
+}
+
+void* ScanExecutor::WorkerEntry(void* arg)
+{
+	std::pair<ScanExecutor*, int>* self = static_cast<std::pair<ScanExecutor*, int>*>(arg);
+	self->first->WorkerLoop(self->second);
+	return NULL;
+}
+
+void ScanExecutor::WorkerLoop(const int worker)
+{
+	while (true)
+	{
+		pthread_barrier_wait(&m_start);
+		if (m_stop)
+		{
+			break;
+		}
+		RunSlices(worker);
+		pthread_barrier_wait(&m_done);
+	}
+}
+
+// even contiguous slices, so in the common case a worker updates the same
+// devices every cycle and keeps them in its cache
+void ScanExecutor::Partition()
+{
+	long count = m_devices.size();
+	for (int i = 0; i < m_threadCount; ++i)
+	{
+		m_slices[i].next.store(count * i / m_threadCount, std::memory_order_relaxed);
+		m_slices[i].end = count * (i + 1) / m_threadCount;
+		m_slices[i].stolen = 0;
+	}
+}
+
+void ScanExecutor::RunSlices(const int worker)
+{
+	// own slice first, then go round the others
+	for (int i = 0; i < m_threadCount; ++i)
+	{
+		Slice& slice = m_slices[(worker + i) % m_threadCount];
+		while (true)
+		{
+			long begin = slice.next.fetch_add(SCAN_CHUNK, std::memory_order_relaxed);
+			if (begin >= slice.end)
+			{
+				break;
+			}
+			long end = begin + SCAN_CHUNK < slice.end ? begin + SCAN_CHUNK : slice.end;
+			for (long d = begin; d < end; ++d)
+			{
+				m_devices[d]->Update();
+			}
+			if (i)
+			{
+				++m_slices[worker].stolen;
+			}
+		}
+	}
+}
+
+Nanoseconds ScanExecutor::RunCycle()
+{
+	Nanoseconds start = MonotonicNanoseconds(); // real time, the scan clock may be virtual
+	SampleScanTime();
+	Partition();
+	pthread_barrier_wait(&m_start); // barrier waits order Partition before the workers
+	RunSlices(0);
+	pthread_barrier_wait(&m_done);
+	
+	m_lastCycleTime = MonotonicNanoseconds() - start;
+	++m_cycles;
+	m_totalCycleTime += m_lastCycleTime;
+	if (m_lastCycleTime < m_minCycleTime)
+	{
+		m_minCycleTime = m_lastCycleTime;
+	}
+	if (m_lastCycleTime > m_maxCycleTime)
+	{
+		m_maxCycleTime = m_lastCycleTime;
+	}
+	return m_lastCycleTime;
+}
+
+double ScanExecutor::MeanCycleTime() const
+{
+	return m_cycles ? (double)m_totalCycleTime / m_cycles : 0.;
+}
+
+int ScanExecutor::StolenLastCycle() const
+{
+	int stolen = 0;
+	for (int i = 0; i < m_threadCount; ++i)
+	{
+		stolen += m_slices[i].stolen;
+	}
+	return stolen;
+}
+
+void ScanExecutor::ResetStatistics()
+{
+	m_cycles = 0;
+	m_lastCycleTime = 0;
+	m_minCycleTime = 0x7fffffffffffffffLL;
+	m_maxCycleTime = 0;
+	m_totalCycleTime = 0;
+}
@@ -0,0 +1,109 @@
+///////////////////////////////////////////////////////////////////////////////
+// FILE:          ScanExecutor.h
+// PROJECT:       Devices 
+// SUBSYSTEM:     Device Controller 
+//-----------------------------------------------------------------------------
+// DESCRIPTION:   runs one Update() pass over all registered devices per scan
+//                cycle on a pool of worker threads
+//             
+// COPYRIGHT:     Karl Hoover, No Prior Art, 2009
+//
+// LICENSE:       This library is free software; you can redistribute it and/or
+//                modify it under the terms of the GNU Lesser General Public
+//                License (LGPL) as published by the Free Software Foundation.
+//                See license text at http://www.gnu.org/licenses/lgpl.txt 
+//                Briefly you can use this source code pretty much however you
+//                wish, as long as this notice remains intact and you
+//                prominently acknowledge this copyright.
+//
+//                This file is distributed in the hope that it will be useful,
+//                but WITHOUT ANY WARRANTY; without even the implied warranty
+//                of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//                IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//                CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+//                INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES.
+//
+// AUTHOR:        Karl Hoover  karl.hoover@gmail.com
+//
+// REVISIONS:     1.0 October 16, 2026  needs C++11 for <atomic>
+//
+// NOTES:   
+// The registered devices are split into one contiguous slice per worker.
+// Each cycle a worker claims small chunks from the front of its own slice;
+// when its slice is empty it claims chunks from the other workers' slices
+// (work stealing), so a worker that drew slow devices doesn't hold up the
+// cycle. Claiming is a single atomic fetch_add on the slice cursor, so owner
+// and thieves never lock. The calling thread is worker 0, RunCycle() returns
+// after every device has had exactly one Update(), i.e. at the barrier.
+//
+// Devices must not be registered while a cycle is running. Two devices
+// updated in the same cycle may run on different threads at the same time,
+// anything they share (the ProcessImage outputs) must cope with that.
+
+#ifndef SCANEXECUTOR_H
+#define SCANEXECUTOR_H
+
+#include <vector>
+#include <atomic>
+
+#include <pthread.h>
+
+#include "ScanClock.h"
+
+class Device;
+
+class ScanExecutor
+{
+public:
+	ScanExecutor(const int threads); // total, including the caller of RunCycle
+	~ScanExecutor();
+	void Register(Device& device);
+	int DeviceCount() const {return m_devices.size();};
+	int ThreadCount() const {return m_threadCount;};
+	
+	Nanoseconds RunCycle(); // samples the scan time, returns cycle duration
+	
+	// statistics
+	unsigned long long Cycles() const {return m_cycles;};
+	Nanoseconds LastCycleTime() const {return m_lastCycleTime;};
+	Nanoseconds MinCycleTime() const {return m_minCycleTime;};
+	Nanoseconds MaxCycleTime() const {return m_maxCycleTime;};
+	double MeanCycleTime() const;
+	int StolenLastCycle() const;  // chunks a worker took from another's slice
+	void ResetStatistics();
+
+private:
+	ScanExecutor(const ScanExecutor&);
+	ScanExecutor& operator=(const ScanExecutor&);
+
+	struct Slice  // one per worker, padded so cursors don't share a cache line
+	{
+		std::atomic<long> next;
+		long end;
+		int stolen;
+		char pad[64 - sizeof(std::atomic<long>) - sizeof(long) - sizeof(int)];
+	};
+
+	static void* WorkerEntry(void* arg);
+	void WorkerLoop(const int worker);
+	void RunSlices(const int worker);
+	void Partition();
+
+	std::vector<Device*> m_devices;
+	int m_threadCount;
+	Slice* m_slices;
+	std::vector<pthread_t> m_threads;
+	std::vector<std::pair<ScanExecutor*, int> > m_workerArgs;
+	pthread_barrier_t m_start;
+	pthread_barrier_t m_done;
+	volatile bool m_stop; // only changes between barriers
+
+	unsigned long long m_cycles;
+	Nanoseconds m_lastCycleTime;
+	Nanoseconds m_minCycleTime;
+	Nanoseconds m_maxCycleTime;
+	Nanoseconds m_totalCycleTime;
+};
+
+#endif // SCANEXECUTOR_H
@@ -0,0 +1,263 @@
+///////////////////////////////////////////////////////////////////////////////
+// FILE:          ScanRuntime.cpp
+// PROJECT:       Devices 
+// SUBSYSTEM:     Device Controller 
+//-----------------------------------------------------------------------------
+// DESCRIPTION:   implementation of the monotonic and scan clocks
+//             
+// COPYRIGHT:     Karl Hoover, No Prior Art, 2009
+//
+// LICENSE:       This library is free software; you can redistribute it and/or
+//                modify it under the terms of the GNU Lesser General Public
+//                License (LGPL) as published by the Free Software Foundation.
+//                See license text at http://www.gnu.org/licenses/lgpl.txt 
+//                Briefly you can use this source code pretty much however you
+//                wish, as long as this notice remains intact and you
+//                prominently acknowledge this copyright.
+//
+//                This file is distributed in the hope that it will be useful,
+//                but WITHOUT ANY WARRANTY; without even the implied warranty
+//                of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//                IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//                CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+//                INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES.
+//
+// AUTHOR:        Karl Hoover  karl.hoover@gmail.com
+//
+// REVISIONS:     
+//
+// NOTES:   
+// see ScanRuntime.h for comments and history
+
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+
+#include <sched.h>
+#include <time.h>
+#include <sys/mman.h>
+
+#include "ScanRuntime.h"
+#include "ProcessImage.h"
+#include "ScanExecutor.h"
+#include "TimerWheel.h"
+
+using namespace std;
+
+static void Fail(const string& what, const int error)
+{
+	throw runtime_error("ScanRuntime: cannot " + what + ": " + strerror(error));
+}
+
+ScanRuntime::ScanRuntime(ProcessImage& image, ScanExecutor& executor, 
+	const Nanoseconds period): m_image(image), m_executor(executor), m_period(period),
+	m_wheel(NULL), m_cpu(-1), m_priority(0), m_lockMemory(false), m_started(false),
+	m_running(false), m_stop(false), m_cycles(0), m_overruns(0), m_missed(0)
+{
+	if (period <= 0)
+	{
+		throw invalid_argument("ScanRuntime: the period must be positive");
+	}
+}
+
+ScanRuntime::~ScanRuntime()
+{
+	Stop();
+}
+
+void ScanRuntime::AddHook(const int phase, ScanHook hook, void* context)
+{
+	if (phase < 0 || phase >= SCAN_PHASES)
+	{
+		throw invalid_argument("ScanRuntime: no such phase");
+	}
+	Hook entry;
+	entry.hook = hook;
+	entry.context = context;
+	m_hooks[phase].push_back(entry);
+}
+
+void ScanRuntime::Run()
+{
+	if (m_running.exchange(true))
+	{
+		throw runtime_error("ScanRuntime: already running");
+	}
+	try
+	{
+		SetUpThread();
+	}
+	catch (...)
+	{
+		m_running.store(false, std::memory_order_release);
+		throw;
+	}
+	m_stop.store(false, std::memory_order_release);
+	Loop();
+	m_running.store(false, std::memory_order_release);
+}
+
+void ScanRuntime::Start()
+{
+	if (m_running.exchange(true))
+	{
+		throw runtime_error("ScanRuntime: already running");
+	}
+	if (m_started) // a previous run stopped itself from a hook
+	{
+		pthread_join(m_thread, NULL);
+		m_started = false;
+	}
+	// the thread is created with its affinity and priority, so a failure is
+	// reported here rather than lost in the thread
+	pthread_attr_t attributes;
+	pthread_attr_init(&attributes);
+	int error = 0;
+	string what;
+	if (m_lockMemory && mlockall(MCL_CURRENT | MCL_FUTURE))
+	{
+		error = errno;
+		what = "lock memory";
+	}
+	if (!error && m_cpu >= 0)
+	{
+		cpu_set_t cpus;
+		CPU_ZERO(&cpus);
+		CPU_SET(m_cpu, &cpus);
+		error = pthread_attr_setaffinity_np(&attributes, sizeof(cpus), &cpus);
+		what = "pin to cpu";
+	}
+	if (!error && m_priority > 0)
+	{
+		struct sched_param param;
+		param.sched_priority = m_priority;
+		pthread_attr_setinheritsched(&attributes, PTHREAD_EXPLICIT_SCHED);
+		pthread_attr_setschedpolicy(&attributes, SCHED_FIFO);
+		error = pthread_attr_setschedparam(&attributes, &param);
+		what = "set SCHED_FIFO priority";
+	}
+	if (!error)
+	{
+		m_stop.store(false, std::memory_order_release);
+		error = pthread_create(&m_thread, &attributes, Entry, this);
+		what = "start the scan thread";
+	}
+	pthread_attr_destroy(&attributes);
+	if (error)
+	{
+		m_running.store(false, std::memory_order_release);
+		Fail(what, error);
+	}
+	m_started = true;
+}
+
+void ScanRuntime::Stop()
+{
+	m_stop.store(true, std::memory_order_release);
+	if (m_started && !pthread_equal(pthread_self(), m_thread))
+	{
+		pthread_join(m_thread, NULL);
+		m_started = false;
+	}
+}
+
+void ScanRuntime::ResetStatistics()
+{
+	m_cycles.store(0, std::memory_order_relaxed);
+	m_overruns.store(0, std::memory_order_relaxed);
+	m_missed.store(0, std::memory_order_relaxed);
+	m_wakeLatency.Reset();
+	m_cycleTime.Reset();
+}
+
+void* ScanRuntime::Entry(void* runtime)
+{
+	ScanRuntime* self = static_cast<ScanRuntime*>(runtime);
+	self->Loop();
+	self->m_running.store(false, std::memory_order_release);
+	return NULL;
+}
+
+// Run(): the calling thread gets what Start() gives its thread
+void ScanRuntime::SetUpThread()
+{
+	if (m_lockMemory && mlockall(MCL_CURRENT | MCL_FUTURE))
+	{
+		Fail("lock memory", errno);
+	}
+	if (m_cpu >= 0)
+	{
+		cpu_set_t cpus;
+		CPU_ZERO(&cpus);
+		CPU_SET(m_cpu, &cpus);
+		int error = pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus);
+		if (error)
+		{
+			Fail("pin to cpu", error);
+		}
+	}
+	if (m_priority > 0)
+	{
+		struct sched_param param;
+		param.sched_priority = m_priority;
+		int error = pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
+		if (error)
+		{
+			Fail("set SCHED_FIFO priority", error);
+		}
+	}
+}
+
+void ScanRuntime::RunHooks(const int phase)
+{
+	const vector<Hook>& hooks = m_hooks[phase];
+	for (size_t i = 0; i < hooks.size(); ++i)
+	{
+		hooks[i].hook(hooks[i].context, *this);
+	}
+}
+
+void ScanRuntime::Loop()
+{
+	Nanoseconds deadline = MonotonicNanoseconds() + m_period;
+	while (!m_stop.load(std::memory_order_acquire))
+	{
+		struct timespec wake;
+		wake.tv_sec = deadline / NANOSECONDS_PER_SECOND;
+		wake.tv_nsec = deadline % NANOSECONDS_PER_SECOND;
+		while (EINTR == clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &wake, NULL))
+		{
+		}
+		Nanoseconds start = MonotonicNanoseconds();
+		m_wakeLatency.Record(start > deadline ? start - deadline : 0);
+
+		RunHooks(SCAN_PHASE_INPUTS);
+		m_image.LatchInputs();
+		RunHooks(SCAN_PHASE_LATCHED);
+		m_executor.RunCycle();
+		if (m_wheel)
+		{
+			m_wheel->Advance(ScanTime());
+		}
+		m_image.CommitOutputs();
+		RunHooks(SCAN_PHASE_COMMITTED);
+
+		Nanoseconds end = MonotonicNanoseconds();
+		m_cycleTime.Record(end - start);
+		m_cycles.store(m_cycles.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+		deadline += m_period;
+		if (end > deadline)
+		{
+			// skip the deadlines already gone rather than run late cycles
+			// back to back
+			Nanoseconds missed = (end - deadline) / m_period + 1;
+			deadline += missed * m_period;
+			m_overruns.store(m_overruns.load(std::memory_order_relaxed) + 1, 
+				std::memory_order_relaxed);
+			m_missed.store(m_missed.load(std::memory_order_relaxed) + missed, 
+				std::memory_order_relaxed);
+		}
+	}
+}
@@ -0,0 +1,145 @@
+///////////////////////////////////////////////////////////////////////////////
+// FILE:          ScanRuntime.h
+// PROJECT:       Devices 
+// SUBSYSTEM:     Device Controller 
+//-----------------------------------------------------------------------------
+// DESCRIPTION:   the fixed period scan loop
+//             
+// COPYRIGHT:     Karl Hoover, No Prior Art, 2009
+//
+// LICENSE:       This library is free software; you can redistribute it and/or
+//                modify it under the terms of the GNU Lesser General Public
+//                License (LGPL) as published by the Free Software Foundation.
+//                See license text at http://www.gnu.org/licenses/lgpl.txt 
+//                Briefly you can use this source code pretty much however you
+//                wish, as long as this notice remains intact and you
+//                prominently acknowledge this copyright.
+//
+//                This file is distributed in the hope that it will be useful,
+//                but WITHOUT ANY WARRANTY; without even the implied warranty
+//                of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//                IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//                CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+//                INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES.
+//
+// AUTHOR:        Karl Hoover  karl.hoover@gmail.com
+//
+// REVISIONS:     1.0 October 16, 2026
+//
+// NOTES:   
+// The main loop the library didn't have. A ScanRuntime runs the scan
+// every period on an absolute deadline, clock_nanosleep(TIMER_ABSTIME) on
+// CLOCK_MONOTONIC, so the cycle doesn't drift by however long the work and
+// the wake up took, as a usleep() loop does. Each cycle is, in this order:
+//
+//     SCAN_PHASE_INPUTS hooks     e.g. the IO driver or PlantSimulator
+//     ProcessImage::LatchInputs()
+//     SCAN_PHASE_LATCHED hooks    e.g. AnalogueFilter, InterlockEngine
+//     ScanExecutor::RunCycle()    every device's Update(), samples ScanTime()
+//     TimerWheel::Advance()       if one was given
+//     ProcessImage::CommitOutputs()
+//     SCAN_PHASE_COMMITTED hooks  e.g. StatePublisher, CheckpointWriter
+//
+// A cycle which ends after the next deadline is an overrun. The loop does
+// not try to catch up with a burst of back to back cycles: it counts the
+// deadlines missed and waits for the next one still ahead, so the phase
+// of the scan is kept. WakeLatency() is how late each cycle woke after
+// its deadline, which is the jitter, and CycleTime() how long it ran.
+//
+// For bounded latency on stock Linux: SetCpu() pins the scan thread (keep
+// the core free with isolcpus or a cpuset), SetPriority() puts it in
+// SCHED_FIFO and LockMemory() mlockall()s the process so no page fault
+// stalls a scan. They need CAP_SYS_NICE and CAP_IPC_LOCK (or rlimits);
+// Run() and Start() throw runtime_error if one can't be had, rather than
+// quietly scanning without it. Only the scan thread is set up, an
+// executor's other workers are not.
+//
+// Run() scans on the calling thread until Stop(), Start() on a thread of
+// its own. Stop() may be called from a hook.
+
+#ifndef SCANRUNTIME_H
+#define SCANRUNTIME_H
+
+#include <atomic>
+#include <vector>
+
+#include <pthread.h>
+
+#include "ScanClock.h"
+#include "LatencyHistogram.h"
+
+class ProcessImage;
+class ScanExecutor;
+class TimerWheel;
+class ScanRuntime;
+
+#define SCAN_PHASE_INPUTS 0    // before LatchInputs
+#define SCAN_PHASE_LATCHED 1   // after LatchInputs, before the devices
+#define SCAN_PHASE_COMMITTED 2 // after CommitOutputs
+#define SCAN_PHASES 3
+
+typedef void (*ScanHook)(void* context, ScanRuntime& runtime);
+
+class ScanRuntime
+{
+public:
+	ScanRuntime(ProcessImage& image, ScanExecutor& executor, const Nanoseconds period);
+	~ScanRuntime(); // stops
+
+	// before Run or Start
+	void AddHook(const int phase, ScanHook hook, void* context = NULL);
+	void SetTimerWheel(TimerWheel* wheel) {m_wheel = wheel;};
+	void SetCpu(const int cpu) {m_cpu = cpu;};                // -1: not pinned
+	void SetPriority(const int priority) {m_priority = priority;}; // 1-99 SCHED_FIFO, 0: not
+	void LockMemory(const bool lock) {m_lockMemory = lock;};
+
+	void Run();   // scans on the calling thread until Stop()
+	void Start(); // scans on a new thread
+	void Stop();  // any thread; waits for a Start()ed thread unless called from it
+	bool Running() const {return m_running.load(std::memory_order_acquire);};
+
+	// statistics, any thread
+	Nanoseconds Period() const {return m_period;};
+	unsigned long long Cycles() const {return m_cycles.load(std::memory_order_relaxed);};
+	unsigned long long Overruns() const {return m_overruns.load(std::memory_order_relaxed);};
+	unsigned long long MissedDeadlines() const {return m_missed.load(std::memory_order_relaxed);};
+	const LatencyHistogram& WakeLatency() const {return m_wakeLatency;};
+	const LatencyHistogram& CycleTime() const {return m_cycleTime;};
+	void ResetStatistics(); // not while running
+
+private:
+	ScanRuntime(const ScanRuntime&);
+	ScanRuntime& operator=(const ScanRuntime&);
+	struct Hook
+	{
+		ScanHook hook;
+		void* context;
+	};
+	static void* Entry(void* runtime);
+	void SetUpThread();
+	void Loop();
+	void RunHooks(const int phase);
+
+	ProcessImage& m_image;
+	ScanExecutor& m_executor;
+	Nanoseconds m_period;
+	std::vector<Hook> m_hooks[SCAN_PHASES];
+	TimerWheel* m_wheel;
+	int m_cpu;
+	int m_priority;
+	bool m_lockMemory;
+
+	pthread_t m_thread;
+	bool m_started;  // m_thread is ours to join
+	std::atomic<bool> m_running;
+	std::atomic<bool> m_stop;
+
+	std::atomic<unsigned long long> m_cycles;
+	std::atomic<unsigned long long> m_overruns;
+	std::atomic<unsigned long long> m_missed;
+	LatencyHistogram m_wakeLatency;
+	LatencyHistogram m_cycleTime;
+};
+
+#endif // SCANRUNTIME_H
@@ -0,0 +1,252 @@
+///////////////////////////////////////////////////////////////////////////////
+// FILE:          Sequence.cpp
+// PROJECT:       Devices 
+// SUBSYSTEM:     Device Controller 
+//-----------------------------------------------------------------------------
+// DESCRIPTION:   implementation of the sequence engine
+//             
+// COPYRIGHT:     Karl Hoover, No Prior Art, 2009
+//
+// LICENSE:       This library is free software; you can redistribute it and/or
+//                modify it under the terms of the GNU Lesser General Public
+//                License (LGPL) as published by the Free Software Foundation.
+//                See license text at http://www.gnu.org/licenses/lgpl.txt 
+//                Briefly you can use this source code pretty much however you
+//                wish, as long as this notice remains intact and you
+//                prominently acknowledge this copyright.
+//
+//                This file is distributed in the hope that it will be useful,
+//                but WITHOUT ANY WARRANTY; without even the implied warranty
+//                of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//                IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//                CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+//                INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES.
+//
+// AUTHOR:        Karl Hoover  karl.hoover@gmail.com
+//
+// REVISIONS:     
+//
+// NOTES:   
+// see Sequence.h for comments and history
+
+#include <stdexcept>
+
+#include "Sequence.h"
+#include "device.h"
+
+Sequence::Sequence(): m_waiting(NULL), m_inFlight(0), m_aborted(false), m_running(false),
+	m_done(NULL), m_context(NULL), m_result(COMMAND_RESULT_DONE), m_failedStep(-1), 
+	m_started(0), m_finished(0), m_criticalPathTime(0)
+{
+}
+
+Sequence::~Sequence()
+{
+	delete [] m_waiting;
+}
+
+int Sequence::Step(Device& device, const int command)
+{
+	if (Running())
+	{
+		throw logic_error("Sequence::Step while running");
+	}
+	SequenceStep step = {&device, command, vector<int>(), 0, this, 0, 0, COMMAND_RESULT_DONE};
+	m_steps.push_back(step);
+	delete [] m_waiting;
+	m_waiting = NULL;
+	return m_steps.size() - 1;
+}
+
+void Sequence::After(const int step, const int predecessor)
+{
+	if (Running())
+	{
+		throw logic_error("Sequence::After while running");
+	}
+	if (step < 0 || step >= StepCount() || predecessor < 0 || predecessor >= StepCount())
+	{
+		throw invalid_argument("Sequence::After: no such step");
+	}
+	m_steps[predecessor].successors.push_back(step);
+	++m_steps[step].predecessors;
+	m_order.clear();
+}
+
+// Kahn's algorithm, throws if a cycle leaves steps unordered
+void Sequence::Order()
+{
+	vector<int> waiting(m_steps.size());
+	m_order.clear();
+	for (size_t i = 0; i < m_steps.size(); ++i)
+	{
+		waiting[i] = m_steps[i].predecessors;
+		if (0 == waiting[i])
+		{
+			m_order.push_back(i);
+		}
+	}
+	for (size_t next = 0; next < m_order.size(); ++next)
+	{
+		const vector<int>& successors = m_steps[m_order[next]].successors;
+		for (size_t s = 0; s < successors.size(); ++s)
+		{
+			if (0 == --waiting[successors[s]])
+			{
+				m_order.push_back(successors[s]);
+			}
+		}
+	}
+	if (m_order.size() != m_steps.size())
+	{
+		m_order.clear();
+		throw invalid_argument("Sequence: the steps form a cycle");
+	}
+}
+
+bool Sequence::Start(SequenceCallback done, void* context)
+{
+	if (m_order.size() != m_steps.size())
+	{
+		Order();
+	}
+	bool running = false;
+	if (!m_running.compare_exchange_strong(running, true))
+	{
+		return false;
+	}
+	if (!m_waiting)
+	{
+		m_waiting = new atomic<int>[m_steps.size() ? m_steps.size() : 1];
+	}
+	for (size_t i = 0; i < m_steps.size(); ++i)
+	{
+		m_waiting[i].store(m_steps[i].predecessors, memory_order_relaxed);
+		m_steps[i].started = 0;
+		m_steps[i].finished = 0;
+		m_steps[i].result = COMMAND_RESULT_DONE;
+	}
+	m_done = done;
+	m_context = context;
+	m_result = COMMAND_RESULT_DONE;
+	m_failedStep = -1;
+	m_aborted.store(false, memory_order_relaxed);
+	m_started = MonotonicNanoseconds();
+	// hold one count ourselves so the sequence can't finish while the
+	// roots are still being posted
+	m_inFlight.store(1, memory_order_release);
+	for (size_t i = 0; i < m_steps.size() && !m_aborted.load(memory_order_acquire); ++i)
+	{
+		if (0 == m_steps[i].predecessors)
+		{
+			Launch(i);
+		}
+	}
+	Release();
+	return true;
+}
+
+void Sequence::Launch(const int step)
+{
+	SequenceStep& s = m_steps[step];
+	m_inFlight.fetch_add(1, memory_order_relaxed);
+	s.started = MonotonicNanoseconds();
+	if (!s.device->PostCommand(s.command, StepDone, &s))
+	{
+		s.finished = s.started;
+		s.result = COMMAND_RESULT_REJECTED; // queue full
+		Abort(step, COMMAND_RESULT_REJECTED);
+		Release();
+	}
+}
+
+// scan thread, the device has finished a step's command
+void Sequence::StepDone(void* context, const unsigned long long, const int result)
+{
+	SequenceStep& s = *static_cast<SequenceStep*>(context);
+	Sequence& sequence = *s.sequence;
+	int step = &s - &sequence.m_steps[0];
+	s.finished = MonotonicNanoseconds();
+	s.result = result;
+	if (COMMAND_RESULT_DONE != result)
+	{
+		sequence.Abort(step, result);
+	}
+	else if (!sequence.m_aborted.load(memory_order_acquire))
+	{
+		for (size_t i = 0; i < s.successors.size(); ++i)
+		{
+			int successor = s.successors[i];
+			if (1 == sequence.m_waiting[successor].fetch_sub(1, memory_order_acq_rel))
+			{
+				sequence.Launch(successor);
+			}
+		}
+	}
+	sequence.Release();
+}
+
+void Sequence::Abort(const int step, const int result)
+{
+	bool aborted = false;
+	if (m_aborted.compare_exchange_strong(aborted, true, memory_order_acq_rel))
+	{
+		m_failedStep = step;
+		m_result = result;
+	}
+}
+
+void Sequence::Release()
+{
+	if (1 == m_inFlight.fetch_sub(1, memory_order_acq_rel))
+	{
+		Finish();
+	}
+}
+
+// every step that ran is done: find the longest chain of step times
+void Sequence::Finish()
+{
+	m_finished = MonotonicNanoseconds();
+	vector<Nanoseconds> longest(m_steps.size(), 0); // ending at a step
+	vector<int> previous(m_steps.size(), -1);
+	int last = -1;
+	for (size_t o = 0; o < m_order.size(); ++o)
+	{
+		int i = m_order[o];
+		longest[i] += StepTime(i);
+		if (last < 0 || longest[i] > longest[last])
+		{
+			last = i;
+		}
+		const vector<int>& successors = m_steps[i].successors;
+		for (size_t s = 0; s < successors.size(); ++s)
+		{
+			if (longest[i] > longest[successors[s]])
+			{
+				longest[successors[s]] = longest[i];
+				previous[successors[s]] = i;
+			}
+		}
+	}
+	m_criticalPath.clear();
+	m_criticalPathTime = last < 0 ? 0 : longest[last];
+	for (int i = last; i >= 0; i = previous[i])
+	{
+		m_criticalPath.insert(m_criticalPath.begin(), i);
+	}
+	SequenceCallback done = m_done;
+	void* context = m_context;
+	m_running.store(false, memory_order_release);
+	if (done)
+	{
+		done(context, *this, m_result);
+	}
+}
+
+Nanoseconds Sequence::StepTime(const int step) const
+{
+	const SequenceStep& s = m_steps[step];
+	return s.started ? s.finished - s.started : 0;
+}
@@ -0,0 +1,142 @@
+///////////////////////////////////////////////////////////////////////////////
+// FILE:          Sequence.h
+// PROJECT:       Devices 
+// SUBSYSTEM:     Device Controller 
+//-----------------------------------------------------------------------------
+// DESCRIPTION:   sequences of device commands with ordering constraints
+//             
+// COPYRIGHT:     Karl Hoover, No Prior Art, 2009
+//
+// LICENSE:       This library is free software; you can redistribute it and/or
+//                modify it under the terms of the GNU Lesser General Public
+//                License (LGPL) as published by the Free Software Foundation.
+//                See license text at http://www.gnu.org/licenses/lgpl.txt 
+//                Briefly you can use this source code pretty much however you
+//                wish, as long as this notice remains intact and you
+//                prominently acknowledge this copyright.
+//
+//                This file is distributed in the hope that it will be useful,
+//                but WITHOUT ANY WARRANTY; without even the implied warranty
+//                of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//                IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//                CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+//                INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES.
+//
+// AUTHOR:        Karl Hoover  karl.hoover@gmail.com
+//
+// REVISIONS:     1.0 October 16, 2026
+//
+// NOTES:   
+// A Sequence is a recipe step list such as a pump-down or a load-lock
+// cycle: device commands with "after" constraints, i.e. a directed acyclic
+// graph. Build it once, Start() it as often as needed:
+//
+//     Sequence vent;
+//     int roughing = vent.Step(roughingValve, COMMAND_CLOSE);
+//     int turbo = vent.Step(turboGate, COMMAND_CLOSE);
+//     int purge = vent.Step(ventValve, COMMAND_OPEN);
+//     vent.After(purge, roughing);
+//     vent.After(purge, turbo);
+//     vent.Start(VentDone, &chamber);
+//
+// Start() posts the commands of every step without predecessors, so
+// independent branches run at the same time. Each step's command carries a
+// completion callback (Device::PostCommand); when a step completes with
+// COMMAND_RESULT_DONE, i.e. its valve has come to rest, its successors
+// whose other predecessors are done are posted from within the callback.
+// Nothing polls and nothing blocks: a sequence costs nothing between
+// completions, so hundreds can be in flight.
+//
+// If a step fails (its valve went STATE_INVALID) or is rejected, the
+// sequence aborts: no further step is started, the steps already posted
+// are left to finish, then the sequence finishes with that step's result.
+// The done callback is called once, on the scan thread that completed the
+// last step (or on the thread calling Start() if it couldn't post
+// anything), with COMMAND_RESULT_DONE or the failed step's result.
+//
+// When it has finished, the sequence reports how long it took, and its
+// critical path: the chain of dependent steps whose command times add up
+// to the longest, which is where shortening a step shortens the sequence.
+//
+// Steps may be completed on different scan threads concurrently, the
+// bookkeeping is atomic counters. Don't change or destroy a running
+// sequence, nor the devices it commands.
+
+#ifndef SEQUENCE_H
+#define SEQUENCE_H
+
+#include <vector>
+#include <atomic>
+
+#include "ScanClock.h"
+
+class Device;
+class Sequence;
+
+typedef void (*SequenceCallback)(void* context, Sequence& sequence, const int result);
+
+class Sequence
+{
+public:
+	Sequence();
+	~Sequence();
+	// returns the step's index. Not while running.
+	int Step(Device& device, const int command);
+	// step doesn't start until predecessor has completed
+	void After(const int step, const int predecessor);
+	int StepCount() const {return m_steps.size();};
+
+	// throws invalid_argument if the steps form a cycle; false if the
+	// sequence is already running
+	bool Start(SequenceCallback done = NULL, void* context = NULL);
+	bool Running() const {return m_running.load(std::memory_order_acquire);};
+
+	// once it has finished
+	int Result() const {return m_result;};         // COMMAND_RESULT_
+	int FailedStep() const {return m_failedStep;}; // -1 if none
+	Nanoseconds Elapsed() const {return m_finished - m_started;};
+	Nanoseconds CriticalPathTime() const {return m_criticalPathTime;};
+	void CriticalPath(std::vector<int>& steps) const {steps = m_criticalPath;}; // in order
+	Nanoseconds StepTime(const int step) const; // 0 if it didn't run
+	int StepResult(const int step) const {return m_steps[step].result;};
+
+private:
+	Sequence(const Sequence&);
+	Sequence& operator=(const Sequence&);
+
+	struct SequenceStep
+	{
+		Device* device;
+		int command;
+		std::vector<int> successors;
+		int predecessors;
+		Sequence* sequence;
+		Nanoseconds started;  // 0: not run
+		Nanoseconds finished;
+		int result;
+	};
+	static void StepDone(void* context, const unsigned long long id, const int result);
+	void Launch(const int step);
+	void Abort(const int step, const int result);
+	void Release();  // one fewer step in flight
+	void Finish();
+	void Order();    // m_order, topological
+
+	std::vector<SequenceStep> m_steps;
+	std::vector<int> m_order;
+	std::atomic<int>* m_waiting;  // per step, predecessors not yet done
+	std::atomic<int> m_inFlight;
+	std::atomic<bool> m_aborted;
+	std::atomic<bool> m_running;
+	SequenceCallback m_done;
+	void* m_context;
+	int m_result;
+	int m_failedStep;
+	Nanoseconds m_started;
+	Nanoseconds m_finished;
+	Nanoseconds m_criticalPathTime;
+	std::vector<int> m_criticalPath;
+};
+
+#endif // SEQUENCE_H
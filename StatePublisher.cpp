@@ -0,0 +1,367 @@
+///////////////////////////////////////////////////////////////////////////////
+// FILE:          StatePublisher.cpp
+// PROJECT:       Devices 
+// SUBSYSTEM:     Device Controller 
+//-----------------------------------------------------------------------------
+// DESCRIPTION:   implementation of the monotonic and scan clocks
+//             
+// COPYRIGHT:     Karl Hoover, No Prior Art, 2009
+//
+// LICENSE:       This library is free software; you can redistribute it and/or
+//                modify it under the terms of the GNU Lesser General Public
+//                License (LGPL) as published by the Free Software Foundation.
+//                See license text at http://www.gnu.org/licenses/lgpl.txt 
+//                Briefly you can use this source code pretty much however you
+//                wish, as long as this notice remains intact and you
+//                prominently acknowledge this copyright.
+//
+//                This file is distributed in the hope that it will be useful,
+//                but WITHOUT ANY WARRANTY; without even the implied warranty
+//                of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//                IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//                CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+//                INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES.
+//
+// AUTHOR:        Karl Hoover  karl.hoover@gmail.com
+//
+// REVISIONS:     
+//
+// NOTES:   
+// see StatePublisher.h for comments and history
+
+#include <atomic>
+#include <cstring>
+#include <new>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <sched.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "StatePublisher.h"
+#include "device.h"
+
+using namespace std;
+
+#define STATE_SEGMENT_MAGIC 0x4554415453564544ULL  // "DEVSTATE"
+
+// another process maps the same words, that only works lock free
+static_assert(ATOMIC_INT_LOCK_FREE == 2 && ATOMIC_LLONG_LOCK_FREE == 2,
+	"shared memory needs lock free atomics");
+
+typedef std::atomic<int> SharedInt;
+typedef std::atomic<unsigned long long> SharedWord;
+
+struct StateSegmentHeader
+{
+	unsigned long long magic;
+	unsigned int version;
+	unsigned int deviceCount;
+	unsigned int inputWords;
+	unsigned int outputWords;
+	unsigned int analogueInputs;
+	unsigned int analogueOutputs;
+	unsigned long long size;
+	SharedWord open;      // 1 while the publisher has it
+	SharedWord sequence;  // odd while publishing
+	SharedWord scanTime;
+};
+
+struct StateSegmentDevice  // written once
+{
+	unsigned long long nameHash;
+	char name[STATE_NAME_LENGTH];
+};
+
+// offsets of the arrays, from the counts in the header
+struct StateSegmentLayout
+{
+	size_t devices;
+	size_t states;
+	size_t commands;
+	size_t inputs;
+	size_t outputs;
+	size_t analogueInputs;
+	size_t analogueOutputs;
+	size_t size;
+	StateSegmentLayout(const StateSegmentHeader& header)
+	{
+		devices = sizeof(StateSegmentHeader);
+		states = devices + header.deviceCount * sizeof(StateSegmentDevice);
+		commands = states + header.deviceCount * sizeof(SharedInt);
+		inputs = (commands + header.deviceCount * sizeof(SharedInt) + 7) & ~(size_t)7;
+		outputs = inputs + header.inputWords * sizeof(SharedWord);
+		analogueInputs = outputs + header.outputWords * sizeof(SharedWord);
+		analogueOutputs = analogueInputs + header.analogueInputs * sizeof(SharedWord);
+		size = analogueOutputs + header.analogueOutputs * sizeof(SharedWord);
+	};
+};
+
+template <class T> static T* At(char* map, const size_t offset)
+{
+	return reinterpret_cast<T*>(map + offset);
+}
+
+template <class T> static const T* At(const char* map, const size_t offset)
+{
+	return reinterpret_cast<const T*>(map + offset);
+}
+
+static unsigned long long Bits(const double value)
+{
+	unsigned long long bits;
+	memcpy(&bits, &value, sizeof(bits));
+	return bits;
+}
+
+static double Double(const unsigned long long bits)
+{
+	double value;
+	memcpy(&value, &bits, sizeof(value));
+	return value;
+}
+
+// definitions for class StatePublisher
+
+StatePublisher::StatePublisher(const string& name, const vector<Device*>& devices,
+	const ProcessImage& image): m_name(name), m_devices(devices), m_image(image), 
+	m_map(NULL), m_size(0), m_published(0)
+{
+	m_image.ReadFieldOutputs(m_digital, m_analogue);
+	StateSegmentHeader counts;
+	counts.deviceCount = m_devices.size();
+	counts.inputWords = m_image.InputWordCount();
+	counts.outputWords = m_digital.size();
+	counts.analogueInputs = m_image.AnalogueInputCount();
+	counts.analogueOutputs = m_analogue.size();
+	StateSegmentLayout layout(counts);
+	m_size = layout.size;
+
+	shm_unlink(m_name.c_str()); // left behind by an earlier run
+	int fd = shm_open(m_name.c_str(), O_RDWR | O_CREAT | O_EXCL, 0644);
+	if (fd < 0)
+	{
+		throw runtime_error(m_name + ": cannot create shared memory");
+	}
+	if (ftruncate(fd, m_size) < 0)
+	{
+		close(fd);
+		shm_unlink(m_name.c_str());
+		throw runtime_error(m_name + ": cannot size shared memory");
+	}
+	void* map = mmap(NULL, m_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if (MAP_FAILED == map)
+	{
+		shm_unlink(m_name.c_str());
+		throw runtime_error(m_name + ": cannot mmap shared memory");
+	}
+	m_map = static_cast<char*>(map);
+
+	// the segment comes zero filled, which is every atomic at 0
+	StateSegmentHeader* header = At<StateSegmentHeader>(m_map, 0);
+	header->version = STATE_SEGMENT_VERSION;
+	header->deviceCount = counts.deviceCount;
+	header->inputWords = counts.inputWords;
+	header->outputWords = counts.outputWords;
+	header->analogueInputs = counts.analogueInputs;
+	header->analogueOutputs = counts.analogueOutputs;
+	header->size = m_size;
+	StateSegmentDevice* table = At<StateSegmentDevice>(m_map, layout.devices);
+	for (size_t i = 0; i < m_devices.size(); ++i)
+	{
+		table[i].nameHash = m_devices[i]->NameHash();
+		strncpy(table[i].name, m_devices[i]->Name().c_str(), STATE_NAME_LENGTH - 1);
+	}
+	header->open.store(1, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+	header->magic = STATE_SEGMENT_MAGIC;  // readers check it last
+}
+
+StatePublisher::~StatePublisher()
+{
+	At<StateSegmentHeader>(m_map, 0)->open.store(0, std::memory_order_release);
+	munmap(m_map, m_size);
+	shm_unlink(m_name.c_str());
+}
+
+void StatePublisher::Publish()
+{
+	StateSegmentHeader* header = At<StateSegmentHeader>(m_map, 0);
+	StateSegmentLayout layout(*header);
+	unsigned long long sequence = header->sequence.load(std::memory_order_relaxed);
+	header->sequence.store(sequence + 1, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+
+	header->scanTime.store(ScanTime(), std::memory_order_relaxed);
+	SharedInt* states = At<SharedInt>(m_map, layout.states);
+	SharedInt* commands = At<SharedInt>(m_map, layout.commands);
+	for (size_t i = 0; i < m_devices.size(); ++i)
+	{
+		states[i].store(m_devices[i]->State(), std::memory_order_relaxed);
+		commands[i].store(m_devices[i]->Command(), std::memory_order_relaxed);
+	}
+	SharedWord* inputs = At<SharedWord>(m_map, layout.inputs);
+	const ImageWord* scan = m_image.InputWords();
+	for (size_t i = 0; i < header->inputWords; ++i)
+	{
+		inputs[i].store(scan[i], std::memory_order_relaxed);
+	}
+	// this thread commits the outputs, so this never has to retry
+	m_image.ReadFieldOutputs(m_digital, m_analogue);
+	SharedWord* outputs = At<SharedWord>(m_map, layout.outputs);
+	for (size_t i = 0; i < header->outputWords; ++i)
+	{
+		outputs[i].store(m_digital[i], std::memory_order_relaxed);
+	}
+	SharedWord* analogueInputs = At<SharedWord>(m_map, layout.analogueInputs);
+	for (size_t i = 0; i < header->analogueInputs; ++i)
+	{
+		analogueInputs[i].store(Bits(m_image.ReadAnalogueInput(i)), std::memory_order_relaxed);
+	}
+	SharedWord* analogueOutputs = At<SharedWord>(m_map, layout.analogueOutputs);
+	for (size_t i = 0; i < header->analogueOutputs; ++i)
+	{
+		analogueOutputs[i].store(Bits(m_analogue[i]), std::memory_order_relaxed);
+	}
+
+	header->sequence.store(sequence + 2, std::memory_order_release);
+	++m_published;
+}
+
+// definitions for class StateReader
+
+StateReader::StateReader(const string& name): m_map(NULL), m_size(0)
+{
+	int fd = shm_open(name.c_str(), O_RDONLY, 0);
+	if (fd < 0)
+	{
+		throw runtime_error(name + ": no such shared memory");
+	}
+	struct stat info;
+	if (fstat(fd, &info) < 0 || info.st_size < (off_t)sizeof(StateSegmentHeader))
+	{
+		close(fd);
+		throw runtime_error(name + ": not a state segment");
+	}
+	void* map = mmap(NULL, info.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (MAP_FAILED == map)
+	{
+		throw runtime_error(name + ": cannot mmap shared memory");
+	}
+	m_map = static_cast<const char*>(map);
+	m_size = info.st_size;
+	const StateSegmentHeader* header = At<StateSegmentHeader>(m_map, 0);
+	bool valid = STATE_SEGMENT_MAGIC == header->magic;
+	std::atomic_thread_fence(std::memory_order_acquire);
+	if (!valid || STATE_SEGMENT_VERSION != header->version || m_size != header->size ||
+		StateSegmentLayout(*header).size != m_size)
+	{
+		munmap(const_cast<char*>(m_map), m_size);
+		throw runtime_error(name + ": not a state segment");
+	}
+}
+
+StateReader::~StateReader()
+{
+	munmap(const_cast<char*>(m_map), m_size);
+}
+
+int StateReader::DeviceCount() const
+{
+	return At<StateSegmentHeader>(m_map, 0)->deviceCount;
+}
+
+string StateReader::DeviceName(const int device) const
+{
+	const StateSegmentDevice* table = At<StateSegmentDevice>(m_map, sizeof(StateSegmentHeader));
+	return string(table[device].name);
+}
+
+unsigned long long StateReader::DeviceNameHash(const int device) const
+{
+	const StateSegmentDevice* table = At<StateSegmentDevice>(m_map, sizeof(StateSegmentHeader));
+	return table[device].nameHash;
+}
+
+int StateReader::FindDevice(const string& name) const
+{
+	const StateSegmentDevice* table = At<StateSegmentDevice>(m_map, sizeof(StateSegmentHeader));
+	for (int i = 0; i < DeviceCount(); ++i)
+	{
+		if (!strncmp(table[i].name, name.c_str(), STATE_NAME_LENGTH))
+		{
+			return i;
+		}
+	}
+	return -1;
+}
+
+bool StateReader::Open() const
+{
+	return 1 == At<StateSegmentHeader>(m_map, 0)->open.load(std::memory_order_acquire);
+}
+
+bool StateReader::Read(StateSnapshot& snapshot, const int attempts) const
+{
+	const StateSegmentHeader* header = At<StateSegmentHeader>(m_map, 0);
+	StateSegmentLayout layout(*header);
+	snapshot.states.resize(header->deviceCount);
+	snapshot.commands.resize(header->deviceCount);
+	snapshot.inputs.resize(header->inputWords);
+	snapshot.outputs.resize(header->outputWords);
+	snapshot.analogueInputs.resize(header->analogueInputs);
+	snapshot.analogueOutputs.resize(header->analogueOutputs);
+	const SharedInt* states = At<SharedInt>(m_map, layout.states);
+	const SharedInt* commands = At<SharedInt>(m_map, layout.commands);
+	const SharedWord* inputs = At<SharedWord>(m_map, layout.inputs);
+	const SharedWord* outputs = At<SharedWord>(m_map, layout.outputs);
+	const SharedWord* analogueInputs = At<SharedWord>(m_map, layout.analogueInputs);
+	const SharedWord* analogueOutputs = At<SharedWord>(m_map, layout.analogueOutputs);
+	for (int attempt = 0; attempt < attempts; ++attempt)
+	{
+		unsigned long long before = header->sequence.load(std::memory_order_acquire);
+		if (0 == before)
+		{
+			return false;  // nothing published yet
+		}
+		if (before & 1)
+		{
+			sched_yield(); // let the publisher finish
+			continue;
+		}
+		snapshot.scanTime = header->scanTime.load(std::memory_order_relaxed);
+		for (size_t i = 0; i < snapshot.states.size(); ++i)
+		{
+			snapshot.states[i] = states[i].load(std::memory_order_relaxed);
+			snapshot.commands[i] = commands[i].load(std::memory_order_relaxed);
+		}
+		for (size_t i = 0; i < snapshot.inputs.size(); ++i)
+		{
+			snapshot.inputs[i] = inputs[i].load(std::memory_order_relaxed);
+		}
+		for (size_t i = 0; i < snapshot.outputs.size(); ++i)
+		{
+			snapshot.outputs[i] = outputs[i].load(std::memory_order_relaxed);
+		}
+		for (size_t i = 0; i < snapshot.analogueInputs.size(); ++i)
+		{
+			snapshot.analogueInputs[i] = Double(analogueInputs[i].load(std::memory_order_relaxed));
+		}
+		for (size_t i = 0; i < snapshot.analogueOutputs.size(); ++i)
+		{
+			snapshot.analogueOutputs[i] = Double(analogueOutputs[i].load(std::memory_order_relaxed));
+		}
+		std::atomic_thread_fence(std::memory_order_acquire);
+		if (header->sequence.load(std::memory_order_relaxed) == before)
+		{
+			snapshot.scan = before / 2;
+			return true;
+		}
+	}
+	return false;
+}
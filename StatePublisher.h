@@ -0,0 +1,133 @@
+///////////////////////////////////////////////////////////////////////////////
+// FILE:          StatePublisher.h
+// PROJECT:       Devices 
+// SUBSYSTEM:     Device Controller 
+//-----------------------------------------------------------------------------
+// DESCRIPTION:   device states and IO image in shared memory for other processes
+//             
+// COPYRIGHT:     Karl Hoover, No Prior Art, 2009
+//
+// LICENSE:       This library is free software; you can redistribute it and/or
+//                modify it under the terms of the GNU Lesser General Public
+//                License (LGPL) as published by the Free Software Foundation.
+//                See license text at http://www.gnu.org/licenses/lgpl.txt 
+//                Briefly you can use this source code pretty much however you
+//                wish, as long as this notice remains intact and you
+//                prominently acknowledge this copyright.
+//
+//                This file is distributed in the hope that it will be useful,
+//                but WITHOUT ANY WARRANTY; without even the implied warranty
+//                of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//                IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//                CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+//                INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES.
+//
+// AUTHOR:        Karl Hoover  karl.hoover@gmail.com
+//
+// REVISIONS:     1.0 October 16, 2026
+//
+// NOTES:   
+// HMIs and monitoring tools want every device's State() and Command() and
+// the IO values. Reading them through the getters from another thread
+// races with the scan, and a lock would put the readers into the control
+// loop. Instead the StatePublisher copies them once per scan into a POSIX
+// shared memory segment (shm_open), and any number of local processes map
+// it read only with a StateReader.
+//
+// The copy is made under a sequence counter (seqlock), as CommitOutputs()
+// does for the field outputs: odd while a publish is under way. A reader
+// copies everything out and keeps the copy only if the counter was even
+// and unchanged across it, otherwise it tries again. The publisher never
+// waits for or even knows about readers; a reader can only slow itself.
+// Every value in the segment is an atomic word, doubles stored by their
+// bits, so nothing is torn.
+//
+// The segment is a header, the device table (name hash and name, written
+// once), then per scan the device states, commands, the latched input
+// image, the committed output image and the analogue values. Point and
+// device numbers are those of the plant. The publisher unlinks the segment
+// when it is destroyed and marks it closed, see StateReader::Open(); a
+// publisher which died leaves it open with ScanTime() standing still.
+//
+// Link with -lrt on glibc older than 2.34.
+
+#ifndef STATEPUBLISHER_H
+#define STATEPUBLISHER_H
+
+#include <string>
+#include <vector>
+#include <cstddef>
+
+#include "ScanClock.h"
+#include "ProcessImage.h"
+
+class Device;
+
+#define STATE_SEGMENT_VERSION 1
+#define STATE_NAME_LENGTH 48    // bytes of a published device name, 0 terminated
+#define STATE_READ_ATTEMPTS 100 // before StateReader::Read gives up
+
+class StatePublisher
+{
+public:
+	// creates the segment, e.g. "/plant1", replacing one of that name;
+	// throws runtime_error if it can't
+	StatePublisher(const std::string& name, const std::vector<Device*>& devices,
+		const ProcessImage& image);
+	~StatePublisher();
+	void Publish(); // scan thread, after CommitOutputs()
+	unsigned long long Published() const {return m_published;};
+private:
+	StatePublisher(const StatePublisher&);
+	StatePublisher& operator=(const StatePublisher&);
+	std::string m_name;
+	const std::vector<Device*>& m_devices;
+	const ProcessImage& m_image;
+	char* m_map;
+	size_t m_size;
+	unsigned long long m_published;
+	std::vector<ImageWord> m_digital;  // scratch
+	std::vector<double> m_analogue;
+};
+
+// one consistent scan, as published
+struct StateSnapshot
+{
+	unsigned long long scan;       // publishes so far, this one included
+	Nanoseconds scanTime;          // ScanTime() of that scan
+	std::vector<int> states;       // by device
+	std::vector<int> commands;
+	std::vector<ImageWord> inputs; // latched, as ProcessImage::InputWords()
+	std::vector<ImageWord> outputs;
+	std::vector<double> analogueInputs;
+	std::vector<double> analogueOutputs;
+	bool Input(const int point) const 
+		{return (inputs[point / IMAGE_WORD_BITS] >> (point % IMAGE_WORD_BITS)) & 1;};
+	bool Output(const int point) const 
+		{return (outputs[point / IMAGE_WORD_BITS] >> (point % IMAGE_WORD_BITS)) & 1;};
+};
+
+class StateReader
+{
+public:
+	// maps the segment read only; throws runtime_error if there is none or
+	// it isn't a state segment of this version
+	StateReader(const std::string& name);
+	~StateReader();
+	int DeviceCount() const;
+	std::string DeviceName(const int device) const;
+	unsigned long long DeviceNameHash(const int device) const;
+	int FindDevice(const std::string& name) const; // -1 if there is none
+	bool Open() const; // false once the publisher has closed the segment
+	// a copy of the last scan published, retrying while a publish overlaps
+	// it. False if none was published yet or every attempt overlapped one.
+	bool Read(StateSnapshot& snapshot, const int attempts = STATE_READ_ATTEMPTS) const;
+private:
+	StateReader(const StateReader&);
+	StateReader& operator=(const StateReader&);
+	const char* m_map;
+	size_t m_size;
+};
+
+#endif // STATEPUBLISHER_H
@@ -0,0 +1,351 @@
+///////////////////////////////////////////////////////////////////////////////
+// FILE:          StaticValve.h
+// PROJECT:       Devices 
+// SUBSYSTEM:     Device Controller 
+//-----------------------------------------------------------------------------
+// DESCRIPTION:   valves specialised at compile time, kept in typed arrays
+//             
+// COPYRIGHT:     Karl Hoover, No Prior Art, 2009
+//
+// LICENSE:       This library is free software; you can redistribute it and/or
+//                modify it under the terms of the GNU Lesser General Public
+//                License (LGPL) as published by the Free Software Foundation.
+//                See license text at http://www.gnu.org/licenses/lgpl.txt 
+//                Briefly you can use this source code pretty much however you
+//                wish, as long as this notice remains intact and you
+//                prominently acknowledge this copyright.
+//
+//                This file is distributed in the hope that it will be useful,
+//                but WITHOUT ANY WARRANTY; without even the implied warranty
+//                of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//                IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//                CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+//                INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES.
+//
+// AUTHOR:        Karl Hoover  karl.hoover@gmail.com
+//
+// REVISIONS:     1.0 October 16, 2026
+//
+// NOTES:   
+// The Valve classes in device.h decide InMotion, IsClosed, Open and so on
+// through virtual functions, several per Update, and each valve is a
+// Device with its maps, strings and queues. That suits a plant of a few
+// odd devices. For hundreds or thousands of valves of the same kind this
+// header has the same state machine with the sensor and actuator topology
+// as a compile time parameter:
+//
+//     ValveArray<DoubleThrowTopology> gates(plant.Image());
+//     gates.Add(*device);   // a configured Device, points looked up once
+//     ...
+//     gates.UpdateAll();    // every scan
+//
+// A topology is a struct of static inline functions over the ProcessImage
+// and a small struct of point numbers, so Update inlines completely and a
+// valve is one 64 byte element of a contiguous array. UpdateAll is a
+// straight loop over it.
+//
+// The state machine is Valve::Update's, the same template
+// (ValveStateMachine.h) over a different adapter. Transitions and rejected
+// commands go to the trace (Trace.h) like a Valve's. Kept simple for speed:
+//
+//   - commands are set with SetCommand from the scan thread. One set while
+//     the valve is busy waits for it to come to rest (a queue one deep), no
+//     completion callback. Post from other threads to a Valve if you need to.
+//   - timeouts are per array, there is no timer wheel, UpdateAll polls.
+//   - no latency histograms.
+//
+// The polymorphic SingleThrowValve and DoubleThrowValve remain, for mixed
+// plants and everything that takes a Device or a Valve.
+
+#ifndef STATICVALVE_H
+#define STATICVALVE_H
+
+#include <vector>
+#include <stdexcept>
+
+#include "device.h"
+#include "ValveStateMachine.h"
+
+struct SingleThrowTopology  // CLOSE! and CLOSED?, spring return
+{
+	struct Points
+	{
+		int closeCmd;
+		int closedSensor;
+		int closeOk;
+		int openOk;
+	};
+	static void Bind(const Device& device, Points& p)
+	{
+		p.closeCmd = Output(device, "CLOSE!");
+		p.closedSensor = Input(device, "CLOSED?");
+		p.closeOk = Input(device, "CLOSE_OK?");
+		p.openOk = Input(device, "OPEN_OK?");
+	};
+	static bool InMotion(const ProcessImage& image, const Points& p)
+	{
+		return image.ReadOutput(p.closeCmd) != image.ReadInput(p.closedSensor);
+	};
+	static bool IsOpened(const ProcessImage& image, const Points& p)
+	{
+		return !image.ReadInput(p.closedSensor);
+	};
+	static bool IsClosed(const ProcessImage& image, const Points& p)
+	{
+		return !InMotion(image, p) && image.ReadInput(p.closedSensor);
+	};
+	static bool InvalidSensorState(const ProcessImage&, const Points&) {return false;};
+	static bool Close(ProcessImage& image, const Points& p)
+	{
+		bool ret = image.ReadInput(p.closeOk);
+		if (ret)
+		{
+			image.WriteOutput(p.closeCmd, true);
+		}
+		return ret;
+	};
+	static bool Open(ProcessImage& image, const Points& p)
+	{
+		bool ret = image.ReadInput(p.openOk);
+		if (ret)
+		{
+			image.WriteOutput(p.closeCmd, false);
+		}
+		return ret;
+	};
+	static void IdleOutput(ProcessImage& image, const Points& p)
+	{
+		image.WriteOutput(p.closeCmd, false);
+	};
+
+	static int Input(const Device& device, const char* attribute)
+	{
+		int point = device.DigitalInputPoint(attribute);
+		if (point < 0)
+		{
+			throw std::invalid_argument(device.Name() + ": missing digital input " + attribute);
+		}
+		return point;
+	};
+	static int Output(const Device& device, const char* attribute)
+	{
+		int point = device.DigitalOutputPoint(attribute);
+		if (point < 0)
+		{
+			throw std::invalid_argument(device.Name() + ": missing digital output " + attribute);
+		}
+		return point;
+	};
+};
+
+struct DoubleThrowTopology  // CLOSE!, OPEN!, CLOSED? and OPENED?
+{
+	struct Points
+	{
+		int closeCmd;
+		int openCmd;
+		int closedSensor;
+		int openedSensor;
+		int closeOk;
+		int openOk;
+	};
+	static void Bind(const Device& device, Points& p)
+	{
+		p.closeCmd = SingleThrowTopology::Output(device, "CLOSE!");
+		p.openCmd = SingleThrowTopology::Output(device, "OPEN!");
+		p.closedSensor = SingleThrowTopology::Input(device, "CLOSED?");
+		p.openedSensor = SingleThrowTopology::Input(device, "OPENED?");
+		p.closeOk = SingleThrowTopology::Input(device, "CLOSE_OK?");
+		p.openOk = SingleThrowTopology::Input(device, "OPEN_OK?");
+	};
+	static bool InMotion(const ProcessImage& image, const Points& p)
+	{
+		return (image.ReadOutput(p.closeCmd) && !image.ReadInput(p.closedSensor)) ||
+			(image.ReadOutput(p.openCmd) && !image.ReadInput(p.openedSensor));
+	};
+	static bool IsOpened(const ProcessImage& image, const Points& p)
+	{
+		return !image.ReadInput(p.closedSensor) && image.ReadInput(p.openedSensor);
+	};
+	static bool IsClosed(const ProcessImage& image, const Points& p)
+	{
+		return image.ReadInput(p.closedSensor) && !image.ReadInput(p.openedSensor);
+	};
+	static bool InvalidSensorState(const ProcessImage& image, const Points& p)
+	{
+		return image.ReadInput(p.closedSensor) && image.ReadInput(p.openedSensor);
+	};
+	static bool Close(ProcessImage& image, const Points& p)
+	{
+		bool ret = image.ReadInput(p.closeOk);
+		if (ret)
+		{
+			image.WriteOutput(p.openCmd, false);
+			image.WriteOutput(p.closeCmd, true);
+		}
+		return ret;
+	};
+	static bool Open(ProcessImage& image, const Points& p)
+	{
+		bool ret = image.ReadInput(p.openOk);
+		if (ret)
+		{
+			image.WriteOutput(p.closeCmd, false);
+			image.WriteOutput(p.openCmd, true);
+		}
+		return ret;
+	};
+	static void IdleOutput(ProcessImage& image, const Points& p)
+	{
+		image.WriteOutput(p.closeCmd, false);
+		image.WriteOutput(p.openCmd, false);
+	};
+};
+
+template <class Topology> class ValveArray
+{
+public:
+	ValveArray(ProcessImage& image): m_image(image), 
+		m_motionTimeOut(DEFAULT_MOTION_TIMEOUT * NANOSECONDS_PER_MICROSECOND),
+		m_interlockTimeOut(DEFAULT_INTERLOCK_TIMEOUT * NANOSECONDS_PER_MICROSECOND) {};
+	// a valve from a configured device (which needn't be kept), throws
+	// invalid_argument if it lacks a point the topology needs. Returns its index.
+	int Add(const Device& configured);
+	size_t Size() const {return m_valves.size();};
+	void Reserve(const size_t count) {m_valves.reserve(count);};
+
+	int State(const size_t i) const {return m_valves[i].state;};
+	int Command(const size_t i) const {return m_valves[i].command;};
+	void SetCommand(const size_t i, const int command) {m_valves[i].command = command;}; // scan thread
+	bool IsClosed(const size_t i) const {return Topology::IsClosed(m_image, m_valves[i].points);};
+	bool IsOpened(const size_t i) const {return Topology::IsOpened(m_image, m_valves[i].points);};
+	unsigned long long NameHash(const size_t i) const {return m_valves[i].nameHash;};
+
+	Nanoseconds MotionTimeOut() const {return m_motionTimeOut;};
+	Nanoseconds InterlockTimeOut() const {return m_interlockTimeOut;};
+	void SetMotionTimeOut(const Nanoseconds timeOut) {m_motionTimeOut = timeOut;};
+	void SetInterlockTimeOut(const Nanoseconds timeOut) {m_interlockTimeOut = timeOut;};
+
+	bool Update(const size_t i); // false if a command was rejected
+	int UpdateAll();             // every valve once, returns commands rejected
+
+private:
+	ValveArray(const ValveArray&);
+	ValveArray& operator=(const ValveArray&);
+
+	// one valve, a cache line's worth. ArenaAllocator keeps them on cache
+	// line boundaries, std::allocator needn't.
+	struct alignas(64) Element
+	{
+		typename Topology::Points points;
+		int state;
+		int pendingCommand;   // waiting for the interlock
+		short command;
+		bool initializing;    // motionStartTime is when initializing started
+		Nanoseconds motionStartTime;
+		Nanoseconds waitStartTime;
+		unsigned long long nameHash;
+	};
+	static_assert(sizeof(Element) == 64, "a valve is one cache line's worth of array");
+	struct Machine;  // for UpdateValve, see ValveStateMachine.h
+
+	ProcessImage& m_image;
+	Nanoseconds m_motionTimeOut;
+	Nanoseconds m_interlockTimeOut;
+	std::vector<Element, ArenaAllocator<Element> > m_valves;
+};
+
+template <class Topology>
+int ValveArray<Topology>::Add(const Device& configured)
+{
+	Element v;
+	Topology::Bind(configured, v.points);
+	v.state = STATE_INITIALIZING;
+	v.command = COMMAND_IDLE;
+	v.pendingCommand = COMMAND_IDLE;
+	v.initializing = false;
+	v.motionStartTime = 0;
+	v.waitStartTime = 0;
+	v.nameHash = configured.NameHash();
+	m_valves.push_back(v);
+	return m_valves.size() - 1;
+}
+
+// an element as UpdateValve wants it, see ValveStateMachine.h
+template <class Topology>
+struct ValveArray<Topology>::Machine
+{
+	Machine(ValveArray& array, Element& element): a(array), v(element) {};
+	int State() const {return v.state;};
+	void SetState(const int state, const int reason)
+	{
+		if (state == v.state)
+		{
+			return;
+		}
+		if (STATE_INVALID == state)
+		{
+			v.pendingCommand = COMMAND_IDLE;
+		}
+		Trace(state, reason);
+		v.state = state;
+	};
+	int Command() const {return v.command;};
+	void SetCommand(const int command) {v.command = command;};
+	int& PendingCommand() {return v.pendingCommand;};
+	bool& Initializing() {return v.initializing;};
+	Nanoseconds& MotionStartTime() {return v.motionStartTime;};
+	Nanoseconds& WaitStartTime() {return v.waitStartTime;};
+	Nanoseconds MotionTimeOut() const {return a.m_motionTimeOut;};
+	Nanoseconds InterlockTimeOut() const {return a.m_interlockTimeOut;};
+	bool InMotion() {return Topology::InMotion(a.m_image, v.points);};
+	bool IsOpened() {return Topology::IsOpened(a.m_image, v.points);};
+	bool IsClosed() {return Topology::IsClosed(a.m_image, v.points);};
+	bool InvalidSensorState() {return Topology::InvalidSensorState(a.m_image, v.points);};
+	bool Close() {return Topology::Close(a.m_image, v.points);};
+	bool Open() {return Topology::Open(a.m_image, v.points);};
+	void IdleOutput() {Topology::IdleOutput(a.m_image, v.points);};
+	void TakeCommand() {}; // SetCommand sets it directly
+	void Done() {};
+	bool Defer() {return true;}; // left in command until the valve is at rest
+	void Reject()
+	{
+		Trace(v.state, TRACE_REASON_COMMAND_REJECTED);
+		v.command = COMMAND_IDLE;
+	};
+	void Trace(const int state, const int reason)
+	{
+		TraceRecord record;
+		record.time = ScanTime();
+		record.device = v.nameHash;
+		record.oldState = v.state;
+		record.newState = state;
+		record.command = v.command;
+		record.reason = reason;
+		TraceEvent(record);
+	};
+	ValveArray& a;
+	Element& v;
+};
+
+template <class Topology>
+inline bool ValveArray<Topology>::Update(const size_t i)
+{
+	Machine machine(*this, m_valves[i]);
+	return UpdateValve(machine, ScanTime());
+}
+
+template <class Topology>
+int ValveArray<Topology>::UpdateAll()
+{
+	int rejected = 0;
+	const size_t count = m_valves.size();
+	for (size_t i = 0; i < count; ++i)
+	{
+		rejected += !Update(i);
+	}
+	return rejected;
+}
+
+#endif // STATICVALVE_H
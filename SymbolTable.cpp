@@ -0,0 +1,214 @@
+///////////////////////////////////////////////////////////////////////////////
+// FILE:          SymbolTable.cpp
+// PROJECT:       Devices 
+// SUBSYSTEM:     Device Controller 
+//-----------------------------------------------------------------------------
+// DESCRIPTION:   implementation of the monotonic and scan clocks
+//             
+// COPYRIGHT:     Karl Hoover, No Prior Art, 2009
+//
+// LICENSE:       This library is free software; you can redistribute it and/or
+//                modify it under the terms of the GNU Lesser General Public
+//                License (LGPL) as published by the Free Software Foundation.
+//                See license text at http://www.gnu.org/licenses/lgpl.txt 
+//                Briefly you can use this source code pretty much however you
+//                wish, as long as this notice remains intact and you
+//                prominently acknowledge this copyright.
+//
+//                This file is distributed in the hope that it will be useful,
+//                but WITHOUT ANY WARRANTY; without even the implied warranty
+//                of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//                IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//                CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+//                INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES.
+//
+// AUTHOR:        Karl Hoover  karl.hoover@gmail.com
+//
+// REVISIONS:     
+//
+// NOTES:   
+// see SymbolTable.h for comments and history
+
+#include <atomic>
+#include <cstring>
+#include <stdexcept>
+
+#include <pthread.h>
+
+#include "SymbolTable.h"
+
+using namespace std;
+
+#define SYMBOL_CHUNK (1U << SYMBOL_CHUNK_BITS)
+#define FIRST_INDEX_SIZE 1024 // slots, power of two
+
+// a slot is (hash << 32) | symbol, 0 is empty. Symbol 0, the empty name,
+// is never in the index.
+struct SymbolIndex
+{
+	size_t mask;
+	atomic<unsigned long long>* slots;
+	SymbolIndex* retired; // the one this replaced, for readers still in it
+};
+
+static string* s_chunks[SYMBOL_CHUNKS]; // read after s_count says so
+static atomic<size_t> s_count(1);         // the empty name needs no chunk
+static atomic<SymbolIndex*> s_index(NULL);
+static pthread_mutex_t s_internMtx = PTHREAD_MUTEX_INITIALIZER;
+
+static const string& EmptyName()
+{
+	static const string empty;
+	return empty;
+}
+
+// FNV-1a, folded to 32 bits, never 0 so a slot is never empty by accident
+static unsigned int HashName(const char* name, const size_t length)
+{
+	unsigned long long hash = 14695981039346656037ULL;
+	for (size_t i = 0; i < length; ++i)
+	{
+		hash ^= (unsigned char)name[i];
+		hash *= 1099511628211ULL;
+	}
+	unsigned int folded = (unsigned int)(hash ^ (hash >> 32));
+	return folded ? folded : 1;
+}
+
+static unsigned long long Slot(const unsigned int hash, const Symbol symbol)
+{
+	return ((unsigned long long)hash << 32) | symbol;
+}
+
+static Symbol Probe(const SymbolIndex* index, const char* name, const size_t length,
+	const unsigned int hash)
+{
+	for (size_t i = hash & index->mask; ; i = (i + 1) & index->mask)
+	{
+		unsigned long long slot = index->slots[i].load(memory_order_acquire);
+		if (!slot)
+		{
+			return NO_SYMBOL;
+		}
+		if ((unsigned int)(slot >> 32) == hash)
+		{
+			const string& candidate = SymbolName((Symbol)slot);
+			if (candidate.size() == length && 0 == memcmp(candidate.data(), name, length))
+			{
+				return (Symbol)slot;
+			}
+		}
+	}
+}
+
+static void Insert(SymbolIndex* index, const unsigned int hash, const Symbol symbol)
+{
+	size_t i = hash & index->mask;
+	while (index->slots[i].load(memory_order_relaxed))
+	{
+		i = (i + 1) & index->mask;
+	}
+	index->slots[i].store(Slot(hash, symbol), memory_order_release);
+}
+
+static SymbolIndex* NewIndex(const size_t size)
+{
+	SymbolIndex* index = new SymbolIndex;
+	index->mask = size - 1;
+	index->slots = new atomic<unsigned long long>[size];
+	for (size_t i = 0; i < size; ++i)
+	{
+		index->slots[i].store(0, memory_order_relaxed);
+	}
+	index->retired = NULL;
+	return index;
+}
+
+// under s_internMtx: a twice as big index with everything in it
+static SymbolIndex* Grow(SymbolIndex* old)
+{
+	SymbolIndex* index = NewIndex(old ? 2 * (old->mask + 1) : FIRST_INDEX_SIZE);
+	size_t count = s_count.load(memory_order_relaxed);
+	for (Symbol symbol = 1; symbol < count; ++symbol)
+	{
+		const string& name = SymbolName(symbol);
+		Insert(index, HashName(name.data(), name.size()), symbol);
+	}
+	index->retired = old;
+	s_index.store(index, memory_order_release);
+	return index;
+}
+
+Symbol InternSymbol(const char* name, const size_t length)
+{
+	if (0 == length)
+	{
+		return 0;
+	}
+	unsigned int hash = HashName(name, length);
+	pthread_mutex_lock(&s_internMtx);
+	SymbolIndex* index = s_index.load(memory_order_relaxed);
+	Symbol symbol = index ? Probe(index, name, length, hash) : NO_SYMBOL;
+	if (NO_SYMBOL == symbol)
+	{
+		size_t count = s_count.load(memory_order_relaxed);
+		if (count >= (size_t)SYMBOL_CHUNKS * SYMBOL_CHUNK)
+		{
+			pthread_mutex_unlock(&s_internMtx);
+			throw length_error("InternSymbol: symbol table full");
+		}
+		symbol = count;
+		string*& chunk = s_chunks[symbol >> SYMBOL_CHUNK_BITS];
+		if (!chunk)
+		{
+			chunk = new string[SYMBOL_CHUNK];
+		}
+		chunk[symbol & (SYMBOL_CHUNK - 1)].assign(name, length);
+		s_count.store(count + 1, memory_order_release);
+		if (!index || 2 * (count + 1) > index->mask + 1)
+		{
+			Grow(index); // has the new one already
+		}
+		else
+		{
+			Insert(index, hash, symbol);
+		}
+	}
+	pthread_mutex_unlock(&s_internMtx);
+	return symbol;
+}
+
+Symbol InternSymbol(const string& name)
+{
+	return InternSymbol(name.data(), name.size());
+}
+
+Symbol FindSymbol(const char* name, const size_t length)
+{
+	if (0 == length)
+	{
+		return 0;
+	}
+	const SymbolIndex* index = s_index.load(memory_order_acquire);
+	return index ? Probe(index, name, length, HashName(name, length)) : NO_SYMBOL;
+}
+
+Symbol FindSymbol(const string& name)
+{
+	return FindSymbol(name.data(), name.size());
+}
+
+const string& SymbolName(const Symbol symbol)
+{
+	if (0 == symbol)
+	{
+		return EmptyName();
+	}
+	return s_chunks[symbol >> SYMBOL_CHUNK_BITS][symbol & (SYMBOL_CHUNK - 1)];
+}
+
+size_t SymbolCount()
+{
+	return s_count.load(memory_order_acquire);
+}
@@ -0,0 +1,70 @@
+///////////////////////////////////////////////////////////////////////////////
+// FILE:          SymbolTable.h
+// PROJECT:       Devices 
+// SUBSYSTEM:     Device Controller 
+//-----------------------------------------------------------------------------
+// DESCRIPTION:   interned device and IO names
+//             
+// COPYRIGHT:     Karl Hoover, No Prior Art, 2009
+//
+// LICENSE:       This library is free software; you can redistribute it and/or
+//                modify it under the terms of the GNU Lesser General Public
+//                License (LGPL) as published by the Free Software Foundation.
+//                See license text at http://www.gnu.org/licenses/lgpl.txt 
+//                Briefly you can use this source code pretty much however you
+//                wish, as long as this notice remains intact and you
+//                prominently acknowledge this copyright.
+//
+//                This file is distributed in the hope that it will be useful,
+//                but WITHOUT ANY WARRANTY; without even the implied warranty
+//                of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//                IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//                CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+//                INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES.
+//
+// AUTHOR:        Karl Hoover  karl.hoover@gmail.com
+//
+// REVISIONS:     1.0 October 16, 2026
+//
+// NOTES:   
+// Every device and IO name is interned once, when the object is built,
+// into a Symbol: a small dense integer, 0 being the empty name. The name
+// itself is kept once in a process wide table, so objects hold 4 bytes
+// instead of a string, Name() hands back a reference to the interned
+// string without allocating, and two names compare equal if and only if
+// their symbols do.
+//
+// The table is append only. Names are stored in fixed size chunks which
+// never move, and looked up through an open addressing hash index whose
+// slots pack the name's hash with its symbol, so readers (SymbolName,
+// FindSymbol) take no lock and allocate nothing, from any thread, while
+// another thread interns. InternSymbol takes a mutex; when the index gets
+// half full a twice as big one is built and published, the old one is
+// left for readers still probing it and never freed. Interned names live
+// until the process exits, which is fine for configuration, but don't
+// intern data.
+
+#ifndef SYMBOLTABLE_H
+#define SYMBOLTABLE_H
+
+#include <string>
+#include <cstddef>
+
+typedef unsigned int Symbol;
+
+#define NO_SYMBOL 0xffffffffU      // FindSymbol: never interned
+#define SYMBOL_CHUNK_BITS 12       // 4096 names per chunk
+#define SYMBOL_CHUNKS 4096         // at most 16M names
+
+// adds the name if it's new. Throws length_error when the table is full.
+extern Symbol InternSymbol(const char* name, const size_t length);
+extern Symbol InternSymbol(const std::string& name);
+// no lock, no allocation, NO_SYMBOL if the name was never interned
+extern Symbol FindSymbol(const char* name, const size_t length);
+extern Symbol FindSymbol(const std::string& name);
+// no lock, no allocation; the symbol must have come from this table
+extern const std::string& SymbolName(const Symbol symbol);
+extern size_t SymbolCount(); // including the empty name
+
+#endif // SYMBOLTABLE_H
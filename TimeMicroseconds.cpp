@@ -30,6 +30,7 @@
 // NOTES:   
 // see TimeMicroseconds.h for comments and history
 
+#include <cstddef>
 #include <sys/time.h>
 unsigned long long TimeMicroseconds()
 {
@@ -28,5 +28,7 @@
 // REVISIONS:     1.0 March 25, 2009   compiles with gcc 4.0.1  
 //
 // NOTES:   
+// wall clock time, it steps with NTP. Measure intervals and timeouts with
+// the monotonic clock in ScanClock.h.
 //
 extern unsigned long long TimeMicroseconds();
@@ -0,0 +1,207 @@
+///////////////////////////////////////////////////////////////////////////////
+// FILE:          TimerWheel.cpp
+// PROJECT:       Devices 
+// SUBSYSTEM:     Device Controller 
+//-----------------------------------------------------------------------------
+// DESCRIPTION:   implementation of the hierarchical timer wheel
+//             
+// COPYRIGHT:     Karl Hoover, No Prior Art, 2009
+//
+// LICENSE:       This library is free software; you can redistribute it and/or
+//                modify it under the terms of the GNU Lesser General Public
+//                License (LGPL) as published by the Free Software Foundation.
+//                See license text at http://www.gnu.org/licenses/lgpl.txt 
+//                Briefly you can use this source code pretty much however you
+//                wish, as long as this notice remains intact and you
+//                prominently acknowledge this copyright.
+//
+//                This file is distributed in the hope that it will be useful,
+//                but WITHOUT ANY WARRANTY; without even the implied warranty
+//                of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//                IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//                CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+//                INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES.
+//
+// AUTHOR:        Karl Hoover  karl.hoover@gmail.com
+//
+// REVISIONS:     
+//
+// NOTES:   
+// see TimerWheel.h for comments and history
+
+#include "TimerWheel.h"
+#include "device.h"
+
+#define SLOT_MASK (TIMER_WHEEL_SLOTS - 1)
+
+// slot lists are circular with the head as sentinel, so an empty slot points
+// at itself and an armed timer never has a NULL neighbour
+
+TimerWheel::TimerWheel(const Nanoseconds tickTime, const Nanoseconds now):
+	m_tickTime(tickTime > 0 ? tickTime : 1), m_pending(0)
+{
+	m_now = now < 0 ? 0 : now / m_tickTime;
+	for (int level = 0; level < TIMER_WHEEL_LEVELS; ++level)
+	{
+		for (int slot = 0; slot < TIMER_WHEEL_SLOTS; ++slot)
+		{
+			m_slots[level][slot].m_next = &m_slots[level][slot];
+			m_slots[level][slot].m_prev = &m_slots[level][slot];
+		}
+	}
+	pthread_mutex_init(&m_mtx, NULL);
+}
+
+TimerWheel::~TimerWheel()
+{
+	// leave no dangling pointers in timers which outlive the wheel
+	for (int level = 0; level < TIMER_WHEEL_LEVELS; ++level)
+	{
+		for (int slot = 0; slot < TIMER_WHEEL_SLOTS; ++slot)
+		{
+			Timer& head = m_slots[level][slot];
+			while (head.m_next != &head)
+			{
+				Unlink(*head.m_next);
+			}
+		}
+	}
+	pthread_mutex_destroy(&m_mtx);
+}
+
+void TimerWheel::Unlink(Timer& timer)
+{
+	timer.m_prev->m_next = timer.m_next;
+	timer.m_next->m_prev = timer.m_prev;
+	timer.m_next = NULL;
+	timer.m_prev = NULL;
+	--m_pending;
+}
+
+// put the timer in the slot matching how far away it is. Called with the
+// lock held, m_tick already set. A tick already reached goes in the current
+// level 0 slot, which is about to be (or being) fired.
+void TimerWheel::Insert(Timer& timer)
+{
+	unsigned long long tick = timer.m_tick < m_now ? m_now : timer.m_tick;
+	unsigned long long delta = tick - m_now;
+	int level = 0;
+	while (level < TIMER_WHEEL_LEVELS - 1 && 
+		delta >= (1ULL << (TIMER_WHEEL_SLOT_BITS * (level + 1))))
+	{
+		++level;
+	}
+	if (delta >= (1ULL << (TIMER_WHEEL_SLOT_BITS * TIMER_WHEEL_LEVELS)))
+	{
+		// beyond the top level: park it in the furthest slot, it will be
+		// cascaded and re-inserted until it is in range
+		tick = m_now + (1ULL << (TIMER_WHEEL_SLOT_BITS * TIMER_WHEEL_LEVELS)) - 1;
+	}
+	Timer& head = m_slots[level][(tick >> (TIMER_WHEEL_SLOT_BITS * level)) & SLOT_MASK];
+	timer.m_prev = head.m_prev;
+	timer.m_next = &head;
+	head.m_prev->m_next = &timer;
+	head.m_prev = &timer;
+	++m_pending;
+}
+
+void TimerWheel::Arm(Timer& timer, Device& device, const Nanoseconds deadline)
+{
+	pthread_mutex_lock(&m_mtx);
+	if (timer.Armed())
+	{
+		Unlink(timer);
+	}
+	timer.m_device = &device;
+	timer.m_deadline = deadline;
+	timer.m_tick = deadline < 0 ? 0 : (deadline + m_tickTime - 1) / m_tickTime; // round up, never early
+	if (timer.m_tick <= m_now) // that tick has already been fired
+	{
+		timer.m_tick = m_now + 1;
+	}
+	Insert(timer);
+	pthread_mutex_unlock(&m_mtx);
+}
+
+void TimerWheel::Cancel(Timer& timer)
+{
+	pthread_mutex_lock(&m_mtx);
+	if (timer.Armed())
+	{
+		Unlink(timer);
+	}
+	pthread_mutex_unlock(&m_mtx);
+}
+
+void TimerWheel::Splice(Timer& from, Timer& to)
+{
+	if (from.m_next == &from)
+	{
+		to.m_next = &to;
+		to.m_prev = &to;
+		return;
+	}
+	to.m_next = from.m_next;
+	to.m_prev = from.m_prev;
+	to.m_next->m_prev = &to;
+	to.m_prev->m_next = &to;
+	from.m_next = &from;
+	from.m_prev = &from;
+}
+
+// re-insert the timers of the level's current slot, they are now close
+// enough for a finer level
+void TimerWheel::Cascade(const int level)
+{
+	Timer list;
+	Splice(m_slots[level][(m_now >> (TIMER_WHEEL_SLOT_BITS * level)) & SLOT_MASK], list);
+	while (list.m_next != &list)
+	{
+		Timer& timer = *list.m_next;
+		Unlink(timer);
+		Insert(timer);
+	}
+}
+
+int TimerWheel::Advance(const Nanoseconds now)
+{
+	int fired = 0;
+	unsigned long long target = now < 0 ? 0 : now / m_tickTime;
+	pthread_mutex_lock(&m_mtx);
+	while (m_now < target)
+	{
+		if (0 == m_pending) // nothing to fire, skip the idle ticks
+		{
+			m_now = target;
+			break;
+		}
+		++m_now;
+		if (0 == (m_now & SLOT_MASK)) // level 0 wrapped
+		{
+			// top down, so a timer can fall through several levels at once
+			for (int level = TIMER_WHEEL_LEVELS - 1; level > 0; --level)
+			{
+				if (0 == (m_now & ((1ULL << (TIMER_WHEEL_SLOT_BITS * level)) - 1)))
+				{
+					Cascade(level);
+				}
+			}
+		}
+		Timer expired;
+		Splice(m_slots[0][m_now & SLOT_MASK], expired);
+		while (expired.m_next != &expired)
+		{
+			Timer& timer = *expired.m_next;
+			Unlink(timer);
+			Device* device = timer.m_device;
+			++fired;
+			// the device will usually cancel or re-arm, possibly this timer
+			pthread_mutex_unlock(&m_mtx);
+			device->DoProcessTimeouts();
+			pthread_mutex_lock(&m_mtx);
+		}
+	}
+	pthread_mutex_unlock(&m_mtx);
+	return fired;
+}
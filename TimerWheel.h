@@ -0,0 +1,111 @@
+///////////////////////////////////////////////////////////////////////////////
+// FILE:          TimerWheel.h
+// PROJECT:       Devices 
+// SUBSYSTEM:     Device Controller 
+//-----------------------------------------------------------------------------
+// DESCRIPTION:   hierarchical timer wheel for device timeouts
+//             
+// COPYRIGHT:     Karl Hoover, No Prior Art, 2009
+//
+// LICENSE:       This library is free software; you can redistribute it and/or
+//                modify it under the terms of the GNU Lesser General Public
+//                License (LGPL) as published by the Free Software Foundation.
+//                See license text at http://www.gnu.org/licenses/lgpl.txt 
+//                Briefly you can use this source code pretty much however you
+//                wish, as long as this notice remains intact and you
+//                prominently acknowledge this copyright.
+//
+//                This file is distributed in the hope that it will be useful,
+//                but WITHOUT ANY WARRANTY; without even the implied warranty
+//                of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//                IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//                CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+//                INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES.
+//
+// AUTHOR:        Karl Hoover  karl.hoover@gmail.com
+//
+// REVISIONS:     1.0 October 16, 2026
+//
+// NOTES:   
+// Instead of every valve comparing the clock against its motion start time
+// on every scan, a valve arms a Timer when it starts to move or starts to
+// wait for an interlock, and cancels it when it gets there. When a deadline
+// passes the wheel calls the device's DoProcessTimeouts(), so an idle plant
+// costs nothing.
+//
+// Four levels of 256 slots, like the classic Unix kernel timer wheel. Level
+// 0 holds timers due in the next 256 ticks, level 1 the next 256*256 and so
+// on; when level 0 wraps, the next level 1 slot is cascaded down. Arm and
+// Cancel are O(1), each Timer is an intrusive doubly linked list node that
+// lives in its owner, so nothing is allocated. A timer never fires early,
+// it fires on the first tick at or after its deadline.
+//
+// Arm/Cancel may be called from any thread (a ScanExecutor updates valves
+// concurrently). Advance() must not run concurrently with device updates,
+// since it calls the devices itself; give it its own phase of the scan.
+
+#ifndef TIMERWHEEL_H
+#define TIMERWHEEL_H
+
+#include <cstddef>
+
+#include "ScanClock.h"
+
+#include <pthread.h>
+
+class Device;
+
+class Timer  // embed one in the object which needs a timeout
+{
+public:
+	Timer(): m_next(NULL), m_prev(NULL), m_tick(0), m_deadline(0), m_device(NULL) {};
+	// copying the owner must not copy the wheel's links, a copy is unarmed
+	Timer(const Timer&): m_next(NULL), m_prev(NULL), m_tick(0), m_deadline(0), 
+		m_device(NULL) {};
+	Timer& operator=(const Timer&) {return *this;};
+	bool Armed() const {return NULL != m_prev;}; // only safe under the wheel's lock
+	Nanoseconds Deadline() const {return m_deadline;}; // as given to Arm
+private:
+	friend class TimerWheel;
+	Timer* m_next;
+	Timer* m_prev;
+	unsigned long long m_tick;
+	Nanoseconds m_deadline;
+	Device* m_device;
+};
+
+#define TIMER_WHEEL_LEVELS 4
+#define TIMER_WHEEL_SLOTS 256  // per level, power of two
+#define TIMER_WHEEL_SLOT_BITS 8
+
+class TimerWheel
+{
+public:
+	// same clock as ScanTime()
+	TimerWheel(const Nanoseconds tickTime, const Nanoseconds now);
+	~TimerWheel();
+	// (re)arm: device.DoProcessTimeouts() is called once deadline has passed
+	void Arm(Timer& timer, Device& device, const Nanoseconds deadline);
+	void Cancel(Timer& timer);
+	int Advance(const Nanoseconds now); // returns number of timers fired
+	int Pending() const {return m_pending;};
+	Nanoseconds TickTime() const {return m_tickTime;};
+
+private:
+	TimerWheel(const TimerWheel&);
+	TimerWheel& operator=(const TimerWheel&);
+
+	void Insert(Timer& timer);
+	void Unlink(Timer& timer);
+	void Cascade(const int level);
+	static void Splice(Timer& from, Timer& to); // move a whole slot list
+
+	Timer m_slots[TIMER_WHEEL_LEVELS][TIMER_WHEEL_SLOTS]; // list heads
+	Nanoseconds m_tickTime;
+	unsigned long long m_now;  // ticks processed so far
+	int m_pending;
+	pthread_mutex_t m_mtx;
+};
+
+#endif // TIMERWHEEL_H
@@ -0,0 +1,279 @@
+///////////////////////////////////////////////////////////////////////////////
+// FILE:          Trace.cpp
+// PROJECT:       Devices 
+// SUBSYSTEM:     Device Controller 
+//-----------------------------------------------------------------------------
+// DESCRIPTION:   implementation of the transition trace
+//             
+// COPYRIGHT:     Karl Hoover, No Prior Art, 2009
+//
+// LICENSE:       This library is free software; you can redistribute it and/or
+//                modify it under the terms of the GNU Lesser General Public
+//                License (LGPL) as published by the Free Software Foundation.
+//                See license text at http://www.gnu.org/licenses/lgpl.txt 
+//                Briefly you can use this source code pretty much however you
+//                wish, as long as this notice remains intact and you
+//                prominently acknowledge this copyright.
+//
+//                This file is distributed in the hope that it will be useful,
+//                but WITHOUT ANY WARRANTY; without even the implied warranty
+//                of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//                IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//                CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+//                INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES.
+//
+// AUTHOR:        Karl Hoover  karl.hoover@gmail.com
+//
+// REVISIONS:     
+//
+// NOTES:   
+// see Trace.h for comments and history
+
+#include <cstdio>
+#include <cstring>
+#include <cerrno>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+
+#include "Trace.h"
+
+using namespace std;
+
+#define TRACE_DRAIN_RECORDS 4096  // per write(2)
+
+// one recording thread to the drain thread
+class TraceRing
+{
+public:
+	TraceRing(const unsigned int size): m_records(size), m_mask(size - 1),
+		m_head(0), m_tail(0), m_dropped(0) {};
+	void Push(const TraceRecord& record)
+	{
+		unsigned long long head = m_head.load(memory_order_relaxed);
+		if (head - m_tail.load(memory_order_acquire) > m_mask)
+		{
+			m_dropped.store(m_dropped.load(memory_order_relaxed) + 1, memory_order_relaxed);
+			return;
+		}
+		m_records[head & m_mask] = record;
+		m_head.store(head + 1, memory_order_release);
+	};
+	size_t Pop(TraceRecord* records, const size_t maximum)
+	{
+		unsigned long long tail = m_tail.load(memory_order_relaxed);
+		unsigned long long head = m_head.load(memory_order_acquire);
+		size_t count = 0;
+		for (; tail != head && count < maximum; ++tail, ++count)
+		{
+			records[count] = m_records[tail & m_mask];
+		}
+		m_tail.store(tail, memory_order_release);
+		return count;
+	};
+	unsigned long long Dropped() const {return m_dropped.load(memory_order_relaxed);};
+private:
+	vector<TraceRecord> m_records;
+	unsigned long long m_mask;
+	char m_pad0[64];
+	atomic<unsigned long long> m_head; // written by the recording thread
+	char m_pad1[64];
+	atomic<unsigned long long> m_tail; // written by the drain
+	atomic<unsigned long long> m_dropped;
+};
+
+// a writer claims s_writerOpen first and publishes itself in
+// s_activeWriter once it is ready to take records
+static atomic<TraceWriter*> s_activeWriter(NULL);
+static atomic<bool> s_writerOpen(false);
+static unsigned int s_writerGeneration = 0; // under s_writerOpen
+
+void TraceEvent(const TraceRecord& record)
+{
+	TraceWriter* writer = s_activeWriter.load(memory_order_acquire);
+	if (!writer)
+	{
+		return;
+	}
+	static thread_local TraceRing* ring = NULL;
+	static thread_local unsigned int generation = 0;
+	if (!ring || generation != writer->m_generation)
+	{
+		ring = writer->AddRing();
+		generation = writer->m_generation;
+	}
+	ring->Push(record);
+}
+
+TraceWriter::TraceWriter(const string& path, const unsigned int ringRecords):
+	m_fd(-1), m_ringRecords(2), m_generation(0), m_buffer(TRACE_DRAIN_RECORDS),
+	m_stop(false), m_failed(false), m_written(0)
+{
+	while (m_ringRecords < ringRecords)
+	{
+		m_ringRecords *= 2;
+	}
+	if (s_writerOpen.exchange(true))
+	{
+		throw runtime_error(path + ": a trace is already being written");
+	}
+	m_generation = ++s_writerGeneration;
+	m_fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (m_fd < 0)
+	{
+		s_writerOpen.store(false);
+		throw runtime_error(path + ": cannot open trace");
+	}
+	TraceFileHeader header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, "DEVTRACE", sizeof(header.magic));
+	header.version = TRACE_VERSION;
+	header.recordSize = sizeof(TraceRecord);
+	if (write(m_fd, &header, sizeof(header)) != sizeof(header))
+	{
+		close(m_fd);
+		s_writerOpen.store(false);
+		throw runtime_error(path + ": cannot write trace");
+	}
+	pthread_mutex_init(&m_ringMtx, NULL);
+	pthread_mutex_init(&m_drainMtx, NULL);
+	if (pthread_create(&m_thread, NULL, Run, this))
+	{
+		pthread_mutex_destroy(&m_ringMtx);
+		pthread_mutex_destroy(&m_drainMtx);
+		close(m_fd);
+		s_writerOpen.store(false);
+		throw runtime_error(path + ": cannot start trace thread");
+	}
+	s_activeWriter.store(this, memory_order_release); // ready, scan threads may record
+}
+
+TraceWriter::~TraceWriter()
+{
+	s_activeWriter.store(NULL);
+	m_stop.store(true);
+	pthread_join(m_thread, NULL);
+	Drain();
+	close(m_fd);
+	for (size_t i = 0; i < m_rings.size(); ++i)
+	{
+		delete m_rings[i];
+	}
+	pthread_mutex_destroy(&m_ringMtx);
+	pthread_mutex_destroy(&m_drainMtx);
+	s_writerOpen.store(false);
+}
+
+TraceRing* TraceWriter::AddRing()
+{
+	TraceRing* ring = new TraceRing(m_ringRecords);
+	pthread_mutex_lock(&m_ringMtx);
+	m_rings.push_back(ring);
+	pthread_mutex_unlock(&m_ringMtx);
+	return ring;
+}
+
+unsigned long long TraceWriter::Dropped() const
+{
+	unsigned long long dropped = 0;
+	pthread_mutex_lock(&m_ringMtx);
+	for (size_t i = 0; i < m_rings.size(); ++i)
+	{
+		dropped += m_rings[i]->Dropped();
+	}
+	pthread_mutex_unlock(&m_ringMtx);
+	return dropped;
+}
+
+void TraceWriter::Flush()
+{
+	Drain();
+}
+
+void* TraceWriter::Run(void* writer)
+{
+	TraceWriter* self = static_cast<TraceWriter*>(writer);
+	struct timespec idle = {0, 1000000};
+	while (!self->m_stop.load(memory_order_relaxed))
+	{
+		if (0 == self->Drain())
+		{
+			nanosleep(&idle, NULL);
+		}
+	}
+	return NULL;
+}
+
+size_t TraceWriter::Drain()
+{
+	pthread_mutex_lock(&m_drainMtx);
+	// rings are only ever added, a ring added after this is drained next time
+	pthread_mutex_lock(&m_ringMtx);
+	size_t rings = m_rings.size();
+	pthread_mutex_unlock(&m_ringMtx);
+	size_t total = 0;
+	for (size_t i = 0; i < rings; ++i)
+	{
+		pthread_mutex_lock(&m_ringMtx);
+		TraceRing* ring = m_rings[i];
+		pthread_mutex_unlock(&m_ringMtx);
+		size_t count;
+		while ((count = ring->Pop(&m_buffer[0], m_buffer.size())) > 0)
+		{
+			Write(&m_buffer[0], count);
+			total += count;
+		}
+	}
+	pthread_mutex_unlock(&m_drainMtx);
+	return total;
+}
+
+void TraceWriter::Write(const TraceRecord* records, const size_t count)
+{
+	const char* data = reinterpret_cast<const char*>(records);
+	size_t length = count * sizeof(TraceRecord);
+	while (length > 0)
+	{
+		ssize_t written = write(m_fd, data, length);
+		if (written < 0)
+		{
+			if (EINTR == errno)
+			{
+				continue;
+			}
+			m_failed.store(true, memory_order_relaxed);
+			return;
+		}
+		data += written;
+		length -= written;
+	}
+	m_written.fetch_add(count, memory_order_relaxed);
+}
+
+bool ReadTraceFile(const string& path, vector<TraceRecord>& records)
+{
+	records.clear();
+	FILE* file = fopen(path.c_str(), "rb");
+	if (!file)
+	{
+		return false;
+	}
+	TraceFileHeader header;
+	if (fread(&header, sizeof(header), 1, file) != 1 || 
+		memcmp(header.magic, "DEVTRACE", sizeof(header.magic)) ||
+		TRACE_VERSION != header.version || sizeof(TraceRecord) != header.recordSize)
+	{
+		fclose(file);
+		return false;
+	}
+	TraceRecord record;
+	while (fread(&record, sizeof(record), 1, file) == 1)
+	{
+		records.push_back(record);
+	}
+	fclose(file);
+	return true;
+}
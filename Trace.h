@@ -0,0 +1,132 @@
+///////////////////////////////////////////////////////////////////////////////
+// FILE:          Trace.h
+// PROJECT:       Devices 
+// SUBSYSTEM:     Device Controller 
+//-----------------------------------------------------------------------------
+// DESCRIPTION:   binary trace of device state transitions
+//             
+// COPYRIGHT:     Karl Hoover, No Prior Art, 2009
+//
+// LICENSE:       This library is free software; you can redistribute it and/or
+//                modify it under the terms of the GNU Lesser General Public
+//                License (LGPL) as published by the Free Software Foundation.
+//                See license text at http://www.gnu.org/licenses/lgpl.txt 
+//                Briefly you can use this source code pretty much however you
+//                wish, as long as this notice remains intact and you
+//                prominently acknowledge this copyright.
+//
+//                This file is distributed in the hope that it will be useful,
+//                but WITHOUT ANY WARRANTY; without even the implied warranty
+//                of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//                IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//                CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+//                INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES.
+//
+// AUTHOR:        Karl Hoover  karl.hoover@gmail.com
+//
+// REVISIONS:     1.0 October 16, 2026
+//
+// NOTES:   
+// While a TraceWriter exists, every valve state transition, and every
+// command a valve had to reject, is recorded as a fixed size binary
+// TraceRecord. Each recording thread has its own single producer ring, so
+// recording is a couple of stores and a release, it never locks, allocates
+// (after the thread's first record) or waits for I/O. When a ring is full
+// the record is dropped and counted, the scan is never held up. The
+// writer's own thread drains the rings every millisecond or so into the
+// trace file with plain write(2) calls.
+//
+// The file is a TraceFileHeader followed by TraceRecords in the host's byte
+// order. Records of one thread are in order, records of different threads
+// are interleaved by the drain, sort by time if it matters. The device is
+// identified by the hash of its name, as in a checkpoint
+// (CheckpointNameHash); ReadTraceFile() reads a file back.
+//
+// There is one TraceWriter at a time. Destroy it only once nothing is
+// recording any more (the scan has stopped): it drains the rings, closes the
+// file and frees the rings.
+
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <string>
+#include <vector>
+#include <atomic>
+
+#include <pthread.h>
+
+#include "ScanClock.h"
+
+#define TRACE_VERSION 1
+#define DEFAULT_TRACE_RING_RECORDS 65536  // per thread, power of two
+
+// why a transition happened, beyond the ordinary course of a command
+#define TRACE_REASON_NONE 0
+#define TRACE_REASON_MOTION_TIMEOUT 1      // OPENING/CLOSING/INITIALIZING to INVALID
+#define TRACE_REASON_INTERLOCK_TIMEOUT 2   // WAITING to INVALID
+#define TRACE_REASON_SENSOR_CONFLICT 3     // e.g. both CLOSED? and OPENED? made
+#define TRACE_REASON_RESET 4               // COMMAND_RESET out of INVALID
+#define TRACE_REASON_COMMAND_REJECTED 5    // no transition, command not accepted
+
+struct TraceRecord  // fixed size, the on disk record
+{
+	Nanoseconds time;          // ScanTime()
+	unsigned long long device; // CheckpointNameHash of the name
+	short oldState;
+	short newState;
+	short command;
+	unsigned short reason;     // TRACE_REASON_
+};
+
+struct TraceFileHeader
+{
+	char magic[8];             // "DEVTRACE"
+	unsigned int version;      // TRACE_VERSION
+	unsigned int recordSize;   // sizeof(TraceRecord)
+};
+
+// any thread. Does nothing unless a TraceWriter exists.
+extern void TraceEvent(const TraceRecord& record);
+
+class TraceRing;
+
+class TraceWriter
+{
+public:
+	// creates or truncates the file and starts the drain thread; throws
+	// runtime_error if it can't, or if another TraceWriter exists
+	TraceWriter(const std::string& path, 
+		const unsigned int ringRecords = DEFAULT_TRACE_RING_RECORDS);
+	~TraceWriter();
+	void Flush(); // returns once what was recorded before the call is written
+	unsigned long long Written() const {return m_written.load(std::memory_order_relaxed);};
+	unsigned long long Dropped() const; // rings were full
+	bool Failed() const {return m_failed.load(std::memory_order_relaxed);}; // a write failed
+
+private:
+	TraceWriter(const TraceWriter&);
+	TraceWriter& operator=(const TraceWriter&);
+	friend void TraceEvent(const TraceRecord& record);
+	TraceRing* AddRing();  // for a thread's first record
+	static void* Run(void* writer);
+	size_t Drain();        // drain thread, returns records written
+	void Write(const TraceRecord* records, const size_t count);
+
+	int m_fd;
+	unsigned int m_ringRecords;
+	unsigned int m_generation; // tells the threads' rings of an old writer apart, set before publishing
+	pthread_t m_thread;
+	mutable pthread_mutex_t m_ringMtx;  // m_rings, held only briefly
+	pthread_mutex_t m_drainMtx;         // one Drain at a time
+	std::vector<TraceRing*> m_rings;
+	std::vector<TraceRecord> m_buffer;
+	std::atomic<bool> m_stop;
+	std::atomic<bool> m_failed;
+	std::atomic<unsigned long long> m_written;
+};
+
+// the whole file, in file order; false if it isn't a trace file
+extern bool ReadTraceFile(const std::string& path, std::vector<TraceRecord>& records);
+
+#endif // TRACE_H
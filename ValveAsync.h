@@ -0,0 +1,253 @@
+///////////////////////////////////////////////////////////////////////////////
+// FILE:          ValveAsync.h
+// PROJECT:       Devices 
+// SUBSYSTEM:     Device Controller 
+//-----------------------------------------------------------------------------
+// DESCRIPTION:   C++20 coroutines awaiting valve commands
+//             
+// COPYRIGHT:     Karl Hoover, No Prior Art, 2009
+//
+// LICENSE:       This library is free software; you can redistribute it and/or
+//                modify it under the terms of the GNU Lesser General Public
+//                License (LGPL) as published by the Free Software Foundation.
+//                See license text at http://www.gnu.org/licenses/lgpl.txt 
+//                Briefly you can use this source code pretty much however you
+//                wish, as long as this notice remains intact and you
+//                prominently acknowledge this copyright.
+//
+//                This file is distributed in the hope that it will be useful,
+//                but WITHOUT ANY WARRANTY; without even the implied warranty
+//                of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//                IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//                CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+//                INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES.
+//
+// AUTHOR:        Karl Hoover  karl.hoover@gmail.com
+//
+// REVISIONS:     1.0 October 16, 2026  needs C++20 (-std=c++20) for coroutines
+//
+// NOTES:   
+// Client code which has to "open V1, wait until it is open, then close V2"
+// can be written as a coroutine instead of a loop polling State(), or a
+// thread blocked on PostCommandAsync() per operation:
+//
+//     AsyncTask Transfer(Valve& slitValve, Valve& vent)
+//     {
+//         if (COMMAND_RESULT_DONE != co_await OpenAsync(slitValve, 
+//             2 * NANOSECONDS_PER_SECOND))
+//         {
+//             co_return;
+//         }
+//         co_await CloseAsync(vent);
+//     }
+//
+//     Transfer(v1, v2).Start(scheduler);
+//
+// co_await OpenAsync/CloseAsync/ResetAsync/CommandAsync posts the command
+// (Device::PostCommand) with a completion callback and suspends; the
+// valve runs it as any other, waiting for its interlock first if need be,
+// and when it comes to rest or goes STATE_INVALID the scan thread calls
+// back and the coroutine is resumed with the COMMAND_RESULT_. A suspended
+// coroutine is a small heap frame and nothing else: no stack, no thread,
+// no polling, so thousands can be in flight.
+//
+// Where it is resumed depends on how the task was started. With an
+// AsyncScheduler (AsyncScheduler.h) the scan thread only posts the resume
+// and the scheduler's thread(s) run the client code. Started without one
+// it runs on the calling thread up to its first co_await and after that
+// on the scan thread, inside the Update() that completed the command, as
+// a Sequence's callbacks do; keep it short then.
+//
+// A timeout, 0 for none, needs a scheduler: when it passes first the
+// coroutine is resumed with COMMAND_RESULT_TIMED_OUT, the command itself
+// carries on and its completion is then ignored. A timer which didn't
+// fire stays with the scheduler until its deadline and then does nothing.
+// Awaiting with a timeout but without a scheduler is
+// COMMAND_RESULT_REJECTED, nothing is posted. A full command queue is
+// COMMAND_RESULT_REJECTED too.
+//
+// An AsyncTask runs to its end on its own and frees itself; it must not
+// throw (an exception ending it calls std::terminate). A task which is
+// never started is destroyed with its AsyncTask. Don't destroy a device
+// with commands in flight.
+
+#ifndef VALVEASYNC_H
+#define VALVEASYNC_H
+
+#if !defined(__cpp_impl_coroutine) || __cplusplus < 202002L
+#error "ValveAsync.h needs C++20 coroutines, compile with -std=c++20"
+#endif
+
+#include <atomic>
+#include <coroutine>
+#include <exception>
+#include <utility>
+
+#include "device.h"
+#include "AsyncScheduler.h"
+
+class AsyncTask
+{
+public:
+	struct promise_type
+	{
+		AsyncScheduler* scheduler = nullptr; // where to resume, NULL: the scan thread
+		AsyncTask get_return_object() 
+			{return AsyncTask(std::coroutine_handle<promise_type>::from_promise(*this));};
+		std::suspend_always initial_suspend() noexcept {return {};};
+		std::suspend_never final_suspend() noexcept {return {};}; // frees itself
+		void return_void() {};
+		void unhandled_exception() {std::terminate();};
+	};
+	AsyncTask(AsyncTask&& other): m_handle(std::exchange(other.m_handle, nullptr)) {};
+	~AsyncTask() 
+	{
+		if (m_handle)
+		{
+			m_handle.destroy(); // never started
+		}
+	};
+	// runs on the calling thread to its first co_await, then on the scan thread
+	void Start() {std::exchange(m_handle, nullptr).resume();};
+	// everything on the scheduler's threads, from the next Run() or Poll()
+	void Start(AsyncScheduler& scheduler)
+	{
+		m_handle.promise().scheduler = &scheduler;
+		scheduler.Post(Resume, std::exchange(m_handle, nullptr).address());
+	};
+	static void Resume(void* address) {std::coroutine_handle<>::from_address(address).resume();};
+private:
+	AsyncTask(const AsyncTask&);
+	AsyncTask& operator=(const AsyncTask&);
+	explicit AsyncTask(std::coroutine_handle<promise_type> handle): m_handle(handle) {};
+	std::coroutine_handle<promise_type> m_handle;
+};
+
+// co_await CommandAsync(device, command) gives the COMMAND_RESULT_
+class CommandAwaitable
+{
+public:
+	CommandAwaitable(Device& device, const int command, const Nanoseconds timeout):
+		m_device(device), m_command(command), m_timeout(timeout), m_operation(nullptr),
+		m_result(COMMAND_RESULT_REJECTED) {};
+	~CommandAwaitable()
+	{
+		if (m_operation)
+		{
+			Release(m_operation);
+		}
+	};
+	bool await_ready() const noexcept {return false;};
+	bool await_suspend(std::coroutine_handle<AsyncTask::promise_type> handle)
+	{
+		AsyncScheduler* scheduler = handle.promise().scheduler;
+		if (m_timeout > 0 && !scheduler)
+		{
+			return false; // rejected
+		}
+		// shared with the completion and the timer, either may come first,
+		// and both may come after this awaitable is gone
+		const Nanoseconds timeout = m_timeout;
+		Operation* operation = new Operation(handle, scheduler, timeout > 0 ? 3 : 2);
+		m_operation = operation;
+		if (!m_device.PostCommand(m_command, Completed, operation))
+		{
+			// no completion and no timer will come, don't suspend
+			Release(operation);
+			if (timeout > 0)
+			{
+				Release(operation);
+			}
+			return false;
+		}
+		// the completion may have resumed the coroutine and destroyed this
+		// awaitable already, arm the timer from locals only. The timer's
+		// reference keeps the operation alive until it fires.
+		if (timeout > 0)
+		{
+			scheduler->PostAt(MonotonicNanoseconds() + timeout, TimedOut, operation);
+		}
+		return true; // may already have been resumed, touch nothing
+	};
+	int await_resume() const noexcept {return m_operation ? m_operation->result : m_result;};
+private:
+	CommandAwaitable(const CommandAwaitable&);
+	CommandAwaitable& operator=(const CommandAwaitable&);
+	struct Operation
+	{
+		Operation(std::coroutine_handle<> h, AsyncScheduler* s, const int references):
+			handle(h), scheduler(s), result(COMMAND_RESULT_REJECTED), claimed(false), 
+			references(references) {};
+		std::coroutine_handle<> handle;
+		AsyncScheduler* scheduler;
+		int result;
+		std::atomic<bool> claimed;   // resumed, by the completion or the timer
+		std::atomic<int> references;
+	};
+	static void Release(Operation* operation)
+	{
+		if (1 == operation->references.fetch_sub(1, std::memory_order_acq_rel))
+		{
+			delete operation;
+		}
+	};
+	// scan thread
+	static void Completed(void* context, const unsigned long long /*id*/, const int result)
+	{
+		Operation* operation = static_cast<Operation*>(context);
+		if (!operation->claimed.exchange(true))
+		{
+			operation->result = result;
+			if (operation->scheduler)
+			{
+				operation->scheduler->Post(AsyncTask::Resume, operation->handle.address());
+			}
+			else
+			{
+				operation->handle.resume();
+			}
+		}
+		Release(operation);
+	};
+	// scheduler thread
+	static void TimedOut(void* context)
+	{
+		Operation* operation = static_cast<Operation*>(context);
+		if (!operation->claimed.exchange(true))
+		{
+			operation->result = COMMAND_RESULT_TIMED_OUT;
+			operation->handle.resume();
+		}
+		Release(operation);
+	};
+
+	Device& m_device;
+	int m_command;
+	Nanoseconds m_timeout;
+	Operation* m_operation;
+	int m_result;
+};
+
+inline CommandAwaitable CommandAsync(Device& device, const int command, 
+	const Nanoseconds timeout = 0)
+{
+	return CommandAwaitable(device, command, timeout);
+}
+
+inline CommandAwaitable OpenAsync(Valve& valve, const Nanoseconds timeout = 0)
+{
+	return CommandAwaitable(valve, COMMAND_OPEN, timeout);
+}
+
+inline CommandAwaitable CloseAsync(Valve& valve, const Nanoseconds timeout = 0)
+{
+	return CommandAwaitable(valve, COMMAND_CLOSE, timeout);
+}
+
+inline CommandAwaitable ResetAsync(Valve& valve, const Nanoseconds timeout = 0)
+{
+	return CommandAwaitable(valve, COMMAND_RESET, timeout);
+}
+
+#endif // VALVEASYNC_H
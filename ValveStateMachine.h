@@ -0,0 +1,204 @@
+///////////////////////////////////////////////////////////////////////////////
+// FILE:          ValveStateMachine.h
+// PROJECT:       Devices 
+// SUBSYSTEM:     Device Controller 
+//-----------------------------------------------------------------------------
+// DESCRIPTION:   the valve state machine, shared by Valve and ValveArray
+//             
+// COPYRIGHT:     Karl Hoover, No Prior Art, 2009
+//
+// LICENSE:       This library is free software; you can redistribute it and/or
+//                modify it under the terms of the GNU Lesser General Public
+//                License (LGPL) as published by the Free Software Foundation.
+//                See license text at http://www.gnu.org/licenses/lgpl.txt 
+//                Briefly you can use this source code pretty much however you
+//                wish, as long as this notice remains intact and you
+//                prominently acknowledge this copyright.
+//
+//                This file is distributed in the hope that it will be useful,
+//                but WITHOUT ANY WARRANTY; without even the implied warranty
+//                of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//                IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//                CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+//                INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES.
+//
+// AUTHOR:        Karl Hoover  karl.hoover@gmail.com
+//
+// REVISIONS:     1.0 October 16, 2026
+//
+// NOTES:
+// One Update of one valve, written once for both kinds of valve: Valve in
+// device.h, virtual functions over a Device, and ValveArray<Topology> in
+// StaticValve.h, inline functions over an array element. Each passes a
+// small Machine adapter, which the template inlines:
+//
+//     int State();  void SetState(const int state, const int reason);
+//     int Command();  void SetCommand(const int command);
+//     int& PendingCommand();        waiting for the interlock
+//     bool& Initializing();         MotionStartTime() is when it started
+//     Nanoseconds& MotionStartTime();  Nanoseconds& WaitStartTime();
+//     Nanoseconds MotionTimeOut();  Nanoseconds InterlockTimeOut();
+//     bool InMotion();  bool IsOpened();  bool IsClosed();
+//     bool InvalidSensorState();
+//     bool Close();  bool Open();   false if the interlock isn't made
+//     void IdleOutput();
+//     void TakeCommand();  the next queued command into Command(), if any
+//                          and the valve is at rest
+//     void Done();         a COMMAND_RESET found the valve at rest
+//     bool Defer();        a command came while busy, true if it was kept
+//                          for when the valve is at rest
+//     void Reject();       trace the command and drop it
+//
+// The reason passed to SetState is a TRACE_REASON_; a Valve works it out
+// again in StateChanged and ignores it. Entering STATE_INVALID drops the
+// pending command.
+//
+// STATE_INITIALIZING finds out where the valve is from the sensors, IDLE
+// takes a command, WAITING waits for the interlock, OPENING and CLOSING
+// wait for the sensors, all with the motion and interlock timeouts;
+// INVALID wants COMMAND_RESET. Conflicting sensors make any state INVALID.
+
+#ifndef VALVESTATEMACHINE_H
+#define VALVESTATEMACHINE_H
+
+#include "ScanClock.h"
+#include "Trace.h"
+#include "statedefinitions.h"
+
+// start command's motion, or wait for its interlock, or time the wait out
+template <class Machine>
+inline void StartValveCommand(Machine& m, const int command, const Nanoseconds now)
+{
+	bool issued = COMMAND_CLOSE == command ? m.Close() : m.Open();
+	if (issued)
+	{
+		m.MotionStartTime() = now;
+		m.PendingCommand() = COMMAND_IDLE;
+		m.SetState(COMMAND_CLOSE == command ? STATE_CLOSING : STATE_OPENING, TRACE_REASON_NONE);
+	}
+	else if (STATE_WAITING != m.State())
+	{
+		m.WaitStartTime() = now;
+		m.PendingCommand() = command;
+		m.SetState(STATE_WAITING, TRACE_REASON_NONE);
+	}
+	else if (now - m.WaitStartTime() > m.InterlockTimeOut())
+	{
+		m.SetState(STATE_INVALID, TRACE_REASON_INTERLOCK_TIMEOUT);
+	}
+}
+
+// on startup the outputs are whatever they were (all off, or restored from
+// a checkpoint). If the sensors agree with them we are at rest, if not
+// something is still moving: give it the motion timeout to get there.
+template <class Machine>
+inline void InitializeValve(Machine& m, const Nanoseconds now)
+{
+	if (m.InvalidSensorState())
+	{
+		m.SetState(STATE_INVALID, TRACE_REASON_SENSOR_CONFLICT);
+	}
+	else if (!m.InMotion())
+	{
+		m.SetState(STATE_IDLE, TRACE_REASON_NONE);
+	}
+	else if (!m.Initializing())
+	{
+		m.Initializing() = true;
+		m.MotionStartTime() = now;
+	}
+	else if (now - m.MotionStartTime() > m.MotionTimeOut())
+	{
+		m.SetState(STATE_INVALID, TRACE_REASON_MOTION_TIMEOUT);
+	}
+	if (STATE_INITIALIZING != m.State())
+	{
+		m.Initializing() = false;
+	}
+}
+
+// returns false if a command was rejected
+template <class Machine>
+inline bool UpdateValve(Machine& m, const Nanoseconds now)
+{
+	bool ret = true;
+	if (STATE_INITIALIZING == m.State())
+	{
+		InitializeValve(m, now);
+	}
+	m.TakeCommand();
+	switch (m.State())
+	{
+		case STATE_IDLE:
+			switch (m.Command())
+			{
+				case COMMAND_CLOSE:
+				case COMMAND_OPEN:
+					StartValveCommand(m, m.Command(), now);
+					m.SetCommand(COMMAND_IDLE);
+					break;
+				case COMMAND_RESET: // already at rest
+					m.SetCommand(COMMAND_IDLE);
+					m.Done();
+					break;
+			}
+			break;
+
+		case STATE_WAITING:
+			if (COMMAND_OPEN == m.PendingCommand() || COMMAND_CLOSE == m.PendingCommand())
+			{
+				StartValveCommand(m, m.PendingCommand(), now);
+			}
+			break;
+
+		case STATE_OPENING:
+			if (m.IsOpened())
+			{
+				m.SetState(STATE_IDLE, TRACE_REASON_NONE);
+			}
+			else if (now - m.MotionStartTime() > m.MotionTimeOut())
+			{
+				m.SetState(STATE_INVALID, TRACE_REASON_MOTION_TIMEOUT);
+			}
+			break;
+
+		case STATE_CLOSING:
+			if (m.IsClosed())
+			{
+				m.SetState(STATE_IDLE, TRACE_REASON_NONE);
+			}
+			else if (now - m.MotionStartTime() > m.MotionTimeOut())
+			{
+				m.SetState(STATE_INVALID, TRACE_REASON_MOTION_TIMEOUT);
+			}
+			break;
+
+		case STATE_INVALID:
+			if (COMMAND_RESET == m.Command())
+			{
+				m.SetCommand(COMMAND_IDLE);
+				m.IdleOutput();
+				m.SetState(STATE_IDLE, TRACE_REASON_RESET);
+			}
+			break;
+	}
+	// a command we couldn't run now: keep it for later if busy, or reject
+	// it, e.g. one that isn't COMMAND_RESET while STATE_INVALID
+	if (COMMAND_IDLE != m.Command())
+	{
+		bool busy = STATE_IDLE != m.State() && STATE_INVALID != m.State();
+		if (!busy || !m.Defer())
+		{
+			m.Reject();
+			ret = false;
+		}
+	}
+	if (STATE_INVALID != m.State() && m.InvalidSensorState())
+	{
+		m.SetState(STATE_INVALID, TRACE_REASON_SENSOR_CONFLICT);
+	}
+	return ret;
+}
+
+#endif // VALVESTATEMACHINE_H
@@ -32,169 +32,522 @@
 // this is rev 1.1
  
 #include "device.h"
-#include "TimeMicroseconds.h"
-
-bool s_defaultBoolValue = false;
-double  s_defaultDoubleValue = 0.;
+#include "ValveStateMachine.h"
 
 // definitions for class Device
 
+Device::Device(const string name, const string serno, DigitalInputMap&& dis,
+	DigitalOutputMap&& dos, AnalogueInputMap&& ais, AnalogueOutputMap&& aos):
+	StateObject(name), m_dis(std::move(dis)), m_dos(std::move(dos)), 
+	m_ais(std::move(ais)), m_aos(std::move(aos)), m_serno(InternSymbol(serno)), 
+	m_commands(DEFAULT_COMMAND_QUEUE_DEPTH, m_dis.get_allocator().Source()),
+	m_nameHash(CheckpointNameHash(name)), m_boundDis(m_dis.get_allocator()), 
+	m_boundDos(m_dis.get_allocator()), m_boundAis(m_dis.get_allocator()), 
+	m_boundAos(m_dis.get_allocator())
+{
+}
+
 bool Device::Ready() const 
 { 
 	return (STATE_IDLE == State());
 };
 
+int Device::DoProcessCallBacks()
+{
+	return Update()?1:0;
+}
+
+int Device::DoProcessTimeouts()
+{
+	return Update()?1:0;
+}
+
+// a plain Device has no state machine, so it can't carry out a command:
+// complete whatever was posted as rejected
+bool Device::Update()
+{
+	bool ret = true;
+	DeviceCommand command;
+	while (m_commands.Pop(command))
+	{
+		if (command.callback)
+		{
+			command.callback(command.context, command.id, COMMAND_RESULT_REJECTED);
+		}
+		ret = false;
+	}
+	return ret;
+}
+
+void Device::InputPoints(vector<int>& points) const
+{
+	for (size_t i = 0; i < m_boundDis.size(); ++i)
+	{
+		points.push_back(m_boundDis[i].Point());
+	}
+}
+
+int Device::DigitalInputPoint(const string& attribute) const
+{
+	DigitalInputMap::const_iterator it = m_dis.find(attribute);
+	return m_dis.end() == it ? -1 : it->second.Point();
+}
+
+int Device::DigitalOutputPoint(const string& attribute) const
+{
+	DigitalOutputMap::const_iterator it = m_dos.find(attribute);
+	return m_dos.end() == it ? -1 : it->second.Point();
+}
+
+int Device::AnalogueInputPoint(const string& attribute) const
+{
+	AnalogueInputMap::const_iterator it = m_ais.find(attribute);
+	return m_ais.end() == it ? -1 : it->second.Point();
+}
+
+static std::atomic<unsigned long long> s_nextCommandId(1);
+
+unsigned long long Device::PostCommand(const int command, CommandCallback callback,
+	void* context)
+{
+	DeviceCommand posted;
+	posted.id = s_nextCommandId.fetch_add(1, std::memory_order_relaxed);
+	posted.command = command;
+	posted.callback = callback;
+	posted.context = context;
+	if (!m_commands.Push(posted))
+	{
+		return 0;
+	}
+	NotifySelf();
+	return posted.id;
+}
+
+void Device::NotifySelf()
+{
+	if (m_dispatchLink.Dispatcher())
+	{
+		m_dispatchLink.Dispatcher()->Notify(*this);
+	}
+}
+
+void Device::SaveState(DeviceCheckpoint& record) const
+{
+	record.nameHash = m_nameHash;
+	record.state = State();
+	record.command = Command();
+	record.pendingCommand = COMMAND_IDLE;
+}
+
+bool Device::RestoreState(const DeviceCheckpoint& record)
+{
+	SetState(record.state);
+	return true;
+}
+
+static void FulfilPromise(void* context, const unsigned long long, const int result)
+{
+	std::promise<int>* promise = static_cast<std::promise<int>*>(context);
+	promise->set_value(result);
+	delete promise;
+}
+
+std::future<int> Device::PostCommandAsync(const int command)
+{
+	std::promise<int>* promise = new std::promise<int>;
+	std::future<int> future = promise->get_future();
+	if (!PostCommand(command, FulfilPromise, promise))
+	{
+		FulfilPromise(promise, 0, COMMAND_RESULT_REJECTED);
+	}
+	return future;
+}
+
+// binding: look the attribute up once, copy the point into the bound table
+// and hand back its index. A missing attribute is a configuration error, so
+// say which device and which attribute rather than let map::operator[]
+// quietly invent a point reading s_defaultBoolValue. The first binding
+// reserves room for all the attributes, one allocation (in the arena, say)
+// rather than a series of doublings.
+
+DigitalInputHandle Device::BindDigitalInput(const string& attribute)
+{
+	DigitalInputMap::const_iterator it = m_dis.find(attribute);
+	if (m_dis.end() == it)
+	{
+		throw invalid_argument(Name() + ": missing digital input " + attribute);
+	}
+	if (m_boundDis.empty())
+	{
+		m_boundDis.reserve(m_dis.size());
+	}
+	m_boundDis.push_back(it->second);
+	return DigitalInputHandle(m_boundDis.size() - 1);
+}
+
+DigitalOutputHandle Device::BindDigitalOutput(const string& attribute)
+{
+	DigitalOutputMap::const_iterator it = m_dos.find(attribute);
+	if (m_dos.end() == it)
+	{
+		throw invalid_argument(Name() + ": missing digital output " + attribute);
+	}
+	if (m_boundDos.empty())
+	{
+		m_boundDos.reserve(m_dos.size());
+	}
+	m_boundDos.push_back(it->second);
+	return DigitalOutputHandle(m_boundDos.size() - 1);
+}
+
+AnalogueInputHandle Device::BindAnalogueInput(const string& attribute)
+{
+	AnalogueInputMap::const_iterator it = m_ais.find(attribute);
+	if (m_ais.end() == it)
+	{
+		throw invalid_argument(Name() + ": missing analogue input " + attribute);
+	}
+	if (m_boundAis.empty())
+	{
+		m_boundAis.reserve(m_ais.size());
+	}
+	m_boundAis.push_back(it->second);
+	return AnalogueInputHandle(m_boundAis.size() - 1);
+}
+
+AnalogueOutputHandle Device::BindAnalogueOutput(const string& attribute)
+{
+	AnalogueOutputMap::const_iterator it = m_aos.find(attribute);
+	if (m_aos.end() == it)
+	{
+		throw invalid_argument(Name() + ": missing analogue output " + attribute);
+	}
+	if (m_boundAos.empty())
+	{
+		m_boundAos.reserve(m_aos.size());
+	}
+	m_boundAos.push_back(it->second);
+	return AnalogueOutputHandle(m_boundAos.size() - 1);
+}
+
+void Device::UnbindPoints()
+{
+	m_boundDis.clear();
+	m_boundDos.clear();
+	m_boundAis.clear();
+	m_boundAos.clear();
+}
+
 // definitions for class Valve
 
-// this will run some time after the client issues SetCommand(COMMAND_CLOSE)
-// or SetCommand(COMMAND_OPEN) 
+// this will run some time after the client issues PostCommand(COMMAND_CLOSE)
+// or PostCommand(COMMAND_OPEN) 
 // same logic for SingleThrowValve and DoubleThrowValve
+// a Valve as UpdateValve wants it, see ValveStateMachine.h
+struct Valve::Machine
+{
+	Machine(Valve& valve): v(valve) {};
+	int State() const {return v.State();};
+	void SetState(const int state, const int /*reason*/) {v.SetState(state);}; // see StateChanged
+	int Command() const {return v.Command();};
+	void SetCommand(const int command) {v.SetCommand(command);};
+	int& PendingCommand() {return v.m_pendingCommand;};
+	bool& Initializing() {return v.m_initializing;};
+	Nanoseconds& MotionStartTime() {return v.m_motionStartTime;};
+	Nanoseconds& WaitStartTime() {return v.m_waitStartTime;};
+	Nanoseconds MotionTimeOut() const {return v.m_motionTimeOut;};
+	Nanoseconds InterlockTimeOut() const {return v.m_interlockTimeOut;};
+	bool InMotion() {return v.InMotion();};
+	bool IsOpened() {return v.IsOpened();};
+	bool IsClosed() {return v.IsClosed();};
+	bool InvalidSensorState() {return v.InvalidSensorState();};
+	bool Close() {return v.Close();};
+	bool Open() {return v.Open();};
+	void IdleOutput() {v.IdleOutput();};
+	void TakeCommand() {v.TakeCommand();};
+	void Done() {v.CompleteCommand(COMMAND_RESULT_DONE);};
+	// SetCommand bypassed the queue while we were busy, queue it behind
+	// the current motion
+	bool Defer()
+	{
+		if (v.m_commandActive)
+		{
+			return false;
+		}
+		DeviceCommand queued = {0, v.Command(), NULL, NULL};
+		if (!v.m_commands.Push(queued))
+		{
+			return false;
+		}
+		v.SetCommand(COMMAND_IDLE);
+		return true;
+	};
+	void Reject()
+	{
+		v.Trace(v.State(), v.State(), TRACE_REASON_COMMAND_REJECTED);
+		v.RejectCommand();
+	};
+	Valve& v;
+};
+
 bool Valve::Update()
 {
-	bool ret = false;
-	static int pendingCommand; // command to be queued, waiting for interlocks
-	switch( State() )
+	Nanoseconds started = 0;
+	if (0 == (++m_updateCount & (UPDATE_SAMPLE_INTERVAL - 1)))
 	{
-		case STATE_IDLE: // at rest
-			switch ( Command())
-			{
-				case COMMAND_CLOSE:
-					if (Close()) // interlock was met and command was issued 
-					{
-				        m_motionStartTime = TimeMicroseconds(); // microseconds.
-						SetState(STATE_CLOSING);
-					}
-					else
-					{
-				        m_waitStartTime = TimeMicroseconds(); // microseconds.
-						SetState(STATE_WAITING);
-						pendingCommand = Command(); // wait for interlock 
-					}
-					SetCommand(COMMAND_IDLE);
-					break;
-				case COMMAND_OPEN:
-					if (Open())
-					{
-        				m_motionStartTime = TimeMicroseconds(); // microseconds.
-						SetState(STATE_OPENING);
-					}
-					else
-					{
-				        m_waitStartTime = TimeMicroseconds(); // microseconds.
-						SetState(STATE_WAITING);
-						pendingCommand = Command();
-					}
-					SetCommand(COMMAND_IDLE); // COMMAND WAS ACCEPTED
-					break;
-				default:// more commands.
-					break; 
-			} // end of switch on Command 
-			if( COMMAND_IDLE == Command()) 
-			{
-				ret = true; // command was accepted or queued waiting for 
-				// interlocks to be met
-			}
-		break; // STATE_IDLE
-			
-		case STATE_WAITING: // WAITING FOR INTERLOCK FOR QUEUED COMMAND
-			switch ( pendingCommand) //very similar to switch statement as above
-			{
-				case COMMAND_CLOSE:
-					if (Close()) // interlock was met and command was issued 
-					{
-				        m_motionStartTime = TimeMicroseconds(); // microseconds.
-						SetState(STATE_CLOSING);
-					}
-					else
-					{
-						if (TimeMicroseconds() - m_waitStartTime > DEMO_TIMEOUT)
-						{
-							SetState(STATE_INVALID);
-						}
-					}
-					break;
-				case COMMAND_OPEN:
-					if (Open())
-					{
-        				m_motionStartTime = TimeMicroseconds(); // microseconds.
-						SetState(STATE_OPENING);
-					}
-					else
-					{
-						if (TimeMicroseconds() - m_waitStartTime > DEMO_TIMEOUT)
-						{
-							SetState(STATE_INVALID);
-						}
-					}
-					break;
-				default:// more commands.
-					break; 
-			} // end of switch on previousCommand 
-
-		break;
-		
-		case STATE_OPENING:
-			if (IsOpened()) 
-			{
-				SetState(STATE_IDLE);
-			}
-			
-			else
-			{
-				if (TimeMicroseconds() - m_motionStartTime > DEMO_TIMEOUT)
-				{
-					SetState(STATE_INVALID);
-				}
-			}
-		break;
+		started = MonotonicNanoseconds(); // real time, whatever the scan clock source
+	}
+	Machine machine(*this);
+	bool ret = UpdateValve(machine, ScanTime());
+	SyncTimeout();
+	if (started)
+	{
+		Record(&ValveTimings::update, MonotonicNanoseconds() - started);
+	}
+	return ret;
+}
+
+void Valve::SaveState(DeviceCheckpoint& record) const
+{
+	Device::SaveState(record);
+	record.command = m_commandActive ? m_activeCommand.command : Command();
+	record.pendingCommand = m_pendingCommand;
+	if (STATE_OPENING == State() || STATE_CLOSING == State())
+	{
+		record.motionElapsed = ScanTime() - m_motionStartTime;
+	}
+	else if (STATE_WAITING == State())
+	{
+		record.waitElapsed = ScanTime() - m_waitStartTime;
+	}
+}
 
+// call with the outputs restored and the inputs latched. A motion or wait
+// in progress carries on with the time it already had; Update then sees
+// the sensors and finishes it, or times it out. A valve at rest whose
+// sensors don't agree with its outputs initializes instead.
+bool Valve::RestoreState(const DeviceCheckpoint& record)
+{
+	switch (record.state)
+	{
+		case STATE_OPENING:
 		case STATE_CLOSING:
-			if (IsClosed()) 
-			{
-				SetState(STATE_IDLE);
-			}
-			
-			else
+			m_motionStartTime = ScanTime() - record.motionElapsed;
+			break;
+		case STATE_WAITING:
+			if (COMMAND_OPEN != record.pendingCommand && COMMAND_CLOSE != record.pendingCommand)
 			{
-				if (TimeMicroseconds() - m_motionStartTime > DEMO_TIMEOUT)
-				{
-					SetState(STATE_INVALID);
-				}
+				return false;
 			}
-		break;
-			
-		case STATE_INVALID:
-			if (COMMAND_RESET == Command())
+			m_waitStartTime = ScanTime() - record.waitElapsed;
+			m_pendingCommand = record.pendingCommand;
+			break;
+		case STATE_IDLE:
+			if (InMotion() || InvalidSensorState())
 			{
-				SetCommand(COMMAND_IDLE);
-				IdleOutput();
-				SetState(STATE_IDLE);
+				return false;
 			}
-		break;
-		
-	} // switch State()
-	
-	if (COMMAND_IDLE != Command()) // we were not able to process the command at this time,
-	//  try to queue it
+			break;
+		case STATE_INVALID: // still wants a COMMAND_RESET
+			break;
+		default:
+			return false;
+	}
+	m_initializing = false;
+	SetState(record.state);
+	if (STATE_OPENING == State() || STATE_CLOSING == State() || STATE_WAITING == State())
+	{
+		// the client which sent it is gone, finish it without a callback
+		DeviceCommand restored = {0, record.command, NULL, NULL};
+		m_activeCommand = restored;
+		m_commandActive = true;
+	}
+	NotifySelf();
+	SyncTimeout();
+	return true;
+}
+
+// a new command is only started once the previous one has finished and the
+// valve is at rest (or STATE_INVALID, waiting for COMMAND_RESET). A command
+// set directly with SetCommand is run like a queued one without a callback.
+void Valve::TakeCommand()
+{
+	if (m_commandActive || (STATE_IDLE != State() && STATE_INVALID != State()))
+	{
+		return;
+	}
+	if (COMMAND_IDLE != Command())
+	{
+		DeviceCommand direct = {0, Command(), NULL, NULL};
+		m_activeCommand = direct;
+		m_commandActive = true;
+	}
+	else if (m_commands.Pop(m_activeCommand))
 	{
-		if (COMMAND_IDLE == pendingCommand)
+		m_commandActive = true;
+		SetCommand(m_activeCommand.command);
+	}
+}
+
+void Valve::CompleteCommand(const int result)
+{
+	if (!m_commandActive)
+	{
+		return;
+	}
+	m_commandActive = false;
+	if (m_activeCommand.callback)
+	{
+		m_activeCommand.callback(m_activeCommand.context, m_activeCommand.id, result);
+	}
+	NotifySelf(); // there may be more queued
+}
+
+const Valve& Valve::Unbusy(const Valve& valve)
+{
+	if (valve.m_commandActive)
+	{
+		throw logic_error(valve.Name() + ": copying a valve carrying out a command");
+	}
+	return valve;
+}
+
+void Valve::RejectCommand()
+{
+	SetCommand(COMMAND_IDLE);
+	CompleteCommand(COMMAND_RESULT_REJECTED);
+}
+
+// a command is finished when the valve comes to rest or gives up
+void Valve::StateChanged(const int oldState, const int newState)
+{
+	int reason = TRACE_REASON_NONE;
+	if (STATE_INVALID == newState)
+	{
+		if (InvalidSensorState())
 		{
-			pendingCommand = Command();
+			reason = TRACE_REASON_SENSOR_CONFLICT;
 		}
-		else // is this always just a programming bug? might we get here because IO 
-		//from interlock signals/conditions is faulty? to do!
+		else
 		{
-			cerr << Name() << "could not accept command " << Command() << endl;
+			reason = STATE_WAITING == oldState ? TRACE_REASON_INTERLOCK_TIMEOUT : 
+				TRACE_REASON_MOTION_TIMEOUT;
 		}
-		SetCommand(COMMAND_IDLE);
 	}
-	
-	if (InvalidSensorState()) // if, for example, both the OPENED? and CLOSED? 
-	// sensors are made
+	else if (STATE_INVALID == oldState)
 	{
-		SetState(STATE_INVALID);
+		reason = TRACE_REASON_RESET;
 	}
-	
+	Trace(oldState, newState, reason);
+	if (STATE_WAITING == oldState)
+	{
+		Record(&ValveTimings::interlockWait, ScanTime() - m_waitStartTime);
+	}
+	else if (STATE_IDLE == newState && STATE_OPENING == oldState)
+	{
+		Record(&ValveTimings::open, ScanTime() - m_motionStartTime);
+	}
+	else if (STATE_IDLE == newState && STATE_CLOSING == oldState)
+	{
+		Record(&ValveTimings::close, ScanTime() - m_motionStartTime);
+	}
+	if (STATE_OPENING == newState || STATE_CLOSING == newState)
+	{
+		// if it is already there no sensor will change, so look again
+		NotifySelf();
+	}
+	else if (STATE_IDLE == newState)
+	{
+		CompleteCommand(COMMAND_RESULT_DONE);
+	}
+	else if (STATE_INVALID == newState)
+	{
+		m_pendingCommand = COMMAND_IDLE;
+		CompleteCommand(COMMAND_RESULT_FAILED);
+	}
+}
+
+void Valve::Trace(const int oldState, const int newState, const int reason)
+{
+	TraceRecord record;
+	record.time = ScanTime();
+	record.device = m_nameHash;
+	record.oldState = oldState;
+	record.newState = newState;
+	record.command = m_commandActive ? m_activeCommand.command : Command();
+	record.reason = reason;
+	TraceEvent(record);
+}
+
+void Valve::Record(LatencyHistogram ValveTimings::* histogram, const Nanoseconds value)
+{
+	if (m_classTimings)
+	{
+		(m_classTimings->*histogram).Record(value);
+	}
+	if (m_timings)
+	{
+		(m_timings->*histogram).Record(value);
+	}
+}
+
+Valve::~Valve()
+{
+	SetTimerWheel(NULL);
+}
+
+void Valve::SetTimerWheel(TimerWheel* wheel)
+{
+	if (m_timerWheel)
+	{
+		m_timerWheel->Cancel(m_timer);
+	}
+	m_timerWheel = wheel;
+	m_armedDeadline = 0;
+	SyncTimeout();
+}
+
+// the deadline depends only on the state and its start time, so compare
+// with what was armed last and only go to the wheel on a transition. Once
+// the wheel has fired, Update sees the timeout and goes STATE_INVALID.
+void Valve::SyncTimeout()
+{
+	if (!m_timerWheel)
+	{
+		return;
+	}
+	Nanoseconds deadline = 0;
+	switch (State())
+	{
+		case STATE_OPENING:
+		case STATE_CLOSING:
+			deadline = m_motionStartTime + m_motionTimeOut + 1;
+			break;
+		case STATE_WAITING:
+			deadline = m_waitStartTime + m_interlockTimeOut + 1;
+			break;
+		case STATE_INITIALIZING:
+			if (m_initializing)
+			{
+				deadline = m_motionStartTime + m_motionTimeOut + 1;
+			}
+			break;
+		default:
+			break;
+	}
+	if (deadline == m_armedDeadline)
+	{
+		return;
+	}
+	if (deadline)
+	{
+		m_timerWheel->Arm(m_timer, *this, deadline);
+	}
+	else
+	{
+		m_timerWheel->Cancel(m_timer);
+	}
+	m_armedDeadline = deadline;
 }
 
 int Valve::DoProcessCallBacks()  // called when data changes
@@ -211,102 +564,136 @@ int Valve::DoProcessTimeouts()   // called periodically to check completion
 
 // definitions for SingleThrowValve
 
+ValveTimings& SingleThrowValve::ClassTimings()
+{
+	static ValveTimings timings;
+	return timings;
+}
+
+void SingleThrowValve::BindPoints()
+{
+	UnbindPoints(); // converted from another valve
+	m_classTimings = &ClassTimings();
+	m_closeCmd = BindDigitalOutput("CLOSE!");
+	m_closedSensor = BindDigitalInput("CLOSED?");
+	m_closeOk = BindDigitalInput("CLOSE_OK?");
+	m_openOk = BindDigitalInput("OPEN_OK?");
+}
+
 bool SingleThrowValve::InMotion()  // let's say it has one sensor
 // for "closed?" one command for "close!"
 {
-    return (m_dos["CLOSE!"].Value() != m_dis["CLOSED?"].Value());
+    return (Value(m_closeCmd) != Value(m_closedSensor));
     
 };
 
 bool SingleThrowValve::IsOpened()
 {
-	return (!m_dis["CLOSED?"].Value());
+	return (!Value(m_closedSensor));
 };
 
 bool SingleThrowValve::IsClosed()
 {
-	return (!InMotion() && !IsClosed());
+	return (!InMotion() && Value(m_closedSensor));
 }
 
 
 bool SingleThrowValve::Close()
 {
-	bool ret = m_dis["CLOSE_OK?"].Value();
+	bool ret = Value(m_closeOk);
 	if (ret)
 	{
-		m_dos["CLOSE!"].Set(true);
+		Set(m_closeCmd, true);
 	}
 	return ret;
 }
 
 bool SingleThrowValve::Open()
 {
-	bool ret = m_dis["OPEN_OK?"].Value();
+	bool ret = Value(m_openOk);
 	
 	if (ret)
 	{
-		m_dos["CLOSE!"].Set(false);
+		Set(m_closeCmd, false);
 	}
 	return ret;
 };
 
 void  SingleThrowValve::IdleOutput()
 {
-	m_dos["CLOSE!"].Set(false);
+	Set(m_closeCmd, false);
 }
 
 // definitions for DoubleThrowValve
 
+ValveTimings& DoubleThrowValve::ClassTimings()
+{
+	static ValveTimings timings;
+	return timings;
+}
+
+void DoubleThrowValve::BindPoints()
+{
+	UnbindPoints(); // converted from another valve
+	m_classTimings = &ClassTimings();
+	m_closeCmd = BindDigitalOutput("CLOSE!");
+	m_openCmd = BindDigitalOutput("OPEN!");
+	m_closedSensor = BindDigitalInput("CLOSED?");
+	m_openedSensor = BindDigitalInput("OPENED?");
+	m_closeOk = BindDigitalInput("CLOSE_OK?");
+	m_openOk = BindDigitalInput("OPEN_OK?");
+}
+
 bool DoubleThrowValve::InMotion()
 {
 	bool ret;
-	ret = (m_dos["CLOSE!"].Value() && !m_dis["CLOSED?"].Value()) || 
-			(m_dos["OPEN!"].Value() && !m_dis["OPENED?"].Value());
+	ret = (Value(m_closeCmd) && !Value(m_closedSensor)) || 
+			(Value(m_openCmd) && !Value(m_openedSensor));
 	return ret;
-	//if (SecondsNow() - MotionStartTime() > DEMO_TIMEOUT)
+	//if (SecondsNow() - MotionStartTime() > m_motionTimeOut)
 	
 }
 bool DoubleThrowValve::IsOpened()
 {
-	return (!m_dis["CLOSED?"].Value() && m_dis["OPENED?"].Value());
+	return (!Value(m_closedSensor) && Value(m_openedSensor));
 }
 
 bool DoubleThrowValve::IsClosed()
 {
-	return (m_dis["CLOSED?"].Value() && !m_dis["OPENED?"].Value());
+	return (Value(m_closedSensor) && !Value(m_openedSensor));
 };
 
 
 bool DoubleThrowValve::InvalidSensorState()
 {
-	return (m_dis["CLOSED?"].Value() && m_dis["OPENED?"].Value());
+	return (Value(m_closedSensor) && Value(m_openedSensor));
 }
 
 bool DoubleThrowValve::Close()
 {
-	bool ret = m_dis["CLOSE_OK?"].Value();
+	bool ret = Value(m_closeOk);
 	if (ret)
 	{
-		m_dos["OPEN!"].Set(false);
-		m_dos["CLOSE!"].Set(true);
+		Set(m_openCmd, false);
+		Set(m_closeCmd, true);
 	}
 	return ret;
 }
 
 bool DoubleThrowValve::Open()
 {
-	bool ret = m_dis["OPEN_OK?"].Value();
+	bool ret = Value(m_openOk);
 	
 	if (ret)
 	{
-		m_dos["CLOSE!"].Set(false);
-		m_dos["OPEN!"].Set(true);
+		Set(m_closeCmd, false);
+		Set(m_openCmd, true);
 	}
 	return ret;
 }
 
 void  DoubleThrowValve::IdleOutput()
 {
-	m_dos["CLOSE!"].Set(false);
-	m_dos["OPEN!"].Set(false);
+	Set(m_closeCmd, false);
+	Set(m_openCmd, false);
 }
@@ -29,6 +29,41 @@
 //                rev 1.0 March 25, 2009   add pthread mutexes around output
 //                    points
 //                rev 1.1 March 27, 2009   more comments
+//                rev 1.2 October 16, 2026 IO attributes are bound once at
+//                    construction into index handles, no string lookups
+//                    in Update
+//                rev 1.3 October 16, 2026 IO points are views into a packed
+//                    ProcessImage, per point mutexes are gone
+//                rev 1.4 October 16, 2026 the pending command is per valve,
+//                    valves may be updated concurrently by ScanExecutor
+//                rev 1.5 October 16, 2026 per valve motion and interlock
+//                    timeouts, optionally armed on a TimerWheel
+//                rev 1.6 October 16, 2026 outputs are staged lock-free and
+//                    committed once per scan, see ProcessImage.h
+//                rev 1.7 October 16, 2026 valve times are integer nanoseconds
+//                    of the monotonic scan clock, see ScanClock.h
+//                rev 1.8 October 16, 2026 commands are posted to a per device
+//                    lock-free queue with a completion callback
+//                rev 1.9 October 16, 2026 valves start STATE_INITIALIZING,
+//                    device state can be checkpointed and restored
+//                rev 2.0 October 16, 2026 valves record motion, interlock
+//                    wait and Update times, see LatencyHistogram.h
+//                rev 2.1 October 16, 2026 transitions and rejected commands
+//                    go to the binary trace (Trace.h) instead of cerr
+//                rev 2.2 October 16, 2026 analogue inputs can be scaled,
+//                    filtered and deadbanded, see AnalogueFilter.h
+//                rev 2.3 October 16, 2026 devices, their IO maps and bound
+//                    points can live in an Arena and are moved, not copied,
+//                    into Valves
+//                rev 2.4 October 16, 2026 names and serial numbers are
+//                    interned symbols, Name() returns a reference, see
+//                    SymbolTable.h and DeviceRegistry.h
+//                rev 2.5 October 16, 2026 state transitions can be logged
+//                    for a Historian, so none in a scan are lost
+//                rev 2.6 October 17, 2026 Valve::Update is the state machine
+//                    of ValveStateMachine.h, shared with ValveArray
+//                rev 2.7 October 17, 2026 a plain Device rejects commands,
+//                    a device with commands in hand can't be copied
 //
 // NOTES:   
 // I've put multiple classes into one header file, as this library is
@@ -66,14 +101,29 @@
 //       and can see CLOSED? sensor
 // DoubleThrowValve - a Valve which can set CLOSE! and OPEN! outputs and can
 //       see CLOSED? and OPENED? sensors
+//
+// The IO points themselves live in a ProcessImage, see ProcessImage.h.
+
+#ifndef DEVICE_H
+#define DEVICE_H
 
 #include <string>
 #include <vector>
 #include <map>
 #include <iostream>
+#include <stdexcept>
+#include <future>
 
-#include <pthread.h>
-
+#include "Arena.h"
+#include "ProcessImage.h"
+#include "TimerWheel.h"
+#include "ScanClock.h"
+#include "CommandQueue.h"
+#include "ChangeDispatcher.h"
+#include "Checkpoint.h"
+#include "LatencyHistogram.h"
+#include "Trace.h"
+#include "SymbolTable.h"
 #include "statedefinitions.h"
 using namespace std;
 
@@ -81,156 +131,343 @@ using namespace std;
 class StateObject
 {
 public:
-	StateObject( const string name):m_name(name), m_state(STATE_IDLE) {} ;
+	StateObject( const string name):m_name(InternSymbol(name)), m_state(STATE_IDLE), 
+		m_command(COMMAND_IDLE), m_stateLog(NULL) {} ;
+	StateObject(const StateObject& other):m_name(other.m_name), m_state(other.m_state),
+		m_command(other.m_command), m_stateLog(NULL) {}; // a copy isn't logged
 	virtual ~StateObject() {};
-	string Name() const {return m_name;};
+	const string& Name() const {return SymbolName(m_name);};
+	Symbol NameSymbol() const {return m_name;};
 	int State() const {return m_state;};
 	int Command() const {return m_command;}
+	// scan thread only. Other threads post commands, see Device::PostCommand
 	bool SetCommand( const int theCommand) 
 	{
 	m_command  = theCommand;
 	return true;
 	} ;
+	// every transition is logged into log, if not NULL: the state it
+	// started from when the log is empty, then each state entered. The
+	// owner reserves the log and empties it; it never grows past its
+	// capacity, once full the last state entered is overwritten.
+	void SetStateLog(std::vector<int>* log) {m_stateLog = log;};
+	std::vector<int>* StateLog() const {return m_stateLog;};
 private:
-        string m_name;
+	StateObject& operator=(const StateObject&);
+        Symbol m_name;
         int m_state;
         int m_command;
+        std::vector<int>* m_stateLog;
 protected:
-	 void SetState(const int theState) { m_state = theState;};
+	 void SetState(const int theState) 
+	 {
+		int oldState = m_state;
+		m_state = theState;
+		if (oldState != theState)
+		{
+			if (m_stateLog)
+			{
+				LogState(oldState, theState);
+			}
+			StateChanged(oldState, theState);
+		}
+	 };
+	 void LogState(const int oldState, const int newState)
+	 {
+		if (m_stateLog->empty())
+		{
+			m_stateLog->push_back(oldState);
+		}
+		if (m_stateLog->size() < m_stateLog->capacity())
+		{
+			m_stateLog->push_back(newState);
+		}
+		else
+		{
+			m_stateLog->back() = newState;
+		}
+	 };
+	 virtual void StateChanged(const int /*oldState*/, const int /*newState*/) {};
 };
 
 class IO
 {
 public:
-	IO(const string theName):m_name(theName){};
+	IO(const string theName):m_name(InternSymbol(theName)){};
 	virtual ~IO() {};  // possible performance improvement: verify default dtor good enough
-	string Name() const {return m_name;};
+	const string& Name() const {return SymbolName(m_name);};
+	Symbol NameSymbol() const {return m_name;};
 private:
-	string m_name;
+	Symbol m_name;
 };
 
-extern  bool s_defaultBoolValue;  // needed for default ctor in std::map
-extern double  s_defaultDoubleValue;
-
+// the IO classes are views of one point in a ProcessImage. A default
+// constructed point (needed for std::map) has no image and reads false/0.
 
 class DigitalInput : public IO
 {
 private:
-	const bool& m_iopoint;
-	pthread_mutex_t m_mtx;
+	const ProcessImage* m_image;
+	int m_point;
 public:
-	DigitalInput(const string theName, bool& iopoint):IO(theName), m_iopoint(iopoint) {};
-	DigitalInput() : IO(""), m_iopoint(s_defaultBoolValue) {}; 
-	~DigitalInput() {pthread_mutex_destroy(&m_mtx);};
-	bool Value() const { return m_iopoint;};
+	DigitalInput(const string theName, const ProcessImage& image, const int point):
+		IO(theName), m_image(&image), m_point(point) {};
+	DigitalInput() : IO(""), m_image(NULL), m_point(-1) {}; 
+	~DigitalInput() {};
+	bool Value() const { return m_image ? m_image->ReadInput(m_point) : false;};
+	int Point() const {return m_point;};
 };	
 
 class DigitalOutput : public IO
 {
 private:
-	bool& m_iopoint;
-	pthread_mutex_t m_mtx;
+	ProcessImage* m_image;
+	int m_point;
 public:
-	DigitalOutput(const string theName, bool& iopoint):IO(theName), m_iopoint(iopoint)
-		{pthread_mutex_init(&m_mtx, NULL);};
-	DigitalOutput() : IO(""), m_iopoint(s_defaultBoolValue) {};
+	DigitalOutput(const string theName, ProcessImage& image, const int point):
+		IO(theName), m_image(&image), m_point(point) {};
+	DigitalOutput() : IO(""), m_image(NULL), m_point(-1) {};
 	~DigitalOutput() {};
 	void Set(const bool value)
 	{
-	    pthread_mutex_lock(&m_mtx);
-	    m_iopoint = value;
-	    pthread_mutex_unlock(&m_mtx);
+		if (m_image)
+		{
+			m_image->WriteOutput(m_point, value);
+		}
 	};
-	bool Value() const { return m_iopoint;};
+	bool Value() const { return m_image ? m_image->ReadOutput(m_point) : false;};
+	int Point() const {return m_point;};
 };	
 
 class AnalogueInput : public IO
 {
 private:
-	const double& m_iopoint;
+	const ProcessImage* m_image;
+	int m_point;
 public:
-	AnalogueInput(const string theName, const double& iopoint):
-		IO(theName), m_iopoint(iopoint) {};
-	AnalogueInput() : IO(""), m_iopoint(s_defaultDoubleValue) {};
+	AnalogueInput(const string theName, const ProcessImage& image, const int point):
+		IO(theName), m_image(&image), m_point(point) {};
+	AnalogueInput() : IO(""), m_image(NULL), m_point(-1) {};
 	~AnalogueInput(){};
-	double Value() const {return m_iopoint;};
+	double Value() const {return m_image ? m_image->ReadAnalogueInput(m_point) : 0.;};
+	int Point() const {return m_point;};
 };	
 
 class AnalogueOutput : public IO
 {
 private:
-	double& m_iopoint;
-	pthread_mutex_t m_mtx;
+	ProcessImage* m_image;
+	int m_point;
 public:
-	AnalogueOutput(const string theName, double& iopoint):
-		IO(theName), m_iopoint(iopoint) 
-	    {pthread_mutex_init(&m_mtx, NULL);};
-	AnalogueOutput() : IO(""), m_iopoint(s_defaultDoubleValue) {};
-	~AnalogueOutput(){pthread_mutex_destroy(&m_mtx);};
+	AnalogueOutput(const string theName, ProcessImage& image, const int point):
+		IO(theName), m_image(&image), m_point(point) {};
+	AnalogueOutput() : IO(""), m_image(NULL), m_point(-1) {};
+	~AnalogueOutput(){};
 	void Set(const double value)
 	{
-		pthread_mutex_lock(&m_mtx); // for demo purpose, block until we can write
-		// todo need trylock until a timeout expires.
-		m_iopoint = value;
-		pthread_mutex_unlock(&m_mtx);
+		if (m_image)
+		{
+			m_image->WriteAnalogueOutput(m_point, value);
+		}
 	}
+	double Value() const {return m_image ? m_image->ReadAnalogueOutput(m_point) : 0.;};
+	int Point() const {return m_point;};
 };	
 
 
+// an IO attribute of a Device, resolved once by name (e.g. "CLOSED?") into an
+// index into the Device's bound point table. Handles are typed so a
+// DigitalInputHandle can't be used to Set an output. Copying or moving a
+// Device takes its bound points along, so handles stay valid across the
+// Valve constructor chain.
+template <class T> class IOHandle
+{
+public:
+	IOHandle():m_index(-1) {};
+	explicit IOHandle(const int index):m_index(index) {};
+	int Index() const {return m_index;};
+	bool Valid() const {return m_index >= 0;};
+private:
+	int m_index;
+};
+
+typedef IOHandle<DigitalInput> DigitalInputHandle;
+typedef IOHandle<DigitalOutput> DigitalOutputHandle;
+typedef IOHandle<AnalogueInput> AnalogueInputHandle;
+typedef IOHandle<AnalogueOutput> AnalogueOutputHandle;
+
+// a Device's IO attributes by name. Give them an ArenaAllocator on an Arena
+// and the whole device is built in it, e.g. 
+//     DigitalInputMap dis((ArenaAllocator<char>(&plant.Memory())));
+typedef map<string, DigitalInput, less<string>, 
+	ArenaAllocator<pair<const string, DigitalInput> > > DigitalInputMap;
+typedef map<string, DigitalOutput, less<string>, 
+	ArenaAllocator<pair<const string, DigitalOutput> > > DigitalOutputMap;
+typedef map<string, AnalogueInput, less<string>, 
+	ArenaAllocator<pair<const string, AnalogueInput> > > AnalogueInputMap;
+typedef map<string, AnalogueOutput, less<string>, 
+	ArenaAllocator<pair<const string, AnalogueOutput> > > AnalogueOutputMap;
+
 class Device : public StateObject
 {
 public:
 
     Device( const string name, const string serno, map<string, DigitalInput> dis,
 		map<string, DigitalOutput> dos, map<string, AnalogueInput> ais, map<string,
-		AnalogueOutput> aos):StateObject(name), m_serno(serno), m_dis(dis), m_dos(dos),
-        m_ais(ais), m_aos(aos)     {}; 
+		AnalogueOutput> aos):StateObject(name), m_dis(dis.begin(), dis.end()), 
+		m_dos(dos.begin(), dos.end()), m_ais(ais.begin(), ais.end()), 
+		m_aos(aos.begin(), aos.end()), m_serno(InternSymbol(serno)), 
+		m_nameHash(CheckpointNameHash(name)) {}; 
+	// takes the maps over, no copies. The command ring and bound points go
+	// into the maps' arena, if they have one.
+	Device(const string name, const string serno, DigitalInputMap&& dis,
+		DigitalOutputMap&& dos, AnalogueInputMap&& ais, AnalogueOutputMap&& aos);
+	Device(const Device& other) = default; // in the same arena
+	Device(Device&& other) = default;
 	virtual ~Device() {};
+	unsigned long long NameHash() const {return m_nameHash;}; // identifies it in traces
+	const string& SerialNumber() const {return SymbolName(m_serno);};
+	Symbol SerialSymbol() const {return m_serno;};
 	bool Ready() const;
 	int ErrorStatus() const;
 	int WarningStatus() const;
 	virtual int DoProcessCallBacks();  // called when data changes
 	virtual int DoProcessTimeouts();   // called periodically to check completion motions
 	virtual bool Update(); // returns false in case command is issued in invalid state 
+	// image points of the bound digital inputs, i.e. what Update() reads
+	void InputPoints(vector<int>& points) const;
+	// image point of a configured attribute, -1 if there is none. A map
+	// lookup, for setting up, not for the scan.
+	int DigitalInputPoint(const string& attribute) const;
+	int DigitalOutputPoint(const string& attribute) const;
+	int AnalogueInputPoint(const string& attribute) const;
+
+	// any thread: queue a command for the scan thread. Returns the command
+	// id, or 0 if the queue is full. callback(context, id, COMMAND_RESULT_)
+	// is called once from the scan thread when the command has finished;
+	// a plain Device rejects every command at its next Update(). Copying
+	// a device with commands queued throws logic_error.
+	unsigned long long PostCommand(const int command, CommandCallback callback = NULL,
+		void* context = NULL);
+	// same, the future gets the COMMAND_RESULT_ (or REJECTED if full)
+	std::future<int> PostCommandAsync(const int command);
+
+	// warm restart, see Checkpoint.h. RestoreState returns false if the
+	// record doesn't fit what the device sees now.
+	virtual void SaveState(DeviceCheckpoint& record) const;
+	virtual bool RestoreState(const DeviceCheckpoint& record);
 protected:
-	map<string, DigitalInput> m_dis;
-	map<string, DigitalOutput> m_dos;
-	map<string, AnalogueInput> m_ais;
-	map<string, AnalogueOutput> m_aos;
-	string m_serno;
+	// resolve a named IO attribute once, throws invalid_argument if the
+	// configuration table did not supply it. Call from subclass constructors.
+	DigitalInputHandle BindDigitalInput(const string& attribute);
+	DigitalOutputHandle BindDigitalOutput(const string& attribute);
+	AnalogueInputHandle BindAnalogueInput(const string& attribute);
+	AnalogueOutputHandle BindAnalogueOutput(const string& attribute);
+	// forget the bound points, before binding afresh in a device copied
+	// from one already bound, e.g. a Valve converted to a DoubleThrowValve
+	void UnbindPoints();
+
+	// hot path accessors, no strings, no map walks
+	bool Value(const DigitalInputHandle h) const {return m_boundDis[h.Index()].Value();};
+	bool Value(const DigitalOutputHandle h) const {return m_boundDos[h.Index()].Value();};
+	double Value(const AnalogueInputHandle h) const {return m_boundAis[h.Index()].Value();};
+	void Set(const DigitalOutputHandle h, const bool value) {m_boundDos[h.Index()].Set(value);};
+	void Set(const AnalogueOutputHandle h, const double value) {m_boundAos[h.Index()].Set(value);};
+	// ask for another DoProcessCallBacks next scan, e.g. more commands queued
+	void NotifySelf();
+
+	DigitalInputMap m_dis;
+	DigitalOutputMap m_dos;
+	AnalogueInputMap m_ais;
+	AnalogueOutputMap m_aos;
+	Symbol m_serno;
+	CommandQueue m_commands;
+	unsigned long long m_nameHash;
+private:
+	friend class ChangeDispatcher;
+	DispatchLink m_dispatchLink;
+	vector<DigitalInput, ArenaAllocator<DigitalInput> > m_boundDis;
+	vector<DigitalOutput, ArenaAllocator<DigitalOutput> > m_boundDos;
+	vector<AnalogueInput, ArenaAllocator<AnalogueInput> > m_boundAis;
+	vector<AnalogueOutput, ArenaAllocator<AnalogueOutput> > m_boundAos;
 };
 
 class Valve : public Device // a binary motion device with 1 or 2 commands, 
 //1 or 2 sensors and some external material flow or pressure constraints
 {
 public:
-	Valve( Device& baseDevice): Device(baseDevice), m_motionStartTime(0.),
-	m_motionTimeOut(DEMO_TIMEOUT) {};
-	virtual ~Valve() {};
+	// pass std::move(device) to build the valve without copying the device
+	Valve( Device baseDevice): Device(std::move(baseDevice)), m_motionStartTime(0),
+	m_motionTimeOut(DEFAULT_MOTION_TIMEOUT * NANOSECONDS_PER_MICROSECOND), 
+	m_waitStartTime(0), 
+	m_interlockTimeOut(DEFAULT_INTERLOCK_TIMEOUT * NANOSECONDS_PER_MICROSECOND),
+	m_pendingCommand(COMMAND_IDLE), m_classTimings(NULL), m_commandActive(false), 
+	m_initializing(false), m_timerWheel(NULL), m_armedDeadline(0), m_timings(NULL),
+	m_updateCount((unsigned int)(reinterpret_cast<size_t>(this) >> 4)) // stagger the samples
+	{SetState(STATE_INITIALIZING);};
+	virtual ~Valve();
 	// these must be over-ridden depending on number of commands and sensors
 	virtual bool InMotion()= 0;  // position sensor(s) do not match asserted command(s)
 	virtual bool IsOpened() = 0; // opened position is reported
 	virtual bool IsClosed() = 0; // closed position is reported
 	virtual bool Close() = 0;  // returns true if interlock was satisfied and command was issued to hardware
 	virtual bool Open() = 0; // returns true if interlock was satisfied and command was issued
-	virtual double MotionStartTime(void) { return m_motionStartTime;};
+	virtual Nanoseconds MotionStartTime(void) { return m_motionStartTime;};
 	virtual int DoProcessCallBacks();  // called when data changes
 	virtual int DoProcessTimeouts();   // called periodically to check completion of requested motions
 	virtual bool Update();
+	virtual void SaveState(DeviceCheckpoint& record) const;
+	virtual bool RestoreState(const DeviceCheckpoint& record);
+	Nanoseconds MotionTimeOut() const {return m_motionTimeOut;};
+	Nanoseconds InterlockTimeOut() const {return m_interlockTimeOut;};
+	void SetMotionTimeOut(const Nanoseconds timeOut) {m_motionTimeOut = timeOut;};
+	void SetInterlockTimeOut(const Nanoseconds timeOut) {m_interlockTimeOut = timeOut;};
+	// with a wheel the valve arms its own timeouts and DoProcessTimeouts
+	// needn't be polled. NULL (the default) means polled.
+	void SetTimerWheel(TimerWheel* wheel);
+	// timings of this valve alone, in addition to those of its class. 
+	// NULL (the default) means none; the caller owns them.
+	void SetTimings(ValveTimings* timings) {m_timings = timings;};
+	ValveTimings* Timings() const {return m_timings;};
 	
 protected:	
-	double m_motionStartTime;
-	double m_motionTimeOut;
-	double m_waitStartTime;
-	virtual void  IdleOutput();  // turn off outputs in case of motion timeout 
+	Nanoseconds m_motionStartTime;  // ScanTime() 
+	Nanoseconds m_motionTimeOut;
+	Nanoseconds m_waitStartTime;
+	Nanoseconds m_interlockTimeOut;
+	int m_pendingCommand; // command queued, waiting for interlocks
+	virtual void  IdleOutput() = 0;  // turn off outputs in case of motion timeout 
     virtual bool InvalidSensorState() {return false;}  //true if hardware sets conflicting outputs
+	virtual void StateChanged(const int oldState, const int newState);
+	ValveTimings* m_classTimings; // set by the class, see ClassTimings()
+	// valve, for converting: throws logic_error if it is carrying out a
+	// command, which the copy and the original would both complete
+	static const Valve& Unbusy(const Valve& valve);
+private:
+	struct Machine;      // for UpdateValve, see ValveStateMachine.h
+	void TakeCommand();  // next command off the queue, if the valve is at rest
+	void CompleteCommand(const int result);
+	void RejectCommand();
+	void Trace(const int oldState, const int newState, const int reason);
+	DeviceCommand m_activeCommand; // being executed, valid if m_commandActive
+	bool m_commandActive;
+	bool m_initializing; // m_motionStartTime is when initializing started
+	void SyncTimeout();  // arm or cancel m_timer to match the state
+	TimerWheel* m_timerWheel;
+	Timer m_timer;
+	Nanoseconds m_armedDeadline; // 0: none
+	void Record(LatencyHistogram ValveTimings::* histogram, const Nanoseconds value);
+	ValveTimings* m_timings;
+	unsigned int m_updateCount; // for sampling Update times
 };
 
 class SingleThrowValve : public Valve // a single output actuator
 {
 public:
-	SingleThrowValve(Valve& baseValve ): Valve(baseValve) {} ;
+	SingleThrowValve(Device baseDevice ): Valve(std::move(baseDevice)) {BindPoints();} ;
+	SingleThrowValve(Valve& baseValve ): Valve(Unbusy(baseValve)) {BindPoints();} ;
 	virtual ~SingleThrowValve() {};
+	static ValveTimings& ClassTimings(); // of all SingleThrowValves
 	bool InMotion();
 	bool IsOpened(); 
 	bool IsClosed();
@@ -238,14 +475,21 @@ public:
 	virtual bool Open();
 protected:
     virtual void  IdleOutput();  // turn off outputs in case of motion timeout
-
+private:
+	void BindPoints();
+	DigitalOutputHandle m_closeCmd;    // CLOSE!
+	DigitalInputHandle m_closedSensor; // CLOSED?
+	DigitalInputHandle m_closeOk;      // CLOSE_OK?
+	DigitalInputHandle m_openOk;       // OPEN_OK?
 };
 
 class DoubleThrowValve : public Valve  // like a slot valve or a gate valve
 {
 public:
-	DoubleThrowValve (Valve& baseValve): Valve(baseValve) {};
+	DoubleThrowValve (Device baseDevice): Valve(std::move(baseDevice)) {BindPoints();};
+	DoubleThrowValve (Valve& baseValve): Valve(Unbusy(baseValve)) {BindPoints();};
 	virtual ~DoubleThrowValve() {};
+	static ValveTimings& ClassTimings();
 	bool InMotion();
 	bool IsOpened(); 
 	bool IsClosed();
@@ -253,6 +497,15 @@ public:
 	virtual bool Open();
 private:
 	bool InvalidSensorState();
+	void BindPoints();
+	DigitalOutputHandle m_closeCmd;    // CLOSE!
+	DigitalOutputHandle m_openCmd;     // OPEN!
+	DigitalInputHandle m_closedSensor; // CLOSED?
+	DigitalInputHandle m_openedSensor; // OPENED?
+	DigitalInputHandle m_closeOk;      // CLOSE_OK?
+	DigitalInputHandle m_openOk;       // OPEN_OK?
 protected:
     virtual void  IdleOutput();  // turn off outputs in case of motion timeout
 };
+
+#endif // DEVICE_H
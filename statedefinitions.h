@@ -29,6 +29,10 @@
 //
 // REVISIONS:     rev 1.0 March 25, 2009 
 //                rev 1.1 March 27, 2009  more comments
+//                rev 1.2 October 16, 2026 DEMO_TIMEOUT replaced by per valve
+//                    timeouts, these are the defaults
+//                rev 1.3 October 16, 2026 command completion results
+//                rev 1.4 October 16, 2026 timed out, for awaiting clients
 //
 // NOTES:
 //
@@ -40,11 +44,18 @@
 #define STATE_CLOSING 20          // specific to open/close single axis
 #define STATE_OPENING 30          // "
 #define STATE_INVALID -1          // impossible state, such as "IsClosed" && "IsOpen"
-// 5 seconds
-#define DEMO_TIMEOUT 5000000 
+// defaults for the per valve timeouts, microseconds, 5 seconds
+#define DEFAULT_MOTION_TIMEOUT 5000000     // commanded motion must complete
+#define DEFAULT_INTERLOCK_TIMEOUT 5000000  // interlock must be met
 
 #define COMMAND_IDLE 0            // null command
 #define COMMAND_CLOSE 20          // specific to open/close single axis
 #define COMMAND_OPEN 30           // "
 #define COMMAND_RESET 90          // attempt to reach "STATE_IDLE"
 
+// passed to a command's completion callback, see CommandQueue.h
+#define COMMAND_RESULT_DONE 0       // device reached STATE_IDLE
+#define COMMAND_RESULT_FAILED -1    // device went STATE_INVALID
+#define COMMAND_RESULT_REJECTED -2  // not accepted in the device's state
+#define COMMAND_RESULT_TIMED_OUT -3 // the client stopped waiting, see ValveAsync.h
+